@@ -26,11 +26,23 @@ typedef enum {
     MatchNotFound,
     NoSANPresent,
     MalformedCertificate,
-    Error
+    Error,
+    LookupPending
 } HostnameValidationResult;
 
+/* Values for the resolve argument to validate_hostname(). */
+#define HOSTCHECK_NO_RESOLVE	0	/* don't resolve names in the cert */
+#define HOSTCHECK_RESOLVE	1	/* resolve names, may block */
+#define HOSTCHECK_CACHED	2	/* only use previously resolved names */
+#define HOSTCHECK_CACHE_FAILED	3	/* like HOSTCHECK_CACHED, uncached names
+					   are cached as failed lookups */
+
 HostnameValidationResult validate_hostname(const X509 *cert,
 	const char *hostname, const char *ipaddr, int resolve);
+HostnameValidationResult hostcheck_resolve(const X509 *cert,
+	const char *hostname, const char *ipaddr, int fd);
+bool hostcheck_cache_load(const char *buf, size_t len);
+void hostcheck_cache_flush(void);
 
 #endif /* HAVE_OPENSSL */
 
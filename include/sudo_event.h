@@ -39,7 +39,7 @@ struct timeval;		/* for deprecated APIs */
 /* Event flags (internal) */
 #define SUDO_EVQ_INSERTED	0x01U	/* event is on the event queue */
 #define SUDO_EVQ_ACTIVE		0x02U	/* event is on the active queue */
-#define SUDO_EVQ_TIMEOUTS	0x04U	/* event is on the timeouts queue */
+#define SUDO_EVQ_TIMEOUTS	0x04U	/* event is on the timeouts heap */
 
 /* Event loop flags */
 #define SUDO_EVLOOP_ONCE	0x01U	/* Only run once through the loop */
@@ -71,7 +71,6 @@ struct sudo_ev_siginfo_container {
 struct sudo_event {
     TAILQ_ENTRY(sudo_event) entries;
     TAILQ_ENTRY(sudo_event) active_entries;
-    TAILQ_ENTRY(sudo_event) timeouts_entries;
     struct sudo_event_base *base; /* base this event belongs to */
     int fd;			/* fd/signal we are interested in */
     short events;		/* SUDO_EV_* flags (in) */
@@ -80,6 +79,8 @@ struct sudo_event {
     short pfd_idx;		/* index into pfds array (XXX) */
     sudo_ev_callback_t callback;/* user-provided callback */
     struct timespec timeout;	/* for SUDO_EV_TIMEOUT */
+    unsigned long long timeout_seq; /* orders events with the same timeout */
+    unsigned int timeout_idx;	/* index into timeouts heap */
     void *closure;		/* user-provided data pointer */
 };
 TAILQ_HEAD(sudo_event_list, sudo_event);
@@ -87,7 +88,10 @@ TAILQ_HEAD(sudo_event_list, sudo_event);
 struct sudo_event_base {
     struct sudo_event_list events; /* tail queue of all events */
     struct sudo_event_list active; /* tail queue of active events */
-    struct sudo_event_list timeouts; /* tail queue of timeout events */
+    struct sudo_event **timeouts; /* min-heap of timeout events */
+    unsigned int ntimeouts;	/* number of events in the timeouts heap */
+    unsigned int timeouts_max;	/* size of the timeouts array */
+    unsigned long long timeout_seq; /* sequence number of last timeout */
     struct sudo_event signal_event; /* storage for signal pipe event */
     struct sudo_event_list signals[NSIG]; /* array of signal event tail queues */
     struct sigaction *orig_handlers[NSIG]; /* original signal handlers */
@@ -204,6 +208,10 @@ sudo_dso_public bool sudo_ev_got_break_v1(struct sudo_event_base *base);
 /* Add an event to the base's active queue and mark it active (internal). */
 void sudo_ev_activate(struct sudo_event_base *base, struct sudo_event *ev);
 
+/* Return the timeout event that expires first or NULL (internal). */
+#define sudo_ev_first_timeout(_b) \
+    ((_b)->ntimeouts ? (_b)->timeouts[0] : NULL)
+
 /*
  * Backend implementation.
  */
@@ -56,6 +56,19 @@
 #define IOFD_TIMING	5
 #define IOFD_MAX	6
 
+/*
+ * Per-stream compression settings, indexed by IOFD_*.
+ * The level is 0-9 or one of the special values below,
+ * the strategy is a gzdopen() mode character or '\0' for the default.
+ */
+#define IOLOG_COMPRESS_DEFAULT	-1	/* use the zlib default level */
+#define IOLOG_COMPRESS_NONE	-2	/* do not compress this stream */
+
+struct iolog_compress_params {
+    int level[IOFD_MAX];
+    char strategy[IOFD_MAX];
+};
+
 /*
  * Default password prompt regex.
  */
@@ -134,8 +147,11 @@ gid_t iolog_get_gid(void);
 mode_t iolog_get_file_mode(void);
 mode_t iolog_get_dir_mode(void);
 bool iolog_get_compress(void);
+const struct iolog_compress_params *iolog_get_compress_params(void);
 bool iolog_get_flush(void);
+bool iolog_parse_compress_params(const char *str, struct iolog_compress_params *params);
 void iolog_set_compress(bool);
+void iolog_set_compress_params(const struct iolog_compress_params *params);
 void iolog_set_defaults(void);
 void iolog_set_flush(bool);
 void iolog_set_gid(gid_t gid);
@@ -151,5 +167,6 @@ bool iolog_pwfilt_add(void *handle, const char *pattern);
 void iolog_pwfilt_free(void *handle);
 bool iolog_pwfilt_remove(void *handle, const char *pattern);
 bool iolog_pwfilt_run(void *handle, int event, const char *buf, size_t len, char **newbuf);
+void iolog_pwfilt_run_inplace(void *handle, int event, char *buf, size_t len);
 
 #endif /* SUDO_IOLOG_H */
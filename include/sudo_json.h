@@ -97,4 +97,7 @@ sudo_dso_public char *sudo_json_get_buf_v1(struct json_container *jsonc);
 sudo_dso_public unsigned int sudo_json_get_len_v1(struct json_container *jsonc);
 #define sudo_json_get_len(_a) sudo_json_get_len_v1((_a))
 
+sudo_dso_public void sudo_json_clear_buf_v1(struct json_container *jsonc);
+#define sudo_json_clear_buf(_a) sudo_json_clear_buf_v1((_a))
+
 #endif /* SUDO_JSON_H */
@@ -32,11 +32,15 @@
 # include <stdlib.h>
 # include <string.h>
 # include <netdb.h>
+# include <errno.h>
+# include <time.h>
+# include <unistd.h>
 
 # define NEED_INET_NTOP		/* to expose sudo_inet_ntop in sudo_compat.h */
 
 # include  "sudo_compat.h"
 # include  "sudo_debug.h"
+# include  "sudo_queue.h"
 # include  "sudo_util.h"
 # include  "hostcheck.h"
 
@@ -51,67 +55,394 @@
 # define ASN1_STRING_get0_data(x)	ASN1_STRING_data(x)
 #endif /* !HAVE_ASN1_STRING_GET0_DATA && !HAVE_WOLFSSL */
 
+/*
+ * Cache of forward lookups of the names in peer certificates.
+ * Host names are resolved while the TLS handshake is in progress,
+ * caching the result avoids a DNS query for each new connection.
+ * Names that do not exist are cached too, but for a shorter time.
+ * Names that could not be looked up at all are cached for a few
+ * seconds so a client whose names cannot be resolved does not
+ * start a new lookup on every connection.
+ */
+#define HOSTCHECK_CACHE_MAX	256	/* max number of cached names */
+#define HOSTCHECK_CACHE_TTL	300	/* seconds to cache a resolved name */
+#define HOSTCHECK_CACHE_NEG_TTL	30	/* seconds to cache an unknown name */
+#define HOSTCHECK_CACHE_FAIL_TTL 10	/* seconds to cache a failed lookup */
+
+struct hostcheck_entry {
+    TAILQ_ENTRY(hostcheck_entry) entries;
+    time_t expires;
+    size_t addrs_len;
+    char *addrs;		/* NUL-separated, ends in "", NULL if unknown */
+    char name[1];
+};
+TAILQ_HEAD(hostcheck_entry_list, hostcheck_entry);
+
+static struct hostcheck_entry_list hostcheck_cache =
+    TAILQ_HEAD_INITIALIZER(hostcheck_cache);
+static unsigned int hostcheck_cache_len;
+static int hostcheck_record_fd = -1;
+
+static time_t
+hostcheck_now(void)
+{
+    struct timespec now;
+
+    if (sudo_gettime_mono(&now) == -1)
+	return 0;
+    return now.tv_sec;
+}
+
+static void
+hostcheck_entry_free(struct hostcheck_entry *entry)
+{
+    TAILQ_REMOVE(&hostcheck_cache, entry, entries);
+    hostcheck_cache_len--;
+    free(entry);
+}
+
 /**
- * @brief Checks if given hostname resolves to the given IP address.
+ * @brief Removes all entries from the forward lookup cache.
+ */
+void
+hostcheck_cache_flush(void)
+{
+    struct hostcheck_entry *entry;
+    debug_decl(hostcheck_cache_flush, SUDO_DEBUG_UTIL);
+
+    while ((entry = TAILQ_FIRST(&hostcheck_cache)) != NULL)
+	hostcheck_entry_free(entry);
+
+    debug_return;
+}
+
+/**
+ * @brief Finds an unexpired cache entry for hostname.
+ *
+ * @param hostname  hostname to look up
+ *
+ * @return  the cache entry, moved to the front of the cache, or NULL
+ */
+static struct hostcheck_entry *
+hostcheck_cache_find(const char *hostname)
+{
+    struct hostcheck_entry *entry;
+    debug_decl(hostcheck_cache_find, SUDO_DEBUG_UTIL);
+
+    TAILQ_FOREACH(entry, &hostcheck_cache, entries) {
+	if (strcasecmp(entry->name, hostname) != 0)
+	    continue;
+	if (entry->expires <= hostcheck_now()) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"cached lookup of %s has expired", hostname);
+	    hostcheck_entry_free(entry);
+	    break;
+	}
+	if (entry != TAILQ_FIRST(&hostcheck_cache)) {
+	    TAILQ_REMOVE(&hostcheck_cache, entry, entries);
+	    TAILQ_INSERT_HEAD(&hostcheck_cache, entry, entries);
+	}
+	debug_return_ptr(entry);
+    }
+    debug_return_ptr(NULL);
+}
+
+/**
+ * @brief Stores the addresses hostname resolved to in the cache,
+ *        replacing any existing entry and evicting the least
+ *        recently used entry if the cache is full.
+ *
+ * @param hostname   resolved hostname
+ * @param addrs      NUL-separated list of addresses ending in "",
+ *                   or NULL if hostname does not exist
+ * @param addrs_len  length of addrs, including the final ""
+ * @param ttl        number of seconds to keep the entry
+ *
+ * @return  the new cache entry or NULL on memory allocation failure
+ */
+static struct hostcheck_entry *
+hostcheck_cache_insert(const char *hostname, const char *addrs,
+    size_t addrs_len, time_t ttl)
+{
+    struct hostcheck_entry *entry;
+    size_t name_len = strlen(hostname);
+    debug_decl(hostcheck_cache_insert, SUDO_DEBUG_UTIL);
+
+    TAILQ_FOREACH(entry, &hostcheck_cache, entries) {
+	if (strcasecmp(entry->name, hostname) == 0) {
+	    hostcheck_entry_free(entry);
+	    break;
+	}
+    }
+    if (hostcheck_cache_len >= HOSTCHECK_CACHE_MAX) {
+	entry = TAILQ_LAST(&hostcheck_cache, hostcheck_entry_list);
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "cache full, evicting %s", entry->name);
+	hostcheck_entry_free(entry);
+    }
+
+    if (addrs == NULL)
+	addrs_len = 0;
+    entry = malloc(sizeof(*entry) + name_len + addrs_len);
+    if (entry == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unable to allocate memory");
+	debug_return_ptr(NULL);
+    }
+    memcpy(entry->name, hostname, name_len + 1);
+    if (addrs != NULL) {
+	entry->addrs = entry->name + name_len + 1;
+	memcpy(entry->addrs, addrs, addrs_len);
+    } else {
+	entry->addrs = NULL;
+    }
+    entry->expires = hostcheck_now() + ttl;
+    entry->addrs_len = addrs_len;
+    TAILQ_INSERT_HEAD(&hostcheck_cache, entry, entries);
+    hostcheck_cache_len++;
+
+    debug_return_ptr(entry);
+}
+
+/**
+ * @brief Writes a lookup result to the record fd, if one is set.
+ *        The record is the hostname followed by the address list.
+ *        An unknown name is written with an empty address list.
+ *
+ * @param entry  cache entry to write
+ */
+static void
+hostcheck_record(const struct hostcheck_entry *entry)
+{
+    const char *cp = entry->name;
+    size_t len = strlen(entry->name) + 1;
+    ssize_t nwritten;
+    int pass;
+    debug_decl(hostcheck_record, SUDO_DEBUG_UTIL);
+
+    if (hostcheck_record_fd == -1)
+	debug_return;
+
+    for (pass = 0; pass < 2; pass++) {
+	while (len != 0) {
+	    nwritten = write(hostcheck_record_fd, cp, len);
+	    if (nwritten == -1) {
+		if (errno == EINTR)
+		    continue;
+		sudo_debug_printf(
+		    SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		    "unable to write lookup of %s", entry->name);
+		debug_return;
+	    }
+	    cp += nwritten;
+	    len -= (size_t)nwritten;
+	}
+	if (entry->addrs != NULL) {
+	    cp = entry->addrs;
+	    len = entry->addrs_len;
+	} else {
+	    cp = "";
+	    len = 1;
+	}
+    }
+
+    debug_return;
+}
+
+/**
+ * @brief Resolves hostname and stores the result in the cache.
  *
  * @param hostname  hostname to be resolved
- * @param ipaddr    ip address to be checked
  *
- * @return  1 if hostname resolves to the given IP address
- *          0 otherwise
+ * @return  the new cache entry or NULL if hostname could not be resolved
+ *          due to a temporary or memory allocation failure
  */
-static int
-forward_lookup_match(const char *hostname, const char *ipaddr)
+static struct hostcheck_entry *
+forward_lookup(const char *hostname)
 {
-    int rc, ret = 0;
-    struct addrinfo *res = NULL, *p;
+    struct hostcheck_entry *entry = NULL;
+    struct addrinfo hints, *res = NULL, *p;
+    char *addrs = NULL;
+    size_t addrs_len = 0, addrs_size = 0;
     void *addr;
-    struct sockaddr_in *ipv4;
+    int rc;
 #if defined(HAVE_STRUCT_IN6_ADDR)
-    struct sockaddr_in6 *ipv6;
     char ipstr[INET6_ADDRSTRLEN];
 #else
     char ipstr[INET_ADDRSTRLEN];
 #endif
-    debug_decl(forward_lookup_match, SUDO_DEBUG_UTIL);
-
-    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
-	"verify %s resolves to %s", hostname, ipaddr);
+    debug_decl(forward_lookup, SUDO_DEBUG_UTIL);
 
-    if ((rc = getaddrinfo(hostname, NULL, NULL, &res)) != 0) {
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((rc = getaddrinfo(hostname, NULL, &hints, &res)) != 0) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 	    "unable to resolve %s: %s", hostname, gai_strerror(rc));
-        goto exit;
+	switch (rc) {
+	case EAI_NONAME:
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+	case EAI_NODATA:
+#endif
+	    /* Name does not exist, cache the negative result. */
+	    entry = hostcheck_cache_insert(hostname, NULL, 0,
+		HOSTCHECK_CACHE_NEG_TTL);
+	    break;
+	}
+	goto done;
     }
 
     for (p = res; p != NULL; p = p->ai_next) {
-        if (p->ai_family == AF_INET) {
-            ipv4 = (struct sockaddr_in *)p->ai_addr;
-            addr = &(ipv4->sin_addr);
+	size_t len;
+
+	if (p->ai_family == AF_INET) {
+	    addr = &((struct sockaddr_in *)p->ai_addr)->sin_addr;
 #if defined(HAVE_STRUCT_IN6_ADDR)
-        } else if (p->ai_family == AF_INET6) {
-            ipv6 = (struct sockaddr_in6 *)p->ai_addr;
-            addr = &(ipv6->sin6_addr);
+	} else if (p->ai_family == AF_INET6) {
+	    addr = &((struct sockaddr_in6 *)p->ai_addr)->sin6_addr;
 #endif
-        } else {
-            goto exit;
-        }
+	} else {
+	    continue;
+	}
+	if (inet_ntop(p->ai_family, addr, ipstr, sizeof(ipstr)) == NULL)
+	    continue;
+
+	/* Leave room for the terminating empty string. */
+	len = strlen(ipstr) + 1;
+	if (addrs_len + len + 1 > addrs_size) {
+	    char *tmp = realloc(addrs, addrs_size + sizeof(ipstr) * 4);
+	    if (tmp == NULL) {
+		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		    "unable to allocate memory");
+		goto done;
+	    }
+	    addrs = tmp;
+	    addrs_size += sizeof(ipstr) * 4;
+	}
+	memcpy(addrs + addrs_len, ipstr, len);
+	addrs_len += len;
+    }
+    if (addrs_len == 0) {
+	/* No usable addresses, treat like an unknown name. */
+	entry = hostcheck_cache_insert(hostname, NULL, 0,
+	    HOSTCHECK_CACHE_NEG_TTL);
+    } else {
+	addrs[addrs_len++] = '\0';
+	entry = hostcheck_cache_insert(hostname, addrs, addrs_len,
+	    HOSTCHECK_CACHE_TTL);
+    }
 
-        if (inet_ntop(p->ai_family, addr, ipstr, sizeof(ipstr)) != 0) {
+done:
+    if (entry != NULL)
+	hostcheck_record(entry);
+    if (res != NULL)
+	freeaddrinfo(res);
+    free(addrs);
+    debug_return_ptr(entry);
+}
+
+/**
+ * @brief Checks if given hostname resolves to the given IP address.
+ *
+ * @param hostname  hostname to be resolved
+ * @param ipaddr    ip address to be checked
+ * @param resolve   HOSTCHECK_RESOLVE to resolve hostname if it is not
+ *                  cached, HOSTCHECK_CACHED to only use the cache,
+ *                  HOSTCHECK_CACHE_FAILED to cache hostname as a failed
+ *                  lookup if it is not cached
+ *
+ * @return  1 if hostname resolves to the given IP address
+ *          0 otherwise
+ *          -1 if hostname is not cached and resolve is HOSTCHECK_CACHED
+ */
+static int
+forward_lookup_match(const char *hostname, const char *ipaddr, int resolve)
+{
+    struct hostcheck_entry *entry;
+    const char *cp;
+    debug_decl(forward_lookup_match, SUDO_DEBUG_UTIL);
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"verify %s resolves to %s", hostname, ipaddr);
+
+    entry = hostcheck_cache_find(hostname);
+    if (entry == NULL) {
+	switch (resolve) {
+	case HOSTCHECK_RESOLVE:
+	    entry = forward_lookup(hostname);
+	    break;
+	case HOSTCHECK_CACHE_FAILED:
 	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
-		"comparing %s to %s", ipstr, ipaddr);
-            if (strcmp(ipaddr, ipstr) == 0) {
-                ret = 1;
-                break;
-            }
-        }
+		"caching failed lookup of %s", hostname);
+	    entry = hostcheck_cache_insert(hostname, NULL, 0,
+		HOSTCHECK_CACHE_FAIL_TTL);
+	    break;
+	default:
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"%s not in cache", hostname);
+	    debug_return_int(-1);
+	}
+    } else {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "using cached lookup of %s", hostname);
+	hostcheck_record(entry);
+    }
+    if (entry == NULL || entry->addrs == NULL)
+	debug_return_int(0);
+
+    for (cp = entry->addrs; *cp != '\0'; cp += strlen(cp) + 1) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "comparing %s to %s", cp, ipaddr);
+	if (strcmp(ipaddr, cp) == 0)
+	    debug_return_int(1);
     }
+    debug_return_int(0);
+}
 
-exit:
-    if (res != NULL) {
-        freeaddrinfo(res);
+/**
+ * @brief Loads lookup results written by hostcheck_resolve() into
+ *        the cache.
+ *
+ * @param buf  lookup records
+ * @param len  length of buf
+ *
+ * @return  true if all records were loaded, else false
+ */
+bool
+hostcheck_cache_load(const char *buf, size_t len)
+{
+    size_t off = 0, name_len, addr_len, addrs_start;
+    debug_decl(hostcheck_cache_load, SUDO_DEBUG_UTIL);
+
+    while (off < len) {
+	const char *name = buf + off;
+
+	name_len = strnlen(name, len - off);
+	if (name_len == 0 || name_len == len - off)
+	    goto bad;
+	off += name_len + 1;
+
+	addrs_start = off;
+	do {
+	    addr_len = strnlen(buf + off, len - off);
+	    if (addr_len == len - off)
+		goto bad;
+	    off += addr_len + 1;
+	} while (addr_len != 0);
+
+	if (off - addrs_start == 1) {
+	    (void)hostcheck_cache_insert(name, NULL, 0,
+		HOSTCHECK_CACHE_NEG_TTL);
+	} else {
+	    (void)hostcheck_cache_insert(name, buf + addrs_start,
+		off - addrs_start, HOSTCHECK_CACHE_TTL);
+	}
     }
-    debug_return_int(ret);
+    debug_return_bool(true);
+bad:
+    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	"truncated lookup record at offset %zu", off);
+    debug_return_bool(false);
 }
 
 /**
@@ -184,6 +515,7 @@ validate_name(const char *hostname, ASN1_STRING *certname_asn1)
  *          MatchNotFound
  *          MalformedCertificate
  *          Error
+ *          LookupPending
  */
 static HostnameValidationResult
 matches_common_name(const char *hostname, const char *ipaddr, const X509 *cert, int resolve)
@@ -233,9 +565,15 @@ matches_common_name(const char *hostname, const char *ipaddr, const X509 *cert,
 
 
     /* check if hostname in the CN field resolves to the given ip address */
-    if (resolve && forward_lookup_match(nullterm_common_name, ipaddr)) {
-        free(nullterm_common_name);
-		debug_return_int(MatchFound);
+    if (resolve) {
+	switch (forward_lookup_match(nullterm_common_name, ipaddr, resolve)) {
+	case 1:
+	    free(nullterm_common_name);
+	    debug_return_int(MatchFound);
+	case -1:
+	    free(nullterm_common_name);
+	    debug_return_int(LookupPending);
+	}
     }
 
     free(nullterm_common_name);
@@ -263,11 +601,13 @@ matches_common_name(const char *hostname, const char *ipaddr, const X509 *cert,
  *          NoSANPresent
  *          MalformedCertificate
  *          Error
+ *          LookupPending
  */
 static HostnameValidationResult
 matches_subject_alternative_name(const char *hostname, const char *ipaddr, const X509 *cert, int resolve)
 {
     HostnameValidationResult result = MatchNotFound;
+    bool pending = false;
     int i;
     int san_names_nb;
     STACK_OF(GENERAL_NAME) *san_names = NULL;
@@ -307,10 +647,17 @@ matches_subject_alternative_name(const char *hostname, const char *ipaddr, const
                 memcpy(nullterm_dns_name, dns_name, dns_name_length);
                 nullterm_dns_name[dns_name_length] = '\0';
 
-                if (resolve && forward_lookup_match(nullterm_dns_name, ipaddr)) {
-                    free(nullterm_dns_name);
-                    result = MatchFound;
-                    break;
+                if (resolve) {
+                    int rc = forward_lookup_match(nullterm_dns_name, ipaddr,
+                        resolve);
+                    if (rc == 1) {
+                        free(nullterm_dns_name);
+                        result = MatchFound;
+                        break;
+                    }
+                    /* Keep checking, another name may match. */
+                    if (rc == -1)
+                        pending = true;
                 }
                 free(nullterm_dns_name);
             }
@@ -349,6 +696,9 @@ matches_subject_alternative_name(const char *hostname, const char *ipaddr, const
     }
     sk_GENERAL_NAME_pop_free(san_names, GENERAL_NAME_free);
 
+    if (result == MatchNotFound && pending)
+        result = LookupPending;
+
     debug_return_int(result);
 }
 
@@ -366,11 +716,16 @@ matches_subject_alternative_name(const char *hostname, const char *ipaddr, const
  * @param ipaddr    remote peer's IP address
  * @param resolve   if the value is not 0, the function checks that the value of the
  *                  SAN GEN_DNS or the value of CN resolves to the given ipaddr or not.
+ *                  With HOSTCHECK_CACHED, only names that have already been
+ *                  resolved are checked, see hostcheck_resolve().
+ *                  HOSTCHECK_CACHE_FAILED is like HOSTCHECK_CACHED but
+ *                  names that are not cached are cached as failed lookups.
  *
  * @return  MatchFound
  *          MatchNotFound
  *          MalformedCertificate
  *          Error
+ *          LookupPending if there was no match but a name was not cached
  */
 HostnameValidationResult
 validate_hostname(const X509 *cert, const char *hostname, const char *ipaddr, int resolve)
@@ -397,4 +752,34 @@ validate_hostname(const X509 *cert, const char *hostname, const char *ipaddr, in
 
     debug_return_int(res);
 }
+
+/**
+ * @brief Resolve the names in the given X509 certificate that are needed
+ *        for hostname/IP validation, writing the results to fd.
+ *
+ * This may block and is meant to be run in a separate process.
+ * The caller reads the results from the other end of fd, loads them
+ * with hostcheck_cache_load() and then calls validate_hostname()
+ * with HOSTCHECK_CACHED.
+ *
+ * @param cert      X509 certificate
+ * @param hostname  remote peer's name
+ * @param ipaddr    remote peer's IP address
+ * @param fd        file descriptor to write the lookup results to
+ *
+ * @return  the result of validate_hostname() with HOSTCHECK_RESOLVE
+ */
+HostnameValidationResult
+hostcheck_resolve(const X509 *cert, const char *hostname, const char *ipaddr,
+    int fd)
+{
+    HostnameValidationResult res;
+    debug_decl(hostcheck_resolve, SUDO_DEBUG_UTIL);
+
+    hostcheck_record_fd = fd;
+    res = validate_hostname(cert, hostname, ipaddr, HOSTCHECK_RESOLVE);
+    hostcheck_record_fd = -1;
+
+    debug_return_int(res);
+}
 #endif /* HAVE_OPENSSL */
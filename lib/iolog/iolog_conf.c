@@ -27,6 +27,7 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_STDBOOL_H
 # include <stdbool.h>
 #else
@@ -47,6 +48,13 @@ static gid_t iolog_gid = ROOT_GID;
 static bool iolog_gid_set;
 static bool iolog_docompress;
 static bool iolog_doflush;
+static struct iolog_compress_params iolog_compress_params = {
+    {
+	IOLOG_COMPRESS_DEFAULT, IOLOG_COMPRESS_DEFAULT, IOLOG_COMPRESS_DEFAULT,
+	IOLOG_COMPRESS_DEFAULT, IOLOG_COMPRESS_DEFAULT, IOLOG_COMPRESS_DEFAULT
+    },
+    { '\0', '\0', '\0', '\0', '\0', '\0' }
+};
 
 /*
  * Reset I/O log settings to default values.
@@ -62,6 +70,7 @@ iolog_set_defaults(void)
     iolog_gid_set = false;
     iolog_docompress = false;
     iolog_doflush = false;
+    (void)iolog_parse_compress_params("", &iolog_compress_params);
 }
 
 /*
@@ -144,6 +153,105 @@ iolog_set_compress(bool newval)
     debug_return;
 }
 
+/*
+ * Parse per-stream compression settings of the form:
+ *	stream=level[:strategy] ...
+ * where stream is an I/O log file name (ttyin, ttyout, timing, etc),
+ * level is 0-9, "default" or "none" and strategy is one of "default",
+ * "filtered", "huffman", "rle" or "fixed".  Entries are separated by
+ * white space or commas.  Streams that are not listed use the defaults.
+ * Returns true on success, false on a parse error.
+ */
+bool
+iolog_parse_compress_params(const char *str,
+    struct iolog_compress_params *params)
+{
+    static const struct {
+	const char *name;
+	char ch;
+    } strategies[] = {
+	{ "default", '\0' },
+	{ "filtered", 'f' },
+	{ "huffman", 'h' },
+	{ "rle", 'R' },
+	{ "fixed", 'F' }
+    };
+    struct iolog_compress_params newparams;
+    const char *cp, *ep, *val, *strategy;
+    size_t len, vlen;
+    int iofd, level;
+    unsigned int i;
+    debug_decl(iolog_parse_compress_params, SUDO_DEBUG_UTIL);
+
+    for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	newparams.level[iofd] = IOLOG_COMPRESS_DEFAULT;
+	newparams.strategy[iofd] = '\0';
+    }
+
+    for (cp = sudo_strsplit(str, str + strlen(str), " \t,", &ep);
+	    cp != NULL; cp = sudo_strsplit(NULL, str + strlen(str), " \t,", &ep)) {
+	len = (size_t)(ep - cp);
+	if ((val = memchr(cp, '=', len)) == NULL)
+	    goto bad;
+	for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	    const char *name = iolog_fd_to_name(iofd);
+	    if (strncmp(cp, name, (size_t)(val - cp)) == 0 &&
+		    name[val - cp] == '\0')
+		break;
+	}
+	if (iofd == IOFD_MAX)
+	    goto bad;
+	val++;
+	vlen = (size_t)(ep - val);
+
+	/* Optional strategy follows the level. */
+	strategy = memchr(val, ':', vlen);
+	if (strategy != NULL) {
+	    vlen = (size_t)(strategy - val);
+	    strategy++;
+	    for (i = 0; i < nitems(strategies); i++) {
+		if (strncmp(strategy, strategies[i].name,
+			(size_t)(ep - strategy)) == 0 &&
+			strategies[i].name[ep - strategy] == '\0')
+		    break;
+	    }
+	    if (i == nitems(strategies))
+		goto bad;
+	    newparams.strategy[iofd] = strategies[i].ch;
+	}
+
+	if (vlen == 1 && val[0] >= '0' && val[0] <= '9') {
+	    level = val[0] - '0';
+	} else if (vlen == 7 && strncmp(val, "default", 7) == 0) {
+	    level = IOLOG_COMPRESS_DEFAULT;
+	} else if (vlen == 4 && strncmp(val, "none", 4) == 0 &&
+		strategy == NULL) {
+	    level = IOLOG_COMPRESS_NONE;
+	} else {
+	    goto bad;
+	}
+	newparams.level[iofd] = level;
+    }
+
+    *params = newparams;
+    debug_return_bool(true);
+bad:
+    sudo_debug_printf(SUDO_DEBUG_WARN,
+	"%s: invalid compression setting in \"%s\"", __func__, str);
+    debug_return_bool(false);
+}
+
+/*
+ * Set per-stream compression settings.
+ */
+void
+iolog_set_compress_params(const struct iolog_compress_params *params)
+{
+    debug_decl(iolog_set_compress_params, SUDO_DEBUG_UTIL);
+    iolog_compress_params = *params;
+    debug_return;
+}
+
 /*
  * Set iolog_doflush
  */
@@ -195,6 +303,12 @@ iolog_get_compress(void)
     return iolog_docompress;
 }
 
+const struct iolog_compress_params *
+iolog_get_compress_params(void)
+{
+    return &iolog_compress_params;
+}
+
 bool
 iolog_get_flush(void)
 {
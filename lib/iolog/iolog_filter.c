@@ -43,15 +43,33 @@
 #include "sudo_queue.h"
 #include "sudo_util.h"
 
+/*
+ * Password prompts are written at the end of an output chunk so we
+ * only need to check the tail of a buffer for a match.  This bounds
+ * the cost of the filter for large chunks of output.
+ */
+#define PWFILT_TAIL_MAX	256
+
 struct pwfilt_regex {
     TAILQ_ENTRY(pwfilt_regex) entries;
     char *pattern;
     regex_t regex;
+    bool combine;
 };
 TAILQ_HEAD(pwfilt_regex_list, pwfilt_regex);
 
+/*
+ * The patterns are merged into at most two regular expressions,
+ * one case-sensitive and one case-insensitive, that are compiled on
+ * demand after the filter list changes.  Patterns that cannot be
+ * merged safely are matched on their own.
+ */
 struct pwfilt_handle {
     struct pwfilt_regex_list filters;
+    regex_t combined[2];
+    bool have_combined[2];
+    bool combined_ok;
+    bool dirty;
     bool is_filtered;
 };
 
@@ -64,7 +82,7 @@ iolog_pwfilt_alloc(void)
     struct pwfilt_handle *handle;
     debug_decl(iolog_pwfilt_alloc, SUDO_DEBUG_UTIL);
 
-    handle = malloc(sizeof(*handle));
+    handle = calloc(1, sizeof(*handle));
     if (handle != NULL) {
 	TAILQ_INIT(&handle->filters);
 	handle->is_filtered = false;
@@ -73,6 +91,158 @@ iolog_pwfilt_alloc(void)
     debug_return_ptr(handle);
 }
 
+/*
+ * Free the combined regular expressions, if any.
+ */
+static void
+iolog_pwfilt_free_combined(struct pwfilt_handle *handle)
+{
+    int i;
+    debug_decl(iolog_pwfilt_free_combined, SUDO_DEBUG_UTIL);
+
+    for (i = 0; i < 2; i++) {
+	if (handle->have_combined[i]) {
+	    regfree(&handle->combined[i]);
+	    handle->have_combined[i] = false;
+	}
+    }
+    handle->combined_ok = false;
+    handle->dirty = true;
+
+    debug_return;
+}
+
+/*
+ * Returns true if pattern can be wrapped in parentheses and merged
+ * with other patterns without changing its meaning.  This is not the
+ * case if it contains a back reference, which would refer to the
+ * wrong group, or an unmatched ')', which regcomp(3) may accept as
+ * a literal but would close the wrapping group early.
+ */
+static bool
+iolog_pwfilt_combinable(const char *pattern)
+{
+    const char *cp;
+    int depth = 0;
+    debug_decl(iolog_pwfilt_combinable, SUDO_DEBUG_UTIL);
+
+    for (cp = pattern; *cp != '\0'; cp++) {
+	switch (*cp) {
+	case '\\':
+	    if (cp[1] >= '1' && cp[1] <= '9')
+		debug_return_bool(false);
+	    if (cp[1] != '\0')
+		cp++;
+	    break;
+	case '[':
+	    /* Skip bracket expression, a leading ']' is a literal. */
+	    cp++;
+	    if (*cp == '^')
+		cp++;
+	    if (*cp == ']')
+		cp++;
+	    while (*cp != ']') {
+		if (*cp == '\0')
+		    debug_return_bool(false);
+		if (cp[0] == '[' &&
+			(cp[1] == ':' || cp[1] == '.' || cp[1] == '=')) {
+		    const char term = cp[1];
+		    for (cp += 2; cp[0] != term || cp[1] != ']'; cp++) {
+			if (*cp == '\0')
+			    debug_return_bool(false);
+		    }
+		    cp++;
+		}
+		cp++;
+	    }
+	    break;
+	case '(':
+	    depth++;
+	    break;
+	case ')':
+	    if (depth == 0)
+		debug_return_bool(false);
+	    depth--;
+	    break;
+	}
+    }
+    debug_return_bool(depth == 0);
+}
+
+/*
+ * Merge the combinable patterns with the same case sensitivity into a
+ * single regular expression of the form "(pat1)|(pat2)|...".  The
+ * individual patterns have already been validated by sudo_regex_compile().
+ * If this fails, the filters will be matched one at a time instead.
+ */
+static void
+iolog_pwfilt_combine(struct pwfilt_handle *handle)
+{
+    struct pwfilt_regex *filt;
+    char *pattern = NULL, *cp;
+    size_t size = 1;
+    int i;
+    debug_decl(iolog_pwfilt_combine, SUDO_DEBUG_UTIL);
+
+    iolog_pwfilt_free_combined(handle);
+    handle->dirty = false;
+
+    TAILQ_FOREACH(filt, &handle->filters, entries) {
+	size += strlen(filt->pattern) + 3;
+    }
+    if ((pattern = malloc(size)) == NULL)
+	goto done;
+
+    for (i = 0; i < 2; i++) {
+	cp = pattern;
+	TAILQ_FOREACH(filt, &handle->filters, entries) {
+	    const char *pat = filt->pattern;
+	    bool anchored = false, icase = false;
+	    size_t patlen;
+
+	    /* Same (?i) handling as sudo_regex_compile(). */
+	    if (*pat == '^') {
+		anchored = true;
+		pat++;
+	    }
+	    if (strncmp(pat, "(?i)", 4) == 0) {
+		icase = true;
+		pat += 4;
+	    }
+	    if (!filt->combine || icase != (i == 1))
+		continue;
+	    if (cp != pattern)
+		*cp++ = '|';
+	    *cp++ = '(';
+	    if (anchored)
+		*cp++ = '^';
+	    patlen = strlen(pat);
+	    memcpy(cp, pat, patlen);
+	    cp += patlen;
+	    *cp++ = ')';
+	}
+	*cp = '\0';
+	if (cp == pattern)
+	    continue;
+
+	if (regcomp(&handle->combined[i], pattern,
+		REG_EXTENDED|REG_NOSUB|(i ? REG_ICASE : 0)) != 0) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+		"unable to compile combined pattern \"%s\"", pattern);
+	    goto done;
+	}
+	handle->have_combined[i] = true;
+    }
+    handle->combined_ok = true;
+
+done:
+    if (!handle->combined_ok)
+	iolog_pwfilt_free_combined(handle);
+    handle->dirty = false;
+    free(pattern);
+    debug_return;
+}
+
 /*
  * Unlink filt from filters and free it.
  */
@@ -106,6 +276,7 @@ iolog_pwfilt_free(void *vhandle)
 	while ((filt = TAILQ_FIRST(&handle->filters)) != NULL) {
 	    iolog_pwfilt_free_filter(&handle->filters, filt);
 	}
+	iolog_pwfilt_free_combined(handle);
 	free(handle);
     }
     debug_return;
@@ -134,8 +305,10 @@ iolog_pwfilt_add(void *vhandle, const char *pattern)
 	    pattern, U_(errstr));
 	goto bad;
     }
+    filt->combine = iolog_pwfilt_combinable(filt->pattern);
 
     TAILQ_INSERT_TAIL(&handle->filters, filt, entries);
+    iolog_pwfilt_free_combined(handle);
     debug_return_bool(true);
 
 oom:
@@ -165,23 +338,100 @@ iolog_pwfilt_remove(void *vhandle, const char *pattern)
 	    ret = true;
 	}
     }
+    if (ret)
+	iolog_pwfilt_free_combined(handle);
     debug_return_bool(ret);
 }
 
 /*
- * If logging output and filtering is _not_ enabled, match buf against the
- * password filter list patterns and, if there is a match, enable filtering.
- * If logging output and filtering _is_ enabled, disable filtering.
+ * Match the last PWFILT_TAIL_MAX bytes of buf against the regular
+ * expression re without making a NUL-terminated copy on the heap.
+ */
+static bool
+iolog_pwfilt_regexec(regex_t *re, const char *buf, size_t len)
+{
+    size_t start = len > PWFILT_TAIL_MAX ? len - PWFILT_TAIL_MAX : 0;
+    int eflags = start ? REG_NOTBOL : 0;
+#ifdef REG_STARTEND
+    regmatch_t match;
+
+    if (len == 0)
+	return regexec(re, "", 0, NULL, 0) == 0;
+    match.rm_so = (regoff_t)start;
+    match.rm_eo = (regoff_t)len;
+    return regexec(re, buf, 1, &match, eflags|REG_STARTEND) == 0;
+#else
+    char tail[PWFILT_TAIL_MAX + 1];
+
+    memcpy(tail, buf + start, len - start);
+    tail[len - start] = '\0';
+    return regexec(re, tail, 0, NULL, eflags) == 0;
+#endif
+}
+
+/*
+ * Returns true if the tail of buf matches a password prompt.
+ */
+static bool
+iolog_pwfilt_match(struct pwfilt_handle *handle, const char *buf, size_t len)
+{
+    struct pwfilt_regex *filt;
+    int i;
+    debug_decl(iolog_pwfilt_match, SUDO_DEBUG_UTIL);
+
+    if (handle->dirty)
+	iolog_pwfilt_combine(handle);
+
+    if (handle->combined_ok) {
+	for (i = 0; i < 2; i++) {
+	    if (handle->have_combined[i] &&
+		    iolog_pwfilt_regexec(&handle->combined[i], buf, len))
+		debug_return_bool(true);
+	}
+    }
+    TAILQ_FOREACH(filt, &handle->filters, entries) {
+	if (handle->combined_ok && filt->combine)
+	    continue;
+	if (iolog_pwfilt_regexec(&filt->regex, buf, len))
+	    debug_return_bool(true);
+    }
+    debug_return_bool(false);
+}
+
+/*
+ * Returns the number of bytes at the start of buf that should be
+ * replaced with stars.  Filtering stops after reaching cr/nl.
+ */
+static size_t
+iolog_pwfilt_input(struct pwfilt_handle *handle, const char *buf, size_t len)
+{
+    size_t i;
+    debug_decl(iolog_pwfilt_input, SUDO_DEBUG_UTIL);
+
+    for (i = 0; i < len; i++) {
+	if (buf[i] == '\r' || buf[i] == '\n') {
+	    handle->is_filtered = false;
+	    break;
+	}
+    }
+    debug_return_size_t(i);
+}
+
+/*
+ * If logging output, match the end of buf against the password filter
+ * list patterns and enable filtering if there is a match.  Any other
+ * output disables filtering.
  * If logging input and filtering is enabled, replace all characters in
  * buf with stars ('*') up to the next linefeed or carriage return.
+ * The filtered input is stored in newly-allocated memory in *newbuf.
  */
 bool
 iolog_pwfilt_run(void *vhandle, int event, const char *buf,
     size_t len, char **newbuf)
 {
     struct pwfilt_handle *handle = vhandle;
-    struct pwfilt_regex *filt;
     char *copy;
+    size_t i;
     debug_decl(iolog_pwfilt_run, SUDO_DEBUG_UTIL);
 
     /*
@@ -192,39 +442,12 @@ iolog_pwfilt_run(void *vhandle, int event, const char *buf,
      */
     switch (event) {
     case IO_EVENT_TTYOUT:
-	/* If filtering passwords and we receive output, disable it. */
-	if (handle->is_filtered)
-	    handle->is_filtered = false;
-
-	/* Make a copy of buf that is NUL-terminated. */
-	copy = malloc(len + 1);
-	if (copy == NULL) {
-	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
-	    debug_return_bool(false);
-	}
-	memcpy(copy, buf, len);
-	copy[len] = '\0';
-
 	/* Check output for a password prompt. */
-	TAILQ_FOREACH(filt, &handle->filters, entries) {
-	    if (regexec(&filt->regex, copy, 0, NULL, 0) == 0) {
-		handle->is_filtered = true;
-		break;
-	    }
-	}
-	free(copy);
+	handle->is_filtered = iolog_pwfilt_match(handle, buf, len);
 	break;
     case IO_EVENT_TTYIN:
 	if (handle->is_filtered) {
-	    unsigned int i;
-
-	    for (i = 0; i < len; i++) {
-		/* We will stop filtering after reaching cr/nl. */
-		if (buf[i] == '\r' || buf[i] == '\n') {
-		    handle->is_filtered = false;
-		    break;
-		}
-	    }
+	    i = iolog_pwfilt_input(handle, buf, len);
 	    if (i != 0) {
 		/* Filtered, replace buffer with '*' chars. */
 		copy = malloc(len);
@@ -246,3 +469,29 @@ iolog_pwfilt_run(void *vhandle, int event, const char *buf,
 
     debug_return_bool(true);
 }
+
+/*
+ * Like iolog_pwfilt_run() but filtered input is replaced with
+ * stars directly in buf, which must be writable.
+ */
+void
+iolog_pwfilt_run_inplace(void *vhandle, int event, char *buf, size_t len)
+{
+    struct pwfilt_handle *handle = vhandle;
+    debug_decl(iolog_pwfilt_run_inplace, SUDO_DEBUG_UTIL);
+
+    switch (event) {
+    case IO_EVENT_TTYOUT:
+	handle->is_filtered = iolog_pwfilt_match(handle, buf, len);
+	break;
+    case IO_EVENT_TTYIN:
+	if (handle->is_filtered) {
+	    size_t i = iolog_pwfilt_input(handle, buf, len);
+	    if (i != 0)
+		memset(buf, '*', i);
+	}
+	break;
+    }
+
+    debug_return;
+}
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_STDBOOL_H
 # include <stdbool.h>
 #else
@@ -42,6 +43,33 @@
 
 static unsigned char const gzip_magic[2] = {0x1f, 0x8b};
 
+#ifdef HAVE_ZLIB_H
+/*
+ * Append the compression level and strategy for iofd to the
+ * gzdopen() mode string.
+ */
+static const char *
+iolog_gzmode(int iofd, const char *mode, char *buf, size_t bufsize)
+{
+    const struct iolog_compress_params *params = iolog_get_compress_params();
+    int level = params->level[iofd];
+    char strategy = params->strategy[iofd];
+    size_t len;
+
+    if (*mode != 'w' || (level < 0 && strategy == '\0'))
+	return mode;
+    len = strlcpy(buf, mode, bufsize);
+    if (len + 3 > bufsize)
+	return mode;
+    if (level >= 0)
+	buf[len++] = (char)('0' + level);
+    if (strategy != '\0')
+	buf[len++] = strategy;
+    buf[len] = '\0';
+    return buf;
+}
+#endif /* HAVE_ZLIB_H */
+
 /*
  * Open the specified I/O log file and store in iol.
  * Stores the open file handle which has the close-on-exec flag set.
@@ -83,7 +111,8 @@ iolog_open(struct iolog_file *iol, int dfd, int iofd, const char *mode)
 			"%s: unable to fchown %d:%d %s", __func__,
 			(int)iolog_uid, (int)iolog_gid, file);
 		}
-		iol->compressed = iolog_get_compress();
+		iol->compressed = iolog_get_compress() &&
+		    iolog_get_compress_params()->level[iofd] != IOLOG_COMPRESS_NONE;
 	    } else {
 		/* check for gzip magic number */
 		if (pread(fd, magic, sizeof(magic), 0) == ssizeof(magic)) {
@@ -93,9 +122,12 @@ iolog_open(struct iolog_file *iol, int dfd, int iofd, const char *mode)
 	    }
 	    if (fcntl(fd, F_SETFD, FD_CLOEXEC) != -1) {
 #ifdef HAVE_ZLIB_H
-		if (iol->compressed)
-		    iol->fd.g = gzdopen(fd, mode);
-		else
+		if (iol->compressed) {
+		    char gzmode[8];
+
+		    iol->fd.g = gzdopen(fd,
+			iolog_gzmode(iofd, mode, gzmode, sizeof(gzmode)));
+		} else
 #endif
 		    iol->fd.f = fdopen(fd, mode);
 	    }
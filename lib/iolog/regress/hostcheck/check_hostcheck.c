@@ -0,0 +1,306 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudo_compat.h"
+#include "sudo_util.h"
+#include "sudo_fatal.h"
+
+#if defined(HAVE_OPENSSL) && !defined(HAVE_WOLFSSL)
+# include <openssl/x509.h>
+# include <openssl/x509v3.h>
+# include "hostcheck.h"
+#endif
+
+sudo_dso_public int main(int argc, char *argv[]);
+
+#if defined(HAVE_OPENSSL) && !defined(HAVE_WOLFSSL)
+/*
+ * Stub resolver with an injected delay to simulate a slow DNS server.
+ * Overrides the libc getaddrinfo() used by hostcheck.c.
+ */
+#define STUB_DELAY_MS	100
+
+static struct stub_host {
+    const char *name;
+    const char *addr;
+    int error;
+} stub_hosts[] = {
+    { "a.example.com", "192.0.2.1" },
+    { "b.example.com", "192.0.2.2" },
+    { "v6.example.com", "2001:db8::2" },
+    { "flaky.example.com", NULL, EAI_AGAIN },
+    { NULL }
+};
+static unsigned int stub_calls;
+
+int
+getaddrinfo(const char *node, const char *service,
+    const struct addrinfo *hints, struct addrinfo **res)
+{
+    struct timespec ts = { 0, STUB_DELAY_MS * 1000000L };
+    struct stub_host *sh;
+    struct addrinfo *ai;
+    size_t salen;
+
+    stub_calls++;
+    nanosleep(&ts, NULL);
+
+    for (sh = stub_hosts; sh->name != NULL; sh++) {
+	if (strcmp(sh->name, node) == 0)
+	    break;
+    }
+    if (sh->name == NULL)
+	return EAI_NONAME;
+    if (sh->error != 0)
+	return sh->error;
+
+    salen = sizeof(struct sockaddr_in6);
+    if ((ai = calloc(1, sizeof(*ai) + salen)) == NULL)
+	return EAI_MEMORY;
+    ai->ai_addr = (struct sockaddr *)(ai + 1);
+    if (inet_pton(AF_INET, sh->addr,
+	    &((struct sockaddr_in *)ai->ai_addr)->sin_addr) == 1) {
+	ai->ai_family = AF_INET;
+	ai->ai_addrlen = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, sh->addr,
+	    &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr) == 1) {
+	ai->ai_family = AF_INET6;
+	ai->ai_addrlen = sizeof(struct sockaddr_in6);
+    } else {
+	free(ai);
+	return EAI_FAIL;
+    }
+    ai->ai_addr->sa_family = ai->ai_family;
+    *res = ai;
+    return 0;
+}
+
+void
+freeaddrinfo(struct addrinfo *ai)
+{
+    struct addrinfo *next;
+
+    for (; ai != NULL; ai = next) {
+	next = ai->ai_next;
+	free(ai);
+    }
+}
+
+/*
+ * Create a certificate with the given CN and optional subjectAltName.
+ */
+static X509 *
+make_cert(const char *cn, const char *san)
+{
+    X509_EXTENSION *ext;
+    X509 *cert;
+
+    if ((cert = X509_new()) == NULL)
+	sudo_fatalx("unable to allocate cert");
+    if (!X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN",
+	    MBSTRING_ASC, (const unsigned char *)cn, -1, -1, 0))
+	sudo_fatalx("unable to set CN %s", cn);
+    if (san != NULL) {
+	ext = X509V3_EXT_conf_nid(NULL, NULL, NID_subject_alt_name,
+	    (char *)san);
+	if (ext == NULL || !X509_add_ext(cert, ext, -1))
+	    sudo_fatalx("unable to set subjectAltName %s", san);
+	X509_EXTENSION_free(ext);
+    }
+    return cert;
+}
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    sudo_gettime_mono(&now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+	(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/*
+ * Validate a cert and check the result and number of resolver calls.
+ */
+static void
+check_validate(const char *desc, X509 *cert, const char *ipaddr, int resolve,
+    HostnameValidationResult expected, unsigned int expected_calls,
+    int *ntests, int *nerrors)
+{
+    HostnameValidationResult result;
+    unsigned int calls = stub_calls;
+    struct timespec start;
+    double ms;
+
+    (*ntests)++;
+    sudo_gettime_mono(&start);
+    result = validate_hostname(cert, ipaddr, ipaddr, resolve);
+    ms = elapsed_ms(&start);
+    if (result != expected || stub_calls - calls != expected_calls) {
+	sudo_warnx("%s: got result %d with %u lookups, "
+	    "expected %d with %u lookups", desc, result, stub_calls - calls,
+	    expected, expected_calls);
+	(*nerrors)++;
+    } else if (expected_calls == 0 && ms >= STUB_DELAY_MS) {
+	sudo_warnx("%s: took %.1f ms without a lookup", desc, ms);
+	(*nerrors)++;
+    }
+}
+
+static void
+test_hostcheck(int *ntests, int *nerrors)
+{
+    X509 *san_cert, *cn_cert, *v6_cert, *flaky_cert;
+    char buf[1024];
+    ssize_t nread;
+    size_t len = 0;
+    int pfd[2];
+
+    san_cert = make_cert("ignored.example.com",
+	"DNS:a.example.com,DNS:b.example.com");
+    cn_cert = make_cert("missing.example.com", NULL);
+    v6_cert = make_cert("v6.example.com", NULL);
+    flaky_cert = make_cert("flaky.example.com", NULL);
+
+    /* Nothing cached yet, cached-only validation must not block. */
+    check_validate("uncached", san_cert, "192.0.2.2", HOSTCHECK_CACHED,
+	LookupPending, 0, ntests, nerrors);
+
+    /* Resolve the names as the logsrvd resolver process would. */
+    (*ntests)++;
+    if (pipe(pfd) == -1)
+	sudo_fatal("pipe");
+    if (hostcheck_resolve(san_cert, "192.0.2.2", "192.0.2.2", pfd[1]) !=
+	    MatchFound || stub_calls != 2) {
+	sudo_warnx("hostcheck_resolve: expected match with 2 lookups");
+	(*nerrors)++;
+    }
+    close(pfd[1]);
+    while ((nread = read(pfd[0], buf + len, sizeof(buf) - len)) > 0)
+	len += (size_t)nread;
+    close(pfd[0]);
+
+    /* Load the results into an empty cache. */
+    (*ntests)++;
+    hostcheck_cache_flush();
+    if (!hostcheck_cache_load(buf, len)) {
+	sudo_warnx("unable to load %zu bytes of lookup results", len);
+	(*nerrors)++;
+    }
+    check_validate("loaded", san_cert, "192.0.2.2", HOSTCHECK_CACHED,
+	MatchFound, 0, ntests, nerrors);
+    check_validate("loaded, wrong addr", san_cert, "192.0.2.3",
+	HOSTCHECK_CACHED, MatchNotFound, 0, ntests, nerrors);
+    check_validate("cached", san_cert, "192.0.2.1", HOSTCHECK_RESOLVE,
+	MatchFound, 0, ntests, nerrors);
+
+    /* Unknown names are cached too. */
+    check_validate("unknown", cn_cert, "192.0.2.2", HOSTCHECK_RESOLVE,
+	MatchNotFound, 1, ntests, nerrors);
+    check_validate("unknown, cached", cn_cert, "192.0.2.2",
+	HOSTCHECK_RESOLVE, MatchNotFound, 0, ntests, nerrors);
+    check_validate("unknown, cached only", cn_cert, "192.0.2.2",
+	HOSTCHECK_CACHED, MatchNotFound, 0, ntests, nerrors);
+
+    /* IPv6 address from the CN. */
+    check_validate("IPv6", v6_cert, "2001:db8::2", HOSTCHECK_RESOLVE,
+	MatchFound, 1, ntests, nerrors);
+    check_validate("IPv6, cached", v6_cert, "2001:db8::2",
+	HOSTCHECK_CACHED, MatchFound, 0, ntests, nerrors);
+
+    /* Temporary resolver failures are not cached. */
+    check_validate("temporary failure", flaky_cert, "192.0.2.2",
+	HOSTCHECK_RESOLVE, MatchNotFound, 1, ntests, nerrors);
+    check_validate("temporary failure, cached only", flaky_cert,
+	"192.0.2.2", HOSTCHECK_CACHED, LookupPending, 0, ntests, nerrors);
+
+    /* After the lookup, names that are still not cached are failures. */
+    check_validate("failed lookup", flaky_cert, "192.0.2.2",
+	HOSTCHECK_CACHE_FAILED, MatchNotFound, 0, ntests, nerrors);
+    check_validate("failed lookup, cached only", flaky_cert, "192.0.2.2",
+	HOSTCHECK_CACHED, MatchNotFound, 0, ntests, nerrors);
+    check_validate("resolved, failed lookup mode", san_cert, "192.0.2.1",
+	HOSTCHECK_CACHE_FAILED, MatchFound, 0, ntests, nerrors);
+
+    /* No lookups at all when resolving is disabled. */
+    check_validate("no resolve", san_cert, "192.0.2.9", HOSTCHECK_NO_RESOLVE,
+	MatchNotFound, 0, ntests, nerrors);
+
+    /* Truncated results are rejected. */
+    (*ntests)++;
+    if (hostcheck_cache_load("x.example.com\0" "192.0.2.1", 23)) {
+	sudo_warnx("loaded truncated lookup results");
+	(*nerrors)++;
+    }
+
+    hostcheck_cache_flush();
+    X509_free(san_cert);
+    X509_free(cn_cert);
+    X509_free(v6_cert);
+    X509_free(flaky_cert);
+}
+#endif /* HAVE_OPENSSL && !HAVE_WOLFSSL */
+
+int
+main(int argc, char *argv[])
+{
+    int ch, ntests = 0, errors = 0;
+
+    initprogname(argc > 0 ? argv[0] : "check_hostcheck");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    /* ignore */
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+    argc -= optind;
+    argv += optind;
+
+#if defined(HAVE_OPENSSL) && !defined(HAVE_WOLFSSL)
+    test_hostcheck(&ntests, &errors);
+#endif
+
+    if (ntests != 0) {
+	printf("hostcheck: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", errors,
+	    (ntests - errors) * 100 / ntests);
+    }
+
+    return errors;
+}
@@ -0,0 +1,218 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudo_compat.h"
+#include "sudo_util.h"
+#include "sudo_fatal.h"
+#include "sudo_iolog.h"
+
+sudo_dso_public int main(int argc, char *argv[]);
+
+#define D	IOLOG_COMPRESS_DEFAULT
+#define N	IOLOG_COMPRESS_NONE
+
+static struct compress_test {
+    const char *str;
+    bool valid;
+    int level[IOFD_MAX];
+    char strategy[IOFD_MAX];
+} test_data[] = {
+    { "", true, { D, D, D, D, D, D }, "" },
+    { "ttyout=1", true, { D, D, D, D, 1, D }, "" },
+    { "ttyout=9:huffman timing=none", true, { D, D, D, D, 9, N },
+	{ 0, 0, 0, 0, 'h', 0 } },
+    { "stdin=0,stdout=6:rle, ttyin=default:filtered", true,
+	{ 0, 6, D, D, D, D }, { 0, 'R', 0, 'f', 0, 0 } },
+    { "stderr=default:fixed", true, { D, D, D, D, D, D },
+	{ 0, 0, 'F', 0, 0, 0 } },
+    { "ttyout", false },
+    { "ttyout=", false },
+    { "ttyout=10", false },
+    { "ttyout=none:rle", false },
+    { "ttyout=1:bogus", false },
+    { "tty=1", false },
+    { "ttyoutput=1", false },
+    { "ttyout=1 bogus=2", false },
+    { NULL }
+};
+
+static void
+test_parse(int *ntests, int *nerrors)
+{
+    struct compress_test *td;
+    struct iolog_compress_params params;
+    int iofd;
+
+    for (td = test_data; td->str != NULL; td++) {
+	(*ntests)++;
+	if (iolog_parse_compress_params(td->str, &params) != td->valid) {
+	    sudo_warnx("\"%s\": expected %s", td->str,
+		td->valid ? "success" : "failure");
+	    (*nerrors)++;
+	    continue;
+	}
+	if (!td->valid)
+	    continue;
+	for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	    if (params.level[iofd] != td->level[iofd] ||
+		    params.strategy[iofd] != td->strategy[iofd]) {
+		sudo_warnx("\"%s\": %s: got level %d strategy '%c', "
+		    "expected level %d strategy '%c'", td->str,
+		    iolog_fd_to_name(iofd), params.level[iofd],
+		    params.strategy[iofd] ? params.strategy[iofd] : '-',
+		    td->level[iofd],
+		    td->strategy[iofd] ? td->strategy[iofd] : '-');
+		(*nerrors)++;
+		break;
+	    }
+	}
+    }
+}
+
+#ifdef HAVE_ZLIB_H
+/*
+ * Write a short I/O log stream and check whether it was compressed.
+ */
+static void
+test_open(int dfd, int iofd, bool expect_gzip, int *ntests, int *nerrors)
+{
+    const char *name = iolog_fd_to_name(iofd);
+    const char *errstr;
+    struct iolog_file iol = { true };
+    unsigned char magic[2];
+    int fd;
+
+    (*ntests)++;
+    if (!iolog_open(&iol, dfd, iofd, "w")) {
+	sudo_warn("unable to open %s", name);
+	(*nerrors)++;
+	return;
+    }
+    if (iolog_write(&iol, "hello world\n", 12, &errstr) != 12) {
+	sudo_warnx("unable to write %s: %s", name, errstr);
+	(*nerrors)++;
+    }
+    if (!iolog_close(&iol, &errstr)) {
+	sudo_warnx("unable to close %s: %s", name, errstr);
+	(*nerrors)++;
+	return;
+    }
+
+    fd = openat(dfd, name, O_RDONLY);
+    if (fd == -1 || read(fd, magic, sizeof(magic)) != sizeof(magic)) {
+	sudo_warn("unable to read %s", name);
+	(*nerrors)++;
+    } else if ((magic[0] == 0x1f && magic[1] == 0x8b) != expect_gzip) {
+	sudo_warnx("%s: expected %s file", name,
+	    expect_gzip ? "compressed" : "uncompressed");
+	(*nerrors)++;
+    }
+    if (fd != -1)
+	close(fd);
+}
+
+/*
+ * Write I/O log files with per-stream settings in a temporary directory.
+ */
+static void
+test_compress(int *ntests, int *nerrors)
+{
+    char testdir[] = "compress.XXXXXX";
+    const char *rmargs[] = { "rm", "-rf", NULL, NULL };
+    struct iolog_compress_params params;
+    int dfd, status;
+
+    if (mkdtemp(testdir) == NULL)
+	sudo_fatal("unable to create test dir");
+    rmargs[2] = testdir;
+    dfd = open(testdir, O_RDONLY);
+    if (dfd == -1)
+	sudo_fatal("unable to open %s", testdir);
+
+    iolog_set_owner(geteuid(), getegid());
+    iolog_set_compress(true);
+    if (!iolog_parse_compress_params("ttyout=1:huffman timing=none", &params))
+	sudo_fatalx("unable to parse compression settings");
+    iolog_set_compress_params(&params);
+
+    test_open(dfd, IOFD_TTYIN, true, ntests, nerrors);
+    test_open(dfd, IOFD_TTYOUT, true, ntests, nerrors);
+    test_open(dfd, IOFD_TIMING, false, ntests, nerrors);
+    close(dfd);
+
+    /* Clean up (avoid running via shell) */
+    switch (fork()) {
+    case -1:
+	sudo_warn("fork");
+	_exit(1);
+    case 0:
+	execvp("rm", (char **)rmargs);
+	_exit(1);
+    default:
+	wait(&status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    (*nerrors)++;
+	break;
+    }
+}
+#endif /* HAVE_ZLIB_H */
+
+int
+main(int argc, char *argv[])
+{
+    int ch, ntests = 0, errors = 0;
+
+    initprogname(argc > 0 ? argv[0] : "check_iolog_compress");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    /* ignore */
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+    argc -= optind;
+    argv += optind;
+
+    test_parse(&ntests, &errors);
+#ifdef HAVE_ZLIB_H
+    test_compress(&ntests, &errors);
+#endif
+
+    if (ntests != 0) {
+	printf("iolog_compress: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", errors,
+	    (ntests - errors) * 100 / ntests);
+    }
+
+    return errors;
+}
@@ -34,12 +34,69 @@
 
 sudo_dso_public int main(int argc, char *argv[]);
 
+/*
+ * Patterns with a back reference or an unmatched ')' cannot be
+ * merged with the others and must still match on their own.
+ */
+static const struct pwfilt_test {
+    const char *patterns[3];
+    const char *output;
+    bool filtered;
+} pwfilt_tests[] = {
+    { { "(..)\\1: $" }, "abab: ", true },
+    { { "(..)\\1: $", "(?i)password: $" }, "abab: ", true },
+    { { "(..)\\1: $", "(?i)password: $" }, "abcd: ", false },
+    { { "(..)\\1: $", "(?i)password: $" }, "PASSWORD: ", true },
+    { { "(?i)(pin|code) \\1: $", "PIN: $" }, "Code code: ", true },
+    { { "secret)code: $", "PIN: $" }, "secret)code: ", true },
+    { { "secret)code: $", "PIN: $" }, "PIN: ", true },
+    { { "[()]: $", "PIN: $" }, "(: ", true },
+    { { "[()]: $", "PIN: $" }, "): ", true },
+};
+
+/*
+ * Returns the number of errors.
+ */
+static int
+check_pwfilt(const struct pwfilt_test *test)
+{
+    char input[] = "1234\n", output[64];
+    void *handle;
+    bool filtered;
+    size_t i;
+
+    handle = iolog_pwfilt_alloc();
+    if (handle == NULL)
+	sudo_fatalx("unable to allocate memory");
+    for (i = 0; i < nitems(test->patterns); i++) {
+	if (test->patterns[i] == NULL)
+	    break;
+	if (!iolog_pwfilt_add(handle, test->patterns[i])) {
+	    iolog_pwfilt_free(handle);
+	    return 1;
+	}
+    }
+    (void)strlcpy(output, test->output, sizeof(output));
+    iolog_pwfilt_run_inplace(handle, IO_EVENT_TTYOUT, output, strlen(output));
+    iolog_pwfilt_run_inplace(handle, IO_EVENT_TTYIN, input, strlen(input));
+    iolog_pwfilt_free(handle);
+
+    filtered = input[0] == '*';
+    if (filtered != test->filtered) {
+	sudo_warnx("\"%s\": expected %sfiltered, got %sfiltered",
+	    test->output, test->filtered ? "" : "not ",
+	    filtered ? "" : "not ");
+	return 1;
+    }
+    return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
     int dfd = -1, ttyin_fd = -1, ttyout_fd = -1, ttyin_ok_fd = -1;
     int ch, i, ntests = 0, errors = 0;
-    void *passprompt_regex = NULL;
+    void *passprompt_regex = NULL, *passprompt_inplace = NULL;
 
     initprogname(argc > 0 ? argv[0] : "check_iolog_filter");
 
@@ -56,17 +113,33 @@ main(int argc, char *argv[])
     argc -= optind;
     argv += optind;
 
+    for (i = 0; i < (int)nitems(pwfilt_tests); i++) {
+	ntests++;
+	errors += check_pwfilt(&pwfilt_tests[i]);
+    }
+
     passprompt_regex = iolog_pwfilt_alloc();
     if (passprompt_regex == NULL)
 	sudo_fatalx("unable to allocate memory");
     if (!iolog_pwfilt_add(passprompt_regex, "(?i)password[: ]*"))
 	exit(1);
 
+    /* Multiple patterns are matched as a single regular expression. */
+    passprompt_inplace = iolog_pwfilt_alloc();
+    if (passprompt_inplace == NULL)
+	sudo_fatalx("unable to allocate memory");
+    if (!iolog_pwfilt_add(passprompt_inplace, "^Enter passphrase: $"))
+	exit(1);
+    if (!iolog_pwfilt_add(passprompt_inplace, "(?i)password[: ]*"))
+	exit(1);
+    if (!iolog_pwfilt_add(passprompt_inplace, "PIN: $"))
+	exit(1);
+
     for (i = 0; i < argc; i++) {
 	struct iolog_file iolog_timing = { true };
 	struct timing_closure timing;
 	const char *logdir = argv[i];
-	char tbuf[8192], fbuf[8192];
+	char tbuf[8192], fbuf[8192], ibuf[8192];
 	ssize_t nread;
 
 	ntests++;
@@ -152,6 +225,9 @@ main(int argc, char *argv[])
 		errors++;
 		continue;
 	    }
+	    memcpy(ibuf, tbuf, timing.u.nbytes);
+	    iolog_pwfilt_run_inplace(passprompt_inplace, timing.event, ibuf,
+		timing.u.nbytes);
 
 	    if (timing.event == IO_EVENT_TTYIN) {
 		nread = read(ttyin_ok_fd, fbuf, timing.u.nbytes);
@@ -171,6 +247,13 @@ main(int argc, char *argv[])
 		    free(newbuf);
 		    break;
 		}
+		if (memcmp(fbuf, ibuf, timing.u.nbytes) != 0) {
+		    sudo_warnx("%s: in-place ttyin mismatch at byte %lld",
+			argv[i], (long long)lseek(fd, 0, SEEK_CUR));
+		    errors++;
+		    free(newbuf);
+		    break;
+		}
 	    }
 
 	    free(newbuf);
@@ -192,6 +275,7 @@ next:
 	    iolog_close(&iolog_timing, NULL);
     }
     iolog_pwfilt_free(passprompt_regex);
+    iolog_pwfilt_free(passprompt_inplace);
 
     if (ntests != 0) {
 	printf("iolog_filter: %d test%s run, %d errors, %d%% success rate\n",
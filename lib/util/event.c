@@ -89,6 +89,123 @@ sudo_ev_deactivate_all(struct sudo_event_base *base)
     debug_return;
 }
 
+/*
+ * Timeout events are stored in a binary min-heap ordered by expiration
+ * time, so adding, rescheduling or removing a timeout is O(log n) even
+ * with a large number of connections.  Events with the same expiration
+ * time fire in the order their timeouts were set.
+ */
+static inline bool
+sudo_ev_timeout_before(struct sudo_event *ev1, struct sudo_event *ev2)
+{
+    if (sudo_timespeccmp(&ev1->timeout, &ev2->timeout, !=))
+	return sudo_timespeccmp(&ev1->timeout, &ev2->timeout, <);
+    return ev1->timeout_seq < ev2->timeout_seq;
+}
+
+static inline void
+sudo_ev_timeout_place(struct sudo_event_base *base, struct sudo_event *ev,
+    unsigned int idx)
+{
+    base->timeouts[idx] = ev;
+    ev->timeout_idx = idx;
+}
+
+/*
+ * Restore the heap property after the timeout of the event at
+ * index idx has changed.
+ */
+static void
+sudo_ev_timeout_sift(struct sudo_event_base *base, unsigned int idx)
+{
+    struct sudo_event *ev = base->timeouts[idx];
+
+    /* Move up while earlier than the parent. */
+    while (idx > 0) {
+	const unsigned int parent = (idx - 1) / 2;
+	if (!sudo_ev_timeout_before(ev, base->timeouts[parent]))
+	    break;
+	sudo_ev_timeout_place(base, base->timeouts[parent], idx);
+	idx = parent;
+    }
+
+    /* Move down while later than the earliest child. */
+    for (;;) {
+	unsigned int child = (2 * idx) + 1;
+	if (child >= base->ntimeouts)
+	    break;
+	if (child + 1 < base->ntimeouts &&
+		sudo_ev_timeout_before(base->timeouts[child + 1],
+		base->timeouts[child]))
+	    child++;
+	if (!sudo_ev_timeout_before(base->timeouts[child], ev))
+	    break;
+	sudo_ev_timeout_place(base, base->timeouts[child], idx);
+	idx = child;
+    }
+    sudo_ev_timeout_place(base, ev, idx);
+}
+
+/*
+ * Make sure there is room in the timeouts heap for one more event.
+ */
+static int
+sudo_ev_timeout_reserve(struct sudo_event_base *base)
+{
+    struct sudo_event **timeouts;
+    unsigned int new_max;
+    debug_decl(sudo_ev_timeout_reserve, SUDO_DEBUG_EVENT);
+
+    if (base->ntimeouts < base->timeouts_max)
+	debug_return_int(0);
+
+    new_max = base->timeouts_max ? base->timeouts_max * 2 : 32;
+    if (new_max < base->timeouts_max) {
+	errno = ENOMEM;
+	debug_return_int(-1);
+    }
+    timeouts = reallocarray(base->timeouts, new_max, sizeof(*timeouts));
+    if (timeouts == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "%s: unable to allocate %u timeouts", __func__, new_max);
+	debug_return_int(-1);
+    }
+    base->timeouts = timeouts;
+    base->timeouts_max = new_max;
+    debug_return_int(0);
+}
+
+/*
+ * Add an event to the timeouts heap or, if it is already there,
+ * move it to match its new timeout.  Space must have been reserved.
+ */
+static void
+sudo_ev_timeout_set(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    ev->timeout_seq = ++base->timeout_seq;
+    if (!ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
+	sudo_ev_timeout_place(base, ev, base->ntimeouts++);
+	SET(ev->flags, SUDO_EVQ_TIMEOUTS);
+    }
+    sudo_ev_timeout_sift(base, ev->timeout_idx);
+}
+
+/*
+ * Remove an event from the timeouts heap.
+ */
+static void
+sudo_ev_timeout_remove(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    const unsigned int idx = ev->timeout_idx;
+
+    CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
+    if (idx != --base->ntimeouts) {
+	/* Fill the hole with the last event. */
+	sudo_ev_timeout_place(base, base->timeouts[base->ntimeouts], idx);
+	sudo_ev_timeout_sift(base, idx);
+    }
+}
+
 /*
  * Activate all signal events for which the corresponding signal_pending[]
  * flag is set.
@@ -172,7 +289,6 @@ sudo_ev_base_init(struct sudo_event_base *base)
     debug_decl(sudo_ev_base_init, SUDO_DEBUG_EVENT);
 
     TAILQ_INIT(&base->events);
-    TAILQ_INIT(&base->timeouts);
     for (i = 0; i < NSIG; i++)
 	TAILQ_INIT(&base->signals[i]);
     if (sudo_ev_base_alloc_impl(base) != 0) {
@@ -244,6 +360,7 @@ sudo_ev_base_free_v1(struct sudo_event_base *base)
     sudo_ev_base_free_impl(base);
     close(base->signal_pipe[0]);
     close(base->signal_pipe[1]);
+    free(base->timeouts);
     free(base);
 
     debug_return;
@@ -495,12 +612,11 @@ sudo_ev_add_v2(struct sudo_event_base *base, struct sudo_event *ev,
 
     /* Only add new events to the events list. */
     if (ISSET(ev->flags, SUDO_EVQ_INSERTED)) {
-	/* If event no longer has a timeout, remove from timeouts queue. */
+	/* If event no longer has a timeout, remove from timeouts heap. */
 	if (timo == NULL && ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
 	    sudo_debug_printf(SUDO_DEBUG_INFO,
-		"%s: removing event %p from timeouts queue", __func__, ev);
-	    CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+		"%s: removing event %p from timeouts heap", __func__, ev);
+	    sudo_ev_timeout_remove(base, ev);
 	}
     } else {
 	/* Special handling for signal events. */
@@ -511,6 +627,8 @@ sudo_ev_add_v2(struct sudo_event_base *base, struct sudo_event *ev,
 	sudo_debug_printf(SUDO_DEBUG_INFO,
 	    "%s: adding event %p to base %p, fd %d, events %d",
 	    __func__, ev, base, ev->fd, ev->events);
+	if (timo != NULL && sudo_ev_timeout_reserve(base) != 0)
+	    debug_return_int(-1);
 	if (ev->events & (SUDO_EV_READ|SUDO_EV_WRITE)) {
 	    if (sudo_ev_add_impl(base, ev) != 0)
 		debug_return_int(-1);
@@ -525,24 +643,14 @@ sudo_ev_add_v2(struct sudo_event_base *base, struct sudo_event *ev,
     }
     /* Timeouts can be changed for existing events. */
     if (timo != NULL) {
-	struct sudo_event *evtmp;
-	if (ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
-	    /* Remove from timeouts list, then add back. */
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+	if (!ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
+	    if (sudo_ev_timeout_reserve(base) != 0)
+		debug_return_int(-1);
 	}
-	/* Convert to absolute time and insert in sorted order; O(n). */
+	/* Convert to absolute time and add to (or move in) the heap. */
 	sudo_gettime_mono(&ev->timeout);
 	sudo_timespecadd(&ev->timeout, timo, &ev->timeout);
-	TAILQ_FOREACH(evtmp, &base->timeouts, timeouts_entries) {
-	    if (sudo_timespeccmp(&ev->timeout, &evtmp->timeout, <))
-		break;
-	}
-	if (evtmp != NULL) {
-	    TAILQ_INSERT_BEFORE(evtmp, ev, timeouts_entries);
-	} else {
-	    TAILQ_INSERT_TAIL(&base->timeouts, ev, timeouts_entries);
-	}
-	SET(ev->flags, SUDO_EVQ_TIMEOUTS);
+	sudo_ev_timeout_set(base, ev);
     }
     debug_return_int(0);
 }
@@ -613,9 +721,9 @@ sudo_ev_del_v1(struct sudo_event_base *base, struct sudo_event *ev)
 	/* Unlink from event list. */
 	TAILQ_REMOVE(&base->events, ev, entries);
 
-	/* Unlink from timeouts list. */
+	/* Remove from timeouts heap. */
 	if (ISSET(ev->flags, SUDO_EVQ_TIMEOUTS))
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+	    sudo_ev_timeout_remove(base, ev);
     }
 
     /* Unlink from active list. */
@@ -684,12 +792,11 @@ rescan:
 	case 0:
 	    /* Timed out, activate timeout events. */
 	    sudo_gettime_mono(&now);
-	    while ((ev = TAILQ_FIRST(&base->timeouts)) != NULL) {
+	    while ((ev = sudo_ev_first_timeout(base)) != NULL) {
 		if (sudo_timespeccmp(&ev->timeout, &now, >))
 		    break;
-		/* Remove from timeouts list. */
-		CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
-		TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+		/* Remove from timeouts heap. */
+		sudo_ev_timeout_remove(base, ev);
 		/* Make event active. */
 		ev->revents = SUDO_EV_TIMEOUT;
 		TAILQ_INSERT_TAIL(&base->active, ev, active_entries);
@@ -193,7 +193,7 @@ sudo_ev_scan_impl(struct sudo_event_base *base, unsigned int flags)
     int nready;
     debug_decl(sudo_ev_loop, SUDO_DEBUG_EVENT);
 
-    if ((ev = TAILQ_FIRST(&base->timeouts)) != NULL) {
+    if ((ev = sudo_ev_first_timeout(base)) != NULL) {
 	sudo_gettime_mono(&now);
 	sudo_timespecsub(&ev->timeout, &now, &ts);
 	if (ts.tv_sec < 0)
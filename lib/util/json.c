@@ -421,3 +421,14 @@ sudo_json_get_len_v1(struct json_container *jsonc)
 {
     return jsonc->buflen;
 }
+
+/*
+ * Discard the buffered JSON text, e.g. after it has been written out.
+ * Open objects and arrays are not affected.
+ */
+void
+sudo_json_clear_buf_v1(struct json_container *jsonc)
+{
+    jsonc->buflen = 0;
+    jsonc->buf[0] = '\0';
+}
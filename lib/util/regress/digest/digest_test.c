@@ -1146,7 +1146,55 @@ run_tests(unsigned int digest_type, struct test_vector *test_vectors)
 }
 
 /*
- * Verify SHA2 functions using NIST byte-oriented short message test vectors.
+ * Hash one million 'a' characters, fed to the digest in chunks
+ * of varying size to exercise both the buffered and the multi-block
+ * update paths.
+ */
+static void
+run_long_test(unsigned int digest_type, const char *expected)
+{
+    static const size_t chunks[] = { 1, 63, 64, 65, 127, 1000, 4096 };
+    struct sudo_digest *ctx;
+    unsigned char buf[4096], md[64];
+    char mdhex[128 + 1];
+    size_t i, j, len, n, digest_len;
+
+    digest_len = sudo_digest_getlen(digest_type);
+    if (digest_len == 0 || digest_len > sizeof(md))
+	sudo_fatalx("invalid digest length for type %d", digest_type);
+
+    ctx = sudo_digest_alloc(digest_type);
+    if (ctx == NULL)
+	sudo_fatal(NULL);
+    memset(buf, 'a', sizeof(buf));
+
+    for (i = 0; i < nitems(chunks); i++) {
+	ntests++;
+	for (len = 1000000; len != 0; len -= n) {
+	    n = MIN(len, chunks[i]);
+	    sudo_digest_update(ctx, buf, n);
+	}
+	sudo_digest_final(ctx, md);
+
+	for (j = 0; j < digest_len; j++) {
+	    mdhex[j * 2]       = hex[md[j] >> 4];
+	    mdhex[(j * 2) + 1] = hex[md[j] & 0x0f];
+	}
+	mdhex[j * 2] = '\0';
+
+	if (strcmp(expected, mdhex) != 0) {
+	    sudo_warnx("test %u: chunk size %zu: expected %s, got %s",
+		digest_type, chunks[i], expected, mdhex);
+	    errors++;
+	}
+	sudo_digest_reset(ctx);
+    }
+    sudo_digest_free(ctx);
+}
+
+/*
+ * Verify SHA2 functions using NIST byte-oriented short message test vectors
+ * and a long message.
  */
 int
 main(int argc, char *argv[])
@@ -1169,6 +1217,13 @@ main(int argc, char *argv[])
     run_tests(SUDO_DIGEST_SHA224, sha224_vectors);
     run_tests(SUDO_DIGEST_SHA256, sha256_vectors);
     run_tests(SUDO_DIGEST_SHA512, sha512_vectors);
+    run_long_test(SUDO_DIGEST_SHA224,
+	"20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67");
+    run_long_test(SUDO_DIGEST_SHA256,
+	"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    run_long_test(SUDO_DIGEST_SHA512,
+	"e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+	"de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
 
     if (ntests != 0) {
 	printf("%s: %d tests run, %d errors, %d%% success rate\n",
@@ -0,0 +1,180 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudo_compat.h"
+#include "sudo_event.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+
+sudo_dso_public int main(int argc, char *argv[]);
+
+#define NTIMERS	2000
+
+static struct timer {
+    struct sudo_event *ev;
+    struct timespec deadline;
+    int fired;
+    bool deleted;
+} timers[NTIMERS];
+
+static struct timespec last_fired;
+static unsigned int seed = 1;
+static int errors, ntests;
+
+static unsigned int
+next_rand(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void
+timer_cb(int fd, int what, void *v)
+{
+    struct timer *t = v;
+
+    ntests++;
+    if (what != SUDO_EV_TIMEOUT || t->deleted || t->fired != 0) {
+	sudo_warnx("timer %d: unexpected callback, what %d, fired %d%s",
+	    (int)(t - timers), what, t->fired,
+	    t->deleted ? " (deleted)" : "");
+	errors++;
+    }
+    ntests++;
+    if (sudo_timespeccmp(&t->deadline, &last_fired, <)) {
+	sudo_warnx("timer %d: fired out of order [%lld, %ld] < [%lld, %ld]",
+	    (int)(t - timers), (long long)t->deadline.tv_sec,
+	    t->deadline.tv_nsec, (long long)last_fired.tv_sec,
+	    last_fired.tv_nsec);
+	errors++;
+    }
+    last_fired = t->deadline;
+    t->fired++;
+}
+
+/*
+ * Set a timer to fire in 0-40ms, replacing any existing timeout.
+ */
+static void
+timer_add(struct sudo_event_base *base, struct timer *t)
+{
+    struct timespec timo, *deadline;
+
+    timo.tv_sec = 0;
+    timo.tv_nsec = (long)(next_rand() % 40) * 1000000;
+    if (sudo_ev_add(base, t->ev, &timo, false) == -1)
+	sudo_fatalx("unable to add timer %d", (int)(t - timers));
+    ntests++;
+    if ((deadline = sudo_ev_get_timeout(t->ev)) == NULL) {
+	sudo_warnx("timer %d: no timeout after sudo_ev_add", (int)(t - timers));
+	errors++;
+	return;
+    }
+    t->deadline = *deadline;
+}
+
+/*
+ * Add, re-arm and delete many timeout events and make sure they
+ * fire in order of their deadlines.
+ */
+int
+main(int argc, char *argv[])
+{
+    struct sudo_event_base *base;
+    struct timespec left;
+    int ch, i;
+
+    initprogname(argc > 0 ? argv[0] : "event_test");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    /* ignore */
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    if ((base = sudo_ev_base_alloc()) == NULL)
+	sudo_fatalx("unable to allocate event base");
+
+    for (i = 0; i < NTIMERS; i++) {
+	timers[i].ev = sudo_ev_alloc(-1, SUDO_EV_TIMEOUT, timer_cb, &timers[i]);
+	if (timers[i].ev == NULL)
+	    sudo_fatalx("unable to allocate timer %d", i);
+	timer_add(base, &timers[i]);
+    }
+
+    /* Re-arm every other timer and delete every fifth one. */
+    for (i = 0; i < NTIMERS; i += 2)
+	timer_add(base, &timers[i]);
+    for (i = 0; i < NTIMERS; i += 5) {
+	if (sudo_ev_del(base, timers[i].ev) == -1)
+	    sudo_fatalx("unable to delete timer %d", i);
+	timers[i].deleted = true;
+    }
+
+    /* A deleted timer has no time left, a pending one does. */
+    ntests++;
+    if (sudo_ev_get_timeleft(timers[0].ev, &left) != -1) {
+	sudo_warnx("timer 0: time left after deletion");
+	errors++;
+    }
+    ntests++;
+    if (sudo_ev_get_timeleft(timers[1].ev, &left) != 0 || left.tv_sec != 0) {
+	sudo_warnx("timer 1: unexpected time left [%lld, %ld]",
+	    (long long)left.tv_sec, left.tv_nsec);
+	errors++;
+    }
+
+    if (sudo_ev_dispatch(base) == -1)
+	sudo_fatalx("error running event loop");
+
+    for (i = 0; i < NTIMERS; i++) {
+	ntests++;
+	if (timers[i].fired != (timers[i].deleted ? 0 : 1)) {
+	    sudo_warnx("timer %d: fired %d times", i, timers[i].fired);
+	    errors++;
+	}
+	sudo_ev_free(timers[i].ev);
+    }
+    sudo_ev_base_free(base);
+
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    return errors;
+}
@@ -58,6 +58,7 @@ main(int argc, char *argv[])
 {
     struct json_container jsonc;
     struct json_value value;
+    char flushed[sizeof(outbuf)];
     int ch, errors = 0, ntests = 0;
 
     initprogname(argc > 0 ? argv[0] : "json_test");
@@ -163,6 +164,19 @@ main(int argc, char *argv[])
 	errors++;
     }
 
+    /* Flush what we have so far, the remainder is appended later. */
+    if (strlcpy(flushed, sudo_json_get_buf(&jsonc), sizeof(flushed)) >= sizeof(flushed)) {
+	sudo_warnx("flushed JSON output too large");
+	errors++;
+	goto done;
+    }
+    sudo_json_clear_buf(&jsonc);
+    ntests++;
+    if (sudo_json_get_len(&jsonc) != 0) {
+	sudo_warnx("JSON buffer not empty after clearing it");
+	errors++;
+    }
+
     value.type = JSON_NULL;
     ntests++;
     if (!sudo_json_add_value(&jsonc, "null1", &value)) {
@@ -218,9 +232,12 @@ main(int argc, char *argv[])
 	goto done;
     }
 
-    if (strcmp(outbuf, jsonc.buf) != 0) {
+    ntests++;
+    if (strlcat(flushed, jsonc.buf, sizeof(flushed)) >= sizeof(flushed) ||
+	    strcmp(outbuf, flushed) != 0) {
 	fprintf(stderr, "Expected:\n%s\n", outbuf);
-	fprintf(stderr, "Received:\n%s\n", jsonc.buf);
+	fprintf(stderr, "Received:\n%s\n", flushed);
+	errors++;
     }
 
 done:
@@ -47,6 +47,31 @@
 # include "compat/endian.h"
 #endif
 
+/*
+ * Use the SHA extensions on x86 and the ARMv8 crypto extensions for
+ * the SHA-256 block function when the CPU supports them.
+ * The choice is made at run time, the portable code is the fallback.
+ */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+# if defined(__x86_64__) || defined(__i386__)
+#  define SHA256_X86_SHANI
+#  include <cpuid.h>
+#  include <immintrin.h>
+# elif defined(__aarch64__)
+#  if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#   define SHA256_ARMV8
+#   define SHA256_ARMV8_TARGET
+#  elif defined(HAVE_GETAUXVAL) && !defined(__clang__) && __GNUC__ >= 8
+#   define SHA256_ARMV8
+#   define SHA256_ARMV8_TARGET __attribute__((target("+crypto")))
+#   include <sys/auxv.h>
+#  endif
+#  ifdef SHA256_ARMV8
+#   include <arm_neon.h>
+#  endif
+# endif
+#endif
+
 #include "sudo_compat.h"
 #include "compat/sha2.h"
 
@@ -201,8 +226,8 @@ SHA256Init(SHA2_CTX *ctx)
 #define s0(x) (rotrFixed(x,7)^rotrFixed(x,18)^(x>>3))
 #define s1(x) (rotrFixed(x,17)^rotrFixed(x,19)^(x>>10))
 
-void
-SHA256Transform(uint32_t state[8], const uint8_t data[SHA256_BLOCK_LENGTH])
+static void
+SHA256Transform_generic(uint32_t state[8], const uint8_t data[SHA256_BLOCK_LENGTH])
 {
 	uint32_t W[16];
 	uint32_t T[8];
@@ -247,6 +272,271 @@ SHA256Transform(uint32_t state[8], const uint8_t data[SHA256_BLOCK_LENGTH])
 #undef s1
 #undef R
 
+static void
+sha256_blocks_generic(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	while (nblocks--) {
+		SHA256Transform_generic(state, data);
+		data += SHA256_BLOCK_LENGTH;
+	}
+}
+
+#ifdef SHA256_X86_SHANI
+/*
+ * SHA-256 using the Intel SHA extensions.
+ * The state is kept in two registers as ABEF and CDGH, each
+ * sha256rnds2 instruction performs two rounds.
+ */
+
+/* Four rounds using the message words in m. */
+#define SHANI_ROUNDS(m, i) do {						\
+	MSG = _mm_add_epi32(m,						\
+	    _mm_loadu_si128((const __m128i *)&SHA256_K[i]));		\
+	STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);		\
+	MSG = _mm_shuffle_epi32(MSG, 0x0e);				\
+	STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);		\
+} while (0)
+
+/* Finish computing the next four message words in "next". */
+#define SHANI_MSG2(next, cur, prev) do {				\
+	next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4));	\
+	next = _mm_sha256msg2_epu32(next, cur);				\
+} while (0)
+
+/* Start computing message words from "prev" and "cur". */
+#define SHANI_MSG1(prev, cur)						\
+	prev = _mm_sha256msg1_epu32(prev, cur)
+
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	const __m128i MASK =
+	    _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+	__m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+	__m128i MSG, MSG0, MSG1, MSG2, MSG3, TMP;
+
+	/* Load state, rearranging it into ABEF and CDGH. */
+	TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+	STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	TMP = _mm_shuffle_epi32(TMP, 0xb1);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0x1b);
+	STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xf0);
+
+	while (nblocks--) {
+		ABEF_SAVE = STATE0;
+		CDGH_SAVE = STATE1;
+
+		/* Load the message in big endian byte order. */
+		MSG0 = _mm_shuffle_epi8(
+		    _mm_loadu_si128((const __m128i *)(data + 0)), MASK);
+		MSG1 = _mm_shuffle_epi8(
+		    _mm_loadu_si128((const __m128i *)(data + 16)), MASK);
+		MSG2 = _mm_shuffle_epi8(
+		    _mm_loadu_si128((const __m128i *)(data + 32)), MASK);
+		MSG3 = _mm_shuffle_epi8(
+		    _mm_loadu_si128((const __m128i *)(data + 48)), MASK);
+
+		SHANI_ROUNDS(MSG0, 0);
+		SHANI_ROUNDS(MSG1, 4);
+		SHANI_MSG1(MSG0, MSG1);
+		SHANI_ROUNDS(MSG2, 8);
+		SHANI_MSG1(MSG1, MSG2);
+		SHANI_ROUNDS(MSG3, 12);
+		SHANI_MSG2(MSG0, MSG3, MSG2);
+		SHANI_MSG1(MSG2, MSG3);
+		SHANI_ROUNDS(MSG0, 16);
+		SHANI_MSG2(MSG1, MSG0, MSG3);
+		SHANI_MSG1(MSG3, MSG0);
+		SHANI_ROUNDS(MSG1, 20);
+		SHANI_MSG2(MSG2, MSG1, MSG0);
+		SHANI_MSG1(MSG0, MSG1);
+		SHANI_ROUNDS(MSG2, 24);
+		SHANI_MSG2(MSG3, MSG2, MSG1);
+		SHANI_MSG1(MSG1, MSG2);
+		SHANI_ROUNDS(MSG3, 28);
+		SHANI_MSG2(MSG0, MSG3, MSG2);
+		SHANI_MSG1(MSG2, MSG3);
+		SHANI_ROUNDS(MSG0, 32);
+		SHANI_MSG2(MSG1, MSG0, MSG3);
+		SHANI_MSG1(MSG3, MSG0);
+		SHANI_ROUNDS(MSG1, 36);
+		SHANI_MSG2(MSG2, MSG1, MSG0);
+		SHANI_MSG1(MSG0, MSG1);
+		SHANI_ROUNDS(MSG2, 40);
+		SHANI_MSG2(MSG3, MSG2, MSG1);
+		SHANI_MSG1(MSG1, MSG2);
+		SHANI_ROUNDS(MSG3, 44);
+		SHANI_MSG2(MSG0, MSG3, MSG2);
+		SHANI_MSG1(MSG2, MSG3);
+		SHANI_ROUNDS(MSG0, 48);
+		SHANI_MSG2(MSG1, MSG0, MSG3);
+		SHANI_MSG1(MSG3, MSG0);
+		SHANI_ROUNDS(MSG1, 52);
+		SHANI_MSG2(MSG2, MSG1, MSG0);
+		SHANI_ROUNDS(MSG2, 56);
+		SHANI_MSG2(MSG3, MSG2, MSG1);
+		SHANI_ROUNDS(MSG3, 60);
+
+		STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+		STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+		data += SHA256_BLOCK_LENGTH;
+	}
+
+	/* Store state, converting back from ABEF and CDGH. */
+	TMP = _mm_shuffle_epi32(STATE0, 0x1b);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xb1);
+	STATE0 = _mm_blend_epi16(TMP, STATE1, 0xf0);
+	STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+	_mm_storeu_si128((__m128i *)&state[0], STATE0);
+	_mm_storeu_si128((__m128i *)&state[4], STATE1);
+}
+
+#undef SHANI_ROUNDS
+#undef SHANI_MSG1
+#undef SHANI_MSG2
+
+static int
+sha256_have_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* SSSE3 and SSE4.1 are used to shuffle the state and message. */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if ((ecx & (1U << 9)) == 0 || (ecx & (1U << 19)) == 0)
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1U << 29)) != 0;
+}
+#endif /* SHA256_X86_SHANI */
+
+#ifdef SHA256_ARMV8
+/*
+ * SHA-256 using the ARMv8 cryptography extensions.
+ * The sha256h and sha256h2 instructions each update half of
+ * the state, four rounds at a time.
+ */
+
+/* Four rounds using the message words in m. */
+#define ARMV8_ROUNDS(m, i) do {						\
+	TMP = vaddq_u32(m, vld1q_u32(&SHA256_K[i]));			\
+	SAVE = STATE0;							\
+	STATE0 = vsha256hq_u32(STATE0, STATE1, TMP);			\
+	STATE1 = vsha256h2q_u32(STATE1, SAVE, TMP);			\
+} while (0)
+
+/* Compute the next four message words in m0. */
+#define ARMV8_SCHED(m0, m1, m2, m3)					\
+	m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3)
+
+SHA256_ARMV8_TARGET
+static void
+sha256_blocks_armv8(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	uint32x4_t STATE0, STATE1, ABCD_SAVE, EFGH_SAVE, SAVE, TMP;
+	uint32x4_t MSG0, MSG1, MSG2, MSG3;
+
+	STATE0 = vld1q_u32(&state[0]);
+	STATE1 = vld1q_u32(&state[4]);
+
+	while (nblocks--) {
+		ABCD_SAVE = STATE0;
+		EFGH_SAVE = STATE1;
+
+		/* Load the message in big endian byte order. */
+		MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+		MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		ARMV8_ROUNDS(MSG0, 0);
+		ARMV8_SCHED(MSG0, MSG1, MSG2, MSG3);
+		ARMV8_ROUNDS(MSG1, 4);
+		ARMV8_SCHED(MSG1, MSG2, MSG3, MSG0);
+		ARMV8_ROUNDS(MSG2, 8);
+		ARMV8_SCHED(MSG2, MSG3, MSG0, MSG1);
+		ARMV8_ROUNDS(MSG3, 12);
+		ARMV8_SCHED(MSG3, MSG0, MSG1, MSG2);
+		ARMV8_ROUNDS(MSG0, 16);
+		ARMV8_SCHED(MSG0, MSG1, MSG2, MSG3);
+		ARMV8_ROUNDS(MSG1, 20);
+		ARMV8_SCHED(MSG1, MSG2, MSG3, MSG0);
+		ARMV8_ROUNDS(MSG2, 24);
+		ARMV8_SCHED(MSG2, MSG3, MSG0, MSG1);
+		ARMV8_ROUNDS(MSG3, 28);
+		ARMV8_SCHED(MSG3, MSG0, MSG1, MSG2);
+		ARMV8_ROUNDS(MSG0, 32);
+		ARMV8_SCHED(MSG0, MSG1, MSG2, MSG3);
+		ARMV8_ROUNDS(MSG1, 36);
+		ARMV8_SCHED(MSG1, MSG2, MSG3, MSG0);
+		ARMV8_ROUNDS(MSG2, 40);
+		ARMV8_SCHED(MSG2, MSG3, MSG0, MSG1);
+		ARMV8_ROUNDS(MSG3, 44);
+		ARMV8_SCHED(MSG3, MSG0, MSG1, MSG2);
+		ARMV8_ROUNDS(MSG0, 48);
+		ARMV8_ROUNDS(MSG1, 52);
+		ARMV8_ROUNDS(MSG2, 56);
+		ARMV8_ROUNDS(MSG3, 60);
+
+		STATE0 = vaddq_u32(STATE0, ABCD_SAVE);
+		STATE1 = vaddq_u32(STATE1, EFGH_SAVE);
+		data += SHA256_BLOCK_LENGTH;
+	}
+
+	vst1q_u32(&state[0], STATE0);
+	vst1q_u32(&state[4], STATE1);
+}
+
+#undef ARMV8_ROUNDS
+#undef ARMV8_SCHED
+
+static int
+sha256_have_armv8(void)
+{
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+	return 1;
+#else
+	/* HWCAP_SHA2 from <asm/hwcap.h> */
+	return (getauxval(AT_HWCAP) & (1UL << 6)) != 0;
+#endif
+}
+#endif /* SHA256_ARMV8 */
+
+static void sha256_blocks_init(uint32_t state[8], const uint8_t *data, size_t nblocks);
+
+/*
+ * Process nblocks full blocks of data.
+ * Starts out pointing to sha256_blocks_init() which selects the
+ * best implementation for this CPU on first use.
+ */
+static void (*sha256_blocks)(uint32_t state[8], const uint8_t *data,
+    size_t nblocks) = sha256_blocks_init;
+
+static void
+sha256_blocks_init(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	sha256_blocks = sha256_blocks_generic;
+#ifdef SHA256_X86_SHANI
+	if (sha256_have_shani())
+		sha256_blocks = sha256_blocks_shani;
+#endif
+#ifdef SHA256_ARMV8
+	if (sha256_have_armv8())
+		sha256_blocks = sha256_blocks_armv8;
+#endif
+	sha256_blocks(state, data, nblocks);
+}
+
+void
+SHA256Transform(uint32_t state[8], const uint8_t data[SHA256_BLOCK_LENGTH])
+{
+	sha256_blocks(state, data, 1);
+}
+
 void
 SHA256Update(SHA2_CTX *ctx, const uint8_t *data, size_t len)
 {
@@ -256,9 +546,12 @@ SHA256Update(SHA2_CTX *ctx, const uint8_t *data, size_t len)
 	ctx->count[0] += ((uint64_t)len << 3);
 	if ((j + len) > SHA256_BLOCK_LENGTH - 1) {
 		memcpy(&ctx->buffer[j], data, (i = SHA256_BLOCK_LENGTH - j));
-		SHA256Transform(ctx->state.st32, ctx->buffer);
-		for ( ; i + SHA256_BLOCK_LENGTH - 1 < len; i += SHA256_BLOCK_LENGTH)
-			SHA256Transform(ctx->state.st32, (uint8_t *)&data[i]);
+		sha256_blocks(ctx->state.st32, ctx->buffer, 1);
+		if (len - i >= SHA256_BLOCK_LENGTH) {
+			size_t nblocks = (len - i) / SHA256_BLOCK_LENGTH;
+			sha256_blocks(ctx->state.st32, &data[i], nblocks);
+			i += nblocks * SHA256_BLOCK_LENGTH;
+		}
 		j = 0;
 	}
 	memcpy(&ctx->buffer[j], &data[i], len - i);
@@ -103,6 +103,23 @@
 #  define ARMCRC32
 #endif
 
+/*
+  Otherwise, check at run time for the x86 carry-less multiply instruction or
+  the ARM CRC32 instructions, if the compiler can generate code for them.
+ */
+#if !defined(ARMCRC32) && !defined(MAKECRCH) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#  if defined(__x86_64__) || defined(__i386__)
+#    define PCLMULCRC32
+#    include <cpuid.h>
+#    include <immintrin.h>
+#  elif defined(__aarch64__) && defined(__linux__) && !defined(__clang__) && \
+        __GNUC__ >= 8
+#    define ARMCRC32_RUNTIME
+#    include <sys/auxv.h>
+#  endif
+#endif
+
 /* Local functions. */
 local z_crc_t multmodp OF((z_crc_t a, z_crc_t b));
 local z_crc_t x2nmodp OF((z_off64_t n, unsigned k));
@@ -744,6 +761,166 @@ local z_word_t crc_word_big(data)
 
 #endif
 
+#ifdef PCLMULCRC32
+
+#define Z_SIMD_MIN 64               /* fewest bytes worth folding */
+
+/*
+  Compute the CRC of len bytes at buf using carry-less multiplication to fold
+  four 128-bit lanes at a time, as described in "Fast CRC Computation for
+  Generic Polynomials Using PCLMULQDQ Instruction" by Gopal et al. (Intel,
+  2009). len must be at least 64 and a multiple of 16. crc is pre-conditioned
+  and the result is returned without post-conditioning.
+ */
+__attribute__((target("pclmul,sse4.1")))
+local z_crc_t crc32_pclmul(crc, buf, len)
+    z_crc_t crc;
+    const unsigned char FAR *buf;
+    z_size_t len;
+{
+    /* Bit-reflected folding constants and Barrett reduction constants. */
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    /* Load the first 64 bytes and fold in the initial CRC. */
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buf += 64;
+    len -= 64;
+
+    /* Fold four lanes in parallel, 64 bytes at a time. */
+    x0 = k1k2;
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one. */
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Fold in any remaining 16-byte blocks. */
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits down to 64 bits. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits. */
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (z_crc_t)_mm_extract_epi32(x1, 1);
+}
+
+/* Return true if the processor has the PCLMULQDQ and SSE4.1 instructions. */
+local int crc32_simd_ok()
+{
+    static int avail = -1;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (avail == -1) {
+        avail = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+                (ecx & (1U << 1)) != 0 && (ecx & (1U << 19)) != 0;
+    }
+    return avail;
+}
+
+#endif /* PCLMULCRC32 */
+
+#ifdef ARMCRC32_RUNTIME
+
+#define Z_SIMD_MIN 16               /* fewest bytes worth the call */
+
+/*
+  Compute the CRC of len bytes at buf with the ARMv8 CRC32 instructions. crc
+  is pre-conditioned and the result is returned without post-conditioning.
+ */
+__attribute__((target("+crc")))
+local z_crc_t crc32_armv8(crc, buf, len)
+    z_crc_t crc;
+    const unsigned char FAR *buf;
+    z_size_t len;
+{
+    z_crc_t val;
+    z_word_t word;
+
+    while (len && ((z_size_t)buf & 7) != 0) {
+        len--;
+        val = *buf++;
+        __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"(val));
+    }
+    while (len >= 8) {
+        word = *(z_word_t const *)buf;
+        __asm__("crc32x %w0, %w0, %x1" : "+r"(crc) : "r"(word));
+        buf += 8;
+        len -= 8;
+    }
+    while (len) {
+        len--;
+        val = *buf++;
+        __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"(val));
+    }
+    return crc;
+}
+
+/* Return true if the processor has the CRC32 instructions. */
+local int crc32_simd_ok()
+{
+    static int avail = -1;
+
+    if (avail == -1)
+        avail = (getauxval(AT_HWCAP) & (1UL << 7)) != 0;    /* HWCAP_CRC32 */
+    return avail;
+}
+
+#endif /* ARMCRC32_RUNTIME */
+
 /* ========================================================================= */
 unsigned long ZEXPORT crc32_z(crc, buf, len)
     unsigned long crc;
@@ -760,6 +937,20 @@ unsigned long ZEXPORT crc32_z(crc, buf, len)
     /* Pre-condition the CRC */
     crc = (~crc) & 0xffffffff;
 
+#if defined(PCLMULCRC32)
+    /* Fold all full 16-byte blocks, leaving the rest to the code below. */
+    if (len >= Z_SIMD_MIN && crc32_simd_ok()) {
+        z_size_t chunk = len & ~(z_size_t)15;
+
+        crc = crc32_pclmul((z_crc_t)crc, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+#elif defined(ARMCRC32_RUNTIME)
+    if (len >= Z_SIMD_MIN && crc32_simd_ok())
+        return crc32_armv8((z_crc_t)crc, buf, len) ^ 0xffffffff;
+#endif
+
 #ifdef W
 
     /* If provided enough bytes, do a braided CRC calculation. */
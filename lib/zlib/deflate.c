@@ -106,6 +106,13 @@ local  void check_match OF((deflate_state *s, IPos start, IPos match,
 #endif
 /* Matches of length 3 are discarded if their distance exceeds TOO_FAR */
 
+#if !defined(UNALIGNED_OK) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__aarch64__)) && \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define LONGEST_MATCH_WORDS
+#endif
+/* Compare match candidates a 64-bit word at a time in longest_match() */
+
 /* Values for max_lazy_match, good_match and max_chain_length, depending on
  * the desired pack level (0..9). The values given below have been tuned to
  * exclude worst case performance for pathological files. Better values may be
@@ -1385,6 +1392,26 @@ local uInt longest_match(s, cur_match)
         scan += 2, match++;
         Assert(*scan == *match, "match[2]?");
 
+#ifdef LONGEST_MATCH_WORDS
+        /* Compare eight bytes at a time, the lowest differing byte of the
+         * first mismatched word ends the match. The 32 comparisons cover
+         * strstart + 3 through strstart + 258, no further than the byte
+         * by byte loop below.
+         */
+        scan++, match++;
+        do {
+            unsigned long long sv, mv;
+
+            __builtin_memcpy(&sv, scan, sizeof(sv));
+            __builtin_memcpy(&mv, match, sizeof(mv));
+            if (sv != mv) {
+                scan += __builtin_ctzll(sv ^ mv) >> 3;
+                break;
+            }
+            scan += 8, match += 8;
+        } while (scan < strend);
+        if (scan > strend) scan = strend;
+#else
         /* We check for insufficient lookahead only every 8th comparison;
          * the 256th check will be made at strstart + 258.
          */
@@ -1394,6 +1421,7 @@ local uInt longest_match(s, cur_match)
                  *++scan == *++match && *++scan == *++match &&
                  *++scan == *++match && *++scan == *++match &&
                  scan < strend);
+#endif /* LONGEST_MATCH_WORDS */
 
         Assert(scan <= s->window + (unsigned)(s->window_size - 1),
                "wild scan");
@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -33,6 +34,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #ifdef HAVE_STDBOOL_H
 # include <stdbool.h>
 #else
@@ -84,6 +86,18 @@ static int logsrvd_debug_instance = SUDO_DEBUG_INSTANCE_INITIALIZER;
 TAILQ_HEAD(connection_list, connection_closure);
 static struct connection_list connections = TAILQ_HEAD_INITIALIZER(connections);
 static struct listener_list listeners = TAILQ_HEAD_INITIALIZER(listeners);
+static unsigned int nconnections;	/* client connections, not journals */
+static unsigned int nread_paused;	/* connections waiting for buffer space */
+static size_t total_buffered;		/* bytes queued for writing */
+static unsigned long long nrate_limited;
+#if defined(HAVE_OPENSSL)
+static unsigned long long ntls_resumed;	/* abbreviated TLS handshakes */
+/* Connections waiting for a free host name lookup process. */
+static struct connection_list lookup_queue =
+    TAILQ_HEAD_INITIALIZER(lookup_queue);
+static unsigned int npeer_lookups;	/* running lookup processes */
+#endif
+static bool listeners_paused;
 static const char server_id[] = "Sudo Audit Server " PACKAGE_VERSION;
 static const char *conf_file = NULL;
 
@@ -93,7 +107,9 @@ static void server_msg_cb(int fd, int what, void *v);
 static void server_commit_cb(int fd, int what, void *v);
 #if defined(HAVE_OPENSSL)
 static void tls_handshake_cb(int fd, int what, void *v);
+static void start_queued_peer_lookups(void);
 #endif
+static void listeners_enable(struct sudo_event_base *evbase, bool enable);
 
 /*
  * Free a struct connection_closure container and its contents.
@@ -109,6 +125,17 @@ connection_closure_free(struct connection_closure *closure)
 	struct connection_buffer *buf;
 
 	TAILQ_REMOVE(&connections, closure, entries);
+	if (closure->sock != -1) {
+	    nconnections--;
+	    if (listeners_paused && (nconnections <
+		    logsrvd_conf_server_max_connections() ||
+		    logsrvd_conf_server_max_connections() == 0)) {
+		listeners_enable(evbase, true);
+	    }
+	}
+	if (closure->read_paused)
+	    nread_paused--;
+	total_buffered -= closure->buffered;
 
 	if (closure->state == CONNECTING && closure->journal != NULL) {
 	    /* Failed to relay journal file, retry later. */
@@ -125,6 +152,18 @@ connection_closure_free(struct connection_closure *closure)
 		SSL_shutdown(closure->ssl);
 	    SSL_free(closure->ssl);
 	}
+	if (closure->lookup_queued)
+	    TAILQ_REMOVE(&lookup_queue, closure, lookup_entries);
+	if (closure->lookup_fd != -1)
+	    close(closure->lookup_fd);
+	if (closure->lookup_pid > 0) {
+	    /* Client went away while its host names were being resolved. */
+	    kill(closure->lookup_pid, SIGKILL);
+	    while (waitpid(closure->lookup_pid, NULL, 0) == -1 &&
+		    errno == EINTR)
+		continue;
+	    npeer_lookups--;
+	}
 #endif
 	if (closure->sock != -1) {
 	    shutdown(closure->sock, SHUT_RDWR);
@@ -136,6 +175,8 @@ connection_closure_free(struct connection_closure *closure)
 	sudo_ev_free(closure->write_ev);
 #if defined(HAVE_OPENSSL)
 	sudo_ev_free(closure->ssl_accept_ev);
+	sudo_ev_free(closure->lookup_ev);
+	free(closure->lookup_buf.data);
 #endif
 	eventlog_free(closure->evlog);
 	free(closure->read_buf.data);
@@ -154,6 +195,8 @@ connection_closure_free(struct connection_closure *closure)
 	free(closure->journal_path);
 	if (closure->journal != NULL)
 	    fclose(closure->journal);
+	if (closure->journal_session != NULL)
+	    journal_session_release(closure->journal_session);
 	free(closure);
 
 	if (shutting_down && TAILQ_EMPTY(&connections))
@@ -177,6 +220,9 @@ connection_closure_alloc(int fd, bool tls, bool relay_only,
 	debug_return_ptr(NULL);
 
     closure->iolog_dir_fd = -1;
+#if defined(HAVE_OPENSSL)
+    closure->lookup_fd = -1;
+#endif
     closure->sock = relay_only ? -1 : fd;
     closure->evbase = base;
     TAILQ_INIT(&closure->write_bufs);
@@ -193,6 +239,8 @@ connection_closure_alloc(int fd, bool tls, bool relay_only,
     }
 
     TAILQ_INSERT_TAIL(&connections, closure, entries);
+    if (closure->sock != -1)
+	nconnections++;
 
     closure->read_buf.size = 64 * 1024;
     closure->read_buf.data = malloc(closure->read_buf.size);
@@ -265,6 +313,12 @@ connection_close(struct connection_closure *closure)
 	    closure->journal = NULL;
 	    new_closure->journal_path = closure->journal_path;
 	    closure->journal_path = NULL;
+	    new_closure->journal_session = closure->journal_session;
+	    closure->journal_session = NULL;
+
+	    /* A rejected session has no ExitMessage, mark it finished. */
+	    if (new_closure->journal_session != NULL)
+		journal_session_finish(new_closure->journal_session);
 
 	    /* Connect to the first relay available asynchronously. */
 	    if (!connect_relay(new_closure)) {
@@ -277,7 +331,12 @@ connection_close(struct connection_closure *closure)
 	/* Journal relayed successfully, remove backing file. */
 	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
 	    "removing journal file %s", closure->journal_path);
-	unlink(closure->journal_path);
+	if (closure->journal_session != NULL) {
+	    journal_session_done(closure->journal_session);
+	    closure->journal_session = NULL;
+	} else {
+	    unlink(closure->journal_path);
+	}
 
 	/* Process the next outgoing file (if any). */
 	logsrvd_queue_enable(0, closure->evbase);
@@ -296,6 +355,7 @@ get_free_buf(size_t len, struct connection_closure *closure)
     buf = TAILQ_FIRST(&closure->free_bufs);
     if (buf != NULL) {
         TAILQ_REMOVE(&closure->free_bufs, buf, entries);
+	closure->nfree_bufs--;
     } else {
         if ((buf = calloc(1, sizeof(*buf))) == NULL)
 	    goto oom;
@@ -324,6 +384,114 @@ oom:
     debug_return_ptr(NULL);
 }
 
+/*
+ * Resume reading from a connection paused by pause_reading().
+ */
+static void
+resume_reading(struct connection_closure *closure)
+{
+    debug_decl(resume_reading, SUDO_DEBUG_UTIL);
+
+    closure->read_paused = false;
+    nread_paused--;
+
+    /* The read event may have been removed by an error or exit. */
+    if (closure->error || closure->state != RUNNING)
+	debug_return;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"resuming reads from %s, %zu bytes buffered",
+	closure->journal_path ? closure->journal_path : closure->ipaddr,
+	closure->buffered);
+    if (sudo_ev_add(closure->evbase, closure->read_ev, NULL, false) == -1) {
+	sudo_warnx("%s", U_("unable to add event to queue"));
+	schedule_error_message(_("unable to allocate memory"), closure);
+    }
+
+    debug_return;
+}
+
+/*
+ * If the server is buffering more than max_buffered bytes, stop reading
+ * from a connection that is streaming I/O and has its own data queued.
+ * Connections that are still being set up are not paused so that
+ * accept and reject messages are processed promptly.
+ */
+static void
+pause_reading(struct connection_closure *closure)
+{
+    const size_t max_buffered = logsrvd_conf_server_max_buffered();
+    debug_decl(pause_reading, SUDO_DEBUG_UTIL);
+
+    if (max_buffered == 0 || total_buffered <= max_buffered)
+	debug_return;
+    if (closure->state != RUNNING || closure->buffered == 0 ||
+	    closure->read_paused || closure->write_instead_of_read)
+	debug_return;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"pausing reads from %s, %zu of %zu bytes buffered",
+	closure->journal_path ? closure->journal_path : closure->ipaddr,
+	closure->buffered, total_buffered);
+    sudo_ev_del(closure->evbase, closure->read_ev);
+    closure->read_paused = true;
+    nread_paused++;
+
+    debug_return;
+}
+
+/*
+ * Add a buffer to a write queue belonging to closure.
+ */
+void
+enqueue_write_buf(struct connection_buffer_list *queue,
+    struct connection_buffer *buf, struct connection_closure *closure)
+{
+    TAILQ_INSERT_TAIL(queue, buf, entries);
+    closure->buffered += buf->len;
+    total_buffered += buf->len;
+}
+
+/*
+ * Remove a buffer that has been written from its queue and
+ * return it to the closure's free list.  Resumes reading from
+ * paused connections once there is room in the buffer budget.
+ */
+void
+release_write_buf(struct connection_buffer_list *queue,
+    struct connection_buffer *buf, struct connection_closure *closure)
+{
+    struct connection_closure *paused, *next;
+    debug_decl(release_write_buf, SUDO_DEBUG_UTIL);
+
+    TAILQ_REMOVE(queue, buf, entries);
+    closure->buffered -= buf->len;
+    total_buffered -= buf->len;
+    buf->off = 0;
+    buf->len = 0;
+    if (closure->nfree_bufs < FREE_BUFS_MAX) {
+	TAILQ_INSERT_TAIL(&closure->free_bufs, buf, entries);
+	closure->nfree_bufs++;
+    } else {
+	free(buf->data);
+	free(buf);
+    }
+
+    if (nread_paused != 0) {
+	if (total_buffered < logsrvd_conf_server_max_buffered()) {
+	    TAILQ_FOREACH_SAFE(paused, &connections, entries, next) {
+		if (paused->read_paused)
+		    resume_reading(paused);
+	    }
+	} else if (closure->read_paused && closure->buffered == 0) {
+	    /* Let each paused connection make progress in turn. */
+	    resume_reading(closure);
+	}
+    }
+
+    debug_return;
+}
+
 static bool
 fmt_server_message(struct connection_closure *closure, ServerMessage *msg)
 {
@@ -354,7 +522,7 @@ fmt_server_message(struct connection_closure *closure, ServerMessage *msg)
     memcpy(buf->data, &msg_len, sizeof(msg_len));
     server_message__pack(msg, buf->data + sizeof(msg_len));
     buf->len = len;
-    TAILQ_INSERT_TAIL(&closure->write_bufs, buf, entries);
+    enqueue_write_buf(&closure->write_bufs, buf, closure);
 
     ret = true;
 
@@ -983,10 +1151,7 @@ server_msg_cb(int fd, int what, void *v)
 	/* sent entire message, move buf to free list */
 	sudo_debug_printf(SUDO_DEBUG_INFO,
 	    "%s: finished sending %zu bytes to client", __func__, buf->len);
-	buf->off = 0;
-	buf->len = 0;
-	TAILQ_REMOVE(&closure->write_bufs, buf, entries);
-	TAILQ_INSERT_TAIL(&closure->free_bufs, buf, entries);
+	release_write_buf(&closure->write_bufs, buf, closure);
 	if (TAILQ_EMPTY(&closure->write_bufs)) {
 	    /* Write queue empty, check state. */
 	    sudo_ev_del(closure->evbase, closure->write_ev);
@@ -1080,7 +1245,11 @@ client_msg_cb(int fd, int what, void *v)
         }
     } else
 #endif
-    {
+    if (closure->sock == -1 && closure->journal_session != NULL) {
+	/* Replaying a journal from the journal store. */
+	nread = (size_t)journal_session_read(closure->journal_session,
+	    buf->data + buf->len, buf->size - buf->len);
+    } else {
         nread = (size_t)read(fd, buf->data + buf->len, buf->size - buf->len);
     }
 
@@ -1120,6 +1289,7 @@ client_msg_cb(int fd, int what, void *v)
 		closure->errstr = _("unable to allocate memory");
 		goto send_error;
 	    }
+	    pause_reading(closure);
 	    debug_return;
 	}
 
@@ -1140,6 +1310,9 @@ client_msg_cb(int fd, int what, void *v)
     if (closure->state == FINISHED)
 	goto close_connection;
 
+    /* Stop reading if we cannot keep up with the client. */
+    pause_reading(closure);
+
     debug_return;
 
 send_error:
@@ -1248,6 +1421,9 @@ start_protocol(struct connection_closure *closure)
 }
 
 #if defined(HAVE_OPENSSL)
+/* Client connection whose TLS handshake is in progress, if any. */
+static struct connection_closure *accepting;
+
 static int
 verify_peer_identity(int preverify_ok, X509_STORE_CTX *ctx)
 {
@@ -1256,6 +1432,7 @@ verify_peer_identity(int preverify_ok, X509_STORE_CTX *ctx)
     SSL *ssl;
     X509 *current_cert;
     X509 *peer_cert;
+    int resolve = HOSTCHECK_RESOLVE;
     debug_decl(verify_peer_identity, SUDO_DEBUG_UTIL);
 
     /* if pre-verification of the cert failed, just propagate that result back */
@@ -1277,12 +1454,25 @@ verify_peer_identity(int preverify_ok, X509_STORE_CTX *ctx)
     ssl = X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
     closure = (struct connection_closure *)SSL_get_ex_data(ssl, 1);
 
-    result = validate_hostname(peer_cert, closure->ipaddr, closure->ipaddr, 1);
+    /*
+     * Don't block the event loop resolving host names in a client cert,
+     * they are resolved after the handshake if not already cached.
+     */
+    if (accepting != NULL && accepting->ssl == ssl)
+	resolve = HOSTCHECK_CACHED;
+
+    result = validate_hostname(peer_cert, closure->ipaddr, closure->ipaddr,
+	resolve);
 
     switch(result)
     {
         case MatchFound:
             debug_return_int(1);
+        case LookupPending:
+            sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+                "deferring hostname validation until names are resolved");
+            accepting->lookup_pending = true;
+            debug_return_int(1);
         default:
             sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
                 "hostname validation failed");
@@ -1316,6 +1506,311 @@ set_tls_verify_peer(void)
     debug_return;
 }
 
+/*
+ * The verify callback is not run when a TLS session is resumed.
+ * Check the client cert saved in the session against the client's
+ * address, as verify_peer_identity() would have done.
+ */
+static bool
+verify_resumed_peer(struct connection_closure *closure)
+{
+    HostnameValidationResult result;
+    X509 *peer_cert;
+    debug_decl(verify_resumed_peer, SUDO_DEBUG_UTIL);
+
+    peer_cert = SSL_get_peer_certificate(closure->ssl);
+    if (peer_cert == NULL) {
+	sudo_warnx("%s: missing peer certificate", closure->ipaddr);
+	debug_return_bool(false);
+    }
+    result = validate_hostname(peer_cert, closure->ipaddr, closure->ipaddr,
+	HOSTCHECK_CACHED);
+    X509_free(peer_cert);
+
+    switch (result) {
+    case MatchFound:
+	debug_return_bool(true);
+    case LookupPending:
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "deferring hostname validation until names are resolved");
+	closure->lookup_pending = true;
+	debug_return_bool(true);
+    default:
+	sudo_warnx("%s: hostname validation failed", closure->ipaddr);
+	debug_return_bool(false);
+    }
+}
+
+/*
+ * Start the actual protocol now that the TLS handshake is complete.
+ */
+static bool
+tls_handshake_done(struct connection_closure *closure)
+{
+    debug_decl(tls_handshake_done, SUDO_DEBUG_UTIL);
+
+    if (!TAILQ_EMPTY(logsrvd_conf_relay_address()) && !closure->store_first) {
+	if (!connect_relay(closure))
+	    debug_return_bool(false);
+    } else {
+	if (!start_protocol(closure))
+	    debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
+/*
+ * Finish validating the client cert once the resolver process
+ * has written its results and exited.
+ */
+static bool
+finish_peer_lookup(struct connection_closure *closure)
+{
+    HostnameValidationResult result = Error;
+    struct connection_buffer *buf = &closure->lookup_buf;
+    X509 *peer_cert;
+    debug_decl(finish_peer_lookup, SUDO_DEBUG_UTIL);
+
+    sudo_ev_free(closure->lookup_ev);
+    closure->lookup_ev = NULL;
+    close(closure->lookup_fd);
+    closure->lookup_fd = -1;
+    while (waitpid(closure->lookup_pid, NULL, 0) == -1 && errno == EINTR)
+	continue;
+    closure->lookup_pid = 0;
+    closure->lookup_pending = false;
+    npeer_lookups--;
+
+    if (!hostcheck_cache_load((char *)buf->data, buf->len)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "incomplete lookup results for %s", closure->ipaddr);
+    }
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+
+    /*
+     * Names the resolver could not look up are cached as failures
+     * so the client's next connection does not start a new lookup.
+     */
+    peer_cert = SSL_get_peer_certificate(closure->ssl);
+    if (peer_cert != NULL) {
+	result = validate_hostname(peer_cert, closure->ipaddr,
+	    closure->ipaddr, HOSTCHECK_CACHE_FAILED);
+	X509_free(peer_cert);
+    }
+    if (result != MatchFound) {
+	sudo_warnx("%s: hostname validation failed", closure->ipaddr);
+	debug_return_bool(false);
+    }
+
+    debug_return_bool(tls_handshake_done(closure));
+}
+
+/*
+ * Cache the names in the client cert that the resolver did not look
+ * up, for example because it timed out, as failed lookups.
+ */
+static void
+cache_failed_lookups(struct connection_closure *closure)
+{
+    X509 *peer_cert;
+    debug_decl(cache_failed_lookups, SUDO_DEBUG_UTIL);
+
+    peer_cert = SSL_get_peer_certificate(closure->ssl);
+    if (peer_cert != NULL) {
+	(void)validate_hostname(peer_cert, closure->ipaddr, closure->ipaddr,
+	    HOSTCHECK_CACHE_FAILED);
+	X509_free(peer_cert);
+    }
+
+    debug_return;
+}
+
+/*
+ * Read host name lookup results from the resolver process.
+ */
+static void
+peer_lookup_cb(int fd, int what, void *v)
+{
+    struct connection_closure *closure = v;
+    struct connection_buffer *buf = &closure->lookup_buf;
+    ssize_t nread;
+    debug_decl(peer_lookup_cb, SUDO_DEBUG_UTIL);
+
+    if (what == SUDO_EV_TIMEOUT) {
+	sudo_warnx("host name lookup for %s timed out", closure->ipaddr);
+	goto bad;
+    }
+
+    if (buf->len == buf->size) {
+	const size_t new_size = buf->size ? buf->size * 2 : 1024;
+	uint8_t *new_data;
+
+	if (new_size > 64 * 1024) {
+	    sudo_warnx("host name lookup for %s: too many results",
+		closure->ipaddr);
+	    goto bad;
+	}
+	if ((new_data = realloc(buf->data, new_size)) == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    goto bad;
+	}
+	buf->data = new_data;
+	buf->size = new_size;
+    }
+
+    nread = read(fd, buf->data + buf->len, buf->size - buf->len);
+    switch (nread) {
+    case -1:
+	if (errno == EAGAIN || errno == EINTR)
+	    debug_return;
+	sudo_warn("%s: read", closure->ipaddr);
+	goto bad;
+    case 0:
+	/* Resolver is done. */
+	if (!finish_peer_lookup(closure))
+	    goto bad;
+	start_queued_peer_lookups();
+	break;
+    default:
+	buf->len += (size_t)nread;
+	break;
+    }
+
+    debug_return;
+bad:
+    cache_failed_lookups(closure);
+    connection_close(closure);
+    start_queued_peer_lookups();
+    debug_return;
+}
+
+/*
+ * The client cert contains host names that are not in the lookup cache.
+ * Resolve them in a child process so that a slow DNS server does not
+ * stall the event loop, reading the results via a pipe.
+ * If PEER_LOOKUPS_MAX lookups are already running, the connection
+ * waits until one of them finishes.
+ */
+static bool
+start_peer_lookup(struct connection_closure *closure)
+{
+    X509 *peer_cert;
+    int flags, pfd[2];
+    debug_decl(start_peer_lookup, SUDO_DEBUG_UTIL);
+
+    if (npeer_lookups >= PEER_LOOKUPS_MAX) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "%u host name lookups running, queueing lookup for %s",
+	    npeer_lookups, closure->ipaddr);
+	TAILQ_INSERT_TAIL(&lookup_queue, closure, lookup_entries);
+	closure->lookup_queued = true;
+	debug_return_bool(true);
+    }
+
+    peer_cert = SSL_get_peer_certificate(closure->ssl);
+    if (peer_cert == NULL) {
+	sudo_warnx("%s: missing peer certificate", closure->ipaddr);
+	debug_return_bool(false);
+    }
+
+    if (pipe2(pfd, O_CLOEXEC) == -1) {
+	sudo_warn("pipe2");
+	X509_free(peer_cert);
+	debug_return_bool(false);
+    }
+
+    closure->lookup_pid = sudo_debug_fork();
+    switch (closure->lookup_pid) {
+    case -1:
+	sudo_warn("fork");
+	close(pfd[0]);
+	close(pfd[1]);
+	X509_free(peer_cert);
+	closure->lookup_pid = 0;
+	debug_return_bool(false);
+    case 0:
+	/* child */
+	close(pfd[0]);
+	(void)hostcheck_resolve(peer_cert, closure->ipaddr, closure->ipaddr,
+	    pfd[1]);
+	_exit(EXIT_SUCCESS);
+    }
+    npeer_lookups++;
+    close(pfd[1]);
+    X509_free(peer_cert);
+    closure->lookup_fd = pfd[0];
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"resolving host names for %s in process %d", closure->ipaddr,
+	(int)closure->lookup_pid);
+
+    flags = fcntl(closure->lookup_fd, F_GETFL, 0);
+    if (flags == -1 ||
+	    fcntl(closure->lookup_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+	sudo_warn("fcntl(O_NONBLOCK)");
+	debug_return_bool(false);
+    }
+
+    closure->lookup_ev = sudo_ev_alloc(closure->lookup_fd,
+	SUDO_EV_READ|SUDO_EV_PERSIST, peer_lookup_cb, closure);
+    if (closure->lookup_ev == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    if (sudo_ev_add(closure->evbase, closure->lookup_ev,
+	    logsrvd_conf_server_timeout(), false) == -1) {
+	sudo_warnx("%s", U_("unable to add event to queue"));
+	debug_return_bool(false);
+    }
+
+    debug_return_bool(true);
+}
+
+/*
+ * Start lookups for connections that were queued by start_peer_lookup().
+ * The names may have been cached by an earlier lookup in the meantime,
+ * for example when a client reconnects repeatedly.
+ */
+static void
+start_queued_peer_lookups(void)
+{
+    struct connection_closure *closure;
+    HostnameValidationResult result;
+    X509 *peer_cert;
+    debug_decl(start_queued_peer_lookups, SUDO_DEBUG_UTIL);
+
+    while (npeer_lookups < PEER_LOOKUPS_MAX &&
+	    (closure = TAILQ_FIRST(&lookup_queue)) != NULL) {
+	TAILQ_REMOVE(&lookup_queue, closure, lookup_entries);
+	closure->lookup_queued = false;
+
+	result = Error;
+	peer_cert = SSL_get_peer_certificate(closure->ssl);
+	if (peer_cert != NULL) {
+	    result = validate_hostname(peer_cert, closure->ipaddr,
+		closure->ipaddr, HOSTCHECK_CACHED);
+	    X509_free(peer_cert);
+	}
+	switch (result) {
+	case MatchFound:
+	    closure->lookup_pending = false;
+	    if (!tls_handshake_done(closure))
+		connection_close(closure);
+	    break;
+	case LookupPending:
+	    if (!start_peer_lookup(closure))
+		connection_close(closure);
+	    break;
+	default:
+	    sudo_warnx("%s: hostname validation failed", closure->ipaddr);
+	    connection_close(closure);
+	    break;
+	}
+    }
+
+    debug_return;
+}
+
 static void
 tls_handshake_cb(int fd, int what, void *v)
 {
@@ -1329,7 +1824,9 @@ tls_handshake_cb(int fd, int what, void *v)
         goto bad;
     }
 
+    accepting = closure;
     handshake_status = SSL_accept(closure->ssl);
+    accepting = NULL;
     err = SSL_get_error(closure->ssl, handshake_status);
     switch (err) {
         case SSL_ERROR_NONE:
@@ -1388,15 +1885,26 @@ tls_handshake_cb(int fd, int what, void *v)
         SSL_get_version(closure->ssl),
         SSL_get_cipher(closure->ssl));
 
-    /* Start the actual protocol now that the TLS handshake is complete. */
-    if (!TAILQ_EMPTY(logsrvd_conf_relay_address()) && !closure->store_first) {
-	if (!connect_relay(closure))
-	    goto bad;
-    } else {
-	if (!start_protocol(closure))
+    if (SSL_session_reused(closure->ssl)) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "resumed TLS session with %s", closure->ipaddr);
+	ntls_resumed++;
+	if (logsrvd_conf_server_tls_check_peer()) {
+	    if (!verify_resumed_peer(closure))
+		goto bad;
+	}
+    }
+
+    if (closure->lookup_pending) {
+	/* Resolve host names in the client cert before going further. */
+	if (!start_peer_lookup(closure))
 	    goto bad;
+	debug_return;
     }
 
+    if (!tls_handshake_done(closure))
+	goto bad;
+
     debug_return;
 bad:
     connection_close(closure);
@@ -1538,19 +2046,185 @@ bad:
     debug_return_int(-1);
 }
 
+/*
+ * Enable or disable all listeners, used to stop accepting new
+ * connections while max_connections are active.
+ */
+static void
+listeners_enable(struct sudo_event_base *evbase, bool enable)
+{
+    struct listener *l;
+    debug_decl(listeners_enable, SUDO_DEBUG_UTIL);
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"%s new connections, %u active", enable ? "resuming" : "pausing",
+	nconnections);
+    TAILQ_FOREACH(l, &listeners, entries) {
+	if (enable) {
+	    if (sudo_ev_add(evbase, l->ev, NULL, false) == -1)
+		sudo_fatal("%s", U_("unable to add event to queue"));
+	} else {
+	    sudo_ev_del(evbase, l->ev);
+	}
+    }
+    listeners_paused = !enable;
+
+    debug_return;
+}
+
+/*
+ * Per-address connection rate limiting using a token bucket for
+ * each source.  Sources are stored in a fixed-size table indexed
+ * by a keyed hash of the address; a collision simply replaces the
+ * older entry.
+ */
+#define ADMIT_SOURCES_MAX	1024
+
+static struct admit_source {
+    struct timespec last;
+    unsigned long long tokens;	/* in thousandths of a connection */
+    unsigned char addr[16];
+    int family;
+} admit_sources[ADMIT_SOURCES_MAX];
+static unsigned int admit_seed;
+
+static bool
+admit_source(const union sockaddr_union *sa_un)
+{
+    const unsigned long long rate = logsrvd_conf_server_max_connection_rate();
+    const unsigned long long burst = rate * 1000;
+    struct admit_source *src;
+    struct timespec now, diff;
+    unsigned char addr[16];
+    unsigned int i, hash;
+    size_t addrlen;
+    debug_decl(admit_source, SUDO_DEBUG_UTIL);
+
+    if (rate == 0)
+	debug_return_bool(true);
+
+    memset(addr, 0, sizeof(addr));
+    switch (sa_un->sa.sa_family) {
+    case AF_INET:
+	addrlen = sizeof(sa_un->sin.sin_addr);
+	memcpy(addr, &sa_un->sin.sin_addr, addrlen);
+	break;
+#ifdef HAVE_STRUCT_IN6_ADDR
+    case AF_INET6:
+	addrlen = sizeof(sa_un->sin6.sin6_addr);
+	memcpy(addr, &sa_un->sin6.sin6_addr, addrlen);
+	break;
+#endif
+    default:
+	debug_return_bool(true);
+    }
+
+    /* FNV-1a hash of the address, keyed so collisions are unpredictable. */
+    if (admit_seed == 0)
+	admit_seed = arc4random() | 1;
+    hash = 2166136261U ^ admit_seed;
+    for (i = 0; i < addrlen; i++) {
+	hash ^= addr[i];
+	hash *= 16777619U;
+    }
+    src = &admit_sources[hash % ADMIT_SOURCES_MAX];
+
+    if (sudo_gettime_mono(&now) == -1)
+	debug_return_bool(true);
+    if (src->family != sa_un->sa.sa_family ||
+	    memcmp(src->addr, addr, sizeof(addr)) != 0) {
+	/* New source, start with a full bucket. */
+	src->family = sa_un->sa.sa_family;
+	memcpy(src->addr, addr, sizeof(addr));
+	src->tokens = burst;
+    } else {
+	/* Refill at rate connections per second, up to one second's worth. */
+	sudo_timespecsub(&now, &src->last, &diff);
+	if (diff.tv_sec < 0 || diff.tv_sec >= 1) {
+	    src->tokens = burst;
+	} else {
+	    src->tokens += rate * (unsigned long long)diff.tv_nsec / 1000000;
+	    if (src->tokens > burst)
+		src->tokens = burst;
+	}
+    }
+    src->last = now;
+
+    if (src->tokens < 1000)
+	debug_return_bool(false);
+    src->tokens -= 1000;
+    debug_return_bool(true);
+}
+
+/*
+ * Maximum number of connections to accept per listener wakeup.
+ * This keeps a flood of new connections from starving existing clients.
+ */
+#define ACCEPT_BATCH_MAX	64
+
+/*
+ * Accept a new connection on the listening socket fd.
+ * The new socket is non-blocking and close-on-exec.
+ * Returns the socket on success or -1 on error.
+ */
+static int
+accept_connection(int fd, union sockaddr_union *sa_un)
+{
+    socklen_t salen = sizeof(*sa_un);
+    int sock;
+    debug_decl(accept_connection, SUDO_DEBUG_UTIL);
+
+    memset(sa_un, 0, sizeof(*sa_un));
+#ifdef HAVE_ACCEPT4
+    sock = accept4(fd, &sa_un->sa, &salen, SOCK_NONBLOCK|SOCK_CLOEXEC);
+#else
+    sock = accept(fd, &sa_un->sa, &salen);
+    if (sock != -1) {
+	int flags = fcntl(sock, F_GETFL, 0);
+	if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1 ||
+		fcntl(sock, F_SETFD, FD_CLOEXEC) == -1) {
+	    sudo_warn("fcntl(O_NONBLOCK)");
+	    close(sock);
+	    sock = -1;
+	    errno = EINTR;	/* not fatal, just try the next one */
+	}
+    }
+#endif
+    debug_return_int(sock);
+}
+
 static void
 listener_cb(int fd, int what, void *v)
 {
     struct listener *l = v;
     struct sudo_event_base *evbase = sudo_ev_get_base(l->ev);
     union sockaddr_union sa_un;
-    socklen_t salen = sizeof(sa_un);
+    unsigned int naccepted;
     int sock;
     debug_decl(listener_cb, SUDO_DEBUG_UTIL);
 
-    memset(&sa_un, 0, sizeof(sa_un));
-    sock = accept(fd, &sa_un.sa, &salen);
-    if (sock != -1) {
+    /*
+     * Drain the listen queue in batches, the listening socket is
+     * non-blocking so we stop when there are no more connections.
+     */
+    for (naccepted = 0; naccepted < ACCEPT_BATCH_MAX; naccepted++) {
+	sock = accept_connection(fd, &sa_un);
+	if (sock == -1) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+		/* TODO: pause accepting on ENFILE and EMFILE */
+		sudo_warn("accept");
+	    }
+	    break;
+	}
+	if (!admit_source(&sa_un)) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+		"connection rate exceeded, dropping new connection");
+	    nrate_limited++;
+	    close(sock);
+	    continue;
+	}
 	if (logsrvd_conf_server_tcp_keepalive()) {
 	    int keepalive = 1;
 	    if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive,
@@ -1563,11 +2237,12 @@ listener_cb(int fd, int what, void *v)
 	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 		"unable to start new connection");
 	}
-    } else {
-	if (errno == EAGAIN || errno == EINTR)
-	    debug_return;
-	/* TODO: pause accepting on ENFILE and EMFILE */
-	sudo_warn("accept");
+	if (logsrvd_conf_server_max_connections() != 0 &&
+		nconnections >= logsrvd_conf_server_max_connections()) {
+	    /* Leave new connections in the listen queue for now. */
+	    listeners_enable(evbase, false);
+	    break;
+	}
     }
 
     debug_return;
@@ -1623,6 +2298,12 @@ server_setup(struct sudo_event_base *base)
     }
     ret = nlisteners > 0;
 
+    /* The connection limit may have changed. */
+    listeners_paused = false;
+    if (logsrvd_conf_server_max_connections() != 0 &&
+	    nconnections >= logsrvd_conf_server_max_connections())
+	listeners_enable(base, false);
+
 #if defined(HAVE_OPENSSL)
     if (ret)
 	set_tls_verify_peer();
@@ -1640,6 +2321,10 @@ server_reload(struct sudo_event_base *evbase)
     debug_decl(server_reload, SUDO_DEBUG_UTIL);
 
     sudo_debug_printf(SUDO_DEBUG_INFO, "reloading server config");
+#if defined(HAVE_OPENSSL)
+    /* Host names in client certs may resolve differently now. */
+    hostcheck_cache_flush();
+#endif
     if (logsrvd_conf_read(conf_file)) {
 	/* Re-initialize listeners. */
 	if (!server_setup(evbase))
@@ -1739,6 +2424,21 @@ server_dump_stats(void)
 	}
 	sudo_debug_printf(SUDO_DEBUG_INFO, "%d client connection(s)\n", n);
     }
+    sudo_debug_printf(SUDO_DEBUG_INFO, "admission control:");
+    sudo_debug_printf(SUDO_DEBUG_INFO, "  active clients: %u%s", nconnections,
+	listeners_paused ? " (not accepting)" : "");
+    sudo_debug_printf(SUDO_DEBUG_INFO, "  buffered bytes: %zu", total_buffered);
+    sudo_debug_printf(SUDO_DEBUG_INFO, "  paused readers: %u", nread_paused);
+    sudo_debug_printf(SUDO_DEBUG_INFO, "  rate limited: %llu", nrate_limited);
+#if defined(HAVE_OPENSSL)
+    sudo_debug_printf(SUDO_DEBUG_INFO, "  resumed TLS sessions: %llu",
+	ntls_resumed);
+    n = 0;
+    TAILQ_FOREACH(closure, &lookup_queue, lookup_entries)
+	n++;
+    sudo_debug_printf(SUDO_DEBUG_INFO,
+	"  host name lookups: %u running, %d queued", npeer_lookups, n);
+#endif
     logsrvd_queue_dump();
 
     debug_return;
@@ -1788,7 +2488,8 @@ register_signal(int signo, struct sudo_event_base *base)
 static void
 logsrvd_cleanup(void)
 {
-    /* TODO: cleanup like on signal */
+    /* Write out buffered journal records. */
+    journal_store_close();
     return;
 }
 
@@ -2019,6 +2720,7 @@ main(int argc, char *argv[])
     sudo_ev_dispatch(evbase);
     if (!nofork && logsrvd_conf_pid_file() != NULL)
 	unlink(logsrvd_conf_pid_file());
+    journal_store_close();
     logsrvd_conf_cleanup();
 
     debug_return_int(0);
@@ -46,9 +46,18 @@
 /* Shutdown timeout (in seconds) in case client connections time out. */
 #define SHUTDOWN_TIMEO	10
 
+/* Maximum number of unused buffers to keep on a connection's free list. */
+#define FREE_BUFS_MAX	8
+
+/* Maximum number of client cert host name lookup processes at once. */
+#define PEER_LOOKUPS_MAX	8
+
 /* Template for mkstemp(3) when creating temporary files. */
 #define RELAY_TEMPLATE	"relay.XXXXXXXX"
 
+/* Size of a segment file in the journal store (relay_dir/segments). */
+#define JOURNAL_SEGMENT_SIZE	(64 * 1024 * 1024)
+
 /*
  * Connection status.
  * In the RUNNING state we expect I/O log buffers.
@@ -62,21 +71,35 @@ enum connection_status {
     FINISHED
 };
 
+/*
+ * A connection attempt to a single relay address.
+ */
+struct relay_attempt {
+    struct connection_closure *closure;
+    struct server_address *relay;
+    struct sudo_event *connect_ev;
+    int sock;
+};
+
 /*
  * Per-connection relay state.
  */
 struct relay_closure {
     struct server_address_list *relays;
     struct server_address *relay_addr;
+    struct relay_attempt *attempts;
+    struct sudo_event *attempt_ev;
     struct sudo_event *read_ev;
     struct sudo_event *write_ev;
-    struct sudo_event *connect_ev;
     struct connection_buffer read_buf;
     struct connection_buffer_list write_bufs;
     struct peer_info relay_name;
 #if defined(HAVE_OPENSSL)
     struct tls_client_closure tls_client;
 #endif
+    size_t nattempts;
+    size_t next_attempt;
+    size_t pending;
     int sock;
     bool read_instead_of_write;
     bool write_instead_of_read;
@@ -95,17 +118,27 @@ struct connection_closure {
     struct connection_buffer read_buf;
     struct connection_buffer_list write_bufs;
     struct connection_buffer_list free_bufs;
+    size_t buffered;
+    unsigned int nfree_bufs;
     struct sudo_event_base *evbase;
     struct sudo_event *commit_ev;
     struct sudo_event *read_ev;
     struct sudo_event *write_ev;
 #if defined(HAVE_OPENSSL)
+    TAILQ_ENTRY(connection_closure) lookup_entries;
     struct sudo_event *ssl_accept_ev;
+    struct sudo_event *lookup_ev;
+    struct connection_buffer lookup_buf;
     SSL *ssl;
+    pid_t lookup_pid;
+    int lookup_fd;
+    bool lookup_pending;
+    bool lookup_queued;
 #endif
     const char *errstr;
     FILE *journal;
     char *journal_path;
+    struct journal_session *journal_session;
     struct iolog_file iolog_files[IOFD_MAX];
     int iolog_dir_fd;
     int sock;
@@ -117,6 +150,7 @@ struct connection_closure {
     bool read_instead_of_write;
     bool write_instead_of_read;
     bool temporary_write_event;
+    bool read_paused;
 #ifdef HAVE_STRUCT_IN6_ADDR
     char ipaddr[INET6_ADDRSTRLEN];
 #else
@@ -161,6 +195,10 @@ struct server_address {
     char *sa_str;
     union sockaddr_union sa_un;
     socklen_t sa_size;
+    struct timespec last_failure;
+#if defined(HAVE_OPENSSL)
+    SSL_SESSION *tls_session;	/* relay only, for session resumption */
+#endif
     bool tls;
 };
 TAILQ_HEAD(server_address_list, server_address);
@@ -182,6 +220,7 @@ TAILQ_HEAD(listener_list, listener);
 struct outgoing_journal {
     TAILQ_ENTRY(outgoing_journal) entries;
     char *journal_path;
+    struct journal_session *session;
 };
 TAILQ_HEAD(outgoing_journal_queue, outgoing_journal);
 
@@ -202,6 +241,8 @@ bool schedule_commit_point(TimeSpec *commit_point, struct connection_closure *cl
 bool fmt_log_id_message(const char *id, struct connection_closure *closure);
 bool schedule_error_message(const char *errstr, struct connection_closure *closure);
 struct connection_buffer *get_free_buf(size_t, struct connection_closure *closure);
+void enqueue_write_buf(struct connection_buffer_list *queue, struct connection_buffer *buf, struct connection_closure *closure);
+void release_write_buf(struct connection_buffer_list *queue, struct connection_buffer *buf, struct connection_closure *closure);
 struct connection_closure *connection_closure_alloc(int fd, bool tls, bool relay_only, struct sudo_event_base *base);
 
 /* logsrvd_conf.c */
@@ -218,6 +259,9 @@ bool logsrvd_conf_relay_tcp_keepalive(void);
 bool logsrvd_conf_server_tcp_keepalive(void);
 const char *logsrvd_conf_pid_file(void);
 struct timespec *logsrvd_conf_server_timeout(void);
+unsigned int logsrvd_conf_server_max_connections(void);
+unsigned int logsrvd_conf_server_max_connection_rate(void);
+size_t logsrvd_conf_server_max_buffered(void);
 struct timespec *logsrvd_conf_relay_connect_timeout(void);
 struct timespec *logsrvd_conf_relay_timeout(void);
 time_t logsrvd_conf_relay_retry_interval(void);
@@ -238,6 +282,7 @@ void logsrvd_warn_stderr(bool enabled);
 
 /* logsrvd_journal.c */
 extern struct client_message_switch cms_journal;
+bool journal_store_init(void);
 
 /* logsrvd_local.c */
 extern struct client_message_switch cms_local;
@@ -257,6 +302,27 @@ bool logsrvd_queue_insert(struct connection_closure *closure);
 bool logsrvd_queue_scan(struct sudo_event_base *evbase);
 void logsrvd_queue_dump(void);
 
+/* logsrvd_segment.c */
+struct journal_session;
+bool journal_store_open(const char *dir, off_t segment_size);
+void journal_store_close(void);
+struct journal_session *journal_store_next_ready(struct journal_session *prev);
+unsigned int journal_store_nsegments(void);
+struct journal_session *journal_session_create(void);
+struct journal_session *journal_session_lookup(const char *name);
+bool journal_session_attach(struct journal_session *js);
+void journal_session_release(struct journal_session *js);
+const char *journal_session_name(struct journal_session *js);
+bool journal_session_finished(struct journal_session *js);
+int journal_session_fd(struct journal_session *js);
+bool journal_session_write(struct journal_session *js, const uint8_t *buf, size_t len, const struct timespec *elapsed);
+bool journal_session_finish(struct journal_session *js);
+bool journal_session_truncate(struct journal_session *js);
+bool journal_session_done(struct journal_session *js);
+ssize_t journal_session_read(struct journal_session *js, void *buf, size_t len);
+bool journal_session_seek(struct journal_session *js, const struct timespec *target, struct timespec *elapsed);
+void journal_session_rewind(struct journal_session *js);
+
 /* logsrvd_relay.c */
 extern struct client_message_switch cms_relay;
 void relay_closure_free(struct relay_closure *relay_closure);
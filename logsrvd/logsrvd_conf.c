@@ -113,6 +113,9 @@ static struct logsrvd_config {
         struct address_list_container addresses;
         struct timespec timeout;
         bool tcp_keepalive;
+	unsigned int max_connections;
+	unsigned int max_connection_rate;
+	size_t max_buffered;
 	enum server_log_type log_type;
 	FILE *log_stream;
 	char *log_file;
@@ -153,6 +156,7 @@ static struct logsrvd_config {
 	bool compress;
 	bool flush;
 	bool gid_set;
+	struct iolog_compress_params compress_params;
 	bool log_passwords;
 	uid_t uid;
 	gid_t gid;
@@ -263,6 +267,24 @@ logsrvd_conf_server_timeout(void)
     return NULL;
 }
 
+unsigned int
+logsrvd_conf_server_max_connections(void)
+{
+    return logsrvd_config->server.max_connections;
+}
+
+unsigned int
+logsrvd_conf_server_max_connection_rate(void)
+{
+    return logsrvd_config->server.max_connection_rate;
+}
+
+size_t
+logsrvd_conf_server_max_buffered(void)
+{
+    return logsrvd_config->server.max_buffered;
+}
+
 #if defined(HAVE_OPENSSL)
 SSL_CTX *
 logsrvd_server_tls_ctx(void)
@@ -386,6 +408,16 @@ cb_iolog_compress(struct logsrvd_config *config, const char *str, size_t offset)
     debug_return_bool(true);
 }
 
+static bool
+cb_iolog_compress_streams(struct logsrvd_config *config, const char *str, size_t offset)
+{
+    debug_decl(cb_iolog_compress_streams, SUDO_DEBUG_UTIL);
+
+    if (!iolog_parse_compress_params(str, &config->iolog.compress_params))
+	debug_return_bool(false);
+    debug_return_bool(true);
+}
+
 static bool
 cb_iolog_log_passwords(struct logsrvd_config *config, const char *str, size_t offset)
 {
@@ -552,7 +584,7 @@ append_address(struct server_address_list *addresses, const char *str,
     for (res = res0; res != NULL; res = res->ai_next) {
 	struct server_address *addr;
 
-	if ((addr = malloc(sizeof(*addr))) == NULL) {
+	if ((addr = calloc(1, sizeof(*addr))) == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    goto done;
 	}
@@ -610,6 +642,51 @@ cb_server_keepalive(struct logsrvd_config *config, const char *str, size_t offse
     debug_return_bool(true);
 }
 
+static bool
+cb_server_max_connections(struct logsrvd_config *config, const char *str, size_t offset)
+{
+    unsigned int val;
+    const char *errstr;
+    debug_decl(cb_server_max_connections, SUDO_DEBUG_UTIL);
+
+    val = (unsigned int)sudo_strtonum(str, 0, UINT_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+
+    config->server.max_connections = val;
+    debug_return_bool(true);
+}
+
+static bool
+cb_server_max_connection_rate(struct logsrvd_config *config, const char *str, size_t offset)
+{
+    unsigned int val;
+    const char *errstr;
+    debug_decl(cb_server_max_connection_rate, SUDO_DEBUG_UTIL);
+
+    val = (unsigned int)sudo_strtonum(str, 0, INT_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+
+    config->server.max_connection_rate = val;
+    debug_return_bool(true);
+}
+
+static bool
+cb_server_max_buffered(struct logsrvd_config *config, const char *str, size_t offset)
+{
+    size_t val;
+    const char *errstr;
+    debug_decl(cb_server_max_buffered, SUDO_DEBUG_UTIL);
+
+    val = (size_t)sudo_strtonum(str, 0, SSIZE_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+
+    config->server.max_buffered = val;
+    debug_return_bool(true);
+}
+
 static bool
 cb_server_pid_file(struct logsrvd_config *config, const char *str, size_t offset)
 {
@@ -1077,6 +1154,10 @@ address_list_delref(struct server_address_list *al)
 	struct server_address *addr;
 	while ((addr = TAILQ_FIRST(al))) {
 	    TAILQ_REMOVE(al, addr, entries);
+#if defined(HAVE_OPENSSL)
+	    if (addr->tls_session != NULL)
+		SSL_SESSION_free(addr->tls_session);
+#endif
 	    sudo_rcstr_delref(addr->sa_str);
 	    sudo_rcstr_delref(addr->sa_host);
 	    free(addr);
@@ -1088,6 +1169,9 @@ static struct logsrvd_config_entry server_conf_entries[] = {
     { "listen_address", cb_server_listen_address },
     { "timeout", cb_server_timeout },
     { "tcp_keepalive", cb_server_keepalive },
+    { "max_connections", cb_server_max_connections },
+    { "max_connection_rate", cb_server_max_connection_rate },
+    { "max_buffered", cb_server_max_buffered },
     { "pid_file", cb_server_pid_file },
     { "server_log", cb_server_log },
 #if defined(HAVE_OPENSSL)
@@ -1129,6 +1213,7 @@ static struct logsrvd_config_entry iolog_conf_entries[] = {
     { "iolog_file", cb_iolog_file },
     { "iolog_flush", cb_iolog_flush },
     { "iolog_compress", cb_iolog_compress },
+    { "iolog_compress_streams", cb_iolog_compress_streams },
     { "iolog_user", cb_iolog_user },
     { "iolog_group", cb_iolog_group },
     { "iolog_mode", cb_iolog_mode },
@@ -1342,6 +1427,7 @@ logsrvd_conf_iolog_setconf(struct logsrvd_config *config)
 
     iolog_set_defaults();
     iolog_set_compress(config->iolog.compress);
+    iolog_set_compress_params(&config->iolog.compress_params);
     iolog_set_flush(config->iolog.flush);
     iolog_set_owner(config->iolog.uid, config->iolog.gid);
     iolog_set_mode(config->iolog.mode);
@@ -1652,6 +1738,7 @@ logsrvd_conf_alloc(void)
 
     /* I/O log defaults */
     config->iolog.compress = false;
+    (void)iolog_parse_compress_params("", &config->iolog.compress_params);
     config->iolog.flush = true;
     config->iolog.mode = S_IRUSR|S_IWUSR;
     config->iolog.maxseq = SESSID_MAX;
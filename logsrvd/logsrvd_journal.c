@@ -135,35 +135,54 @@ done:
 }
 
 /*
- * Create a temporary file in the relay dir and store it in the closure.
+ * Open the journal store in the segments subdirectory of the relay dir.
+ * The relay dir is only read the first time; it is not changed by
+ * a configuration reload.
+ */
+bool
+journal_store_init(void)
+{
+    char path[PATH_MAX];
+    int len;
+    debug_decl(journal_store_init, SUDO_DEBUG_UTIL);
+
+    len = snprintf(path, sizeof(path), "%s/segments",
+	logsrvd_conf_relay_dir());
+    if (len < 0 || (size_t)len >= sizeof(path)) {
+	errno = ENAMETOOLONG;
+	sudo_warn("%s/segments", logsrvd_conf_relay_dir());
+	debug_return_bool(false);
+    }
+
+    debug_return_bool(journal_store_open(path, JOURNAL_SEGMENT_SIZE));
+}
+
+/*
+ * Create a new session in the journal store and store it in the closure.
+ * The journal file in the closure is only used to drive the event loop.
  */
 static bool
 journal_create(struct connection_closure *closure)
 {
-    char journal_path[PATH_MAX];
+    struct journal_session *js;
     int fd;
     debug_decl(journal_create, SUDO_DEBUG_UTIL);
 
-    fd = journal_mkstemp("incoming", journal_path, sizeof(journal_path));
-    if (fd == -1) {
+    if (!journal_store_init() || (js = journal_session_create()) == NULL) {
 	closure->errstr = _("unable to create journal file");
 	debug_return_bool(false);
     }
-    if (!sudo_lock_file(fd, SUDO_TLOCK)) {
-	sudo_warn(U_("unable to lock %s"), journal_path);
-	unlink(journal_path);
-	close(fd);
-	closure->errstr = _("unable to lock journal file");
-	debug_return_bool(false);
-    }
-    if (!journal_fdopen(fd, journal_path, closure)) {
+    fd = journal_session_fd(js);
+    if (fd == -1 || !journal_fdopen(fd, journal_session_name(js), closure)) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
-	    "unable to fdopen journal file %s", journal_path);
-	unlink(journal_path);
-	close(fd);
+	    "unable to fdopen journal file %s", journal_session_name(js));
+	if (fd != -1)
+	    close(fd);
+	journal_session_done(js);
 	closure->errstr = _("unable to open journal file");
 	debug_return_bool(false);
     }
+    closure->journal_session = js;
 
     debug_return_bool(true);
 }
@@ -171,6 +190,7 @@ journal_create(struct connection_closure *closure)
 /*
  * Flush any buffered data, rewind journal to the beginning and
  * move to the outgoing directory.
+ * For the journal store, just mark the session ready to relay.
  * The actual open file is closed in connection_closure_free().
  */
 static bool
@@ -181,6 +201,14 @@ journal_finish(struct connection_closure *closure)
     int fd;
     debug_decl(journal_finish, SUDO_DEBUG_UTIL);
 
+    if (closure->journal_session != NULL) {
+	if (!journal_session_finish(closure->journal_session)) {
+	    closure->errstr = _("unable to write journal file");
+	    debug_return_bool(false);
+	}
+	debug_return_bool(true);
+    }
+
     if (fflush(closure->journal) != 0) {
 	closure->errstr = _("unable to write journal file");
 	debug_return_bool(false);
@@ -222,185 +250,424 @@ journal_finish(struct connection_closure *closure)
     debug_return_bool(true);
 }
 
+/* Initial size of the buffer used to seek in a journal file. */
+#define JOURNAL_SEEK_BUFSIZE	(64 * 1024)
+
+/*
+ * Buffered reader used to seek in a journal file.  Messages are
+ * read into a single buffer that grows to fit the largest one.
+ */
+struct journal_reader {
+    uint8_t *buf;
+    size_t bufsize;
+    size_t len;		/* number of valid bytes in buf */
+    off_t start;	/* file offset of buf[0] */
+    int fd;
+};
+
+/*
+ * Make sure the len bytes at file offset pos are in the reader's buffer.
+ * Returns a pointer to them or NULL on error or EOF (errno is set to 0).
+ */
+static const uint8_t *
+journal_reader_fill(struct journal_reader *rdr, off_t pos, size_t len)
+{
+    debug_decl(journal_reader_fill, SUDO_DEBUG_UTIL);
+
+    if (pos >= rdr->start && pos + (off_t)len <= rdr->start + (off_t)rdr->len)
+	debug_return_const_ptr(rdr->buf + (pos - rdr->start));
+
+    if (len > rdr->bufsize) {
+	const size_t newsize = sudo_pow2_roundup(len);
+	uint8_t *newbuf;
+
+	if (newsize < len || (newbuf = malloc(newsize)) == NULL) {
+	    errno = ENOMEM;
+	    debug_return_const_ptr(NULL);
+	}
+	free(rdr->buf);
+	rdr->buf = newbuf;
+	rdr->bufsize = newsize;
+    }
+
+    rdr->start = pos;
+    rdr->len = 0;
+    while (rdr->len < rdr->bufsize) {
+	const ssize_t nread = pread(rdr->fd, rdr->buf + rdr->len,
+	    rdr->bufsize - rdr->len, pos + (off_t)rdr->len);
+	if (nread == -1) {
+	    if (errno == EINTR)
+		continue;
+	    debug_return_const_ptr(NULL);
+	}
+	if (nread == 0)
+	    break;
+	rdr->len += (size_t)nread;
+    }
+    if (rdr->len < len) {
+	errno = 0;
+	debug_return_const_ptr(NULL);
+    }
+    debug_return_const_ptr(rdr->buf);
+}
+
 /*
- * Seek ahead in the journal to the specified target time.
- * Returns true if we reached the target time exactly, else false.
+ * Parse a protocol buffers varint, advancing *cpp past it.
  */
 static bool
-journal_seek(struct timespec *target, struct connection_closure *closure)
+wire_varint(const uint8_t **cpp, const uint8_t *end, uint64_t *valp)
+{
+    const uint8_t *cp = *cpp;
+    uint64_t val = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift < 64 && cp < end; shift += 7) {
+	const uint8_t ch = *cp++;
+
+	val |= (uint64_t)(ch & 0x7f) << shift;
+	if ((ch & 0x80) == 0) {
+	    *cpp = cp;
+	    *valp = val;
+	    return true;
+	}
+    }
+    return false;
+}
+
+/*
+ * Parse the value of a protocol buffers field with the specified
+ * wire type, advancing *cpp past it.  Length-delimited values are
+ * returned via datap and lenp, varints via valp.
+ */
+static bool
+wire_value(const uint8_t **cpp, const uint8_t *end, unsigned int wire_type,
+    uint64_t *valp, const uint8_t **datap, size_t *lenp)
+{
+    uint64_t val = 0;
+
+    switch (wire_type) {
+    case 0:	/* varint */
+	if (!wire_varint(cpp, end, &val))
+	    return false;
+	break;
+    case 1:	/* 64-bit */
+	if (end - *cpp < 8)
+	    return false;
+	*cpp += 8;
+	break;
+    case 2:	/* length-delimited */
+	if (!wire_varint(cpp, end, &val) || val > (uint64_t)(end - *cpp))
+	    return false;
+	*datap = *cpp;
+	*lenp = (size_t)val;
+	*cpp += val;
+	break;
+    case 5:	/* 32-bit */
+	if (end - *cpp < 4)
+	    return false;
+	*cpp += 4;
+	break;
+    default:
+	/* Groups are not used by the protocol. */
+	return false;
+    }
+    *valp = val;
+    return true;
+}
+
+/*
+ * Find the type and delay of a packed ClientMessage by walking the wire
+ * format, without unpacking it.  The I/O buffer contents are skipped over.
+ * Returns false if the message cannot be parsed this way, in which
+ * case the caller should fall back to client_message__unpack().
+ */
+static bool
+journal_scan_message(const uint8_t *buf, size_t len,
+    ClientMessage__TypeCase *typep, TimeSpec *delay)
+{
+    const uint8_t *cp = buf, *end = buf + len, *data = NULL;
+    ClientMessage__TypeCase type = CLIENT_MESSAGE__TYPE__NOT_SET;
+    size_t data_len = 0;
+    bool have_delay = false;
+    uint64_t tag, val;
+
+    /* Find the oneof member, skipping unknown fields. */
+    while (cp < end) {
+	const uint8_t *field_data = NULL;
+	size_t field_len = 0;
+
+	if (!wire_varint(&cp, end, &tag) ||
+		!wire_value(&cp, end, tag & 7, &val, &field_data, &field_len))
+	    return false;
+	if ((tag >> 3) >= CLIENT_MESSAGE__TYPE_ACCEPT_MSG &&
+		(tag >> 3) <= CLIENT_MESSAGE__TYPE_HELLO_MSG) {
+	    /* Let the full decoder deal with anything unusual. */
+	    if ((tag & 7) != 2 || type != CLIENT_MESSAGE__TYPE__NOT_SET)
+		return false;
+	    type = (ClientMessage__TypeCase)(tag >> 3);
+	    data = field_data;
+	    data_len = field_len;
+	}
+    }
+
+    switch (type) {
+    case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
+    case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
+    case CLIENT_MESSAGE__TYPE_STDIN_BUF:
+    case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
+    case CLIENT_MESSAGE__TYPE_STDERR_BUF:
+    case CLIENT_MESSAGE__TYPE_WINSIZE_EVENT:
+    case CLIENT_MESSAGE__TYPE_SUSPEND_EVENT:
+	/* The delay is field 1 of IoBuffer, ChangeWindowSize and CommandSuspend. */
+	delay->tv_sec = 0;
+	delay->tv_nsec = 0;
+	cp = data;
+	end = data + data_len;
+	while (cp < end) {
+	    const uint8_t *ts = NULL, *ts_end;
+	    size_t ts_len = 0;
+
+	    if (!wire_varint(&cp, end, &tag) ||
+		    !wire_value(&cp, end, tag & 7, &val, &ts, &ts_len))
+		return false;
+	    if ((tag >> 3) != 1)
+		continue;
+	    if ((tag & 7) != 2)
+		return false;
+
+	    /* TimeSpec: tv_sec is field 1, tv_nsec is field 2. */
+	    have_delay = true;
+	    ts_end = ts + ts_len;
+	    while (ts < ts_end) {
+		const uint8_t *unused_data;
+		size_t unused_len;
+
+		if (!wire_varint(&ts, ts_end, &tag) ||
+			!wire_value(&ts, ts_end, tag & 7, &val, &unused_data,
+			&unused_len))
+		    return false;
+		if ((tag >> 3) == 1 && (tag & 7) == 0)
+		    delay->tv_sec = (int64_t)val;
+		else if ((tag >> 3) == 2 && (tag & 7) == 0)
+		    delay->tv_nsec = (int32_t)val;
+	    }
+	}
+	if (!have_delay)
+	    return false;
+	break;
+    default:
+	break;
+    }
+
+    *typep = type;
+    return true;
+}
+
+/*
+ * Fully unpack a ClientMessage to find its type and delay.
+ * Used when journal_scan_message() is unable to parse the message.
+ */
+static bool
+journal_unpack_message(const uint8_t *buf, size_t len,
+    ClientMessage__TypeCase *typep, TimeSpec *delay)
+{
+    ClientMessage *msg;
+    TimeSpec *msg_delay = NULL;
+    debug_decl(journal_unpack_message, SUDO_DEBUG_UTIL);
+
+    msg = client_message__unpack(NULL, len, buf);
+    if (msg == NULL) {
+	sudo_warnx(U_("unable to unpack %s size %zu"), "ClientMessage", len);
+	debug_return_bool(false);
+    }
+
+    switch (msg->type_case) {
+    case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
+	msg_delay = msg->u.ttyin_buf->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
+	msg_delay = msg->u.ttyout_buf->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_STDIN_BUF:
+	msg_delay = msg->u.stdin_buf->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
+	msg_delay = msg->u.stdout_buf->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_STDERR_BUF:
+	msg_delay = msg->u.stderr_buf->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_WINSIZE_EVENT:
+	msg_delay = msg->u.winsize_event->delay;
+	break;
+    case CLIENT_MESSAGE__TYPE_SUSPEND_EVENT:
+	msg_delay = msg->u.suspend_event->delay;
+	break;
+    default:
+	break;
+    }
+    *typep = msg->type_case;
+    delay->tv_sec = msg_delay ? msg_delay->tv_sec : 0;
+    delay->tv_nsec = msg_delay ? msg_delay->tv_nsec : 0;
+    client_message__free_unpacked(msg, NULL);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Seek ahead in a journal file to the specified target time, adding
+ * the message delays to the elapsed time.  Only the message type and
+ * delay are parsed, the messages are not unpacked.
+ * On success, the journal is positioned after the message that
+ * reached the target.
+ */
+static bool
+journal_seek_file(struct timespec *target, struct connection_closure *closure)
 {
-    ClientMessage *msg = NULL;
-    size_t nread, bufsize = 0;
-    uint8_t *buf = NULL;
+    struct journal_reader rdr = { NULL, 0, 0, 0, fileno(closure->journal) };
+    const uint8_t *cp;
     uint32_t msg_len;
+    off_t pos = 0;
     bool ret = false;
-    debug_decl(journal_seek, SUDO_DEBUG_UTIL);
+    debug_decl(journal_seek_file, SUDO_DEBUG_UTIL);
+
+    if ((rdr.buf = malloc(JOURNAL_SEEK_BUFSIZE)) == NULL) {
+	closure->errstr = _("unable to allocate memory");
+	debug_return_bool(false);
+    }
+    rdr.bufsize = JOURNAL_SEEK_BUFSIZE;
 
     for (;;) {
-	TimeSpec *delay = NULL;
+	ClientMessage__TypeCase type;
+	TimeSpec delay = TIME_SPEC__INIT;
 
 	/* Read message size (uint32_t in network byte order). */
-	nread = fread(&msg_len, sizeof(msg_len), 1, closure->journal);
-	if (nread != 1) {
-	    if (feof(closure->journal)) {
-		sudo_warnx(U_("%s: %s"), closure->journal_path,
-		    U_("unexpected EOF reading journal file"));
-		closure->errstr = _("unexpected EOF reading journal file");
-	    } else {
-		sudo_warn(U_("%s: %s"), closure->journal_path,
-		    U_("error reading journal file"));
-		closure->errstr = _("error reading journal file");
-	    }
+	if ((cp = journal_reader_fill(&rdr, pos, sizeof(msg_len))) == NULL)
 	    break;
-	}
+	memcpy(&msg_len, cp, sizeof(msg_len));
 	msg_len = ntohl(msg_len);
 	if (msg_len > MESSAGE_SIZE_MAX) {
 	    sudo_warnx(U_("%s: %s"), closure->journal_path,
 		U_("client message too large"));
 	    closure->errstr = _("client message too large");
-	    break;
-	}
-
-	/* Read actual message now that we know the size. */
-	if (msg_len != 0) {
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"%s: reading message %u bytes", closure->journal_path, msg_len);
-
-	    if (msg_len > bufsize) {
-		bufsize = sudo_pow2_roundup(msg_len);
-		if (bufsize < msg_len) {
-		    /* overflow */
-		    errno = ENOMEM;
-		    closure->errstr = _("unable to allocate memory");
-		    break;
-		}
-		free(buf);
-		if ((buf = malloc(bufsize)) == NULL) {
-		    closure->errstr = _("unable to allocate memory");
-		    break;
-		}
-	    }
-
-	    nread = fread(buf, msg_len, 1, closure->journal);
-	    if (nread != 1) {
-		if (feof(closure->journal)) {
-		    sudo_warnx(U_("%s: %s"), closure->journal_path,
-			U_("unexpected EOF reading journal file"));
-		    closure->errstr = _("unexpected EOF reading journal file");
-		} else {
-		    sudo_warn(U_("%s: %s"), closure->journal_path,
-			U_("error reading journal file"));
-		    closure->errstr = _("error reading journal file");
-		}
-		break;
-	    }
+	    goto done;
 	}
 
-	client_message__free_unpacked(msg, NULL);
-	msg = client_message__unpack(NULL, msg_len, buf);
-	if (msg == NULL) {
-	    sudo_warnx(U_("unable to unpack %s size %zu"), "ClientMessage",
-		(size_t)msg_len);
-	    closure->errstr = _("invalid journal file, unable to restart");
+	/* The message itself, which is usually already buffered. */
+	cp = journal_reader_fill(&rdr, pos, sizeof(msg_len) + msg_len);
+	if (cp == NULL)
 	    break;
+	cp += sizeof(msg_len);
+	pos += (off_t)(sizeof(msg_len) + msg_len);
+
+	if (!journal_scan_message(cp, msg_len, &type, &delay)) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"%s: unable to scan message at offset %lld, unpacking",
+		closure->journal_path,
+		(long long)(pos - (off_t)msg_len - (off_t)sizeof(msg_len)));
+	    if (!journal_unpack_message(cp, msg_len, &type, &delay)) {
+		closure->errstr = _("invalid journal file, unable to restart");
+		goto done;
+	    }
 	}
 
-	switch (msg->type_case) {
+	switch (type) {
 	case CLIENT_MESSAGE__TYPE_HELLO_MSG:
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past ClientHello (%d)", msg->type_case);
-	    break;
 	case CLIENT_MESSAGE__TYPE_ACCEPT_MSG:
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past AcceptMessage (%d)", msg->type_case);
-	    break;
 	case CLIENT_MESSAGE__TYPE_REJECT_MSG:
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past RejectMessage (%d)", msg->type_case);
-	    break;
 	case CLIENT_MESSAGE__TYPE_EXIT_MSG:
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past ExitMessage (%d)", msg->type_case);
-	    break;
 	case CLIENT_MESSAGE__TYPE_RESTART_MSG:
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past RestartMessage (%d)", msg->type_case);
-	    break;
 	case CLIENT_MESSAGE__TYPE_ALERT_MSG:
 	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"seeking past AlertMessage (%d)", msg->type_case);
+		"seeking past ClientMessage (%d)", type);
 	    break;
 	case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
-	    delay = msg->u.ttyin_buf->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read IoBuffer (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
-	    delay = msg->u.ttyout_buf->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read IoBuffer (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_STDIN_BUF:
-	    delay = msg->u.stdin_buf->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read IoBuffer (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
-	    delay = msg->u.stdout_buf->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read stdout_buf (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_STDERR_BUF:
-	    delay = msg->u.stderr_buf->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read stderr_buf (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_WINSIZE_EVENT:
-	    delay = msg->u.winsize_event->delay;
-	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read ChangeWindowSize (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
-	    break;
 	case CLIENT_MESSAGE__TYPE_SUSPEND_EVENT:
-	    delay = msg->u.suspend_event->delay;
 	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-		"read CommandSuspend (%d), delay [%lld, %ld]", msg->type_case,
-		(long long)delay->tv_sec, (long)delay->tv_nsec);
+		"read ClientMessage (%d), delay [%lld, %d]", type,
+		(long long)delay.tv_sec, delay.tv_nsec);
+	    update_elapsed_time(&delay, &closure->elapsed_time);
 	    break;
 	default:
 	    sudo_warnx(U_("unexpected type_case value %d in %s from %s"),
-		msg->type_case, "ClientMessage", closure->journal_path);
+		type, "ClientMessage", closure->journal_path);
 	    break;
 	}
-	if (delay != NULL)
-	    update_elapsed_time(delay, &closure->elapsed_time);
 
 	if (sudo_timespeccmp(&closure->elapsed_time, target, >=)) {
-	    if (sudo_timespeccmp(&closure->elapsed_time, target, ==)) {
-		ret = true;
-		break;
-	    }
-
-	    /* Mismatch between resume point and stored log. */
-	    closure->errstr = _("invalid journal file, unable to restart");
-	    sudo_warnx(U_("%s: unable to find resume point [%lld, %ld]"),
-		closure->journal_path, (long long)target->tv_sec,
-		target->tv_nsec);
+	    ret = true;
 	    break;
 	}
     }
 
-    client_message__free_unpacked(msg, NULL);
-    free(buf);
+    if (!ret) {
+	if (errno == 0) {
+	    sudo_warnx(U_("%s: %s"), closure->journal_path,
+		U_("unexpected EOF reading journal file"));
+	    closure->errstr = _("unexpected EOF reading journal file");
+	} else if (errno == ENOMEM) {
+	    closure->errstr = _("unable to allocate memory");
+	} else {
+	    sudo_warn(U_("%s: %s"), closure->journal_path,
+		U_("error reading journal file"));
+	    closure->errstr = _("error reading journal file");
+	}
+	goto done;
+    }
 
+    /* Continue reading or writing after the last message. */
+    if (fseeko(closure->journal, pos, SEEK_SET) == -1) {
+	sudo_warn(U_("%s: %s"), closure->journal_path,
+	    U_("error reading journal file"));
+	closure->errstr = _("error reading journal file");
+	ret = false;
+    }
+
+done:
+    free(rdr.buf);
     debug_return_bool(ret);
 }
 
+/*
+ * Seek ahead in the journal to the specified target time.
+ * Returns true if we reached the target time exactly, else false.
+ */
+static bool
+journal_seek(struct timespec *target, struct connection_closure *closure)
+{
+    debug_decl(journal_seek, SUDO_DEBUG_UTIL);
+
+    if (closure->journal_session != NULL) {
+	/* The journal store records the elapsed time of each message. */
+	if (!journal_session_seek(closure->journal_session, target,
+		&closure->elapsed_time)) {
+	    sudo_warnx(U_("%s: %s"), closure->journal_path,
+		U_("unexpected EOF reading journal file"));
+	    closure->errstr = _("unexpected EOF reading journal file");
+	    debug_return_bool(false);
+	}
+    } else {
+	if (!journal_seek_file(target, closure))
+	    debug_return_bool(false);
+    }
+
+    if (!sudo_timespeccmp(&closure->elapsed_time, target, ==)) {
+	/* Mismatch between resume point and stored log. */
+	closure->errstr = _("invalid journal file, unable to restart");
+	sudo_warnx(U_("%s: unable to find resume point [%lld, %ld]"),
+	    closure->journal_path, (long long)target->tv_sec,
+	    target->tv_nsec);
+	debug_return_bool(false);
+    }
+
+    debug_return_bool(true);
+}
+
 /*
  * Restart an existing journal.
  * Seeks to the resume_point in RestartMessage before continuing.
@@ -422,6 +689,27 @@ journal_restart(RestartMessage *msg, uint8_t *buf, size_t buflen,
     } else {
     	cp = msg->log_id;
     }
+    if (strncmp(cp, "journal.", 8) == 0) {
+	/* Session in the journal store. */
+	struct journal_session *js;
+
+	if (!journal_store_init() || (js = journal_session_lookup(cp)) == NULL) {
+	    sudo_warnx(U_("unable to open %s"), cp);
+	    closure->errstr = _("unable to create journal file");
+	    debug_return_bool(false);
+	}
+	fd = journal_session_fd(js);
+	if (fd == -1 || !journal_fdopen(fd, cp, closure)) {
+	    if (fd != -1)
+		close(fd);
+	    journal_session_release(js);
+	    closure->errstr = _("unable to allocate memory");
+	    debug_return_bool(false);
+	}
+	closure->journal_session = js;
+	journal_session_rewind(js);
+	goto seek;
+    }
     len = snprintf(journal_path, sizeof(journal_path), "%s/incoming/%s",
 	logsrvd_conf_relay_dir(), cp);
     if (len >= ssizeof(journal_path)) {
@@ -442,15 +730,24 @@ journal_restart(RestartMessage *msg, uint8_t *buf, size_t buflen,
 	debug_return_bool(false);
     }
 
+seek:
     /* Seek forward to resume point. */
     target.tv_sec = msg->resume_point->tv_sec;
     target.tv_nsec = msg->resume_point->tv_nsec;
     if (!journal_seek(&target, closure)) {
 	sudo_warn(U_("unable to seek to [%lld, %ld] in journal file %s"),
-	    (long long)target.tv_sec, target.tv_nsec, journal_path);
+	    (long long)target.tv_sec, target.tv_nsec, closure->journal_path);
 	debug_return_bool(false);
     }
 
+    /* New messages replace anything after the resume point. */
+    if (closure->journal_session != NULL) {
+	if (!journal_session_truncate(closure->journal_session)) {
+	    closure->errstr = _("unable to write journal file");
+	    debug_return_bool(false);
+	}
+    }
+
     debug_return_bool(true);
 }
 
@@ -460,6 +757,15 @@ journal_write(uint8_t * restrict buf, size_t len, struct connection_closure * re
     uint32_t msg_len;
     debug_decl(journal_write, SUDO_DEBUG_UTIL);
 
+    if (closure->journal_session != NULL) {
+	if (!journal_session_write(closure->journal_session, buf, len,
+		&closure->elapsed_time)) {
+	    closure->errstr = _("unable to write journal file");
+	    debug_return_bool(false);
+	}
+	debug_return_bool(true);
+    }
+
     /* 32-bit message length in network byte order. */
     msg_len = htonl((uint32_t)len);
     if (fwrite(&msg_len, 1, sizeof(msg_len), closure->journal) != sizeof(msg_len)) {
@@ -575,11 +881,9 @@ journal_iobuf(int iofd, IoBuffer *iobuf, uint8_t * restrict buf, size_t len,
 {
     debug_decl(journal_iobuf, SUDO_DEBUG_UTIL);
 
-    if (!journal_write(buf, len, closure))
-	debug_return_bool(false);
     update_elapsed_time(iobuf->delay, &closure->elapsed_time);
 
-    debug_return_bool(true);
+    debug_return_bool(journal_write(buf, len, closure));
 }
 
 /*
@@ -567,7 +567,7 @@ store_iobuf_local(int iofd, IoBuffer *iobuf, uint8_t *buf, size_t buflen,
 {
     const struct eventlog *evlog = closure->evlog;
     struct ProtobufCBinaryData data = iobuf->data;
-    char tbuf[1024], *newbuf = NULL;
+    char tbuf[1024];
     const char *errstr;
     int len;
     debug_decl(store_iobuf_local, SUDO_DEBUG_UTIL);
@@ -589,11 +589,9 @@ store_iobuf_local(int iofd, IoBuffer *iobuf, uint8_t *buf, size_t buflen,
     }
 
     if (!logsrvd_conf_iolog_log_passwords()) {
-	if (!iolog_pwfilt_run(logsrvd_conf_iolog_passprompt_regex(), iofd,
-		(char *)data.data, data.len, &newbuf))
-	    goto bad;
-	if (newbuf != NULL)
-	    data.data = (uint8_t *)newbuf;
+	/* The unpacked message buffer is ours, filter it in place. */
+	iolog_pwfilt_run_inplace(logsrvd_conf_iolog_passprompt_regex(), iofd,
+	    (char *)data.data, data.len);
     }
 
     /* Write to specified I/O log file. */
@@ -624,10 +622,8 @@ store_iobuf_local(int iofd, IoBuffer *iobuf, uint8_t *buf, size_t buflen,
 	}
     }
 
-    free(newbuf);
     debug_return_bool(true);
 bad:
-    free(newbuf);
     if (closure->errstr == NULL)
 	closure->errstr = _("error writing IoBuffer");
     debug_return_bool(false);
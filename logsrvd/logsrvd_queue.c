@@ -96,24 +96,37 @@ outgoing_queue_cb(int unused, int what, void *v)
 	FILE *fp;
 	int fd;
 
-	fd = open(oj->journal_path, O_RDWR);
-	if (fd == -1) {
-	    if (errno == ENOENT) {
-		TAILQ_REMOVE(&outgoing_journal_queue, oj, entries);
-		free(oj->journal_path);
-		free(oj);
+	if (oj->session != NULL) {
+	    /* Session in the journal store. */
+	    if (!journal_session_attach(oj->session))
+		continue;
+	    fd = journal_session_fd(oj->session);
+	    if (fd == -1) {
+		journal_session_release(oj->session);
+		break;
+	    }
+	} else {
+	    fd = open(oj->journal_path, O_RDWR);
+	    if (fd == -1) {
+		if (errno == ENOENT) {
+		    TAILQ_REMOVE(&outgoing_journal_queue, oj, entries);
+		    free(oj->journal_path);
+		    free(oj);
+		}
+		continue;
+	    }
+	    if (!sudo_lock_file(fd, SUDO_TLOCK)) {
+		sudo_warn(U_("unable to lock %s"), oj->journal_path);
+		close(fd);
+		continue;
 	    }
-	    continue;
-	}
-	if (!sudo_lock_file(fd, SUDO_TLOCK)) {
-	    sudo_warn(U_("unable to lock %s"), oj->journal_path);
-	    close(fd);
-	    continue;
 	}
 	fp = fdopen(fd, "r");
 	if (fp == NULL) {
 	    sudo_warn(U_("unable to open %s"), oj->journal_path);
 	    close(fd);
+	    if (oj->session != NULL)
+		journal_session_release(oj->session);
 	    break;
 	}
 
@@ -121,10 +134,13 @@ outgoing_queue_cb(int unused, int what, void *v)
 	closure = connection_closure_alloc(fd, false, true, evbase);
 	if (closure == NULL) {
 	    fclose(fp);
+	    if (oj->session != NULL)
+		journal_session_release(oj->session);
 	    break;
 	}
 	closure->journal = fp;
 	closure->journal_path = oj->journal_path;
+	closure->journal_session = oj->session;
 
 	/* Done with oj now, closure owns journal_path. */
 	TAILQ_REMOVE(&outgoing_journal_queue, oj, entries);
@@ -171,7 +187,7 @@ logsrvd_queue_enable(time_t timeout, struct sudo_event_base *evbase)
 /*
  * Allocate a queue item based on the connection and push it on
  * the outgoing queue.
- * Consumes journal_path from the closure.
+ * Consumes journal_path and journal_session from the closure.
  */
 bool
 logsrvd_queue_insert(struct connection_closure *closure)
@@ -185,12 +201,17 @@ logsrvd_queue_insert(struct connection_closure *closure)
 	debug_return_bool(false);
     }
 
-    if ((oj = malloc(sizeof(*oj))) == NULL) {
+    if ((oj = calloc(1, sizeof(*oj))) == NULL) {
 	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	debug_return_bool(false);
     }
     oj->journal_path = closure->journal_path;
     closure->journal_path = NULL;
+    if (closure->journal_session != NULL) {
+	oj->session = closure->journal_session;
+	closure->journal_session = NULL;
+	journal_session_release(oj->session);
+    }
     TAILQ_INSERT_TAIL(&outgoing_journal_queue, oj, entries);
 
     if (!logsrvd_queue_enable(logsrvd_conf_relay_retry_interval(),
@@ -201,8 +222,40 @@ logsrvd_queue_insert(struct connection_closure *closure)
 }
 
 /*
- * Scan the outgoing queue at startup and populate the
- * outgoing_journal_queue.
+ * Add finished sessions in the journal store that have not
+ * been relayed yet to the outgoing_journal_queue.
+ */
+static bool
+logsrvd_queue_scan_store(void)
+{
+    struct journal_session *js = NULL;
+    debug_decl(logsrvd_queue_scan_store, SUDO_DEBUG_UTIL);
+
+    if (!journal_store_init())
+	debug_return_bool(false);
+
+    while ((js = journal_store_next_ready(js)) != NULL) {
+	struct outgoing_journal *oj;
+
+	if ((oj = calloc(1, sizeof(*oj))) == NULL)
+	    goto oom;
+	if ((oj->journal_path = strdup(journal_session_name(js))) == NULL) {
+	    free(oj);
+	    goto oom;
+	}
+	oj->session = js;
+	TAILQ_INSERT_TAIL(&outgoing_journal_queue, oj, entries);
+    }
+
+    debug_return_bool(true);
+oom:
+    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    debug_return_bool(false);
+}
+
+/*
+ * Scan the journal store and outgoing queue at startup and
+ * populate the outgoing_journal_queue.
  */
 bool
 logsrvd_queue_scan(struct sudo_event_base *evbase)
@@ -218,6 +271,9 @@ logsrvd_queue_scan(struct sudo_event_base *evbase)
     if (TAILQ_EMPTY(logsrvd_conf_relay_address()))
 	debug_return_bool(true);
 
+    if (!logsrvd_queue_scan_store())
+	debug_return_bool(false);
+
     dirlen = snprintf(path, sizeof(path), "%s/outgoing/%s",
 	logsrvd_conf_relay_dir(), RELAY_TEMPLATE);
     if (dirlen >= ssizeof(path)) {
@@ -228,10 +284,14 @@ logsrvd_queue_scan(struct sudo_event_base *evbase)
     dirlen -= (int)sizeof(RELAY_TEMPLATE) - 1;
     path[dirlen] = '\0';
 
+    /* Per-session journal files from before the journal store. */
     dirp = opendir(path);
     if (dirp == NULL) {
-	sudo_warn("opendir %s", path);
-	debug_return_bool(false);
+	if (errno != ENOENT) {
+	    sudo_warn("opendir %s", path);
+	    debug_return_bool(false);
+	}
+	goto done;
     }
     prefix_len = strcspn(RELAY_TEMPLATE, "X");
     while ((dent = readdir(dirp)) != NULL) {
@@ -247,7 +307,7 @@ logsrvd_queue_scan(struct sudo_event_base *evbase)
 	path[dirlen] = '\0';
 	if (strlcat(path, dent->d_name, sizeof(path)) >= sizeof(path))
 	    continue;
-	if ((oj = malloc(sizeof(*oj))) == NULL)
+	if ((oj = calloc(1, sizeof(*oj))) == NULL)
 	    goto oom;
 	if ((oj->journal_path = strdup(path)) == NULL) {
 	    free(oj);
@@ -257,6 +317,7 @@ logsrvd_queue_scan(struct sudo_event_base *evbase)
     }
     closedir(dirp);
 
+done:
     /* Process the queue immediately. */
     if (!logsrvd_queue_enable(0, evbase))
 	debug_return_bool(false);
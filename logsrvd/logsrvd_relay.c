@@ -63,9 +63,13 @@
 
 #include "logsrvd.h"
 
+/* Delay before starting a connection to the next relay (RFC 8305). */
+static const struct timespec relay_attempt_delay = { 0, 250000000 };
+
 static void relay_client_msg_cb(int fd, int what, void *v);
 static void relay_server_msg_cb(int fd, int what, void *v);
-static void connect_cb(int sock, int what, void *v);
+static void relay_attempt_cb(int sock, int what, void *v);
+static void relay_attempt_delay_cb(int unused, int what, void *v);
 static bool start_relay(int sock, struct connection_closure *closure);
 
 /*
@@ -92,7 +96,18 @@ relay_closure_free(struct relay_closure *relay_closure)
     sudo_rcstr_delref(relay_closure->relay_name.name);
     sudo_ev_free(relay_closure->read_ev);
     sudo_ev_free(relay_closure->write_ev);
-    sudo_ev_free(relay_closure->connect_ev);
+    if (relay_closure->attempts != NULL) {
+	size_t i;
+
+	for (i = 0; i < relay_closure->nattempts; i++) {
+	    struct relay_attempt *attempt = &relay_closure->attempts[i];
+	    sudo_ev_free(attempt->connect_ev);
+	    if (attempt->sock != -1)
+		close(attempt->sock);
+	}
+	free(relay_closure->attempts);
+    }
+    sudo_ev_free(relay_closure->attempt_ev);
     free(relay_closure->read_buf.data);
     while ((buf = TAILQ_FIRST(&relay_closure->write_bufs)) != NULL) {
 	TAILQ_REMOVE(&relay_closure->write_bufs, buf, entries);
@@ -173,7 +188,7 @@ relay_enqueue_write(uint8_t *msgbuf, size_t len,
 	goto done;
     }
 
-    TAILQ_INSERT_TAIL(&relay_closure->write_bufs, buf, entries);
+    enqueue_write_buf(&relay_closure->write_bufs, buf, closure);
     buf = NULL;
 
     ret = true;
@@ -221,7 +236,7 @@ fmt_client_message(struct connection_closure *closure, ClientMessage *msg)
     memcpy(buf->data, &msg_len, sizeof(msg_len));
     client_message__pack(msg, buf->data + sizeof(msg_len));
     buf->len = len;
-    TAILQ_INSERT_TAIL(&relay_closure->write_bufs, buf, entries);
+    enqueue_write_buf(&relay_closure->write_bufs, buf, closure);
 
     ret = true;
 
@@ -274,6 +289,7 @@ connect_relay_tls(struct connection_closure *closure)
 {
     struct tls_client_closure *tls_client = &closure->relay_closure->tls_client;
     SSL_CTX *ssl_ctx = logsrvd_relay_tls_ctx();
+    struct server_address *relay;
     debug_decl(connect_relay_tls, SUDO_DEBUG_UTIL);
 
     /* Populate struct tls_client_closure. */
@@ -289,6 +305,20 @@ connect_relay_tls(struct connection_closure *closure)
     if (!tls_ctx_client_setup(ssl_ctx, closure->relay_closure->sock, tls_client))
         goto bad;
 
+    /*
+     * Offer the session from our last connection to this relay to
+     * avoid a full handshake.  Sessions are only reused while the relay
+     * list (and thus the TLS context) is from the current configuration.
+     */
+    relay = closure->relay_closure->relay_addr;
+    if (relay->tls_session != NULL &&
+	    closure->relay_closure->relays == logsrvd_conf_relay_address()) {
+	if (!SSL_set_session(tls_client->ssl, relay->tls_session)) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+		"unable to resume TLS session with %s", relay->sa_str);
+	}
+    }
+
     debug_return_bool(true);
 bad:
     debug_return_bool(false);
@@ -296,36 +326,144 @@ bad:
 #endif /* HAVE_OPENSSL */
 
 /*
- * Try to connect to the next relay host.
- * Returns 0 on success, -1 on error, setting errno.
- * If there is no next relay, errno is set to ENOENT.
+ * Order relays for connection attempts.  Relays that failed within
+ * the last retry_interval seconds are tried after the others, least
+ * recently failed first; otherwise the configuration order is kept.
  */
 static int
-connect_relay_next(struct connection_closure *closure)
+relay_attempt_compare(const void *v1, const void *v2)
+{
+    const struct relay_attempt *a1 = v1;
+    const struct relay_attempt *a2 = v2;
+    const struct timespec *f1 = &a1->relay->last_failure;
+    const struct timespec *f2 = &a2->relay->last_failure;
+
+    if (sudo_timespecisset(f1) != sudo_timespecisset(f2))
+	return sudo_timespecisset(f1) ? 1 : -1;
+    if (sudo_timespeccmp(f1, f2, <))
+	return -1;
+    if (sudo_timespeccmp(f1, f2, >))
+	return 1;
+    return a1 < a2 ? -1 : a1 > a2;
+}
+
+/*
+ * Fill in the list of relay addresses to try, most likely to succeed first.
+ */
+static bool
+relay_attempts_init(struct connection_closure *closure)
 {
     struct relay_closure *relay_closure = closure->relay_closure;
     struct server_address *relay;
-    int ret, sock = -1;
-    char *addr;
-    debug_decl(connect_relay_next, SUDO_DEBUG_UTIL);
+    struct timespec now, expired;
+    size_t n = 0;
+    debug_decl(relay_attempts_init, SUDO_DEBUG_UTIL);
 
-    /* Get next relay or return ENOENT none are left. */
-    if (relay_closure->relay_addr != NULL) {
-	relay = TAILQ_NEXT(relay_closure->relay_addr, entries);
-    } else {
-	relay = TAILQ_FIRST(relay_closure->relays);
+    TAILQ_FOREACH(relay, relay_closure->relays, entries)
+	n++;
+    if (n == 0)
+	debug_return_bool(true);
+
+    relay_closure->attempts = reallocarray(NULL, n,
+	sizeof(*relay_closure->attempts));
+    if (relay_closure->attempts == NULL)
+	debug_return_bool(false);
+    relay_closure->attempt_ev = sudo_ev_alloc(-1, SUDO_EV_TIMEOUT,
+	relay_attempt_delay_cb, closure);
+    if (relay_closure->attempt_ev == NULL)
+	debug_return_bool(false);
+
+    /* A failure older than retry_interval no longer counts against a relay. */
+    sudo_gettime_mono(&now);
+    expired.tv_sec = logsrvd_conf_relay_retry_interval();
+    expired.tv_nsec = 0;
+    sudo_timespecsub(&now, &expired, &expired);
+
+    TAILQ_FOREACH(relay, relay_closure->relays, entries) {
+	struct relay_attempt *attempt = &relay_closure->attempts[
+	    relay_closure->nattempts++];
+
+	if (sudo_timespeccmp(&relay->last_failure, &expired, <))
+	    sudo_timespecclear(&relay->last_failure);
+	attempt->closure = closure;
+	attempt->relay = relay;
+	attempt->connect_ev = NULL;
+	attempt->sock = -1;
     }
-    if (relay == NULL) {
-	errno = ENOENT;
-	goto bad;
+    qsort(relay_closure->attempts, relay_closure->nattempts,
+	sizeof(*relay_closure->attempts), relay_attempt_compare);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Close a relay connection attempt that is no longer needed.
+ */
+static void
+relay_attempt_close(struct relay_attempt *attempt)
+{
+    debug_decl(relay_attempt_close, SUDO_DEBUG_UTIL);
+
+    sudo_ev_free(attempt->connect_ev);
+    attempt->connect_ev = NULL;
+    if (attempt->sock != -1) {
+	shutdown(attempt->sock, SHUT_RDWR);
+	close(attempt->sock);
+	attempt->sock = -1;
+    }
+
+    debug_return;
+}
+
+/*
+ * Record a failed connection attempt so the relay is tried last
+ * by subsequent connections.
+ */
+static void
+relay_attempt_failed(struct relay_attempt *attempt, int errnum)
+{
+    debug_decl(relay_attempt_failed, SUDO_DEBUG_UTIL);
+
+    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	"unable to connect to relay %s: %s", attempt->relay->sa_str,
+	strerror(errnum));
+    sudo_gettime_mono(&attempt->relay->last_failure);
+    relay_attempt_close(attempt);
+
+    debug_return;
+}
+
+/*
+ * Start a connection to the relay address in attempt.
+ * Returns 1 if connected, 0 if the connection is in progress
+ * or -1 on error.
+ */
+static int
+relay_attempt_start(struct relay_attempt *attempt)
+{
+    struct connection_closure *closure = attempt->closure;
+    struct server_address *relay = attempt->relay;
+    int ret, sock;
+    debug_decl(relay_attempt_start, SUDO_DEBUG_UTIL);
+
+    switch (relay->sa_un.sa.sa_family) {
+    case AF_INET:
+#ifdef HAVE_STRUCT_IN6_ADDR
+    case AF_INET6:
+#endif
+	break;
+    default:
+	errno = EAFNOSUPPORT;
+	sudo_warn("connect");
+	debug_return_int(-1);
     }
-    relay_closure->relay_addr = relay;
 
     sock = socket(relay->sa_un.sa.sa_family, SOCK_STREAM, 0);
     if (sock == -1) {
 	sudo_warn("socket");
-	goto bad;
+	debug_return_int(-1);
     }
+    attempt->sock = sock;
     if (logsrvd_conf_relay_tcp_keepalive()) {
 	int keepalive = 1;
 	if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive,
@@ -336,91 +474,181 @@ connect_relay_next(struct connection_closure *closure)
     ret = fcntl(sock, F_GETFL, 0);
     if (ret == -1 || fcntl(sock, F_SETFL, ret | O_NONBLOCK) == -1) {
 	sudo_warn("fcntl(O_NONBLOCK)");
-	goto bad;
+	relay_attempt_close(attempt);
+	debug_return_int(-1);
     }
 
     ret = connect(sock, &relay->sa_un.sa, relay->sa_size);
-    if (ret == -1 && errno != EINPROGRESS)
-	goto bad;
+    if (ret == 0)
+	debug_return_int(1);
+    if (errno != EINPROGRESS) {
+	relay_attempt_failed(attempt, errno);
+	debug_return_int(-1);
+    }
+
+    /* Connection will be completed in relay_attempt_cb(). */
+    attempt->connect_ev = sudo_ev_alloc(sock, SUDO_EV_WRITE,
+	relay_attempt_cb, attempt);
+    if (attempt->connect_ev == NULL) {
+	relay_attempt_close(attempt);
+	debug_return_int(-1);
+    }
+    if (sudo_ev_add(closure->evbase, attempt->connect_ev,
+	    logsrvd_conf_relay_connect_timeout(), false) == -1) {
+	sudo_warnx("%s", U_("unable to add event to queue"));
+	relay_attempt_close(attempt);
+	debug_return_int(-1);
+    }
+    debug_return_int(0);
+}
+
+/*
+ * Use the connected socket in attempt for the relay connection and
+ * abandon any other attempts that are still in progress.
+ * Sets closure->errstr on error.
+ */
+static bool
+relay_connected(struct relay_attempt *attempt)
+{
+    struct connection_closure *closure = attempt->closure;
+    struct relay_closure *relay_closure = closure->relay_closure;
+    struct server_address *relay = attempt->relay;
+    char *addr;
+    size_t i;
+    debug_decl(relay_connected, SUDO_DEBUG_UTIL);
+
+    sudo_ev_del(closure->evbase, relay_closure->attempt_ev);
+    for (i = 0; i < relay_closure->nattempts; i++) {
+	struct relay_attempt *other = &relay_closure->attempts[i];
+
+	if (other == attempt)
+	    continue;
+	/* A relay that was started first but has not connected is slow. */
+	if (other < attempt && other->sock != -1)
+	    sudo_gettime_mono(&other->relay->last_failure);
+	relay_attempt_close(other);
+    }
+    relay_closure->pending = 0;
+
+    /* Take over the socket from the attempt. */
+    sudo_ev_free(attempt->connect_ev);
+    attempt->connect_ev = NULL;
+    relay_closure->sock = attempt->sock;
+    attempt->sock = -1;
+    relay_closure->relay_addr = relay;
+    sudo_timespecclear(&relay->last_failure);
 
-    switch (relay->sa_un.sa.sa_family) {
-    case AF_INET:
-	addr = (char *)&relay->sa_un.sin.sin_addr;
-	break;
 #ifdef HAVE_STRUCT_IN6_ADDR
-    case AF_INET6:
+    if (relay->sa_un.sa.sa_family == AF_INET6)
 	addr = (char *)&relay->sa_un.sin6.sin6_addr;
-	break;
+    else
 #endif
-    default:
-	errno = EAFNOSUPPORT;
-	sudo_warn("connect");
-	goto bad;
-    }
+	addr = (char *)&relay->sa_un.sin.sin_addr;
     inet_ntop(relay->sa_un.sa.sa_family, addr,
 	relay_closure->relay_name.ipaddr,
 	sizeof(relay_closure->relay_name.ipaddr));
     relay_closure->relay_name.name = sudo_rcstr_addref(relay->sa_host);
+    closure->state = INITIAL;
 
-    if (ret == 0) {
-	if (relay_closure->sock != -1) {
-	    shutdown(relay_closure->sock, SHUT_RDWR);
-	    close(relay_closure->sock);
-	}
-	relay_closure->sock = sock;
 #if defined(HAVE_OPENSSL)
-	/* Relay connection succeeded, start TLS handshake. */
-	if (relay_closure->relay_addr->tls) {
-	    if (!connect_relay_tls(closure))
-		goto bad;
-	} else
-#endif
-	{
-	    /* Connection succeeded without blocking. */
-	    if (!start_relay(sock, closure))
-		goto bad;
+    /* Relay connection succeeded, start TLS handshake. */
+    if (relay->tls) {
+	if (!connect_relay_tls(closure)) {
+	    closure->errstr = _("TLS handshake with relay host failed");
+	    debug_return_bool(false);
 	}
-    } else {
-	/* Connection will be completed in connect_cb(). */
-	relay_closure->connect_ev = sudo_ev_alloc(sock, SUDO_EV_WRITE,
-	    connect_cb, closure);
-	if (relay_closure->connect_ev == NULL)
-	    goto bad;
-	if (sudo_ev_add(closure->evbase, relay_closure->connect_ev,
-		logsrvd_conf_relay_connect_timeout(), false) == -1) {
-	    sudo_warnx("%s", U_("unable to add event to queue"));
-	    goto bad;
-	}
-	if (relay_closure->sock != -1) {
-	    shutdown(relay_closure->sock, SHUT_RDWR);
-	    close(relay_closure->sock);
+    } else
+#endif
+    {
+	/* Relay connection succeeded, start talking to the client.  */
+	if (!start_relay(relay_closure->sock, closure)) {
+	    closure->errstr = _("unable to allocate memory");
+	    debug_return_bool(false);
 	}
-	relay_closure->sock = sock;
-	closure->state = CONNECTING;
     }
-    debug_return_int(ret);
+    debug_return_bool(true);
+}
 
-bad:
-    /* Connection or system error. */
-    if (sock != -1) {
-	shutdown(sock, SHUT_RDWR);
-	close(sock);
+/*
+ * Start connection attempts until one is in progress, connected
+ * or there are no relays left to try.  Attempts are staggered as
+ * described in RFC 8305; the next one is started after a short delay
+ * or as soon as the current one fails, whichever comes first.
+ * Returns false if no connection is possible or on error.
+ */
+static bool
+relay_attempt_next(struct connection_closure *closure)
+{
+    struct relay_closure *relay_closure = closure->relay_closure;
+    struct relay_attempt *attempt;
+    debug_decl(relay_attempt_next, SUDO_DEBUG_UTIL);
+
+    while (relay_closure->next_attempt < relay_closure->nattempts) {
+	attempt = &relay_closure->attempts[relay_closure->next_attempt++];
+	switch (relay_attempt_start(attempt)) {
+	case 1:
+	    /* Connection succeeded without blocking. */
+	    debug_return_bool(relay_connected(attempt));
+	case 0:
+	    /* Connection will be completed in relay_attempt_cb(). */
+	    relay_closure->pending++;
+	    if (relay_closure->next_attempt < relay_closure->nattempts) {
+		if (sudo_ev_add(closure->evbase, relay_closure->attempt_ev,
+			&relay_attempt_delay, false) == -1) {
+		    sudo_warnx("%s", U_("unable to add event to queue"));
+		    debug_return_bool(false);
+		}
+	    }
+	    closure->state = CONNECTING;
+	    debug_return_bool(true);
+	default:
+	    /* Try the next relay (if any). */
+	    break;
+	}
     }
-    sudo_rcstr_delref(relay_closure->relay_name.name);
-    relay_closure->relay_name.name = NULL;
-    sudo_ev_free(relay_closure->connect_ev);
-    relay_closure->connect_ev = NULL;
-    debug_return_int(-1);
+
+    /* Out of relays, wait for any connections still in progress. */
+    debug_return_bool(relay_closure->pending != 0);
+}
+
+/*
+ * Schedule an error for the client when no relay could be reached.
+ */
+static void
+relay_connect_failed(struct connection_closure *closure)
+{
+    debug_decl(relay_connect_failed, SUDO_DEBUG_UTIL);
+
+    if (closure->errstr == NULL)
+	closure->errstr = _("unable to connect to relay host");
+    if (!schedule_error_message(closure->errstr, closure))
+	connection_close(closure);
+
+    debug_return;
 }
 
+/* The delay between connection attempts has expired. */
 static void
-connect_cb(int sock, int what, void *v)
+relay_attempt_delay_cb(int unused, int what, void *v)
 {
     struct connection_closure *closure = v;
+    debug_decl(relay_attempt_delay_cb, SUDO_DEBUG_UTIL);
+
+    if (!relay_attempt_next(closure))
+	relay_connect_failed(closure);
+
+    debug_return;
+}
+
+static void
+relay_attempt_cb(int sock, int what, void *v)
+{
+    struct relay_attempt *attempt = v;
+    struct connection_closure *closure = attempt->closure;
     struct relay_closure *relay_closure = closure->relay_closure;
     int errnum, optval, ret;
     socklen_t optlen = sizeof(optval);
-    debug_decl(connect_cb, SUDO_DEBUG_UTIL);
+    debug_decl(relay_attempt_cb, SUDO_DEBUG_UTIL);
 
     if (what == SUDO_EV_TIMEOUT) {
 	errnum = ETIMEDOUT;
@@ -428,44 +656,16 @@ connect_cb(int sock, int what, void *v)
 	ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, &optval, &optlen);
 	errnum = ret == 0 ? optval : errno;
     }
+    relay_closure->pending--;
     if (errnum == 0) {
-	closure->state = INITIAL;
-#if defined(HAVE_OPENSSL)
-	/* Relay connection succeeded, start TLS handshake. */
-	if (relay_closure->relay_addr->tls) {
-	    if (!connect_relay_tls(closure)) {
-		closure->errstr = _("TLS handshake with relay host failed");
-		if (!schedule_error_message(closure->errstr, closure))
-		    connection_close(closure);
-	    }
-	} else
-#endif
-	{
-	    /* Relay connection succeeded, start talking to the client.  */
-	    if (!start_relay(sock, closure)) {
-		closure->errstr = _("unable to allocate memory");
-		if (!schedule_error_message(closure->errstr, closure))
-		    connection_close(closure);
-	    }
-	}
+	if (!relay_connected(attempt))
+	    relay_connect_failed(closure);
     } else {
-	/* Connection failed, try next relay (if any). */
-	int res;
-	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
-	    "unable to connect to relay %s (%s): %s",
-	    relay_closure->relay_name.name, relay_closure->relay_name.ipaddr,
-	    strerror(errnum));
-	while ((res = connect_relay_next(closure)) == -1) {
-	    if (errno == ENOENT || errno == EINPROGRESS) {
-		/* Out of relays or connecting asynchronously. */
-		break;
-	    }
-	}
-	if (res == -1 && errno != EINPROGRESS) {
-	    closure->errstr = _("unable to connect to relay host");
-	    if (!schedule_error_message(closure->errstr, closure))
-		connection_close(closure);
-	}
+	/* Connection failed, start the next attempt without delay. */
+	relay_attempt_failed(attempt, errnum);
+	sudo_ev_del(closure->evbase, relay_closure->attempt_ev);
+	if (!relay_attempt_next(closure))
+	    relay_connect_failed(closure);
     }
 
     debug_return;
@@ -476,21 +676,15 @@ bool
 connect_relay(struct connection_closure *closure)
 {
     struct relay_closure *relay_closure;
-    int res;
     debug_decl(connect_relay, SUDO_DEBUG_UTIL);
 
     relay_closure = closure->relay_closure = relay_closure_alloc();
     if (relay_closure == NULL)
 	debug_return_bool(false);
+    if (!relay_attempts_init(closure))
+	debug_return_bool(false);
 
-    while ((res = connect_relay_next(closure)) == -1) {
-	if (errno == ENOENT || errno == EINPROGRESS) {
-	    /* Out of relays or connecting asynchronously. */
-	    break;
-	}
-    }
-
-    if (res == -1 && errno != EINPROGRESS)
+    if (!relay_attempt_next(closure))
 	debug_return_bool(false);
 
     /* Switch to relay client message handlers. */
@@ -527,6 +721,25 @@ handle_server_hello(ServerHello *msg, struct connection_closure *closure)
 	"relay server %s (%s) ID %s", relay_closure->relay_name.name,
 	relay_closure->relay_name.ipaddr, msg->server_id);
 
+#if defined(HAVE_OPENSSL)
+    /*
+     * Remember the TLS session for the next connection to this relay.
+     * With TLS 1.3 the session ticket arrives after the handshake,
+     * so this is the first point at which the session is resumable.
+     */
+    if (relay_closure->tls_client.ssl != NULL &&
+	    relay_closure->relays == logsrvd_conf_relay_address()) {
+	struct server_address *relay = relay_closure->relay_addr;
+	SSL_SESSION *session = SSL_get1_session(relay_closure->tls_client.ssl);
+
+	if (session != NULL) {
+	    if (relay->tls_session != NULL)
+		SSL_SESSION_free(relay->tls_session);
+	    relay->tls_session = session;
+	}
+    }
+#endif
+
     /* TODO: handle redirect */
 
     debug_return_bool(true);
@@ -994,10 +1207,7 @@ relay_client_msg_cb(int fd, int what, void *v)
 	/* sent entire message, move buf to free list */
 	sudo_debug_printf(SUDO_DEBUG_INFO,
 	    "%s: finished sending %zu bytes to server", __func__, buf->len);
-	buf->off = 0;
-	buf->len = 0;
-	TAILQ_REMOVE(&relay_closure->write_bufs, buf, entries);
-	TAILQ_INSERT_TAIL(&closure->free_bufs, buf, entries);
+	release_write_buf(&relay_closure->write_bufs, buf, closure);
 	if (TAILQ_EMPTY(&relay_closure->write_bufs))
 	    sudo_ev_del(closure->evbase, relay_closure->write_ev);
     }
@@ -1024,10 +1234,6 @@ start_relay(int sock, struct connection_closure *closure)
     struct relay_closure *relay_closure = closure->relay_closure;
     debug_decl(start_relay, SUDO_DEBUG_UTIL);
 
-    /* No longer need the connect event. */
-    sudo_ev_free(relay_closure->connect_ev);
-    relay_closure->connect_ev = NULL;
-
     /* Allocate relay read/write events now that we know the socket. */
     relay_closure->read_ev = sudo_ev_alloc(sock, SUDO_EV_READ|SUDO_EV_PERSIST,
 	relay_server_msg_cb, closure);
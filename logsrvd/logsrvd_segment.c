@@ -0,0 +1,1479 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+/*
+ * Segmented journal store used by store-and-forward relaying.
+ *
+ * Instead of a temporary file per session, journaled sessions are
+ * appended to a small number of large segment files.  Every record
+ * in a segment carries a header with the session it belongs to, its
+ * offset in that session's stream and a log sequence number (LSN)
+ * that orders records across segments.  The DATA records of a session,
+ * concatenated, are the same stream that used to be stored in a
+ * per-session journal file.
+ *
+ * The in-memory index maps each session to the segment extents that
+ * hold its data and is rebuilt from the record headers at startup.
+ * Segments are recycled oldest first once no live session refers to
+ * them.  If the oldest segment only holds a little live data, such
+ * as that of a long-running session, the data is copied forward to
+ * the active segment so the old one can be recycled.
+ */
+
+#include <config.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pathnames.h"
+#include "sudo_compat.h"
+#include "sudo_debug.h"
+#include "sudo_fatal.h"
+#include "sudo_gettext.h"
+#include "sudo_iolog.h"
+#include "sudo_queue.h"
+#include "sudo_util.h"
+
+#include "logsrvd.h"
+
+#define SEGMENT_MAGIC		"SUDOJSEG"
+#define SEGMENT_HDR_LEN		16	/* magic + sequence number */
+#define RECORD_HDR_LEN		48
+#define SEGMENT_WBUF_SIZE	(64 * 1024)
+#define SEGMENTS_FREE_MAX	2	/* recycled segments kept for reuse */
+#define SEGMENTS_SEALED_MAX	4	/* sealed segments before cleaning */
+
+/*
+ * Record header layout, all fields in network byte order:
+ *  0  uint32_t  low 32 bits of the segment sequence number
+ *  4  uint32_t  record type
+ *  8  uint32_t  payload length
+ * 12  uint32_t  checksum of the header and payload
+ * 16  uint64_t  session ID
+ * 24  uint64_t  log sequence number
+ * 32  uint64_t  offset in the session stream
+ * 40  uint64_t  session elapsed time in nanoseconds at the end of the record
+ *
+ * The elapsed time lets a restarted session find its resume point
+ * without reading and decoding the messages that precede it.
+ */
+enum record_type {
+    RECORD_DATA = 1,	/* session data */
+    RECORD_END,		/* session finished, ready to relay */
+    RECORD_TRUNCATE,	/* session cut back to offset (restart) */
+    RECORD_ACK		/* session relayed, may be discarded */
+};
+
+struct journal_segment {
+    TAILQ_ENTRY(journal_segment) entries;
+    uint64_t seq;
+    off_t size;
+    off_t tail;		/* end of records, including buffered ones */
+    off_t flushed;	/* end of records written to the file */
+    uint64_t live;	/* bytes of records still referenced */
+    unsigned int refs;	/* number of records still referenced */
+    int fd;
+};
+TAILQ_HEAD(journal_segment_list, journal_segment);
+
+struct journal_extent {
+    struct journal_segment *seg;
+    off_t pos;		/* payload offset in the segment */
+    uint64_t off;	/* offset in the session stream */
+    uint64_t lsn;
+    uint64_t elapsed;	/* elapsed time in nsec after this record */
+    uint32_t len;
+};
+
+struct journal_session {
+    TAILQ_ENTRY(journal_session) entries;
+    struct journal_extent *extents;
+    size_t nextents;
+    size_t extents_size;
+    struct journal_segment *end_seg;
+    uint64_t end_lsn;
+    uint64_t id;
+    uint64_t length;
+    uint64_t read_pos;
+    bool finished;
+    bool busy;
+    char name[sizeof("journal.") + 16];
+};
+TAILQ_HEAD(journal_session_list, journal_session);
+
+/* A record found while scanning the segments at startup. */
+struct scan_record {
+    struct journal_segment *seg;
+    off_t pos;
+    uint64_t session;
+    uint64_t lsn;
+    uint64_t off;
+    uint64_t elapsed;
+    uint32_t len;
+    uint32_t type;
+};
+
+static struct journal_store {
+    struct journal_segment_list segments;	/* oldest first */
+    struct journal_segment_list free_segments;
+    struct journal_session_list sessions;
+    struct journal_segment *active;
+    char *dir;
+    off_t segment_size;
+    uint64_t next_seq;
+    uint64_t next_lsn;
+    uint64_t next_id;
+    unsigned int nsegments;
+    unsigned int nfree;
+    int dfd;
+    bool cleaning;
+    size_t wlen;
+    uint8_t wbuf[SEGMENT_WBUF_SIZE];
+} *store;
+
+static void
+put_u32(uint8_t *cp, uint32_t val)
+{
+    cp[0] = (uint8_t)(val >> 24);
+    cp[1] = (uint8_t)(val >> 16);
+    cp[2] = (uint8_t)(val >> 8);
+    cp[3] = (uint8_t)val;
+}
+
+static void
+put_u64(uint8_t *cp, uint64_t val)
+{
+    put_u32(cp, (uint32_t)(val >> 32));
+    put_u32(cp + 4, (uint32_t)val);
+}
+
+static uint32_t
+get_u32(const uint8_t *cp)
+{
+    return ((uint32_t)cp[0] << 24) | ((uint32_t)cp[1] << 16) |
+	((uint32_t)cp[2] << 8) | (uint32_t)cp[3];
+}
+
+static uint64_t
+get_u64(const uint8_t *cp)
+{
+    return ((uint64_t)get_u32(cp) << 32) | get_u32(cp + 4);
+}
+
+static uint64_t
+timespec_to_nsec(const struct timespec *ts)
+{
+    if (ts->tv_sec < 0 || ts->tv_nsec < 0)
+	return 0;
+    return (uint64_t)ts->tv_sec * 1000000000 + (uint64_t)ts->tv_nsec;
+}
+
+static void
+nsec_to_timespec(uint64_t nsec, struct timespec *ts)
+{
+    ts->tv_sec = (time_t)(nsec / 1000000000);
+    ts->tv_nsec = (long)(nsec % 1000000000);
+}
+
+/*
+ * FNV-1a hash, used to detect torn or stale records.
+ */
+static uint32_t
+cksum_update(uint32_t h, const uint8_t *cp, size_t len)
+{
+    while (len--) {
+	h ^= *cp++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static uint32_t
+record_cksum(const uint8_t *hdr, const uint8_t *p1, size_t l1,
+    const uint8_t *p2, size_t l2)
+{
+    uint32_t h = 2166136261U;
+
+    h = cksum_update(h, hdr, 12);
+    h = cksum_update(h, hdr + 16, RECORD_HDR_LEN - 16);
+    if (l1 != 0)
+	h = cksum_update(h, p1, l1);
+    if (l2 != 0)
+	h = cksum_update(h, p2, l2);
+    return h;
+}
+
+static bool
+pwrite_all(int fd, const void *buf, size_t len, off_t pos)
+{
+    const uint8_t *cp = buf;
+
+    while (len > 0) {
+	ssize_t nwritten = pwrite(fd, cp, len, pos);
+	if (nwritten == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return false;
+	}
+	cp += nwritten;
+	len -= (size_t)nwritten;
+	pos += nwritten;
+    }
+    return true;
+}
+
+static bool
+pread_all(int fd, void *buf, size_t len, off_t pos)
+{
+    uint8_t *cp = buf;
+
+    while (len > 0) {
+	ssize_t nread = pread(fd, cp, len, pos);
+	if (nread == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return false;
+	}
+	if (nread == 0) {
+	    errno = EIO;
+	    return false;
+	}
+	cp += nread;
+	len -= (size_t)nread;
+	pos += nread;
+    }
+    return true;
+}
+
+static void
+segment_name(uint64_t seq, char *buf, size_t bufsize)
+{
+    (void)snprintf(buf, bufsize, "segment.%016llx", (unsigned long long)seq);
+}
+
+/*
+ * Write out any buffered records for the active segment.
+ */
+static bool
+segment_flush(void)
+{
+    struct journal_segment *seg = store->active;
+    debug_decl(segment_flush, SUDO_DEBUG_UTIL);
+
+    if (store->wlen == 0)
+	debug_return_bool(true);
+    if (!pwrite_all(seg->fd, store->wbuf, store->wlen, seg->flushed)) {
+	sudo_warn(U_("unable to write to %s"), store->dir);
+	debug_return_bool(false);
+    }
+    seg->flushed += (off_t)store->wlen;
+    store->wlen = 0;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Write the segment header, which marks the segment as live.
+ */
+static bool
+segment_write_header(struct journal_segment *seg)
+{
+    uint8_t hdr[SEGMENT_HDR_LEN];
+    debug_decl(segment_write_header, SUDO_DEBUG_UTIL);
+
+    memcpy(hdr, SEGMENT_MAGIC, 8);
+    put_u64(hdr + 8, seg->seq);
+    if (!pwrite_all(seg->fd, hdr, sizeof(hdr), 0))
+	debug_return_bool(false);
+    seg->tail = seg->flushed = SEGMENT_HDR_LEN;
+    seg->live = 0;
+    seg->refs = 0;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Reserve disk space for a new segment so that appending records
+ * to it cannot fail for lack of space.  If posix_fallocate() is not
+ * available or not supported by the file system, the segment is
+ * extended with ftruncate() instead and may be sparse.
+ */
+static bool
+segment_allocate(int fd, off_t size)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+    int error;
+#endif
+    debug_decl(segment_allocate, SUDO_DEBUG_UTIL);
+
+#ifdef HAVE_POSIX_FALLOCATE
+    error = posix_fallocate(fd, 0, size);
+    switch (error) {
+    case 0:
+	debug_return_bool(true);
+    case EINVAL:
+# ifdef EOPNOTSUPP
+    case EOPNOTSUPP:
+# endif
+	/* Not supported by the file system. */
+	break;
+    default:
+	errno = error;
+	debug_return_bool(false);
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"posix_fallocate not supported, using ftruncate");
+#endif /* HAVE_POSIX_FALLOCATE */
+    debug_return_bool(ftruncate(fd, size) == 0);
+}
+
+/*
+ * Start a new active segment, recycling a free one if possible.
+ * The caller must flush the old active segment first.
+ */
+static struct journal_segment *
+segment_new(void)
+{
+    struct journal_segment *seg;
+    char name[64], oname[64];
+    debug_decl(segment_new, SUDO_DEBUG_UTIL);
+
+    segment_name(store->next_seq, name, sizeof(name));
+    seg = TAILQ_FIRST(&store->free_segments);
+    if (seg != NULL) {
+	TAILQ_REMOVE(&store->free_segments, seg, entries);
+	store->nfree--;
+	segment_name(seg->seq, oname, sizeof(oname));
+	if (renameat(store->dfd, oname, store->dfd, name) == -1) {
+	    sudo_warn(U_("unable to rename %s to %s"), oname, name);
+	    close(seg->fd);
+	    free(seg);
+	    seg = NULL;
+	}
+    }
+    if (seg == NULL) {
+	seg = calloc(1, sizeof(*seg));
+	if (seg == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    debug_return_ptr(NULL);
+	}
+	seg->fd = openat(store->dfd, name, O_RDWR|O_CREAT|O_EXCL,
+	    S_IRUSR|S_IWUSR);
+	if (seg->fd == -1) {
+	    sudo_warn(U_("unable to open %s/%s"), store->dir, name);
+	    free(seg);
+	    debug_return_ptr(NULL);
+	}
+	(void)fcntl(seg->fd, F_SETFD, FD_CLOEXEC);
+	if (!segment_allocate(seg->fd, store->segment_size)) {
+	    sudo_warn(U_("unable to write to %s/%s"), store->dir, name);
+	    (void)unlinkat(store->dfd, name, 0);
+	    close(seg->fd);
+	    free(seg);
+	    debug_return_ptr(NULL);
+	}
+	seg->size = store->segment_size;
+    }
+    seg->seq = store->next_seq++;
+    if (!segment_write_header(seg)) {
+	sudo_warn(U_("unable to write to %s/%s"), store->dir, name);
+	(void)unlinkat(store->dfd, name, 0);
+	close(seg->fd);
+	free(seg);
+	debug_return_ptr(NULL);
+    }
+    TAILQ_INSERT_TAIL(&store->segments, seg, entries);
+    store->nsegments++;
+    store->active = seg;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"new journal segment %s", name);
+
+    debug_return_ptr(seg);
+}
+
+/*
+ * Remove a segment that holds no live records.
+ * Up to SEGMENTS_FREE_MAX segments are kept for reuse, the rest
+ * are removed.
+ */
+static void
+segment_reclaim(struct journal_segment *seg)
+{
+    static const uint8_t zero[SEGMENT_HDR_LEN];
+    char name[64];
+    debug_decl(segment_reclaim, SUDO_DEBUG_UTIL);
+
+    TAILQ_REMOVE(&store->segments, seg, entries);
+    store->nsegments--;
+    if (store->active == seg) {
+	store->active = NULL;
+	store->wlen = 0;
+    }
+
+    segment_name(seg->seq, name, sizeof(name));
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"reclaiming journal segment %s", name);
+
+    /* A segment without a valid header is ignored at startup. */
+    if (store->nfree < SEGMENTS_FREE_MAX && seg->size == store->segment_size &&
+	    pwrite_all(seg->fd, zero, sizeof(zero), 0)) {
+	TAILQ_INSERT_TAIL(&store->free_segments, seg, entries);
+	store->nfree++;
+	debug_return;
+    }
+    if (unlinkat(store->dfd, name, 0) == -1)
+	sudo_warn(U_("unable to remove %s/%s"), store->dir, name);
+    close(seg->fd);
+    free(seg);
+
+    debug_return;
+}
+
+/*
+ * Append a record to the active segment, starting a new one as needed.
+ * The payload is passed in two parts to avoid a copy.
+ * On success, stores the segment and payload offset of the record.
+ */
+static bool
+record_append(uint32_t type, uint64_t session, uint64_t lsn, uint64_t off,
+    uint64_t elapsed, const uint8_t *p1, size_t l1, const uint8_t *p2, size_t l2,
+    struct journal_segment **segp, off_t *posp)
+{
+    struct journal_segment *seg = store->active;
+    const size_t len = l1 + l2;
+    const size_t reclen = RECORD_HDR_LEN + len;
+    uint8_t hdr[RECORD_HDR_LEN];
+    off_t pos;
+    debug_decl(record_append, SUDO_DEBUG_UTIL);
+
+    if (reclen > (size_t)(store->segment_size - SEGMENT_HDR_LEN)) {
+	sudo_warnx(U_("%s: %s"), store->dir, U_("client message too large"));
+	debug_return_bool(false);
+    }
+    if (seg == NULL || seg->tail + (off_t)reclen > seg->size) {
+	/* Seal the current segment and start a new one. */
+	if (seg != NULL && !segment_flush())
+	    debug_return_bool(false);
+	if ((seg = segment_new()) == NULL)
+	    debug_return_bool(false);
+    }
+
+    put_u32(hdr, (uint32_t)seg->seq);
+    put_u32(hdr + 4, type);
+    put_u32(hdr + 8, (uint32_t)len);
+    put_u64(hdr + 16, session);
+    put_u64(hdr + 24, lsn);
+    put_u64(hdr + 32, off);
+    put_u64(hdr + 40, elapsed);
+    put_u32(hdr + 12, record_cksum(hdr, p1, l1, p2, l2));
+
+    pos = seg->tail;
+    if (store->wlen + reclen > sizeof(store->wbuf)) {
+	if (!segment_flush())
+	    debug_return_bool(false);
+    }
+    if (reclen > sizeof(store->wbuf)) {
+	/* Too big to buffer, write it directly. */
+	if (!pwrite_all(seg->fd, hdr, sizeof(hdr), pos) ||
+		!pwrite_all(seg->fd, p1, l1, pos + RECORD_HDR_LEN) ||
+		!pwrite_all(seg->fd, p2, l2, pos + RECORD_HDR_LEN + (off_t)l1)) {
+	    sudo_warn(U_("unable to write to %s"), store->dir);
+	    debug_return_bool(false);
+	}
+	seg->flushed += (off_t)reclen;
+    } else {
+	uint8_t *cp = store->wbuf + store->wlen;
+	memcpy(cp, hdr, sizeof(hdr));
+	if (l1 != 0)
+	    memcpy(cp + RECORD_HDR_LEN, p1, l1);
+	if (l2 != 0)
+	    memcpy(cp + RECORD_HDR_LEN + l1, p2, l2);
+	store->wlen += reclen;
+    }
+    seg->tail += (off_t)reclen;
+
+    if (segp != NULL)
+	*segp = seg;
+    if (posp != NULL)
+	*posp = pos + RECORD_HDR_LEN;
+    debug_return_bool(true);
+}
+
+/*
+ * Read part of a record payload, flushing buffered records if needed.
+ */
+static bool
+extent_read(struct journal_extent *ext, uint32_t skip, void *buf, size_t len)
+{
+    const off_t pos = ext->pos + skip;
+    debug_decl(extent_read, SUDO_DEBUG_UTIL);
+
+    if (ext->seg == store->active && pos + (off_t)len > ext->seg->flushed) {
+	if (!segment_flush())
+	    debug_return_bool(false);
+    }
+    if (!pread_all(ext->seg->fd, buf, len, pos)) {
+	sudo_warn(U_("unable to read from %s"), store->dir);
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
+static void
+segment_addref(struct journal_segment *seg, size_t len)
+{
+    seg->refs++;
+    seg->live += RECORD_HDR_LEN + len;
+}
+
+static void
+segment_delref(struct journal_segment *seg, size_t len)
+{
+    seg->refs--;
+    seg->live -= RECORD_HDR_LEN + len;
+}
+
+static bool
+session_add_extent(struct journal_session *js, struct journal_segment *seg,
+    off_t pos, uint64_t lsn, uint64_t elapsed, uint32_t len)
+{
+    struct journal_extent *ext;
+    debug_decl(session_add_extent, SUDO_DEBUG_UTIL);
+
+    if (js->nextents == js->extents_size) {
+	size_t new_size = js->extents_size ? js->extents_size * 2 : 16;
+	ext = reallocarray(js->extents, new_size, sizeof(*ext));
+	if (ext == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    debug_return_bool(false);
+	}
+	js->extents = ext;
+	js->extents_size = new_size;
+    }
+    ext = &js->extents[js->nextents++];
+    ext->seg = seg;
+    ext->pos = pos;
+    ext->off = js->length;
+    ext->lsn = lsn;
+    ext->elapsed = elapsed;
+    ext->len = len;
+    js->length += len;
+    segment_addref(seg, len);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Cut a session's stream back to the specified length.
+ */
+static void
+session_cut(struct journal_session *js, uint64_t length)
+{
+    debug_decl(session_cut, SUDO_DEBUG_UTIL);
+
+    while (js->nextents > 0) {
+	struct journal_extent *ext = &js->extents[js->nextents - 1];
+	if (ext->off >= length) {
+	    segment_delref(ext->seg, ext->len);
+	    js->nextents--;
+	    continue;
+	}
+	if (ext->off + ext->len > length) {
+	    const uint32_t newlen = (uint32_t)(length - ext->off);
+	    ext->seg->live -= ext->len - newlen;
+	    ext->len = newlen;
+	}
+	break;
+    }
+    js->length = length;
+    if (js->read_pos > length)
+	js->read_pos = length;
+
+    debug_return;
+}
+
+static struct journal_session *
+session_new(uint64_t id)
+{
+    struct journal_session *js;
+    debug_decl(session_new, SUDO_DEBUG_UTIL);
+
+    if ((js = calloc(1, sizeof(*js))) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_ptr(NULL);
+    }
+    js->id = id;
+    (void)snprintf(js->name, sizeof(js->name), "journal.%016llx",
+	(unsigned long long)id);
+    TAILQ_INSERT_TAIL(&store->sessions, js, entries);
+
+    debug_return_ptr(js);
+}
+
+static void
+session_free(struct journal_session *js)
+{
+    debug_decl(session_free, SUDO_DEBUG_UTIL);
+
+    session_cut(js, 0);
+    if (js->end_seg != NULL)
+	segment_delref(js->end_seg, 0);
+    TAILQ_REMOVE(&store->sessions, js, entries);
+    free(js->extents);
+    free(js);
+
+    debug_return;
+}
+
+/*
+ * Copy the live records in a segment to the active segment.
+ * The copies keep their original LSN so the scan at startup
+ * can discard duplicates if the old segment still exists.
+ */
+static bool
+segment_clean(struct journal_segment *seg)
+{
+    struct journal_session *js;
+    uint8_t *buf = NULL;
+    size_t bufsize = 0;
+    bool ret = false;
+    debug_decl(segment_clean, SUDO_DEBUG_UTIL);
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"copying %llu live bytes from journal segment %llu",
+	(unsigned long long)seg->live, (unsigned long long)seg->seq);
+
+    TAILQ_FOREACH(js, &store->sessions, entries) {
+	size_t i;
+
+	for (i = 0; i < js->nextents; i++) {
+	    struct journal_extent *ext = &js->extents[i];
+	    struct journal_segment *newseg;
+	    off_t newpos;
+
+	    if (ext->seg != seg)
+		continue;
+	    if (ext->len > bufsize) {
+		uint8_t *newbuf;
+		size_t newsize = sudo_pow2_roundup(ext->len);
+		if ((newbuf = realloc(buf, newsize)) == NULL) {
+		    sudo_warnx(U_("%s: %s"), __func__,
+			U_("unable to allocate memory"));
+		    goto done;
+		}
+		buf = newbuf;
+		bufsize = newsize;
+	    }
+	    if (!extent_read(ext, 0, buf, ext->len))
+		goto done;
+	    if (!record_append(RECORD_DATA, js->id, ext->lsn, ext->off,
+		    ext->elapsed, buf, ext->len, NULL, 0, &newseg, &newpos))
+		goto done;
+	    segment_delref(seg, ext->len);
+	    segment_addref(newseg, ext->len);
+	    ext->seg = newseg;
+	    ext->pos = newpos;
+	}
+	if (js->end_seg == seg) {
+	    struct journal_segment *newseg;
+
+	    if (!record_append(RECORD_END, js->id, js->end_lsn, js->length,
+		    0, NULL, 0, NULL, 0, &newseg, NULL))
+		goto done;
+	    segment_delref(seg, 0);
+	    segment_addref(newseg, 0);
+	    js->end_seg = newseg;
+	}
+    }
+    /* The copies must be on disk before the old segment is removed. */
+    ret = segment_flush();
+
+done:
+    free(buf);
+    debug_return_bool(ret);
+}
+
+/*
+ * Recycle segments that are no longer referenced, oldest first.
+ * Sessions are acknowledged in order of their last record, so a
+ * segment is only reclaimed once all older ones are gone.  That
+ * way an ACK record never outlives the data it refers to.
+ */
+static void
+store_reclaim(void)
+{
+    struct journal_segment *seg;
+    debug_decl(store_reclaim, SUDO_DEBUG_UTIL);
+
+    if (store->cleaning)
+	debug_return;
+
+    while ((seg = TAILQ_FIRST(&store->segments)) != NULL) {
+	if (seg == store->active)
+	    break;
+	if (seg->refs != 0) {
+	    /* Only copy forward if most of the segment is garbage. */
+	    if (store->nsegments <= SEGMENTS_SEALED_MAX + 1 ||
+		    seg->live > (uint64_t)seg->size / 2)
+		break;
+	    store->cleaning = true;
+	    if (!segment_clean(seg) || seg->refs != 0) {
+		store->cleaning = false;
+		break;
+	    }
+	    store->cleaning = false;
+	}
+	segment_reclaim(seg);
+    }
+
+    debug_return;
+}
+
+static int
+scan_record_compare(const void *v1, const void *v2)
+{
+    const struct scan_record *r1 = v1;
+    const struct scan_record *r2 = v2;
+
+    if (r1->session != r2->session)
+	return r1->session < r2->session ? -1 : 1;
+    if (r1->lsn != r2->lsn)
+	return r1->lsn < r2->lsn ? -1 : 1;
+    if (r1->seg->seq != r2->seg->seq)
+	return r1->seg->seq < r2->seg->seq ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Read the records in a segment and add them to the scan array.
+ * Stops at the first record that is incomplete, was left over from
+ * a previous use of the segment or fails the checksum.
+ */
+static bool
+segment_scan(struct journal_segment *seg, struct scan_record **recsp,
+    size_t *nrecsp, size_t *recs_sizep)
+{
+    uint8_t hdr[RECORD_HDR_LEN], *buf = NULL;
+    size_t bufsize = 0;
+    off_t pos = SEGMENT_HDR_LEN;
+    bool ret = false;
+    debug_decl(segment_scan, SUDO_DEBUG_UTIL);
+
+    while (pos + RECORD_HDR_LEN <= seg->size) {
+	struct scan_record *rec;
+	uint32_t type, len;
+
+	if (!pread_all(seg->fd, hdr, sizeof(hdr), pos))
+	    break;
+	type = get_u32(hdr + 4);
+	len = get_u32(hdr + 8);
+	if (get_u32(hdr) != (uint32_t)seg->seq || type < RECORD_DATA ||
+		type > RECORD_ACK || len > seg->size - pos - RECORD_HDR_LEN)
+	    break;
+	if (len > bufsize) {
+	    uint8_t *newbuf;
+	    size_t newsize = sudo_pow2_roundup(len);
+	    if ((newbuf = realloc(buf, newsize)) == NULL) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		goto done;
+	    }
+	    buf = newbuf;
+	    bufsize = newsize;
+	}
+	if (len != 0 && !pread_all(seg->fd, buf, len, pos + RECORD_HDR_LEN))
+	    break;
+	if (record_cksum(hdr, buf, len, NULL, 0) != get_u32(hdr + 12))
+	    break;
+
+	if (*nrecsp == *recs_sizep) {
+	    size_t new_size = *recs_sizep ? *recs_sizep * 2 : 256;
+	    rec = reallocarray(*recsp, new_size, sizeof(*rec));
+	    if (rec == NULL) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		goto done;
+	    }
+	    *recsp = rec;
+	    *recs_sizep = new_size;
+	}
+	rec = &(*recsp)[(*nrecsp)++];
+	rec->seg = seg;
+	rec->pos = pos + RECORD_HDR_LEN;
+	rec->type = type;
+	rec->len = len;
+	rec->session = get_u64(hdr + 16);
+	rec->lsn = get_u64(hdr + 24);
+	rec->off = get_u64(hdr + 32);
+	rec->elapsed = get_u64(hdr + 40);
+
+	if (rec->session >= store->next_id)
+	    store->next_id = rec->session + 1;
+	if (rec->lsn >= store->next_lsn)
+	    store->next_lsn = rec->lsn + 1;
+	pos += RECORD_HDR_LEN + len;
+    }
+    seg->tail = seg->flushed = pos;
+    ret = true;
+
+done:
+    free(buf);
+    debug_return_bool(ret);
+}
+
+/*
+ * Rebuild a session from its records, sorted by LSN.
+ */
+static bool
+session_replay(struct scan_record *recs, size_t nrecs)
+{
+    struct journal_session *js;
+    size_t i;
+    debug_decl(session_replay, SUDO_DEBUG_UTIL);
+
+    if ((js = session_new(recs[0].session)) == NULL)
+	debug_return_bool(false);
+
+    for (i = 0; i < nrecs; i++) {
+	struct scan_record *rec = &recs[i];
+
+	/* Records copied forward share an LSN, use the newest copy. */
+	if (i + 1 < nrecs && recs[i + 1].lsn == rec->lsn)
+	    continue;
+
+	switch (rec->type) {
+	case RECORD_DATA:
+	    if (rec->off > js->length) {
+		sudo_warnx(U_("%s: %s"), js->name,
+		    U_("invalid journal file, unable to restart"));
+		goto ack;
+	    }
+	    session_cut(js, rec->off);
+	    if (!session_add_extent(js, rec->seg, rec->pos, rec->lsn,
+		    rec->elapsed, rec->len))
+		debug_return_bool(false);
+	    break;
+	case RECORD_TRUNCATE:
+	    if (rec->off <= js->length)
+		session_cut(js, rec->off);
+	    break;
+	case RECORD_END:
+	    if (js->end_seg != NULL)
+		segment_delref(js->end_seg, 0);
+	    js->end_seg = rec->seg;
+	    js->end_lsn = rec->lsn;
+	    js->finished = true;
+	    segment_addref(rec->seg, 0);
+	    break;
+	case RECORD_ACK:
+	    goto ack;
+	}
+    }
+    debug_return_bool(true);
+ack:
+    session_free(js);
+    debug_return_bool(true);
+}
+
+static int
+seq_compare(const void *v1, const void *v2)
+{
+    const uint64_t *s1 = v1, *s2 = v2;
+
+    return *s1 < *s2 ? -1 : *s1 > *s2;
+}
+
+/*
+ * Open the segments in the store directory and rebuild the index.
+ */
+static bool
+store_scan(void)
+{
+    struct scan_record *recs = NULL;
+    size_t i, nrecs = 0, recs_size = 0;
+    uint64_t *seqs = NULL;
+    size_t nseqs = 0, seqs_size = 0;
+    struct dirent *dent;
+    bool ret = false;
+    DIR *dirp;
+    debug_decl(store_scan, SUDO_DEBUG_UTIL);
+
+    if ((dirp = opendir(store->dir)) == NULL) {
+	sudo_warn(U_("unable to open %s"), store->dir);
+	debug_return_bool(false);
+    }
+    while ((dent = readdir(dirp)) != NULL) {
+	unsigned long long seq;
+	char *ep;
+
+	if (strncmp(dent->d_name, "segment.", 8) != 0)
+	    continue;
+	errno = 0;
+	seq = strtoull(dent->d_name + 8, &ep, 16);
+	if (*ep != '\0' || errno != 0 || strlen(dent->d_name) != 8 + 16)
+	    continue;
+	if (nseqs == seqs_size) {
+	    uint64_t *tmp;
+	    seqs_size = seqs_size ? seqs_size * 2 : 16;
+	    if ((tmp = reallocarray(seqs, seqs_size, sizeof(*seqs))) == NULL) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		closedir(dirp);
+		goto done;
+	    }
+	    seqs = tmp;
+	}
+	seqs[nseqs++] = seq;
+    }
+    closedir(dirp);
+    if (nseqs != 0)
+	qsort(seqs, nseqs, sizeof(*seqs), seq_compare);
+
+    for (i = 0; i < nseqs; i++) {
+	struct journal_segment *seg;
+	uint8_t hdr[SEGMENT_HDR_LEN];
+	char name[64];
+	struct stat sb;
+
+	if ((seg = calloc(1, sizeof(*seg))) == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    goto done;
+	}
+	seg->seq = seqs[i];
+	if (seg->seq >= store->next_seq)
+	    store->next_seq = seg->seq + 1;
+	segment_name(seg->seq, name, sizeof(name));
+	seg->fd = openat(store->dfd, name, O_RDWR|O_NOFOLLOW);
+	if (seg->fd == -1 || fstat(seg->fd, &sb) == -1) {
+	    sudo_warn(U_("unable to open %s/%s"), store->dir, name);
+	    if (seg->fd != -1)
+		close(seg->fd);
+	    free(seg);
+	    continue;
+	}
+	(void)fcntl(seg->fd, F_SETFD, FD_CLOEXEC);
+	seg->size = sb.st_size;
+
+	if (!S_ISREG(sb.st_mode) || seg->size < SEGMENT_HDR_LEN ||
+		!pread_all(seg->fd, hdr, sizeof(hdr), 0) ||
+		memcmp(hdr, SEGMENT_MAGIC, 8) != 0 ||
+		get_u64(hdr + 8) != seg->seq) {
+	    /* Not in use, recycle it. */
+	    if (S_ISREG(sb.st_mode) && store->nfree < SEGMENTS_FREE_MAX &&
+		    seg->size == store->segment_size) {
+		TAILQ_INSERT_TAIL(&store->free_segments, seg, entries);
+		store->nfree++;
+	    } else {
+		(void)unlinkat(store->dfd, name, 0);
+		close(seg->fd);
+		free(seg);
+	    }
+	    continue;
+	}
+	TAILQ_INSERT_TAIL(&store->segments, seg, entries);
+	store->nsegments++;
+	if (!segment_scan(seg, &recs, &nrecs, &recs_size))
+	    goto done;
+    }
+
+    /* Group records by session and replay them in LSN order. */
+    if (nrecs != 0)
+	qsort(recs, nrecs, sizeof(*recs), scan_record_compare);
+    for (i = 0; i < nrecs; ) {
+	size_t j;
+
+	for (j = i + 1; j < nrecs && recs[j].session == recs[i].session; j++)
+	    continue;
+	if (!session_replay(recs + i, j - i))
+	    goto done;
+	i = j;
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"%s: %u segments, %zu records", store->dir, store->nsegments, nrecs);
+
+    /* New records always go to a fresh segment. */
+    store_reclaim();
+    ret = true;
+
+done:
+    free(recs);
+    free(seqs);
+    debug_return_bool(ret);
+}
+
+/*
+ * Open the journal store in dir, creating it if needed, and
+ * rebuild the session index from the existing segments.
+ * The store stays open until journal_store_close() is called,
+ * later calls return true without reopening it.
+ */
+bool
+journal_store_open(const char *dir, off_t segment_size)
+{
+    char path[PATH_MAX];
+    int len;
+    debug_decl(journal_store_open, SUDO_DEBUG_UTIL);
+
+    if (store != NULL)
+	debug_return_bool(true);
+
+    len = snprintf(path, sizeof(path), "%s/segment", dir);
+    if (len < 0 || (size_t)len >= sizeof(path)) {
+	errno = ENAMETOOLONG;
+	sudo_warn("%s/segment", dir);
+	debug_return_bool(false);
+    }
+
+    if ((store = calloc(1, sizeof(*store))) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    TAILQ_INIT(&store->segments);
+    TAILQ_INIT(&store->free_segments);
+    TAILQ_INIT(&store->sessions);
+    store->segment_size = segment_size;
+    store->next_seq = 1;
+    store->next_lsn = 1;
+    store->next_id = 1;
+    store->dfd = sudo_open_parent_dir(path, logsrvd_conf_iolog_uid(),
+	logsrvd_conf_iolog_gid(), S_IRWXU|S_IXGRP|S_IXOTH, false);
+    if (store->dfd == -1) {
+	sudo_warn(U_("unable to open %s"), dir);
+	goto bad;
+    }
+    if ((store->dir = strdup(dir)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto bad;
+    }
+    if (!store_scan())
+	goto bad;
+
+    /* Avoid reusing the name of a session relayed before a restart. */
+    if (store->next_id < (uint64_t)time(NULL) << 20)
+	store->next_id = (uint64_t)time(NULL) << 20;
+
+    debug_return_bool(true);
+bad:
+    journal_store_close();
+    debug_return_bool(false);
+}
+
+/*
+ * Flush buffered records and free the journal store.
+ */
+void
+journal_store_close(void)
+{
+    struct journal_segment *seg;
+    struct journal_session *js;
+    debug_decl(journal_store_close, SUDO_DEBUG_UTIL);
+
+    if (store == NULL)
+	debug_return;
+
+    if (store->active != NULL)
+	(void)segment_flush();
+    while ((js = TAILQ_FIRST(&store->sessions)) != NULL) {
+	TAILQ_REMOVE(&store->sessions, js, entries);
+	free(js->extents);
+	free(js);
+    }
+    while ((seg = TAILQ_FIRST(&store->segments)) != NULL) {
+	TAILQ_REMOVE(&store->segments, seg, entries);
+	close(seg->fd);
+	free(seg);
+    }
+    while ((seg = TAILQ_FIRST(&store->free_segments)) != NULL) {
+	TAILQ_REMOVE(&store->free_segments, seg, entries);
+	close(seg->fd);
+	free(seg);
+    }
+    if (store->dfd != -1)
+	close(store->dfd);
+    free(store->dir);
+    free(store);
+    store = NULL;
+
+    debug_return;
+}
+
+/*
+ * Return the next finished session after prev that is waiting to
+ * be relayed, or the first one if prev is NULL.
+ */
+struct journal_session *
+journal_store_next_ready(struct journal_session *prev)
+{
+    struct journal_session *js;
+    debug_decl(journal_store_next_ready, SUDO_DEBUG_UTIL);
+
+    if (store == NULL)
+	debug_return_ptr(NULL);
+    js = prev ? TAILQ_NEXT(prev, entries) : TAILQ_FIRST(&store->sessions);
+    while (js != NULL && (!js->finished || js->busy))
+	js = TAILQ_NEXT(js, entries);
+
+    debug_return_ptr(js);
+}
+
+/*
+ * Number of segments in use, not including free ones.
+ */
+unsigned int
+journal_store_nsegments(void)
+{
+    return store ? store->nsegments : 0;
+}
+
+/*
+ * Create a new, empty session in the store.
+ */
+struct journal_session *
+journal_session_create(void)
+{
+    struct journal_session *js;
+    debug_decl(journal_session_create, SUDO_DEBUG_UTIL);
+
+    if (store == NULL)
+	debug_return_ptr(NULL);
+    if ((js = session_new(store->next_id)) != NULL) {
+	store->next_id++;
+	js->busy = true;
+    }
+
+    debug_return_ptr(js);
+}
+
+/*
+ * Look up an unfinished session by name and mark it busy.
+ */
+struct journal_session *
+journal_session_lookup(const char *name)
+{
+    struct journal_session *js;
+    debug_decl(journal_session_lookup, SUDO_DEBUG_UTIL);
+
+    if (store == NULL)
+	debug_return_ptr(NULL);
+    TAILQ_FOREACH(js, &store->sessions, entries) {
+	if (strcmp(js->name, name) == 0) {
+	    if (js->busy || js->finished)
+		break;
+	    js->busy = true;
+	    debug_return_ptr(js);
+	}
+    }
+
+    debug_return_ptr(NULL);
+}
+
+/*
+ * Mark a session as busy; returns false if it is already in use.
+ */
+bool
+journal_session_attach(struct journal_session *js)
+{
+    debug_decl(journal_session_attach, SUDO_DEBUG_UTIL);
+
+    if (js->busy)
+	debug_return_bool(false);
+    js->busy = true;
+    js->read_pos = 0;
+    debug_return_bool(true);
+}
+
+/*
+ * Mark a session as no longer in use by a connection.
+ * Buffered records are written out so a restarted client can
+ * resume the session, just as closing a journal file would.
+ */
+void
+journal_session_release(struct journal_session *js)
+{
+    debug_decl(journal_session_release, SUDO_DEBUG_UTIL);
+
+    if (!js->finished && store->active != NULL)
+	(void)segment_flush();
+    js->busy = false;
+
+    debug_return;
+}
+
+const char *
+journal_session_name(struct journal_session *js)
+{
+    return js->name;
+}
+
+bool
+journal_session_finished(struct journal_session *js)
+{
+    return js->finished;
+}
+
+/*
+ * Return a new file descriptor used to drive reads from the session
+ * via the event loop.  It is always readable; the actual data is
+ * read with journal_session_read().
+ */
+int
+journal_session_fd(struct journal_session *js)
+{
+    int fd;
+    debug_decl(journal_session_fd, SUDO_DEBUG_UTIL);
+
+    fd = open(_PATH_DEVNULL, O_RDWR);
+    if (fd == -1)
+	sudo_warn(U_("unable to open %s"), _PATH_DEVNULL);
+    else
+	(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    debug_return_int(fd);
+}
+
+/*
+ * Append a message to the session, prefixed by its 32-bit length
+ * in network byte order, like a per-session journal file.
+ * The elapsed time includes the delay of the message itself.
+ */
+bool
+journal_session_write(struct journal_session *js, const uint8_t *buf,
+    size_t len, const struct timespec *elapsed)
+{
+    struct journal_segment *seg;
+    uint8_t msg_len[4];
+    uint64_t lsn, nsec;
+    off_t pos;
+    debug_decl(journal_session_write, SUDO_DEBUG_UTIL);
+
+    if (js->finished || len > UINT32_MAX - sizeof(msg_len)) {
+	errno = EINVAL;
+	debug_return_bool(false);
+    }
+    put_u32(msg_len, (uint32_t)len);
+    lsn = store->next_lsn++;
+    nsec = timespec_to_nsec(elapsed);
+    if (!record_append(RECORD_DATA, js->id, lsn, js->length, nsec, msg_len,
+	    sizeof(msg_len), buf, len, &seg, &pos))
+	debug_return_bool(false);
+    if (!session_add_extent(js, seg, pos, lsn, nsec,
+	    (uint32_t)(len + sizeof(msg_len))))
+	debug_return_bool(false);
+    store_reclaim();
+
+    debug_return_bool(true);
+}
+
+/*
+ * Mark the session finished and ready to relay.
+ */
+bool
+journal_session_finish(struct journal_session *js)
+{
+    struct journal_segment *seg;
+    uint64_t lsn;
+    debug_decl(journal_session_finish, SUDO_DEBUG_UTIL);
+
+    if (js->finished)
+	debug_return_bool(true);
+    lsn = store->next_lsn++;
+    if (!record_append(RECORD_END, js->id, lsn, js->length, 0, NULL, 0,
+	    NULL, 0, &seg, NULL))
+	debug_return_bool(false);
+    if (!segment_flush())
+	debug_return_bool(false);
+    segment_addref(seg, 0);
+    js->end_seg = seg;
+    js->end_lsn = lsn;
+    js->finished = true;
+    js->read_pos = 0;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Discard the session data after the current read position.
+ * Used when a client restarts a session.
+ */
+bool
+journal_session_truncate(struct journal_session *js)
+{
+    uint64_t lsn;
+    debug_decl(journal_session_truncate, SUDO_DEBUG_UTIL);
+
+    if (js->finished) {
+	errno = EINVAL;
+	debug_return_bool(false);
+    }
+    if (js->read_pos == js->length)
+	debug_return_bool(true);
+    lsn = store->next_lsn++;
+    if (!record_append(RECORD_TRUNCATE, js->id, lsn, js->read_pos, 0,
+	    NULL, 0, NULL, 0, NULL, NULL))
+	debug_return_bool(false);
+    session_cut(js, js->read_pos);
+
+    debug_return_bool(true);
+}
+
+/*
+ * The session has been relayed, discard it.
+ */
+bool
+journal_session_done(struct journal_session *js)
+{
+    bool ret;
+    debug_decl(journal_session_done, SUDO_DEBUG_UTIL);
+
+    ret = record_append(RECORD_ACK, js->id, store->next_lsn++, js->length, 0,
+	NULL, 0, NULL, 0, NULL, NULL);
+    session_free(js);
+    store_reclaim();
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Read up to len bytes of session data from the current read position.
+ * Returns the number of bytes read, 0 at the end of the session or -1
+ * on error.
+ */
+ssize_t
+journal_session_read(struct journal_session *js, void *buf, size_t len)
+{
+    uint8_t *cp = buf;
+    size_t lo, hi, total = 0;
+    debug_decl(journal_session_read, SUDO_DEBUG_UTIL);
+
+    if (js->read_pos >= js->length || len == 0)
+	debug_return_ssize_t(0);
+
+    /* Find the extent that contains the read position. */
+    lo = 0;
+    hi = js->nextents;
+    while (hi - lo > 1) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (js->extents[mid].off <= js->read_pos)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+
+    while (total < len && lo < js->nextents) {
+	struct journal_extent *ext = &js->extents[lo];
+	const uint32_t skip = (uint32_t)(js->read_pos - ext->off);
+	size_t n = ext->len - skip;
+
+	if (n > len - total)
+	    n = len - total;
+	if (!extent_read(ext, skip, cp + total, n))
+	    debug_return_ssize_t(-1);
+	total += n;
+	js->read_pos += n;
+	if (js->read_pos == ext->off + ext->len)
+	    lo++;
+    }
+
+    debug_return_ssize_t((ssize_t)total);
+}
+
+/*
+ * Move the read position back to the start of the session.
+ */
+void
+journal_session_rewind(struct journal_session *js)
+{
+    js->read_pos = 0;
+}
+
+/*
+ * Move the read position to just past the first message whose elapsed
+ * time is at least target, using the elapsed times stored in the record
+ * headers instead of reading the messages.  The elapsed time at the new
+ * read position is stored in elapsed.
+ * Returns false if the session ends before target.
+ */
+bool
+journal_session_seek(struct journal_session *js, const struct timespec *target,
+    struct timespec *elapsed)
+{
+    const uint64_t nsec = timespec_to_nsec(target);
+    size_t lo, hi;
+    debug_decl(journal_session_seek, SUDO_DEBUG_UTIL);
+
+    /* Skip extents before the read position. */
+    lo = 0;
+    hi = js->nextents;
+    while (lo < hi) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (js->extents[mid].off < js->read_pos)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    /* Elapsed time never decreases, find the first extent at target. */
+    hi = js->nextents;
+    while (lo < hi) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (js->extents[mid].elapsed < nsec)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (lo == js->nextents) {
+	js->read_pos = js->length;
+	debug_return_bool(false);
+    }
+
+    js->read_pos = js->extents[lo].off + js->extents[lo].len;
+    nsec_to_timespec(js->extents[lo].elapsed, elapsed);
+    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	"%s: skipped to offset %llu, extent %zu of %zu", js->name,
+	(unsigned long long)js->read_pos, lo, js->nextents);
+
+    debug_return_bool(true);
+}
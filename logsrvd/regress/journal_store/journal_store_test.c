@@ -0,0 +1,482 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudo_compat.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_iolog.h"
+#include "sudo_queue.h"
+#include "logsrvd.h"
+
+sudo_dso_public int main(int argc, char *argv[]);
+
+#define NSESSIONS	4
+#define SEGMENT_SIZE	8192
+
+/* Expected contents of each session's stream. */
+static struct expected {
+    struct journal_session *js;
+    char name[64];
+    uint8_t *data;
+    size_t len;
+    size_t size;
+    struct timespec elapsed;
+} sessions[NSESSIONS];
+
+static unsigned int seed = 1;
+static int ntests, errors;
+
+/* The store only needs the I/O log owner from the configuration. */
+uid_t
+logsrvd_conf_iolog_uid(void)
+{
+    return geteuid();
+}
+
+gid_t
+logsrvd_conf_iolog_gid(void)
+{
+    return getegid();
+}
+
+static unsigned int
+next_rand(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void
+expect_append(struct expected *exp, const uint8_t *buf, size_t len)
+{
+    if (exp->len + 4 + len > exp->size) {
+	exp->size = sudo_pow2_roundup(exp->len + 4 + len);
+	if ((exp->data = realloc(exp->data, exp->size)) == NULL)
+	    sudo_fatal(NULL);
+    }
+    exp->data[exp->len++] = (uint8_t)(len >> 24);
+    exp->data[exp->len++] = (uint8_t)(len >> 16);
+    exp->data[exp->len++] = (uint8_t)(len >> 8);
+    exp->data[exp->len++] = (uint8_t)len;
+    memcpy(exp->data + exp->len, buf, len);
+    exp->len += len;
+}
+
+/*
+ * Write a message of len bytes filled with ch to a session.
+ * Each message is 1-3ms after the previous one.
+ */
+static void
+write_msg(struct expected *exp, int ch, size_t len)
+{
+    uint8_t *buf;
+
+    if ((buf = malloc(len)) == NULL)
+	sudo_fatal(NULL);
+    memset(buf, ch, len);
+    exp->elapsed.tv_nsec += (long)(1 + next_rand() % 3) * 1000000;
+    if (exp->elapsed.tv_nsec >= 1000000000) {
+	exp->elapsed.tv_sec++;
+	exp->elapsed.tv_nsec -= 1000000000;
+    }
+    ntests++;
+    if (!journal_session_write(exp->js, buf, len, &exp->elapsed)) {
+	sudo_warnx("%s: unable to write %zu bytes", exp->name, len);
+	errors++;
+    } else {
+	expect_append(exp, buf, len);
+    }
+    free(buf);
+}
+
+/*
+ * Read back a session in odd-sized chunks and compare it.
+ */
+static void
+check_session(struct expected *exp, const char *what)
+{
+    uint8_t buf[97], *cp;
+    size_t total = 0;
+    ssize_t nread;
+
+    ntests++;
+    if (exp->js == NULL) {
+	sudo_warnx("%s: %s: missing session", what, exp->name);
+	errors++;
+	return;
+    }
+    journal_session_rewind(exp->js);
+    for (;;) {
+	nread = journal_session_read(exp->js, buf,
+	    1 + next_rand() % sizeof(buf));
+	if (nread <= 0)
+	    break;
+	cp = exp->data + total;
+	if (total + (size_t)nread > exp->len ||
+		memcmp(buf, cp, (size_t)nread) != 0) {
+	    sudo_warnx("%s: %s: mismatch at offset %zu", what, exp->name,
+		total);
+	    errors++;
+	    return;
+	}
+	total += (size_t)nread;
+    }
+    if (nread == -1 || total != exp->len) {
+	sudo_warnx("%s: %s: read %zu bytes, expected %zu", what, exp->name,
+	    total, exp->len);
+	errors++;
+    }
+    journal_session_rewind(exp->js);
+}
+
+static void
+reopen_store(const char *dir, off_t segment_size)
+{
+    int i;
+
+    journal_store_close();
+    for (i = 0; i < NSESSIONS; i++)
+	sessions[i].js = NULL;
+    if (!journal_store_open(dir, segment_size))
+	sudo_fatalx("unable to reopen journal store %s", dir);
+}
+
+/*
+ * Find a session after the store has been reopened.
+ * Unfinished sessions are looked up by name like a restart,
+ * finished ones via the list of sessions ready to relay.
+ */
+static struct journal_session *
+find_session(struct expected *exp, bool finished)
+{
+    struct journal_session *js = NULL;
+
+    if (!finished)
+	return journal_session_lookup(exp->name);
+    while ((js = journal_store_next_ready(js)) != NULL) {
+	if (strcmp(journal_session_name(js), exp->name) == 0) {
+	    if (!journal_session_attach(js))
+		return NULL;
+	    return js;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Damage the first run of len bytes of ch in the newest segment
+ * to simulate a torn write.
+ */
+static bool
+corrupt_msg(const char *dir, int ch, size_t len)
+{
+    char path[PATH_MAX], newest[NAME_MAX + 1] = "";
+    struct dirent *dent;
+    uint8_t buf[SEGMENT_SIZE];
+    ssize_t nread, i, n = 0;
+    DIR *dirp;
+    int fd;
+
+    if ((dirp = opendir(dir)) == NULL)
+	return false;
+    while ((dent = readdir(dirp)) != NULL) {
+	if (strncmp(dent->d_name, "segment.", 8) == 0 &&
+		strcmp(dent->d_name, newest) > 0)
+	    strlcpy(newest, dent->d_name, sizeof(newest));
+    }
+    closedir(dirp);
+
+    snprintf(path, sizeof(path), "%s/%s", dir, newest);
+    if ((fd = open(path, O_RDWR)) == -1)
+	return false;
+    nread = read(fd, buf, sizeof(buf));
+    for (i = 0; i < nread; i++) {
+	n = buf[i] == ch ? n + 1 : 0;
+	if ((size_t)n == len)
+	    break;
+    }
+    if (i == nread) {
+	close(fd);
+	return false;
+    }
+    i -= len / 2;
+    buf[i] ^= 0xff;
+    if (pwrite(fd, buf + i, 1, i) != 1) {
+	close(fd);
+	return false;
+    }
+    close(fd);
+    return true;
+}
+
+static void
+test_store(const char *dir)
+{
+    struct timespec resume, target, elapsed;
+    struct journal_session *js;
+    unsigned int nready = 0;
+    uint8_t *buf;
+    size_t len;
+    int i, j;
+
+    if (!journal_store_open(dir, SEGMENT_SIZE))
+	sudo_fatalx("unable to open journal store %s", dir);
+
+    /* Interleave writes from several sessions across many segments. */
+    for (i = 0; i < 3; i++) {
+	sessions[i].js = journal_session_create();
+	if (sessions[i].js == NULL)
+	    sudo_fatalx("unable to create session");
+	strlcpy(sessions[i].name, journal_session_name(sessions[i].js),
+	    sizeof(sessions[i].name));
+    }
+    for (j = 0; j < 200; j++) {
+	for (i = 0; i < 3; i++)
+	    write_msg(&sessions[i], 'a' + i, 1 + next_rand() % 300);
+	if (j == 49)
+	    resume = sessions[2].elapsed;
+    }
+    for (i = 0; i < 2; i++) {
+	ntests++;
+	if (!journal_session_finish(sessions[i].js)) {
+	    sudo_warnx("%s: unable to finish session", sessions[i].name);
+	    errors++;
+	}
+    }
+    for (i = 0; i < 3; i++)
+	check_session(&sessions[i], "write");
+
+    /* Rebuild the index from the segments. */
+    reopen_store(dir, SEGMENT_SIZE);
+    js = NULL;
+    while ((js = journal_store_next_ready(js)) != NULL)
+	nready++;
+    ntests++;
+    if (nready != 2) {
+	sudo_warnx("reopen: %u sessions ready, expected 2", nready);
+	errors++;
+    }
+    ntests++;
+    if (journal_session_lookup(sessions[0].name) != NULL) {
+	sudo_warnx("reopen: %s: finished session can be restarted",
+	    sessions[0].name);
+	errors++;
+    }
+    for (i = 0; i < 3; i++) {
+	sessions[i].js = find_session(&sessions[i], i < 2);
+	check_session(&sessions[i], "reopen");
+    }
+
+    /* Restart the unfinished session part way through. */
+    js = sessions[2].js;
+    len = 0;
+    for (j = 0; j < 50; j++) {
+	const uint8_t *cp = sessions[2].data + len;
+	len += 4 + (((size_t)cp[0] << 24) | ((size_t)cp[1] << 16) |
+	    ((size_t)cp[2] << 8) | cp[3]);
+    }
+    if ((buf = malloc(len)) == NULL)
+	sudo_fatal(NULL);
+    memcpy(buf, sessions[2].data, len);
+
+    /* Seeking uses the elapsed times recovered from the segments. */
+    target = sessions[2].elapsed;
+    target.tv_sec++;
+    ntests++;
+    if (journal_session_seek(js, &target, &elapsed)) {
+	sudo_warnx("%s: seek past the end succeeded", sessions[2].name);
+	errors++;
+    }
+    journal_session_rewind(js);
+    target = resume;
+    target.tv_nsec--;
+    ntests++;
+    if (!journal_session_seek(js, &target, &elapsed) ||
+	    sudo_timespeccmp(&elapsed, &resume, !=)) {
+	sudo_warnx("%s: inexact seek failed", sessions[2].name);
+	errors++;
+    }
+    journal_session_rewind(js);
+    ntests++;
+    if (!journal_session_seek(js, &resume, &elapsed) ||
+	    sudo_timespeccmp(&elapsed, &resume, !=) ||
+	    !journal_session_truncate(js)) {
+	sudo_warnx("%s: unable to truncate session", sessions[2].name);
+	errors++;
+    }
+    free(sessions[2].data);
+    sessions[2].data = buf;
+    sessions[2].len = sessions[2].size = len;
+    sessions[2].elapsed = resume;
+    for (j = 0; j < 20; j++)
+	write_msg(&sessions[2], 'x', 1 + next_rand() % 300);
+    check_session(&sessions[2], "truncate");
+    reopen_store(dir, SEGMENT_SIZE);
+    sessions[2].js = find_session(&sessions[2], false);
+    check_session(&sessions[2], "truncate reopen");
+
+    /* Relaying the finished sessions should free most segments. */
+    for (i = 0; i < 2; i++) {
+	js = find_session(&sessions[i], true);
+	ntests++;
+	if (js == NULL || !journal_session_done(js)) {
+	    sudo_warnx("%s: unable to remove session", sessions[i].name);
+	    errors++;
+	}
+    }
+    ntests++;
+    if (journal_store_nsegments() > 6) {
+	sudo_warnx("done: %u segments in use", journal_store_nsegments());
+	errors++;
+    }
+    check_session(&sessions[2], "done");
+    reopen_store(dir, SEGMENT_SIZE);
+    ntests++;
+    if (journal_store_next_ready(NULL) != NULL) {
+	sudo_warnx("done: relayed session still ready after reopen");
+	errors++;
+    }
+    sessions[2].js = find_session(&sessions[2], false);
+    check_session(&sessions[2], "done reopen");
+
+    /* A damaged final record is discarded at startup. */
+    sessions[3].js = journal_session_create();
+    if (sessions[3].js == NULL)
+	sudo_fatalx("unable to create session");
+    strlcpy(sessions[3].name, journal_session_name(sessions[3].js),
+	sizeof(sessions[3].name));
+    for (j = 0; j < 5; j++)
+	write_msg(&sessions[3], 'd', 100);
+    len = sessions[3].len;
+    write_msg(&sessions[3], 'z', 100);
+    journal_store_close();
+    ntests++;
+    if (!corrupt_msg(dir, 'z', 100)) {
+	sudo_warnx("unable to corrupt segment in %s", dir);
+	errors++;
+    }
+    sessions[3].len = len;
+    reopen_store(dir, SEGMENT_SIZE);
+    sessions[3].js = find_session(&sessions[3], false);
+    check_session(&sessions[3], "torn write");
+    journal_store_close();
+
+    for (i = 0; i < NSESSIONS; i++)
+	free(sessions[i].data);
+}
+
+/*
+ * Messages larger than the write buffer are written directly.
+ */
+static void
+test_large(const char *dir)
+{
+    struct expected exp = { NULL };
+
+    if (!journal_store_open(dir, 1024 * 1024))
+	sudo_fatalx("unable to open journal store %s", dir);
+    if ((exp.js = journal_session_create()) == NULL)
+	sudo_fatalx("unable to create session");
+    strlcpy(exp.name, journal_session_name(exp.js), sizeof(exp.name));
+    write_msg(&exp, 's', 10);
+    write_msg(&exp, 'L', 200 * 1024);
+    write_msg(&exp, 's', 10);
+    check_session(&exp, "large");
+    reopen_store(dir, 1024 * 1024);
+    exp.js = find_session(&exp, false);
+    check_session(&exp, "large reopen");
+    journal_store_close();
+    free(exp.data);
+}
+
+static void
+cleanup_dir(char *dir)
+{
+    const char *rmargs[] = { "rm", "-rf", NULL, NULL };
+    int status;
+
+    /* Avoid running via shell. */
+    rmargs[2] = dir;
+    switch (fork()) {
+    case -1:
+	sudo_warn("fork");
+	_exit(1);
+    case 0:
+	execvp("rm", (char **)rmargs);
+	_exit(1);
+    default:
+	wait(&status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    errors++;
+	break;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    char dir1[] = "journal.XXXXXX", dir2[] = "journal.XXXXXX";
+    int ch;
+
+    initprogname(argc > 0 ? argv[0] : "journal_store_test");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    /* ignore */
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    if (mkdtemp(dir1) == NULL || mkdtemp(dir2) == NULL)
+	sudo_fatal("unable to create test dir");
+    test_store(dir1);
+    test_large(dir2);
+    cleanup_dir(dir1);
+    cleanup_dir(dir2);
+
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    return errors;
+}
@@ -92,7 +92,8 @@ verify_peer_identity(int preverify_ok, X509_STORE_CTX *ctx)
      */
     result = validate_hostname(peer_cert,
 	peer_info->name ? peer_info->name : peer_info->ipaddr,
-	peer_info->ipaddr, peer_info->name ? 0 : 1);
+	peer_info->ipaddr,
+	peer_info->name ? HOSTCHECK_NO_RESOLVE : HOSTCHECK_RESOLVE);
 
     debug_return_int(result == MatchFound);
 }
@@ -50,6 +50,7 @@
 
 #define DEFAULT_CIPHER_LST12 "HIGH:!aNULL"
 #define DEFAULT_CIPHER_LST13 "TLS_AES_256_GCM_SHA384"
+#define TLS_SESSION_ID_CONTEXT "sudo_logsrvd"
 
 #if defined(HAVE_OPENSSL)
 # include <openssl/bio.h>
@@ -357,6 +358,21 @@ init_tls_context(const char *ca_bundle_file, const char *cert_file,
 	goto bad;
     }
 
+    /*
+     * Allow session resumption, which avoids the certificate exchange
+     * and verification of a full handshake.  A session ID context is
+     * required to resume sessions when the peer's cert is verified.
+     */
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_BOTH);
+    if (!SSL_CTX_set_session_id_context(ctx,
+	    (const unsigned char *)TLS_SESSION_ID_CONTEXT,
+	    sizeof(TLS_SESSION_ID_CONTEXT) - 1)) {
+	errstr = ERR_reason_error_string(ERR_get_error());
+	sudo_warnx("SSL_CTX_set_session_id_context: %s",
+	    errstr ? errstr : strerror(errno));
+	goto bad;
+    }
+
     /*
      * Load diffie-hellman parameters from a file if specified.
      * Failure to open the file is not a fatal error.
@@ -31,6 +31,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
 #include <string.h>
 #include <errno.h>
 
@@ -206,6 +211,27 @@ no_aliases(const struct sudoers_parse_tree *parse_tree)
 	rbisempty(parse_tree->aliases));
 }
 
+/*
+ * Free the flattened member list of an alias, if any.
+ * The members themselves are owned by the aliases they came from.
+ */
+static void
+alias_free_expansion(struct alias *a)
+{
+    struct member *m;
+    debug_decl(alias_free_expansion, SUDOERS_DEBUG_ALIAS);
+
+    if (a->expanded) {
+	while ((m = TAILQ_FIRST(&a->expansion)) != NULL) {
+	    TAILQ_REMOVE(&a->expansion, m, entries);
+	    free(m);
+	}
+	a->expanded = false;
+    }
+
+    debug_return;
+}
+
 /*
  * Free memory used by an alias struct and its members.
  */
@@ -216,6 +242,7 @@ alias_free(void *v)
     debug_decl(alias_free, SUDOERS_DEBUG_ALIAS);
 
     if (a != NULL) {
+	alias_free_expansion(a);
 	free(a->name);
 	sudo_rcstr_delref(a->file);
 	free_members(&a->members);
@@ -239,13 +266,41 @@ alias_remove(struct sudoers_parse_tree *parse_tree, const char *name,
     if (parse_tree->aliases != NULL) {
 	key.name = (char *)name;
 	key.type = type;
-	if ((node = rbfind(parse_tree->aliases, &key)) != NULL)
-	    debug_return_ptr(rbdelete(parse_tree->aliases, node));
+	if ((node = rbfind(parse_tree->aliases, &key)) != NULL) {
+	    struct alias *a = rbdelete(parse_tree->aliases, node);
+	    alias_free_expansion(a);
+	    debug_return_ptr(a);
+	}
     }
     errno = ENOENT;
     debug_return_ptr(NULL);
 }
 
+/*
+ * Insert an existing alias, such as one returned by alias_remove(),
+ * into a parse tree.  The parse tree takes ownership of the alias.
+ * Returns true on success and false on failure, setting errno.
+ */
+bool
+alias_insert(struct sudoers_parse_tree *parse_tree, struct alias *a)
+{
+    debug_decl(alias_insert, SUDOERS_DEBUG_ALIAS);
+
+    if (parse_tree->aliases == NULL) {
+	if ((parse_tree->aliases = alloc_aliases()) == NULL)
+	    debug_return_bool(false);
+    }
+
+    switch (rbinsert(parse_tree->aliases, a, NULL)) {
+    case 1:
+	errno = EEXIST;
+	debug_return_bool(false);
+    case -1:
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
 struct rbtree *
 alloc_aliases(void)
 {
@@ -378,3 +433,148 @@ alias_find_used(struct sudoers_parse_tree *parse_tree, struct rbtree *used_alias
 
     debug_return_bool(errors ? false : true);
 }
+
+/*
+ * Comparison function for the red-black tree of members already
+ * present in an alias expansion.  Command members are compared by
+ * address, everything else by type and name.
+ */
+static int
+expanded_member_compare(const void *v1, const void *v2)
+{
+    const struct member *m1 = v1;
+    const struct member *m2 = v2;
+
+    if (m1->type != m2->type)
+	return m1->type - m2->type;
+    if (m1->name == m2->name)
+	return 0;
+    if (m1->name == NULL || m2->name == NULL)
+	return m1->name == NULL ? -1 : 1;
+    return strcmp(m1->name, m2->name);
+}
+
+static int
+expanded_cmnd_compare(const void *v1, const void *v2)
+{
+    const struct member *m1 = v1;
+    const struct member *m2 = v2;
+
+    if (m1->name == m2->name)
+	return 0;
+    return (uintptr_t)m1->name < (uintptr_t)m2->name ? -1 : 1;
+}
+
+/*
+ * Add the members of list to the expansion of an alias of the
+ * specified type, inlining nested aliases.  Lists are matched last
+ * entry first and the first match wins, so members are visited in
+ * that order and a member that duplicates one already seen is
+ * dropped since it can never be reached.  A reference to an alias
+ * that is undefined or recursive is kept as a plain WORD, which is
+ * how the match functions treat it (Cmnd_Alias references are
+ * ignored instead).  Negation of an alias reference is folded into
+ * its members.  The copies share the name of the original member,
+ * so after an alias is freed the expansions must be rebuilt before
+ * matching again (see sudoers_reload()).
+ * Returns true on success, false on allocation failure.
+ */
+static bool
+alias_expand_members(const struct sudoers_parse_tree *parse_tree,
+    const struct member_list *list, bool negated, short alias_type,
+    struct rbtree *seen, struct member_list *expansion)
+{
+    struct member *m, *copy;
+    struct alias *a;
+    bool ok;
+    debug_decl(alias_expand_members, SUDOERS_DEBUG_ALIAS);
+
+    TAILQ_FOREACH_REVERSE(m, list, member_list, entries) {
+	if (m->type == ALIAS) {
+	    a = alias_get(parse_tree, m->name, alias_type);
+	    if (a != NULL) {
+		ok = alias_expand_members(parse_tree, &a->members,
+		    negated != (bool)m->negated, alias_type, seen, expansion);
+		alias_put(a);
+		if (!ok)
+		    debug_return_bool(false);
+		continue;
+	    }
+	    if (alias_type == CMNDALIAS)
+		continue;
+	}
+
+	if ((copy = malloc(sizeof(*copy))) == NULL)
+	    debug_return_bool(false);
+	copy->name = m->name;
+	copy->type = m->type == ALIAS ? WORD : m->type;
+	copy->negated = negated != (bool)m->negated;
+	switch (rbinsert(seen, copy, NULL)) {
+	case 0:
+	    TAILQ_INSERT_HEAD(expansion, copy, entries);
+	    break;
+	case 1:
+	    /* Shadowed by an earlier match. */
+	    free(copy);
+	    break;
+	default:
+	    free(copy);
+	    debug_return_bool(false);
+	}
+    }
+    debug_return_bool(true);
+}
+
+static int
+alias_expand_func(struct sudoers_parse_tree *parse_tree, struct alias *a,
+    void *v)
+{
+    bool *errors = v;
+    struct rbtree *seen;
+    bool ok = false;
+    debug_decl(alias_expand_func, SUDOERS_DEBUG_ALIAS);
+
+    alias_free_expansion(a);
+    TAILQ_INIT(&a->expansion);
+    a->expanded = true;
+
+    seen = rbcreate(a->type == CMNDALIAS ?
+	expanded_cmnd_compare : expanded_member_compare);
+    if (seen != NULL) {
+	/* Mark alias in use so a reference back to it is a loop. */
+	a->used = true;
+	ok = alias_expand_members(parse_tree, &a->members, false, a->type,
+	    seen, &a->expansion);
+	a->used = false;
+	rbdestroy(seen, NULL);
+    }
+    if (!ok) {
+	/* Fall back on the unexpanded member list. */
+	alias_free_expansion(a);
+	*errors = true;
+    }
+    debug_return_int(0);
+}
+
+/*
+ * Flatten the member list of every alias in parse_tree so that
+ * matching an alias does not need to look up and recurse into
+ * nested aliases.  The original member lists are left intact for
+ * display and conversion.  Must be called again if aliases are
+ * added to, removed from or modified in the parse tree.
+ * Returns true on success, false if an alias could not be expanded.
+ */
+bool
+alias_expand(struct sudoers_parse_tree *parse_tree)
+{
+    bool errors = false;
+    debug_decl(alias_expand, SUDOERS_DEBUG_ALIAS);
+
+    alias_apply(parse_tree, alias_expand_func, &errors);
+    if (errors) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unable to expand aliases");
+    }
+
+    debug_return_bool(!errors);
+}
@@ -491,6 +491,9 @@ set_callbacks(void)
     /* Set iolog_mode callback. */
     sudo_defs_table[I_IOLOG_MODE].callback = cb_iolog_mode;
 
+    /* Set compress_io_streams callback. */
+    sudo_defs_table[I_COMPRESS_IO_STREAMS].callback = cb_compress_io_streams;
+
     /* Set timestampowner callback. */
     sudo_defs_table[I_TIMESTAMPOWNER].callback = cb_timestampowner;
 
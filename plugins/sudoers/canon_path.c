@@ -32,9 +32,9 @@
 #include <errno.h>
 
 #include "sudoers.h"
-#include "redblack.h"
+#include "hashtab.h"
 
-static struct rbtree *canon_cache;
+static struct hashtab *canon_cache;
 
 /*
  * A cache_item includes storage for both the original path and the
@@ -61,6 +61,16 @@ compare(const void *v1, const void *v2)
     return strcmp(ci1->pathname, ci2->pathname);
 }
 
+/*
+ * Hash function for canon_cache.
+ */
+static unsigned int
+hash(const void *v)
+{
+    const struct cache_item *ci = (const struct cache_item *)v;
+    return hthash_string(HTHASH_INIT, ci->pathname);
+}
+
 /* Convert a pointer returned by canon_path() to a struct cache_item *. */
 #define resolved_to_item(_r) ((struct cache_item *)((_r) - offsetof(struct cache_item, resolved)))
 
@@ -103,7 +113,7 @@ canon_path_free_cache(void)
     debug_decl(canon_path_free_cache, SUDOERS_DEBUG_UTIL);
 
     if (canon_cache != NULL) {
-	rbdestroy(canon_cache, canon_path_free_item);
+	htdestroy(canon_cache, canon_path_free_item);
 	canon_cache = NULL;
     }
 
@@ -120,11 +130,11 @@ canon_path(const char *inpath)
     size_t item_size, inlen, reslen = 0;
     char *resolved, resbuf[PATH_MAX];
     struct cache_item key, *item;
-    struct rbnode *node = NULL;
+    struct htnode *node = NULL;
     debug_decl(canon_path, SUDOERS_DEBUG_UTIL);
 
     if (canon_cache == NULL) {
-	canon_cache = rbcreate(compare);
+	canon_cache = htcreate(hash, compare);
 	if (canon_cache == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_str(NULL);
@@ -132,7 +142,7 @@ canon_path(const char *inpath)
     } else {
 	/* Check cache. */
 	key.pathname = (char *)inpath;
-	if ((node = rbfind(canon_cache, &key)) != NULL) {
+	if ((node = htfind(canon_cache, &key)) != NULL) {
 	    item = node->data;
 	    goto done;
 	}
@@ -168,7 +178,7 @@ canon_path(const char *inpath)
     memcpy(item->pathname, inpath, inlen);
     item->pathname[inlen] = '\0';
     item->refcnt = 1;
-    switch (rbinsert(canon_cache, item, NULL)) {
+    switch (htinsert(canon_cache, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
@@ -27,6 +27,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,6 +58,8 @@
 /* Long-only options values. */
 #define OPT_GROUP_FILE	256
 #define OPT_PASSWD_FILE	257
+#define OPT_HOST_LIST	258
+#define OPT_JOBS	259
 
 /*
  * Globals
@@ -85,13 +89,18 @@ static struct option long_opts[] = {
     { "version",	no_argument,		NULL,	'V' },
     { "group-file",	required_argument,	NULL,	OPT_GROUP_FILE },
     { "passwd-file",	required_argument,	NULL,	OPT_PASSWD_FILE },
+    { "host-list",	required_argument,	NULL,	OPT_HOST_LIST },
+    { "jobs",		required_argument,	NULL,	OPT_JOBS },
     { NULL,		no_argument,		NULL,	0 },
 };
 
 sudo_dso_public int main(int argc, char *argv[]);
 static bool convert_sudoers_sudoers(struct sudoers_parse_tree *parse_tree, const char *output_file, struct cvtsudoers_config *conf);
+static bool convert_sudoers(struct sudoers_parse_tree *parse_tree, const char *output_file, enum sudoers_formats output_format, struct cvtsudoers_config *conf);
+static bool convert_sudoers_batch(struct sudoers_parse_tree *parse_tree, const char *host_list, const char *output_dir, enum sudoers_formats output_format, struct cvtsudoers_config *conf, unsigned int jobs);
 static bool parse_sudoers(const char *input_file, struct cvtsudoers_config *conf);
 static bool parse_ldif(struct sudoers_parse_tree *parse_tree, const char *input_file, struct cvtsudoers_config *conf);
+static void cvtsudoers_filter_init(void);
 static bool cvtsudoers_parse_filter(char *expression);
 static struct cvtsudoers_config *cvtsudoers_conf_read(const char *conf_file);
 static void cvtsudoers_conf_free(struct cvtsudoers_config *conf);
@@ -116,7 +125,9 @@ main(int argc, char *argv[])
     const char *output_file = "-";
     const char *conf_file = NULL;
     const char *grfile = NULL, *pwfile = NULL;
+    const char *host_list = NULL;
     const char *cp, *errstr;
+    unsigned int jobs = 0;
     int ch, exitcode = EXIT_FAILURE;
     bool match_local = false;
     debug_decl(main, SUDOERS_DEBUG_MAIN);
@@ -260,6 +271,16 @@ main(int argc, char *argv[])
 	case OPT_PASSWD_FILE:
 	    pwfile = optarg;
 	    break;
+	case OPT_HOST_LIST:
+	    host_list = optarg;
+	    break;
+	case OPT_JOBS:
+	    jobs = (unsigned int)sudo_strtonum(optarg, 1, 1024, &errstr);
+	    if (errstr != NULL) {
+		sudo_warnx(U_("number of jobs: %s: %s"), optarg, U_(errstr));
+		usage();
+	    }
+	    break;
 	default:
 	    usage();
 	    /* NOTREACHED */
@@ -307,6 +328,56 @@ main(int argc, char *argv[])
 	if (!cvtsudoers_parse_filter(conf->filter))
 	    usage();
     }
+    if (host_list != NULL) {
+	/*
+	 * In batch mode, the host filter is supplied by the host list
+	 * and output_file is the directory to store the policies in.
+	 */
+	struct stat sb;
+
+	cvtsudoers_filter_init();
+	if (!STAILQ_EMPTY(&filters->hosts)) {
+	    sudo_warnx("%s",
+		U_("a host filter may not be used with a host list"));
+	    usage();
+	}
+	if (strcmp(output_file, "-") == 0) {
+	    sudo_warnx("%s",
+		U_("an output directory must be specified with a host list"));
+	    usage();
+	}
+	if (strcmp(host_list, "-") == 0) {
+	    /* Input files are read from stdin by default. */
+	    bool uses_stdin = argc == 0;
+	    int i;
+
+	    for (i = 0; i < argc && !uses_stdin; i++) {
+		cp = strrchr(argv[i], ':');
+		uses_stdin = strcmp(cp ? cp + 1 : argv[i], "-") == 0;
+	    }
+	    if (uses_stdin) {
+		sudo_warnx("%s", U_("the host list and the input file may "
+		    "not both be read from the standard input"));
+		usage();
+	    }
+	}
+	if (stat(output_file, &sb) == -1)
+	    sudo_fatal(U_("unable to stat %s"), output_file);
+	if (!S_ISDIR(sb.st_mode))
+	    sudo_fatalx(U_("%s: %s"), output_file, strerror(ENOTDIR));
+	if (jobs == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	    jobs = ncpus > 0 && ncpus <= 1024 ? (unsigned int)ncpus : 1;
+#else
+	    jobs = 1;
+#endif
+	}
+    } else if (jobs != 0) {
+	sudo_warnx("%s",
+	    U_("the number of jobs may only be set with a host list"));
+	usage();
+    }
     if (conf->defstr != NULL) {
 	conf->defaults = cvtsudoers_parse_defaults(conf->defstr);
 	if (conf->defaults == (unsigned int)-1)
@@ -342,7 +413,7 @@ main(int argc, char *argv[])
     }
 
     /* Set pwutil backend to use the filter data. */
-    if (conf->filter != NULL && !match_local) {
+    if (filters != NULL && !match_local) {
 	sudo_pwutil_set_backend(cvtsudoers_make_pwitem, cvtsudoers_make_gritem,
 	    cvtsudoers_make_gidlist_item, cvtsudoers_make_grlist_item);
     } else {
@@ -438,21 +509,12 @@ main(int argc, char *argv[])
 	parse_tree = merge_sudoers(&parse_trees, &merged_tree);
     }
 
-    switch (output_format) {
-    case format_csv:
-	exitcode = !convert_sudoers_csv(parse_tree, output_file, conf);
-	break;
-    case format_json:
-	exitcode = !convert_sudoers_json(parse_tree, output_file, conf);
-	break;
-    case format_ldif:
-	exitcode = !convert_sudoers_ldif(parse_tree, output_file, conf);
-	break;
-    case format_sudoers:
-	exitcode = !convert_sudoers_sudoers(parse_tree, output_file, conf);
-	break;
-    default:
-	sudo_fatalx("error: unhandled output format %d", output_format);
+    if (host_list != NULL) {
+	exitcode = !convert_sudoers_batch(parse_tree, host_list, output_file,
+	    output_format, conf, jobs);
+    } else {
+	exitcode = !convert_sudoers(parse_tree, output_file, output_format,
+	    conf);
     }
 
 done:
@@ -684,11 +746,10 @@ cvtsudoers_parse_suppression(char *expression)
     debug_return_uint(flags);
 }
 
-static bool
-cvtsudoers_parse_filter(char *expression)
+static void
+cvtsudoers_filter_init(void)
 {
-    char *last, *cp = expression;
-    debug_decl(cvtsudoers_parse_filter, SUDOERS_DEBUG_UTIL);
+    debug_decl(cvtsudoers_filter_init, SUDOERS_DEBUG_UTIL);
 
     if (filters == NULL) {
 	if ((filters = malloc(sizeof(*filters))) == NULL) {
@@ -701,6 +762,17 @@ cvtsudoers_parse_filter(char *expression)
 	STAILQ_INIT(&filters->cmnds);
     }
 
+    debug_return;
+}
+
+static bool
+cvtsudoers_parse_filter(char *expression)
+{
+    char *last, *cp = expression;
+    debug_decl(cvtsudoers_parse_filter, SUDOERS_DEBUG_UTIL);
+
+    cvtsudoers_filter_init();
+
     for ((cp = strtok_r(cp, ",", &last)); cp != NULL; (cp = strtok_r(NULL, ",", &last))) {
 	/*
 	 * Filter expression:
@@ -1510,13 +1582,243 @@ done:
     debug_return_bool(ret);
 }
 
+/*
+ * Write parse_tree to output_file in the specified format.
+ */
+static bool
+convert_sudoers(struct sudoers_parse_tree *parse_tree, const char *output_file,
+    enum sudoers_formats output_format, struct cvtsudoers_config *conf)
+{
+    bool ret;
+    debug_decl(convert_sudoers, SUDOERS_DEBUG_UTIL);
+
+    switch (output_format) {
+    case format_csv:
+	ret = convert_sudoers_csv(parse_tree, output_file, conf);
+	break;
+    case format_json:
+	ret = convert_sudoers_json(parse_tree, output_file, conf);
+	break;
+    case format_ldif:
+	ret = convert_sudoers_ldif(parse_tree, output_file, conf);
+	break;
+    case format_sudoers:
+	ret = convert_sudoers_sudoers(parse_tree, output_file, conf);
+	break;
+    default:
+	sudo_fatalx("error: unhandled output format %d", output_format);
+    }
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Compare two host names without regard to case.
+ */
+static int
+host_name_cmp(const void *v1, const void *v2)
+{
+    const struct sudoers_string *s1 = v1;
+    const struct sudoers_string *s2 = v2;
+
+    return strcasecmp(s1->str, s2->str);
+}
+
+/*
+ * Read the host list, one host name per line.
+ * Blank lines and comments are ignored.
+ * Each host gets its own output file, so duplicate host names
+ * (ignoring case) are skipped.
+ */
+static struct sudoers_str_list *
+read_host_list(const char *path)
+{
+    struct sudoers_str_list *hosts;
+    struct sudoers_string *s;
+    struct rbtree *seen;
+    char *line = NULL;
+    size_t linesize = 0;
+    FILE *fp = stdin;
+    debug_decl(read_host_list, SUDOERS_DEBUG_UTIL);
+
+    if (strcmp(path, "-") != 0) {
+	if ((fp = fopen(path, "r")) == NULL) {
+	    sudo_warn(U_("unable to open %s"), path);
+	    debug_return_ptr(NULL);
+	}
+    }
+    hosts = str_list_alloc();
+    seen = rbcreate(host_name_cmp);
+    if (hosts == NULL || seen == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+
+    while (sudo_parseln(&line, &linesize, NULL, fp, 0) != -1) {
+	if (*line == '\0')
+	    continue;		/* skip empty line */
+
+	/* The host name is used as the output file name. */
+	if (strchr(line, '/') != NULL || strcmp(line, ".") == 0 ||
+		strcmp(line, "..") == 0) {
+	    sudo_warnx(U_("%s: invalid host name %s"), path, line);
+	    str_list_free(hosts);
+	    hosts = NULL;
+	    break;
+	}
+	if ((s = sudoers_string_alloc(line)) == NULL) {
+	    sudo_fatalx(U_("%s: %s"), __func__,
+		U_("unable to allocate memory"));
+	}
+	switch (rbinsert(seen, s, NULL)) {
+	case 0:
+	    STAILQ_INSERT_TAIL(hosts, s, entries);
+	    break;
+	case 1:
+	    sudo_warnx(U_("%s: ignoring duplicate host name %s"), path, line);
+	    sudoers_string_free(s);
+	    break;
+	default:
+	    sudo_fatalx(U_("%s: %s"), __func__,
+		U_("unable to allocate memory"));
+	}
+    }
+    rbdestroy(seen, NULL);
+    free(line);
+    if (fp != stdin)
+	fclose(fp);
+
+    debug_return_ptr(hosts);
+}
+
+/*
+ * Filter parse_tree for a single host and write the result to output_file.
+ * Called in a child process, the filters modify the child's copy of the tree.
+ */
+static bool
+convert_sudoers_host(struct sudoers_parse_tree *parse_tree, const char *host,
+    const char *output_file, enum sudoers_formats output_format,
+    struct cvtsudoers_config *conf)
+{
+    struct sudoers_string *s;
+    debug_decl(convert_sudoers_host, SUDOERS_DEBUG_UTIL);
+
+    if ((s = sudoers_string_alloc(host)) == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    STAILQ_INSERT_TAIL(&filters->hosts, s, entries);
+
+    filter_userspecs(parse_tree, conf);
+    filter_defaults(parse_tree, conf);
+    alias_remove_unused(parse_tree);
+    if (conf->prune_matches && conf->expand_aliases)
+	alias_prune(parse_tree, conf);
+
+    debug_return_bool(convert_sudoers(parse_tree, output_file, output_format,
+	conf));
+}
+
+/*
+ * Wait for a batch job to finish.
+ * Returns true if it exited successfully, else false.
+ */
+static bool
+wait_for_job(void)
+{
+    int status;
+    debug_decl(wait_for_job, SUDOERS_DEBUG_UTIL);
+
+    while (waitpid(-1, &status, 0) == -1) {
+	if (errno != EINTR) {
+	    sudo_warn("%s", U_("unable to wait for child process"));
+	    debug_return_bool(false);
+	}
+    }
+    debug_return_bool(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/*
+ * Generate a filtered policy for each host in host_list, writing
+ * the output to a file named after the host in output_dir.
+ * The input is only parsed once; each host is filtered and converted
+ * in its own process, up to "jobs" at a time, using a copy-on-write
+ * view of the parse tree.
+ */
+static bool
+convert_sudoers_batch(struct sudoers_parse_tree *parse_tree,
+    const char *host_list, const char *output_dir,
+    enum sudoers_formats output_format, struct cvtsudoers_config *conf,
+    unsigned int jobs)
+{
+    struct sudoers_str_list *hosts;
+    struct sudoers_string *s;
+    unsigned int running = 0;
+    char output_file[PATH_MAX];
+    bool ret = true;
+    int len;
+    pid_t pid;
+    debug_decl(convert_sudoers_batch, SUDOERS_DEBUG_UTIL);
+
+    if ((hosts = read_host_list(host_list)) == NULL)
+	debug_return_bool(false);
+
+    STAILQ_FOREACH(s, hosts, entries) {
+	len = snprintf(output_file, sizeof(output_file), "%s/%s",
+	    output_dir, s->str);
+	if (len < 0 || (size_t)len >= sizeof(output_file)) {
+	    sudo_warnx(U_("%s/%s: %s"), output_dir, s->str,
+		strerror(ENAMETOOLONG));
+	    ret = false;
+	    continue;
+	}
+
+	/* Limit the number of concurrent jobs. */
+	while (running >= jobs) {
+	    if (!wait_for_job())
+		ret = false;
+	    running--;
+	}
+
+	/* Don't let the child inherit buffered output. */
+	(void)fflush(NULL);
+	switch (pid = fork()) {
+	case -1:
+	    sudo_warn("%s", U_("unable to fork"));
+	    ret = false;
+	    goto done;
+	case 0:
+	    /* child */
+	    if (!convert_sudoers_host(parse_tree, s->str, output_file,
+		    output_format, conf)) {
+		_exit(EXIT_FAILURE);
+	    }
+	    (void)fflush(NULL);
+	    _exit(EXIT_SUCCESS);
+	default:
+	    sudo_debug_printf(SUDO_DEBUG_INFO,
+		"%s: converting policy for %s in process %d", __func__,
+		s->str, (int)pid);
+	    running++;
+	    break;
+	}
+    }
+
+done:
+    while (running > 0) {
+	if (!wait_for_job())
+	    ret = false;
+	running--;
+    }
+    str_list_free(hosts);
+
+    debug_return_bool(ret);
+}
+
 static void
 display_usage(FILE *fp)
 {
     (void) fprintf(fp, "usage: %s [-ehMpV] [-b dn] "
 	"[-c conf_file ] [-d deftypes] [-f output_format] [-i input_format] "
 	"[-I increment] [-m filter] [-o output_file] [-O start_point] "
-	"[-P padding] [-s sections] [input_file]\n", getprogname());
+	"[-P padding] [-s sections] [--host-list=file] [--jobs=num] "
+	"[input_file]\n", getprogname());
 }
 
 sudo_noreturn static void
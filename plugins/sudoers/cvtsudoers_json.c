@@ -45,6 +45,33 @@ struct json_alias_closure {
     short alias_type;
 };
 
+/*
+ * The JSON buffer is written out after each top-level entry so that
+ * memory usage does not depend on the size of the policy.
+ */
+static FILE *json_output_fp;
+static bool json_output_started;
+
+/*
+ * Write out and clear any buffered JSON text.
+ */
+static void
+flush_json(struct json_container *jsonc)
+{
+    debug_decl(flush_json, SUDOERS_DEBUG_UTIL);
+
+    if (sudo_json_get_len(jsonc) != 0) {
+	if (!json_output_started) {
+	    putc('{', json_output_fp);
+	    json_output_started = true;
+	}
+	fputs(sudo_json_get_buf(jsonc), json_output_fp);
+	sudo_json_clear_buf(jsonc);
+    }
+
+    debug_return;
+}
+
 /*
  * Type values used to disambiguate the generic WORD and ALIAS types.
  */
@@ -364,6 +391,7 @@ print_alias_json(struct sudoers_parse_tree *parse_tree, struct alias *a,
 	print_member_json(closure->jsonc, parse_tree, m,
 	    alias_to_word_type(closure->alias_type), false);
     }
+    flush_json(closure->jsonc);
     debug_return_int(0);
 }
 
@@ -521,6 +549,7 @@ print_defaults_json(struct json_container *jsonc,
 	}
 	sudo_json_close_array(jsonc);
 	sudo_json_close_object(jsonc);
+	flush_json(jsonc);
     }
 
     /* Close Defaults array; comma (if any) & newline will be printer later. */
@@ -879,6 +908,7 @@ print_userspecs_json(struct json_container *jsonc,
     sudo_json_open_array(jsonc, "User_Specs");
     TAILQ_FOREACH(us, &parse_tree->userspecs, entries) {
 	print_userspec_json(jsonc, parse_tree, us, expand_aliases);
+	flush_json(jsonc);
     }
     sudo_json_close_array(jsonc);
 
@@ -904,6 +934,8 @@ convert_sudoers_json(const struct sudoers_parse_tree *parse_tree,
 
     /* 4 space indent, non-compact, exit on memory allocation failure. */
     sudo_json_init(&jsonc, 4, false, true, false);
+    json_output_fp = output_fp;
+    json_output_started = false;
 
     /* Dump Defaults in JSON format. */
     if (!ISSET(conf->suppress, SUPPRESS_DEFAULTS)) {
@@ -920,10 +952,9 @@ convert_sudoers_json(const struct sudoers_parse_tree *parse_tree,
 	print_userspecs_json(&jsonc, parse_tree, conf->expand_aliases);
     }
 
-    /* Write JSON output. */
-    if (sudo_json_get_len(&jsonc) != 0) {
-	putc('{', output_fp);
-	fputs(sudo_json_get_buf(&jsonc), output_fp);
+    /* Write remaining JSON output. */
+    flush_json(&jsonc);
+    if (json_output_started) {
 	fputs("\n}\n", output_fp);
 	(void)fflush(output_fp);
 	if (ferror(output_fp))
@@ -32,6 +32,7 @@
 #include <errno.h>
 
 #include "sudoers.h"
+#include "hashtab.h"
 #include "redblack.h"
 #include "cvtsudoers.h"
 #include <gram.h>
@@ -763,75 +764,327 @@ defaults_list_equivalent(struct defaults_list *dl1, struct defaults_list *dl2)
     debug_return_bool(true);
 }
 
+/*
+ * Structural fingerprints used to find candidate duplicates without
+ * comparing every entry against every entry in subsequent sudoers.
+ * Two entries that are considered equivalent (or overridden) by the
+ * comparison functions above always have the same fingerprint.
+ * Anything those functions do not compare exactly, such as user and
+ * host lists or command tags, is left out.
+ */
+static unsigned int
+fingerprint_str(unsigned int h, const char *str)
+{
+    if (str == NULL)
+	return hthash_bytes(h, "\377", 1);
+    return hthash_bytes(h, str, strlen(str) + 1);
+}
+
+static unsigned int
+fingerprint_member(unsigned int h, struct member *m)
+{
+    h = hthash_bytes(h, &m->type, sizeof(m->type));
+    h = hthash_bytes(h, &m->negated, sizeof(m->negated));
+    if (m->type == COMMAND) {
+	struct sudo_command *c = (struct sudo_command *)m->name;
+	struct command_digest *digest;
+
+	h = fingerprint_str(h, c->cmnd);
+	h = fingerprint_str(h, c->args);
+	TAILQ_FOREACH(digest, &c->digests, entries) {
+	    h = hthash_bytes(h, &digest->digest_type,
+		sizeof(digest->digest_type));
+	    h = fingerprint_str(h, digest->digest_str);
+	}
+    } else if (m->type != ALL) {
+	/* The name of ALL may be a struct sudo_command. */
+	h = fingerprint_str(h, m->name);
+    }
+    return h;
+}
+
+static unsigned int
+fingerprint_defaults(unsigned int h, struct defaults *d)
+{
+    struct member *m;
+
+    h = fingerprint_str(h, d->var);
+    h = fingerprint_str(h, d->val);
+    h = hthash_bytes(h, &d->type, sizeof(d->type));
+    h = hthash_bytes(h, &d->op, sizeof(d->op));
+    if (d->type != DEFAULTS) {
+	TAILQ_FOREACH(m, &d->binding->members, entries) {
+	    h = fingerprint_member(h, m);
+	}
+    }
+    return h;
+}
+
+static unsigned int
+fingerprint_cmndspec(unsigned int h, struct cmndspec *cs)
+{
+    const bool has_runasuser = cs->runasuserlist != NULL;
+    const bool has_runasgroup = cs->runasgrouplist != NULL;
+
+    /* Runas lists are checked for overrides so only their presence counts. */
+    h = hthash_bytes(h, &has_runasuser, sizeof(has_runasuser));
+    h = hthash_bytes(h, &has_runasgroup, sizeof(has_runasgroup));
+    h = fingerprint_member(h, cs->cmnd);
+    h = hthash_bytes(h, &cs->timeout, sizeof(cs->timeout));
+    h = hthash_bytes(h, &cs->notbefore, sizeof(cs->notbefore));
+    h = hthash_bytes(h, &cs->notafter, sizeof(cs->notafter));
+    h = fingerprint_str(h, cs->runcwd);
+    h = fingerprint_str(h, cs->runchroot);
+#ifdef HAVE_SELINUX
+    h = fingerprint_str(h, cs->role);
+    h = fingerprint_str(h, cs->type);
+#endif
+#ifdef HAVE_APPARMOR
+    h = fingerprint_str(h, cs->apparmor_profile);
+#endif
+#ifdef HAVE_PRIV_SET
+    h = fingerprint_str(h, cs->privs);
+    h = fingerprint_str(h, cs->limitprivs);
+#endif
+    return h;
+}
+
+static unsigned int
+fingerprint_userspec(struct userspec *us)
+{
+    unsigned int h = HTHASH_INIT;
+    struct privilege *priv;
+    struct cmndspec *cs;
+    struct defaults *d;
+
+    TAILQ_FOREACH(priv, &us->privileges, entries) {
+	TAILQ_FOREACH(d, &priv->defaults, entries) {
+	    h = fingerprint_defaults(h, d);
+	}
+	TAILQ_FOREACH(cs, &priv->cmndlist, entries) {
+	    h = fingerprint_cmndspec(h, cs);
+	}
+	/* Privilege separator. */
+	h = hthash_bytes(h, "\0", 1);
+    }
+    return h;
+}
+
+/*
+ * An index of Defaults or userspecs in all the parse trees, bucketed
+ * by fingerprint.  Entries in a bucket are stored in parse tree order
+ * and, within a parse tree, in list order.  Buckets are keyed by the
+ * fingerprint alone; a fingerprint collision just adds a candidate.
+ */
+struct merge_entry {
+    unsigned int tree;		/* index of the parse tree */
+    void *data;
+};
+
+struct merge_bucket {
+    unsigned int hash;
+    size_t count;
+    size_t size;
+    struct merge_entry *entries;
+};
+
+static unsigned int
+merge_bucket_hash(const void *v)
+{
+    return ((const struct merge_bucket *)v)->hash;
+}
+
+static int
+merge_bucket_compare(const void *v1, const void *v2)
+{
+    const struct merge_bucket *b1 = v1;
+    const struct merge_bucket *b2 = v2;
+
+    return (b1->hash > b2->hash) - (b1->hash < b2->hash);
+}
+
+static void
+merge_bucket_free(void *v)
+{
+    struct merge_bucket *bucket = v;
+
+    free(bucket->entries);
+    free(bucket);
+}
+
+static void
+merge_index_add(struct hashtab *index, unsigned int hash, unsigned int tree,
+    void *data)
+{
+    struct merge_bucket key, *bucket;
+    struct htnode *node;
+    debug_decl(merge_index_add, SUDOERS_DEBUG_UTIL);
+
+    key.hash = hash;
+    node = htfind(index, &key);
+    if (node != NULL) {
+	bucket = node->data;
+    } else {
+	bucket = calloc(1, sizeof(*bucket));
+	if (bucket == NULL) {
+	    sudo_fatalx(U_("%s: %s"), __func__,
+		U_("unable to allocate memory"));
+	}
+	bucket->hash = hash;
+	if (htinsert(index, bucket, NULL) != 0) {
+	    sudo_fatalx(U_("%s: %s"), __func__,
+		U_("unable to allocate memory"));
+	}
+    }
+    if (bucket->count == bucket->size) {
+	size_t newsize = bucket->size ? bucket->size * 2 : 4;
+	struct merge_entry *entries = reallocarray(bucket->entries,
+	    newsize, sizeof(*entries));
+	if (entries == NULL) {
+	    sudo_fatalx(U_("%s: %s"), __func__,
+		U_("unable to allocate memory"));
+	}
+	bucket->entries = entries;
+	bucket->size = newsize;
+    }
+    bucket->entries[bucket->count].tree = tree;
+    bucket->entries[bucket->count].data = data;
+    bucket->count++;
+
+    debug_return;
+}
+
+/*
+ * Find the bucket for hash and return the position of the first entry
+ * that belongs to a parse tree after tree.  Sets *countp to the number
+ * of entries in the bucket.
+ */
+static struct merge_entry *
+merge_index_after(struct hashtab *index, unsigned int hash, unsigned int tree,
+    size_t *startp, size_t *countp)
+{
+    struct merge_bucket key, *bucket;
+    struct htnode *node;
+    size_t lo, hi;
+    debug_decl(merge_index_after, SUDOERS_DEBUG_UTIL);
+
+    key.hash = hash;
+    node = htfind(index, &key);
+    if (node == NULL)
+	debug_return_ptr(NULL);
+    bucket = node->data;
+
+    /* Binary search for the first entry in a subsequent parse tree. */
+    lo = 0;
+    hi = bucket->count;
+    while (lo < hi) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if (bucket->entries[mid].tree <= tree)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    *startp = lo;
+    *countp = bucket->count;
+    debug_return_ptr(bucket->entries);
+}
+
 enum cvtsudoers_conflict {
     CONFLICT_NONE,
     CONFLICT_RESOLVED,
     CONFLICT_UNRESOLVED
 };
 
+/*
+ * Check whether Defaults entry def is a duplicate of, or conflicts with, d.
+ * Returns CONFLICT_NONE if d is unrelated to def.
+ */
+static enum cvtsudoers_conflict
+defaults_conflict(struct defaults *def, struct defaults *d)
+{
+    bool mergeable = false;
+    debug_decl(defaults_conflict, SUDOERS_DEBUG_DEFAULTS);
+
+    /*
+     * We currently only merge host-based Defaults but could do
+     * others as well.  Lists in Defaults entries can be harder
+     * to read, especially command lists.
+     */
+    if (!defaults_var_matches(def, d, &mergeable)) {
+	if (!mergeable || (def->type != DEFAULTS && def->type != DEFAULTS_HOST))
+	    debug_return_int(CONFLICT_NONE);
+    }
+    if (defaults_val_matches(def, d)) {
+	/* Duplicate Defaults entry (may need to merge binding). */
+	if (mergeable) {
+	    if (d->type != def->type &&
+		    (d->type == DEFAULTS || def->type == DEFAULTS)) {
+		/*
+		 * To be able to merge two Defaults, they both must
+		 * have the same binding type.  Convert a global
+		 * Defaults to one bound to single "ALL" member.
+		 */
+		if (d->type == DEFAULTS) {
+		    struct member *m = new_member(NULL, ALL);
+		    TAILQ_INSERT_TAIL(&d->binding->members, m, entries);
+		    d->type = def->type;
+		}
+		if (def->type == DEFAULTS) {
+		    struct member *m = new_member(NULL, ALL);
+		    TAILQ_INSERT_TAIL(&def->binding->members, m, entries);
+		    def->type = d->type;
+		}
+	    }
+
+	    /* Prepend def binding to d (hence double concat). */
+	    TAILQ_CONCAT(&def->binding->members, &d->binding->members, entries);
+	    TAILQ_CONCAT(&d->binding->members, &def->binding->members, entries);
+	}
+	debug_return_int(CONFLICT_RESOLVED);
+    }
+    /*
+     * If the value doesn't match but the Defaults name did we don't
+     * consider that a conflict.
+     */
+    if (!mergeable) {
+	log_warnx(U_("%s:%d:%d: conflicting Defaults entry \"%s\" host-specific in %s:%d:%d"),
+	    def->file, def->line, def->column, def->var,
+	    d->file, d->line, d->column);
+	debug_return_int(CONFLICT_UNRESOLVED);
+    }
+
+    debug_return_int(CONFLICT_NONE);
+}
+
 /*
  * Check for duplicate and conflicting Defaults entries in later sudoers files.
+ * Only Defaults with the same name, as found via the index, are checked.
  * Returns true if we find a conflict or duplicate, else false.
  */
 static enum cvtsudoers_conflict
-defaults_check_conflict(struct defaults *def,
-    struct sudoers_parse_tree *parse_tree0)
+defaults_check_conflict(struct defaults *def, struct hashtab *index,
+    unsigned int tree)
 {
-    struct sudoers_parse_tree *parse_tree = parse_tree0;
-    struct defaults *d;
+    struct merge_entry *entries;
+    size_t i, j, k, count;
+    enum cvtsudoers_conflict ret;
     debug_decl(defaults_check_conflict, SUDOERS_DEBUG_DEFAULTS);
 
-    while ((parse_tree = TAILQ_NEXT(parse_tree, entries)) != NULL) {
-	TAILQ_FOREACH_REVERSE(d, &parse_tree->defaults, defaults_list, entries) {
-	    bool mergeable = false;
-
-	    /*
-	     * We currently only merge host-based Defaults but could do
-	     * others as well.  Lists in Defaults entries can be harder
-	     * to read, especially command lists.
-	     */
-	    if (!defaults_var_matches(def, d, &mergeable)) {
-		if (!mergeable || (def->type != DEFAULTS && def->type != DEFAULTS_HOST))
-		    continue;
-	    }
-	    if (defaults_val_matches(def, d)) {
-		/* Duplicate Defaults entry (may need to merge binding). */
-		if (mergeable) {
-		    if (d->type != def->type &&
-			    (d->type == DEFAULTS || def->type == DEFAULTS)) {
-			/*
-			 * To be able to merge two Defaults, they both must
-			 * have the same binding type.  Convert a global
-			 * Defaults to one bound to single "ALL" member.
-			 */
-			if (d->type == DEFAULTS) {
-			    struct member *m = new_member(NULL, ALL);
-			    TAILQ_INSERT_TAIL(&d->binding->members, m, entries);
-			    d->type = def->type;
-			}
-			if (def->type == DEFAULTS) {
-			    struct member *m = new_member(NULL, ALL);
-			    TAILQ_INSERT_TAIL(&def->binding->members, m, entries);
-			    def->type = d->type;
-			}
-		    }
+    entries = merge_index_after(index, hthash_string(HTHASH_INIT, def->var),
+	tree, &i, &count);
+    if (entries == NULL)
+	debug_return_int(CONFLICT_NONE);
 
-		    /* Prepend def binding to d (hence double concat). */
-		    TAILQ_CONCAT(&def->binding->members, &d->binding->members, entries);
-		    TAILQ_CONCAT(&d->binding->members, &def->binding->members, entries);
-		}
-		debug_return_int(CONFLICT_RESOLVED);
-	    }
-	    /*
-	     * If the value doesn't match but the Defaults name did we don't
-	     * consider that a conflict.
-	     */
-	    if (!mergeable) {
-		log_warnx(U_("%s:%d:%d: conflicting Defaults entry \"%s\" host-specific in %s:%d:%d"),
-		    def->file, def->line, def->column, def->var,
-		    d->file, d->line, d->column);
-		debug_return_int(CONFLICT_UNRESOLVED);
-	    }
+    /* Parse trees in order, entries within a parse tree in reverse. */
+    for (; i < count; i = j) {
+	for (j = i + 1; j < count; j++) {
+	    if (entries[j].tree != entries[i].tree)
+		break;
+	}
+	for (k = j; k-- > i; ) {
+	    ret = defaults_conflict(def, entries[k].data);
+	    if (ret != CONFLICT_NONE)
+		debug_return_int(ret);
 	}
     }
 
@@ -849,8 +1102,10 @@ merge_defaults(struct sudoers_parse_tree_list *parse_trees,
     struct sudoers_parse_tree *merged_tree, struct member_list *bound_hosts)
 {
     struct sudoers_parse_tree *parse_tree;
+    struct hashtab *index;
     struct defaults *def;
     struct member *m;
+    unsigned int tree;
     debug_decl(merge_defaults, SUDOERS_DEBUG_DEFAULTS);
 
     TAILQ_FOREACH(parse_tree, parse_trees, entries) {
@@ -870,13 +1125,27 @@ merge_defaults(struct sudoers_parse_tree_list *parse_trees,
 	}
     }
 
+    /* Index Defaults entries by name to find conflicts quickly. */
+    index = htcreate(merge_bucket_hash, merge_bucket_compare);
+    if (index == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    tree = 0;
+    TAILQ_FOREACH(parse_tree, parse_trees, entries) {
+	TAILQ_FOREACH(def, &parse_tree->defaults, entries) {
+	    merge_index_add(index, hthash_string(HTHASH_INIT, def->var),
+		tree, def);
+	}
+	tree++;
+    }
+
+    tree = 0;
     TAILQ_FOREACH(parse_tree, parse_trees, entries) {
 	while ((def = TAILQ_FIRST(&parse_tree->defaults)) != NULL) {
 	    /*
 	     * Only add Defaults entry if not overridden by subsequent sudoers.
 	     */
 	    TAILQ_REMOVE(&parse_tree->defaults, def, entries);
-	    switch (defaults_check_conflict(def, parse_tree)) {
+	    switch (defaults_check_conflict(def, index, tree)) {
 	    case CONFLICT_NONE:
 		if (def->type != DEFAULTS_HOST) {
 		    log_warnx(U_("%s:%d:%d: unable to make Defaults \"%s\" host-specific"),
@@ -895,7 +1164,9 @@ merge_defaults(struct sudoers_parse_tree_list *parse_trees,
 		break;
 	    }
 	}
+	tree++;
     }
+    htdestroy(index, merge_bucket_free);
 
     /*
      * Simplify host lists in the merged Defaults.
@@ -1026,98 +1297,102 @@ cmndspec_list_equivalent(struct cmndspec_list *csl1, struct cmndspec_list *csl2,
 }
 
 /*
- * Check whether userspec us1 is overridden by another sudoers file entry.
- * If us1 and another userspec differ only in their host lists, merges
- * the hosts from us1 into that userspec.
- * Returns true if overridden, else false.
+ * Check whether userspec us1 is overridden by userspec us2.
+ * If us1 and us2 differ only in their host lists, merges the hosts
+ * from us1 into us2.
+ * Returns CONFLICT_NONE if us2 does not override us1.
  * TODO: merge privs
  */
 static enum cvtsudoers_conflict
-userspec_overridden(struct userspec *us1,
-    struct sudoers_parse_tree *parse_tree, bool check_negated)
+userspec_overridden(struct userspec *us1, struct userspec *us2,
+    bool check_negated)
 {
-    struct userspec *us2;
+    struct privilege *priv1, *priv2;
     bool hosts_differ = false;
     debug_decl(userspec_overridden, SUDOERS_DEBUG_PARSER);
 
-    if (TAILQ_EMPTY(&parse_tree->userspecs))
+    if (!member_list_override(&us1->users, &us2->users, check_negated))
 	debug_return_int(CONFLICT_NONE);
 
-    /* Sudoers rules are applied in reverse order (last match wins). */
-    TAILQ_FOREACH_REVERSE(us2, &parse_tree->userspecs, userspec_list, entries) {
-	struct privilege *priv1, *priv2;
+    /* XXX - order should not matter */
+    priv1 = TAILQ_LAST(&us1->privileges, privilege_list);
+    priv2 = TAILQ_LAST(&us2->privileges, privilege_list);
+    while (priv1 != NULL && priv2 != NULL) {
+	if (!defaults_list_equivalent(&priv1->defaults, &priv2->defaults))
+	    break;
+	if (!cmndspec_list_equivalent(&priv1->cmndlist, &priv2->cmndlist, check_negated))
+	    break;
 
-	if (!member_list_override(&us1->users, &us2->users, check_negated))
-	    continue;
+	if (!member_list_override(&priv1->hostlist, &priv2->hostlist, check_negated))
+	    hosts_differ = true;
 
-	/* XXX - order should not matter */
+	priv1 = TAILQ_PREV(priv1, privilege_list, entries);
+	priv2 = TAILQ_PREV(priv2, privilege_list, entries);
+    }
+    if (priv1 != NULL || priv2 != NULL) {
+	/* mismatch */
+	debug_return_int(CONFLICT_NONE);
+    }
+
+    /*
+     * If we have a match of everything except the host list,
+     * merge the differing host lists.
+     */
+    if (hosts_differ) {
 	priv1 = TAILQ_LAST(&us1->privileges, privilege_list);
 	priv2 = TAILQ_LAST(&us2->privileges, privilege_list);
 	while (priv1 != NULL && priv2 != NULL) {
-	    if (!defaults_list_equivalent(&priv1->defaults, &priv2->defaults))
-		break;
-	    if (!cmndspec_list_equivalent(&priv1->cmndlist, &priv2->cmndlist, check_negated))
-		break;
-
-	    if (!member_list_override(&priv1->hostlist, &priv2->hostlist, check_negated))
-		hosts_differ = true;
-
+	    if (!member_list_override(&priv1->hostlist, &priv2->hostlist, check_negated)) {
+		/*
+		 * Priv matches but hosts differ, prepend priv1 hostlist
+		 * to into priv2 hostlist (hence the double concat).
+		 */
+		TAILQ_CONCAT(&priv1->hostlist, &priv2->hostlist, entries);
+		TAILQ_CONCAT(&priv2->hostlist, &priv1->hostlist, entries);
+		log_warnx(U_("%s:%d:%d: merging userspec into %s:%d:%d"),
+		    us1->file, us1->line, us1->column,
+		    us2->file, us2->line, us2->column);
+	    }
 	    priv1 = TAILQ_PREV(priv1, privilege_list, entries);
 	    priv2 = TAILQ_PREV(priv2, privilege_list, entries);
 	}
-	if (priv1 != NULL || priv2 != NULL) {
-	    /* mismatch */
-	    continue;
-	}
-
-	/*
-	 * If we have a match of everything except the host list,
-	 * merge the differing host lists.
-	 */
-	if (hosts_differ) {
-	    priv1 = TAILQ_LAST(&us1->privileges, privilege_list);
-	    priv2 = TAILQ_LAST(&us2->privileges, privilege_list);
-	    while (priv1 != NULL && priv2 != NULL) {
-		if (!member_list_override(&priv1->hostlist, &priv2->hostlist, check_negated)) {
-		    /*
-		     * Priv matches but hosts differ, prepend priv1 hostlist
-		     * to into priv2 hostlist (hence the double concat).
-		     */
-		    TAILQ_CONCAT(&priv1->hostlist, &priv2->hostlist, entries);
-		    TAILQ_CONCAT(&priv2->hostlist, &priv1->hostlist, entries);
-		    log_warnx(U_("%s:%d:%d: merging userspec into %s:%d:%d"),
-			us1->file, us1->line, us1->column,
-			us2->file, us2->line, us2->column);
-		}
-		priv1 = TAILQ_PREV(priv1, privilege_list, entries);
-		priv2 = TAILQ_PREV(priv2, privilege_list, entries);
-	    }
-	    debug_return_int(CONFLICT_RESOLVED);
-	}
-	debug_return_int(CONFLICT_UNRESOLVED);
+	debug_return_int(CONFLICT_RESOLVED);
     }
-
-    debug_return_int(CONFLICT_NONE);
+    debug_return_int(CONFLICT_UNRESOLVED);
 }
 
 /*
  * Check whether userspec us1 is overridden by another sudoers file entry.
  * If us1 and another userspec differ only in their host lists, merges
- * the hosts from us1 into that userspec.
+ * the hosts from us1 into that userspec.  Only userspecs with the same
+ * fingerprint, as found via the index, are checked.
  * Returns true if overridden, else false.
  */
 static enum cvtsudoers_conflict
-userspec_check_conflict(struct userspec *us1,
-    struct sudoers_parse_tree *parse_tree0)
+userspec_check_conflict(struct userspec *us1, struct hashtab *index,
+    unsigned int tree)
 {
-    struct sudoers_parse_tree *parse_tree = parse_tree0;
+    struct merge_entry *entries;
+    size_t i, j, k, count;
+    enum cvtsudoers_conflict ret;
     debug_decl(userspec_check_conflict, SUDOERS_DEBUG_PARSER);
 
-    while ((parse_tree = TAILQ_NEXT(parse_tree, entries)) != NULL) {
-	enum cvtsudoers_conflict ret =
-	    userspec_overridden(us1, parse_tree, false);
-	if (ret != CONFLICT_NONE)
-	    debug_return_int(ret);
+    entries = merge_index_after(index, fingerprint_userspec(us1), tree,
+	&i, &count);
+    if (entries == NULL)
+	debug_return_int(CONFLICT_NONE);
+
+    /* Sudoers rules are applied in reverse order (last match wins). */
+    for (; i < count; i = j) {
+	for (j = i + 1; j < count; j++) {
+	    if (entries[j].tree != entries[i].tree)
+		break;
+	}
+	for (k = j; k-- > i; ) {
+	    ret = userspec_overridden(us1, entries[k].data, false);
+	    if (ret != CONFLICT_NONE)
+		debug_return_int(ret);
+	}
     }
 
     debug_return_int(CONFLICT_NONE);
@@ -1134,9 +1409,11 @@ merge_userspecs(struct sudoers_parse_tree_list *parse_trees,
     struct sudoers_parse_tree *merged_tree, struct member_list *bound_hosts)
 {
     struct sudoers_parse_tree *parse_tree;
+    struct hashtab *index;
     struct userspec *us;
     struct privilege *priv;
     struct member *m;
+    unsigned int tree;
     debug_decl(merge_userspecs, SUDOERS_DEBUG_DEFAULTS);
 
     /*
@@ -1166,12 +1443,25 @@ merge_userspecs(struct sudoers_parse_tree_list *parse_trees,
     /*
      * Prune out duplicate userspecs after substituting hostname(s).
      * Traverse the list in reverse order--in sudoers last match wins.
+     * Userspecs are indexed by fingerprint to find candidates quickly.
      * XXX - do this at the privilege/cmndspec level instead.
      */
+    index = htcreate(merge_bucket_hash, merge_bucket_compare);
+    if (index == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    tree = 0;
+    TAILQ_FOREACH(parse_tree, parse_trees, entries) {
+	TAILQ_FOREACH(us, &parse_tree->userspecs, entries) {
+	    merge_index_add(index, fingerprint_userspec(us), tree, us);
+	}
+	tree++;
+    }
+
+    tree = 0;
     TAILQ_FOREACH(parse_tree, parse_trees, entries) {
 	while ((us = TAILQ_LAST(&parse_tree->userspecs, userspec_list)) != NULL) {
 	    TAILQ_REMOVE(&parse_tree->userspecs, us, entries);
-	    switch (userspec_check_conflict(us, parse_tree)) {
+	    switch (userspec_check_conflict(us, index, tree)) {
 	    case CONFLICT_NONE:
 		TAILQ_INSERT_HEAD(&merged_tree->userspecs, us, entries);
 		break;
@@ -1185,7 +1475,9 @@ merge_userspecs(struct sudoers_parse_tree_list *parse_trees,
 		break;
 	    }
 	}
+	tree++;
     }
+    htdestroy(index, merge_bucket_free);
 
     /*
      * Simplify member lists in the merged tree.
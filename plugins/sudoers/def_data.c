@@ -695,6 +695,14 @@ struct sudo_defs_types sudo_defs_table[] = {
 	"apparmor_profile", T_STR,
 	N_("AppArmor profile to use in the new security context: %s"),
 	NULL,
+    }, {
+	"compress_io_streams", T_STR,
+	N_("Per-stream I/O log compression settings: %s"),
+	NULL,
+    }, {
+	"log_server_state", T_STR|T_BOOL|T_PATH,
+	N_("Path to the log server health state file: %s"),
+	NULL,
     }, {
 	NULL, 0, NULL
     }
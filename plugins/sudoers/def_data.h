@@ -322,6 +322,10 @@
 #define def_intercept_verify    (sudo_defs_table[I_INTERCEPT_VERIFY].sd_un.flag)
 #define I_APPARMOR_PROFILE      160
 #define def_apparmor_profile    (sudo_defs_table[I_APPARMOR_PROFILE].sd_un.str)
+#define I_COMPRESS_IO_STREAMS   161
+#define def_compress_io_streams (sudo_defs_table[I_COMPRESS_IO_STREAMS].sd_un.str)
+#define I_LOG_SERVER_STATE      162
+#define def_log_server_state    (sudo_defs_table[I_LOG_SERVER_STATE].sd_un.str)
 
 enum def_tuple {
     never,
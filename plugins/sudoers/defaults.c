@@ -598,6 +598,8 @@ init_defaults(void)
 	goto oom;
     if ((def_badpass_message = strdup(_(INCORRECT_PASSWORD))) == NULL)
 	goto oom;
+    if ((def_log_server_state = strdup(_PATH_SUDO_LOGSRV_STATE)) == NULL)
+	goto oom;
     if ((def_lecture_status_dir = strdup(_PATH_SUDO_LECTURE_DIR)) == NULL)
 	goto oom;
     if ((def_timestampdir = strdup(_PATH_SUDO_TIMEDIR)) == NULL)
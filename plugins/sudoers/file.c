@@ -117,6 +117,12 @@ sudo_file_parse(const struct sudo_nss *nss)
     /* Move parsed sudoers policy to nss handle. */
     reparent_parse_tree(&handle->parse_tree);
 
+    /* Flatten nested aliases for matching, not fatal on failure. */
+    (void)alias_expand(&handle->parse_tree);
+
+    /* Build the compact Cmnd_Spec arrays used by sudoers_lookup(). */
+    (void)sudoers_compile_privileges(&handle->parse_tree);
+
     debug_return_ptr(&handle->parse_tree);
 }
 
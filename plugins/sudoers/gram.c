@@ -3890,6 +3890,8 @@ free_privilege(struct privilege *priv)
 	TAILQ_REMOVE(&priv->defaults, def, entries);
 	free_default(def);
     }
+    free(priv->cmndvec);
+    free(priv->cmndbase);
     free(priv);
 
     debug_return;
@@ -0,0 +1,229 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+/*
+ * A simple hash table using open addressing and linear probing.
+ * The slots store the data pointer along with its hash value so
+ * that the compare function is only called on a probable match.
+ * Unlike a red-black tree, no memory is allocated per entry.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sudoers.h"
+#include "hashtab.h"
+
+#define HTINITIAL_SIZE	16
+
+/*
+ * Add len bytes of buf to hash h using FNV-1a.
+ */
+unsigned int
+hthash_bytes(unsigned int h, const void *buf, size_t len)
+{
+    const unsigned char *cp = buf;
+
+    while (len--) {
+	h ^= *cp++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Add a NUL-terminated string to hash h using FNV-1a.
+ */
+unsigned int
+hthash_string(unsigned int h, const char *str)
+{
+    const unsigned char *cp = (const unsigned char *)str;
+
+    while (*cp != '\0') {
+	h ^= *cp++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Create a hash table using the specified hash and compare functions.
+ * The compare function returns 0 if the entries match.
+ * Allocates and returns the initialized (empty) table or NULL if
+ * memory cannot be allocated.
+ */
+struct hashtab *
+htcreate(unsigned int (*hash)(const void *),
+    int (*compar)(const void *, const void *))
+{
+    struct hashtab *table;
+    debug_decl(htcreate, SUDOERS_DEBUG_UTIL);
+
+    if ((table = malloc(sizeof(*table))) == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unable to allocate memory");
+	debug_return_ptr(NULL);
+    }
+    table->nodes = calloc(HTINITIAL_SIZE, sizeof(*table->nodes));
+    if (table->nodes == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unable to allocate memory");
+	free(table);
+	debug_return_ptr(NULL);
+    }
+    table->hash = hash;
+    table->compar = compar;
+    table->size = HTINITIAL_SIZE;
+    table->count = 0;
+
+    debug_return_ptr(table);
+}
+
+/*
+ * Return the slot matching key or, if there is none, the empty
+ * slot where it would be inserted.
+ */
+static struct htnode *
+htlookup(struct hashtab *table, const void *key, unsigned int hash)
+{
+    const size_t mask = table->size - 1;
+    size_t i = hash & mask;
+    struct htnode *node;
+
+    for (;;) {
+	node = &table->nodes[i];
+	if (node->data == NULL)
+	    break;
+	if (node->hash == hash && table->compar(key, node->data) == 0)
+	    break;
+	i = (i + 1) & mask;
+    }
+    return node;
+}
+
+/*
+ * Double the size of the table and rehash the existing entries.
+ * Returns true on success, false on malloc() failure.
+ */
+static bool
+htgrow(struct hashtab *table)
+{
+    struct htnode *old_nodes = table->nodes;
+    const size_t old_size = table->size;
+    size_t i;
+    debug_decl(htgrow, SUDOERS_DEBUG_UTIL);
+
+    table->nodes = calloc(old_size * 2, sizeof(*table->nodes));
+    if (table->nodes == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unable to allocate memory");
+	table->nodes = old_nodes;
+	debug_return_bool(false);
+    }
+    table->size = old_size * 2;
+
+    for (i = 0; i < old_size; i++) {
+	if (old_nodes[i].data != NULL) {
+	    const size_t mask = table->size - 1;
+	    size_t j = old_nodes[i].hash & mask;
+
+	    while (table->nodes[j].data != NULL)
+		j = (j + 1) & mask;
+	    table->nodes[j] = old_nodes[i];
+	}
+    }
+    free(old_nodes);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Insert data pointer into a hash table.
+ * Returns a 0 on success, 1 if a node matching "data" already exists
+ * (filling in "existing" if not NULL), or -1 on malloc() failure.
+ * Pointers to nodes are only valid until the next insertion.
+ */
+int
+htinsert(struct hashtab *table, void *data, struct htnode **existing)
+{
+    const unsigned int hash = table->hash(data);
+    struct htnode *node;
+    debug_decl(htinsert, SUDOERS_DEBUG_UTIL);
+
+    node = htlookup(table, data, hash);
+    if (node->data != NULL) {
+	if (existing != NULL)
+	    *existing = node;
+	debug_return_int(1);
+    }
+
+    /* Keep the load factor at or below 3/4. */
+    if ((table->count + 1) * 4 > table->size * 3) {
+	if (!htgrow(table))
+	    debug_return_int(-1);
+	node = htlookup(table, data, hash);
+    }
+    node->data = data;
+    node->hash = hash;
+    table->count++;
+
+    debug_return_int(0);
+}
+
+/*
+ * Look for a node matching key in the hash table.
+ * Returns a pointer to the node if found, else NULL.
+ */
+struct htnode *
+htfind(struct hashtab *table, const void *key)
+{
+    struct htnode *node;
+    debug_decl(htfind, SUDOERS_DEBUG_UTIL);
+
+    node = htlookup(table, key, table->hash(key));
+    debug_return_ptr(node->data != NULL ? node : NULL);
+}
+
+/*
+ * Destroy the specified hash table, calling the destructor "destroy"
+ * for each node's data pointer and then freeing the table itself.
+ */
+void
+htdestroy(struct hashtab *table, void (*destroy)(void *))
+{
+    size_t i;
+    debug_decl(htdestroy, SUDOERS_DEBUG_UTIL);
+
+    if (destroy != NULL) {
+	for (i = 0; i < table->size; i++) {
+	    if (table->nodes[i].data != NULL)
+		destroy(table->nodes[i].data);
+	}
+    }
+    free(table->nodes);
+    free(table);
+
+    debug_return;
+}
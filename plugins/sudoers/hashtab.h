@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SUDOERS_HASHTAB_H
+#define SUDOERS_HASHTAB_H
+
+/*
+ * Open addressing hash table for caches that only need point lookups.
+ * Entries cannot be removed individually; use redblack.h when ordered
+ * traversal or deletion is required.
+ */
+
+struct htnode {
+    void *data;
+    unsigned int hash;
+};
+
+struct hashtab {
+    unsigned int (*hash)(const void *);
+    int (*compar)(const void *, const void *);
+    struct htnode *nodes;
+    size_t size;		/* number of slots, always a power of 2 */
+    size_t count;		/* number of slots in use */
+};
+
+/* 32-bit FNV-1a */
+#define HTHASH_INIT	2166136261U
+
+unsigned int hthash_bytes(unsigned int h, const void *buf, size_t len);
+unsigned int hthash_string(unsigned int h, const char *str);
+struct htnode *htfind(struct hashtab *, const void *);
+int htinsert(struct hashtab *, void *, struct htnode **);
+struct hashtab *htcreate(unsigned int (*)(const void *),
+	int (*)(const void *, const void *));
+void htdestroy(struct hashtab *, void (*)(void *));
+
+#endif /* SUDOERS_HASHTAB_H */
@@ -41,22 +41,24 @@
 #include "interfaces.h"
 
 static struct interface_list interfaces = SLIST_HEAD_INITIALIZER(interfaces);
+static char *interfaces_pending;
+static bool interfaces_error;
 
 /*
- * Parse a space-delimited list of IP address/netmask pairs and
- * store in a list of interface structures.  Returns true on
- * success and false on parse error or memory allocation error.
+ * Parse a space-delimited list of IP address/netmask pairs.
+ * If list is non-NULL, store the result in a list of interface
+ * structures, otherwise just check the syntax.  The addrinfo string
+ * is modified in the process.  Returns true on success and false
+ * on parse error or memory allocation error.
  */
-bool
-set_interfaces(const char *ai)
+static bool
+parse_interfaces(char *addrinfo, struct interface_list *list)
 {
-    char *addrinfo, *addr, *mask, *last;
-    struct interface *ifp;
+    char *addr, *mask, *last;
+    struct interface *ifp, ifbuf;
     bool ret = false;
-    debug_decl(set_interfaces, SUDOERS_DEBUG_NETIF);
+    debug_decl(parse_interfaces, SUDOERS_DEBUG_NETIF);
 
-    if ((addrinfo = strdup(ai)) == NULL)
-	debug_return_bool(false);
     for (addr = strtok_r(addrinfo, " \t", &last); addr != NULL; addr = strtok_r(NULL, " \t", &last)) {
 	/* Separate addr and mask. */
 	if ((mask = strchr(addr, '/')) == NULL)
@@ -64,7 +66,9 @@ set_interfaces(const char *ai)
 	*mask++ = '\0';
 
 	/* Parse addr and store in list. */
-	if ((ifp = calloc(1, sizeof(*ifp))) == NULL) {
+	if (list == NULL) {
+	    ifp = &ifbuf;
+	} else if ((ifp = calloc(1, sizeof(*ifp))) == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    goto done;
 	}
@@ -74,16 +78,15 @@ set_interfaces(const char *ai)
 	    ifp->family = AF_INET6;
 	    if (inet_pton(AF_INET6, addr, &ifp->addr.ip6) != 1) {
 		sudo_warnx(U_("unable to parse IP address \"%s\""), addr);
-		free(ifp);
-		goto done;
+		goto bad;
 	    }
 	    if (inet_pton(AF_INET6, mask, &ifp->netmask.ip6) != 1) {
 		sudo_warnx(U_("unable to parse netmask \"%s\""), mask);
-		free(ifp);
-		goto done;
+		goto bad;
 	    }
 #else
-	    free(ifp);
+	    if (ifp != &ifbuf)
+		free(ifp);
 	    continue;
 #endif
 	} else {
@@ -91,28 +94,74 @@ set_interfaces(const char *ai)
 	    ifp->family = AF_INET;
 	    if (inet_pton(AF_INET, addr, &ifp->addr.ip4) != 1) {
 		sudo_warnx(U_("unable to parse IP address \"%s\""), addr);
-		free(ifp);
-		goto done;
+		goto bad;
 	    }
 	    if (inet_pton(AF_INET, mask, &ifp->netmask.ip4) != 1) {
 		sudo_warnx(U_("unable to parse netmask \"%s\""), mask);
-		free(ifp);
-		goto done;
+		goto bad;
 	    }
 	}
-	SLIST_INSERT_HEAD(&interfaces, ifp, entries);
+	if (list != NULL)
+	    SLIST_INSERT_HEAD(list, ifp, entries);
     }
     ret = true;
+    goto done;
 
+bad:
+    if (ifp != &ifbuf)
+	free(ifp);
 done:
-    free(addrinfo);
     debug_return_bool(ret);
 }
 
+/*
+ * Store a space-delimited list of IP address/netmask pairs.
+ * The syntax is checked immediately but, since most policies never
+ * match on a network address, the interface list is not built until
+ * get_interfaces() is first called.
+ * Returns true on success and false on parse or memory allocation error.
+ */
+bool
+set_interfaces(const char *ai)
+{
+    char *addrinfo;
+    bool valid;
+    debug_decl(set_interfaces, SUDOERS_DEBUG_NETIF);
+
+    if ((addrinfo = strdup(ai)) == NULL)
+	debug_return_bool(false);
+    valid = parse_interfaces(addrinfo, NULL);
+    free(addrinfo);
+    if (!valid)
+	debug_return_bool(false);
+
+    free(interfaces_pending);
+    if ((interfaces_pending = strdup(ai)) == NULL)
+	debug_return_bool(false);
+    debug_return_bool(true);
+}
+
+/*
+ * Return the list of local interfaces, building it from the address
+ * list stored by set_interfaces() on first use.
+ * Returns NULL if the list could not be built.
+ */
 struct interface_list *
 get_interfaces(void)
 {
-    return &interfaces;
+    debug_decl(get_interfaces, SUDOERS_DEBUG_NETIF);
+
+    if (interfaces_pending != NULL) {
+	if (!parse_interfaces(interfaces_pending, &interfaces)) {
+	    sudo_warnx("%s", U_("unable to parse network address list"));
+	    interfaces_error = true;
+	}
+	free(interfaces_pending);
+	interfaces_pending = NULL;
+    }
+    if (interfaces_error)
+	debug_return_ptr(NULL);
+    debug_return_ptr(&interfaces);
 }
 
 void
@@ -166,6 +166,27 @@ cb_iolog_mode(const char *file, int line, int column,
     return true;
 }
 
+/*
+ * Sudoers callback for compress_io_streams Defaults setting.
+ * The value is passed to the I/O log plugin, just check its syntax.
+ */
+bool
+cb_compress_io_streams(const char *file, int line, int column,
+    const union sudo_defs_val *sd_un, int op)
+{
+    struct iolog_compress_params params;
+    debug_decl(cb_compress_io_streams, SUDOERS_DEBUG_UTIL);
+
+    if (sd_un->str != NULL &&
+	    !iolog_parse_compress_params(sd_un->str, &params)) {
+	log_warningx(SLOG_AUDIT|SLOG_PARSE_ERROR,
+	    N_("%s:%d:%d: invalid compress_io_streams setting \"%s\""),
+	    file, line, column, sd_un->str);
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
 /*
  * Make a shallow copy of a NULL-terminated argument or environment vector.
  * Only the outer array is allocated, the pointers inside are copied.
@@ -204,6 +225,7 @@ free_iolog_details(void)
 	eventlog_free(iolog_details.evlog);
     }
     str_list_free(iolog_details.log_servers);
+    free(iolog_details.state_file);
 #if defined(HAVE_OPENSSL)
     free(iolog_details.ca_bundle);
     free(iolog_details.cert_file);
@@ -436,6 +458,16 @@ iolog_deserialize_info(struct log_details *details, char * const user_info[],
 		}
 		continue;
 	    }
+	    if (strncmp(*cur, "iolog_compress_streams=", sizeof("iolog_compress_streams=") - 1) == 0) {
+		struct iolog_compress_params params;
+		if (iolog_parse_compress_params(*cur + sizeof("iolog_compress_streams=") - 1, &params)) {
+		    iolog_set_compress_params(&params);
+		} else {
+		    sudo_debug_printf(SUDO_DEBUG_WARN,
+			"%s: unable to parse %s", __func__, *cur);
+		}
+		continue;
+	    }
 	    if (strncmp(*cur, "iolog_flush=", sizeof("iolog_flush=") - 1) == 0) {
 		int val = sudo_strtobool(*cur + sizeof("iolog_flush=") - 1);
 		if (val != -1) {
@@ -503,6 +535,13 @@ iolog_deserialize_info(struct log_details *details, char * const user_info[],
 		    TIME_T_MAX, NULL);
 		continue;
 	    }
+	    if (strncmp(*cur, "log_server_state=", sizeof("log_server_state=") - 1) == 0) {
+		free(details->state_file);
+		details->state_file = strdup(*cur + sizeof("log_server_state=") - 1);
+		if (details->state_file == NULL)
+		    goto oom;
+		continue;
+	    }
             if (strncmp(*cur, "log_server_keepalive=", sizeof("log_server_keepalive=") - 1) == 0) {
                 int val = sudo_strtobool(*cur + sizeof("log_server_keepalive=") - 1);
                 if (val != -1) {
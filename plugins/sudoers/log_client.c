@@ -79,65 +79,6 @@ struct client_closure *client_closure;
 static void client_msg_cb(int fd, int what, void *v);
 static void server_msg_cb(int fd, int what, void *v);
 
-static void
-connect_cb(int sock, int what, void *v)
-{
-    int optval, ret, *errnump = v;
-    socklen_t optlen = sizeof(optval);
-    debug_decl(connect_cb, SUDOERS_DEBUG_UTIL);
-
-    if (what == SUDO_PLUGIN_EV_TIMEOUT) {
-	*errnump = ETIMEDOUT;
-    } else {
-	ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, &optval, &optlen);
-	*errnump = ret == 0 ? optval : errno;
-    }
-
-    debug_return;
-}
-
-/*
- * Like connect(2) but with a timeout.
- */
-static int
-timed_connect(int sock, const struct sockaddr *addr, socklen_t addrlen,
-    const struct timespec *timeout)
-{
-    struct sudo_event_base *evbase = NULL;
-    struct sudo_event *connect_event = NULL;
-    int ret, errnum = 0;
-    debug_decl(timed_connect, SUDOERS_DEBUG_UTIL);
-
-    ret = connect(sock, addr, addrlen);
-    if (ret == -1 && errno == EINPROGRESS) {
-	evbase = sudo_ev_base_alloc();
-	connect_event = sudo_ev_alloc(sock, SUDO_PLUGIN_EV_WRITE, connect_cb,
-	    &errnum);
-	if (evbase == NULL || connect_event == NULL) {
-	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
-	    goto done;
-	}
-	if (sudo_ev_add(evbase, connect_event, timeout, false) == -1) {
-	    sudo_warnx("%s", U_("unable to add event to queue"));
-	    goto done;
-	}
-	if (sudo_ev_dispatch(evbase) == -1) {
-	    sudo_warn("%s", U_("error in event loop"));
-	    goto done;
-	}
-	if (errnum == 0)
-	    ret = 0;
-	else
-	    errno = errnum;
-    }
-
-done:
-    sudo_ev_base_free(evbase);
-    sudo_ev_free(connect_event);
-
-    debug_return_int(ret);
-}
-
 #if defined(HAVE_OPENSSL)
 static int
 verify_peer_identity(int preverify_ok, X509_STORE_CTX *ctx)
@@ -423,27 +364,159 @@ done:
 #endif /* HAVE_OPENSSL */
 
 /*
- * Connect to specified host:port
- * If host has multiple addresses, the first one that connects is used.
- * Returns open socket or -1 on error.
+ * A connection attempt to a single log server address.
+ */
+struct connect_attempt {
+    struct connect_race *race;
+    struct sudo_event *connect_ev;
+    struct addrinfo *ai;
+    struct addrinfo *res0;	/* only set for a server's first address */
+    char *copy;			/* only set for a server's first address */
+    const char *host;
+    const char *port;
+    struct timespec start;
+    time_t failed;
+    unsigned int rtt;
+    unsigned int idx;
+    int sock;
+    bool tls;
+    char addr[INET6_ADDRSTRLEN];
+};
+
+/*
+ * Connection attempts to all log server addresses, started in order
+ * and staggered as described in RFC 8305.
+ */
+struct connect_race {
+    struct sudo_event_base *evbase;
+    struct sudo_event *delay_ev;
+    struct connect_attempt *attempts;
+    struct connect_attempt *winner;
+    struct log_server_state *state;
+    const struct timespec *timeout;
+    const char *cause;
+    size_t nattempts;
+    size_t next;
+    size_t pending;
+    bool keepalive;
+};
+
+/* Delay before starting a connection to the next address (RFC 8305). */
+static const struct timespec connect_attempt_delay = { 0, 250000000 };
+
+/* Seconds before a failed server is tried in its usual position again. */
+#define LOG_SERVER_RETRY	60
+
+static void connect_attempt_cb(int sock, int what, void *v);
+
+/*
+ * Fill in the numeric address of attempt and its health as recorded
+ * in the log server state file, if any.
+ */
+static void
+connect_attempt_health(struct connect_attempt *attempt)
+{
+    struct connect_race *race = attempt->race;
+    struct addrinfo *ai = attempt->ai;
+    const void *addr;
+    debug_decl(connect_attempt_health, SUDOERS_DEBUG_UTIL);
+
+    switch (ai->ai_family) {
+    case AF_INET:
+	addr = &((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+	break;
+#ifdef HAVE_STRUCT_IN6_ADDR
+    case AF_INET6:
+	addr = &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+	break;
+#endif
+    default:
+	debug_return;
+    }
+    if (inet_ntop(ai->ai_family, addr, attempt->addr,
+	    sizeof(attempt->addr)) == NULL) {
+	attempt->addr[0] = '\0';
+	debug_return;
+    }
+    if (race->state != NULL) {
+	(void)log_server_state_get(race->state, attempt->addr, attempt->port,
+	    &attempt->failed, &attempt->rtt);
+    }
+
+    debug_return;
+}
+
+/*
+ * Record the result of a connection attempt in the state file.
+ */
+static void
+connect_attempt_record(struct connect_attempt *attempt, bool success)
+{
+    struct connect_race *race = attempt->race;
+    debug_decl(connect_attempt_record, SUDOERS_DEBUG_UTIL);
+
+    if (race->state != NULL && attempt->addr[0] != '\0') {
+	log_server_state_set(race->state, attempt->addr, attempt->port,
+	    success ? 0 : time(NULL), attempt->rtt);
+    }
+
+    debug_return;
+}
+
+/*
+ * Servers that failed recently are tried last, least recently failed
+ * first.  Otherwise, the order of log_servers is preserved.
  */
 static int
-connect_server(const char *host, const char *port, bool tls,
-    struct client_closure *closure, const char **reason)
+connect_attempt_compare(const void *v1, const void *v2)
 {
-    const struct timespec *timeout = &closure->log_details->server_timeout;
-    struct addrinfo hints, *res, *res0;
-    const char *addr, *cause = NULL;
-    int error, sock = -1;
-    debug_decl(connect_server, SUDOERS_DEBUG_UTIL);
+    const struct connect_attempt *a1 = v1;
+    const struct connect_attempt *a2 = v2;
+
+    if ((a1->failed != 0) != (a2->failed != 0))
+	return a1->failed != 0 ? 1 : -1;
+    if (a1->failed != a2->failed)
+	return a1->failed < a2->failed ? -1 : 1;
+    return a1->idx < a2->idx ? -1 : a1->idx > a2->idx;
+}
 
-#if !defined(HAVE_OPENSSL)
-    if (tls) {
-        errno = EPROTONOSUPPORT;
-        sudo_warn("%s:%s(tls)", host, port);
-        debug_return_int(-1);
+/*
+ * Order connection attempts based on log server health.
+ */
+static void
+connect_race_sort(struct connect_race *race)
+{
+    time_t now = time(NULL);
+    size_t i;
+    debug_decl(connect_race_sort, SUDOERS_DEBUG_UTIL);
+
+    /* A server that failed long enough ago is probed again. */
+    for (i = 0; i < race->nattempts; i++) {
+	struct connect_attempt *attempt = &race->attempts[i];
+	if (attempt->failed != 0 && (attempt->failed > now ||
+		now - attempt->failed >= LOG_SERVER_RETRY))
+	    attempt->failed = 0;
     }
-#endif
+    qsort(race->attempts, race->nattempts, sizeof(*race->attempts),
+	connect_attempt_compare);
+
+    debug_return;
+}
+
+/*
+ * Add the addresses of host:port to the list of connection attempts,
+ * alternating between address families as per RFC 8305.
+ * The caller's copy of the server string is owned by the first attempt.
+ */
+static bool
+connect_race_add(struct connect_race *race, char *copy, const char *host,
+    const char *port, bool tls)
+{
+    struct addrinfo hints, *res, *res0;
+    struct connect_attempt *attempts, *attempt;
+    size_t i, n = 0, first;
+    int error;
+    debug_decl(connect_race_add, SUDOERS_DEBUG_UTIL);
 
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
@@ -452,185 +525,474 @@ connect_server(const char *host, const char *port, bool tls,
     if (error != 0) {
 	sudo_warnx(U_("unable to look up %s:%s: %s"), host, port,
 	    gai_strerror(error));
-	debug_return_int(-1);
+	free(copy);
+	debug_return_bool(true);
+    }
+    for (res = res0; res != NULL; res = res->ai_next)
+	n++;
+
+    attempts = reallocarray(race->attempts, race->nattempts + n,
+	sizeof(*attempts));
+    if (attempts == NULL) {
+	freeaddrinfo(res0);
+	free(copy);
+	debug_return_bool(false);
     }
+    race->attempts = attempts;
 
-    for (res = res0; res; res = res->ai_next) {
-	int flags, save_errno;
+    /* Take addresses from the head of the list, switching family each time. */
+    first = race->nattempts;
+    for (i = 0; i < n; i++) {
+	int family = i ? attempts[first + i - 1].ai->ai_family : AF_UNSPEC;
+	struct addrinfo *prev = NULL, *next = NULL;
 
-	sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-	if (sock == -1) {
-	    cause = "socket";
-	    continue;
+	for (res = res0; res != NULL; res = res->ai_next) {
+	    /* Skip addresses already added. */
+	    size_t j;
+	    for (j = first; j < first + i; j++) {
+		if (attempts[j].ai == res)
+		    break;
+	    }
+	    if (j != first + i)
+		continue;
+	    if (prev == NULL)
+		prev = res;
+	    if (res->ai_family != family) {
+		next = res;
+		break;
+	    }
 	}
-	flags = fcntl(sock, F_GETFL, 0);
-	if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
-	    cause = "fcntl(O_NONBLOCK)";
-	    save_errno = errno;
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
+	attempt = &attempts[first + i];
+	memset(attempt, 0, sizeof(*attempt));
+	attempt->race = race;
+	attempt->ai = next ? next : prev;
+	attempt->host = host;
+	attempt->port = port;
+	attempt->idx = (unsigned int)(first + i);
+	attempt->sock = -1;
+	attempt->tls = tls;
+	connect_attempt_health(attempt);
+    }
+    attempts[first].res0 = res0;
+    attempts[first].copy = copy;
+    race->nattempts += n;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Close a connection attempt that is no longer needed.
+ */
+static void
+connect_attempt_close(struct connect_attempt *attempt)
+{
+    debug_decl(connect_attempt_close, SUDOERS_DEBUG_UTIL);
+
+    if (attempt->connect_ev != NULL) {
+	sudo_ev_free(attempt->connect_ev);
+	attempt->connect_ev = NULL;
+    }
+    if (attempt->sock != -1) {
+	close(attempt->sock);
+	attempt->sock = -1;
+    }
+
+    debug_return;
+}
+
+/*
+ * Free a connect_race and any attempts still in progress.
+ */
+static void
+connect_race_free(struct connect_race *race)
+{
+    size_t i;
+    debug_decl(connect_race_free, SUDOERS_DEBUG_UTIL);
+
+    for (i = 0; i < race->nattempts; i++) {
+	struct connect_attempt *attempt = &race->attempts[i];
+
+	connect_attempt_close(attempt);
+	if (attempt->res0 != NULL)
+	    freeaddrinfo(attempt->res0);
+	free(attempt->copy);
+    }
+    free(race->attempts);
+    if (race->delay_ev != NULL)
+	sudo_ev_free(race->delay_ev);
+    sudo_ev_base_free(race->evbase);
+
+    debug_return;
+}
+
+/*
+ * Start a connection to the address in attempt.
+ * Returns 1 if connected, 0 if the connection is in progress
+ * or -1 on error.
+ */
+static int
+connect_attempt_start(struct connect_attempt *attempt)
+{
+    struct connect_race *race = attempt->race;
+    struct addrinfo *ai = attempt->ai;
+    int flags, save_errno, sock;
+    debug_decl(connect_attempt_start, SUDOERS_DEBUG_UTIL);
+
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock == -1) {
+	race->cause = "socket";
+	debug_return_int(-1);
+    }
+    attempt->sock = sock;
+    flags = fcntl(sock, F_GETFL, 0);
+    if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+	race->cause = "fcntl(O_NONBLOCK)";
+	goto bad;
+    }
+    if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1) {
+	race->cause = "fcntl(FD_CLOEXEC)";
+	goto bad;
+    }
+    if (race->keepalive) {
+	flags = 1;
+	if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &flags,
+		sizeof(flags)) == -1) {
+	    race->cause = "setsockopt(SO_KEEPALIVE)";
+	    goto bad;
 	}
-        if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1) {
-	    cause = "fcntl(FD_CLOEXEC)";
-	    save_errno = errno;
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
-        }
-        if (closure->log_details->keepalive) {
-            flags = 1;
-            if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &flags,
-                    sizeof(flags)) == -1) {
-                cause = "setsockopt(SO_KEEPALIVE)";
-                save_errno = errno;
-                close(sock);
-                errno = save_errno;
-                sock = -1;
-                continue;
-            }
-        }
-	if (timed_connect(sock, res->ai_addr, res->ai_addrlen, timeout) == -1) {
-	    /* No need to set cause, caller's error message is sufficient. */
-	    save_errno = errno;
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
+    }
+    sudo_gettime_mono(&attempt->start);
+    if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+	attempt->rtt = 0;
+	debug_return_int(1);
+    }
+    if (errno != EINPROGRESS) {
+	/* No need to set cause, caller's error message is sufficient. */
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "unable to connect to %s port %s", attempt->host, attempt->port);
+	connect_attempt_record(attempt, false);
+	goto bad;
+    }
+
+    /* Connection will be completed in connect_attempt_cb(). */
+    attempt->connect_ev = sudo_ev_alloc(sock, SUDO_PLUGIN_EV_WRITE,
+	connect_attempt_cb, attempt);
+    if (attempt->connect_ev == NULL) {
+	race->cause = U_("unable to allocate memory");
+	goto bad;
+    }
+    if (sudo_ev_add(race->evbase, attempt->connect_ev, race->timeout,
+	    false) == -1) {
+	race->cause = U_("unable to add event to queue");
+	goto bad;
+    }
+    debug_return_int(0);
+bad:
+    save_errno = errno;
+    connect_attempt_close(attempt);
+    errno = save_errno;
+    debug_return_int(-1);
+}
+
+/*
+ * Start connection attempts until one is in progress, connected
+ * or there are no addresses left to try.  If more addresses remain,
+ * the next one is started after connect_attempt_delay unless the
+ * current attempt fails first.
+ */
+static void
+connect_attempt_next(struct connect_race *race)
+{
+    struct connect_attempt *attempt;
+    debug_decl(connect_attempt_next, SUDOERS_DEBUG_UTIL);
+
+    sudo_ev_del(race->evbase, race->delay_ev);
+    while (race->next < race->nattempts) {
+	attempt = &race->attempts[race->next++];
+	switch (connect_attempt_start(attempt)) {
+	case 1:
+	    /* Connection succeeded without blocking. */
+	    race->winner = attempt;
+	    sudo_ev_loopbreak(race->evbase);
+	    debug_return;
+	case 0:
+	    race->pending++;
+	    if (race->next < race->nattempts) {
+		struct timespec delay = connect_attempt_delay;
+
+		/* Use twice the last round trip time, if known (RFC 8305). */
+		if (attempt->rtt != 0 && attempt->rtt < 125000) {
+		    delay.tv_nsec = attempt->rtt * 2000;
+		    if (delay.tv_nsec < 10000000)
+			delay.tv_nsec = 10000000;
+		}
+		if (sudo_ev_add(race->evbase, race->delay_ev, &delay,
+			false) == -1) {
+		    sudo_warnx("%s", U_("unable to add event to queue"));
+		}
+	    }
+	    debug_return;
+	default:
+	    /* Try the next address (if any). */
+	    break;
 	}
-	switch (res->ai_family) {
-	case AF_INET:
-	    addr = (char *)&((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    }
+
+    debug_return;
+}
+
+static void
+connect_attempt_cb(int sock, int what, void *v)
+{
+    struct connect_attempt *attempt = v;
+    struct connect_race *race = attempt->race;
+    int optval, ret, errnum;
+    socklen_t optlen = sizeof(optval);
+    debug_decl(connect_attempt_cb, SUDOERS_DEBUG_UTIL);
+
+    if (what == SUDO_PLUGIN_EV_TIMEOUT) {
+	errnum = ETIMEDOUT;
+    } else {
+	ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, &optval, &optlen);
+	errnum = ret == 0 ? optval : errno;
+    }
+    race->pending--;
+    if (errnum == 0) {
+	struct timespec now;
+
+	sudo_gettime_mono(&now);
+	sudo_timespecsub(&now, &attempt->start, &now);
+	attempt->rtt = (unsigned int)(now.tv_sec * 1000000 + now.tv_nsec / 1000);
+	race->winner = attempt;
+	sudo_ev_del(race->evbase, race->delay_ev);
+	sudo_ev_loopbreak(race->evbase);
+    } else {
+	/* Connection failed, start the next attempt without delay. */
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "unable to connect to %s port %s: %s", attempt->host,
+	    attempt->port, strerror(errnum));
+	connect_attempt_record(attempt, false);
+	connect_attempt_close(attempt);
+	errno = errnum;
+	connect_attempt_next(race);
+    }
+
+    debug_return;
+}
+
+/* The delay between connection attempts has expired. */
+static void
+connect_delay_cb(int unused, int what, void *v)
+{
+    struct connect_race *race = v;
+    debug_decl(connect_delay_cb, SUDOERS_DEBUG_UTIL);
+
+    connect_attempt_next(race);
+
+    debug_return;
+}
+
+/*
+ * Run connection attempts until one succeeds or all have failed.
+ * May be called again to continue with the remaining attempts.
+ * Returns the connected attempt or NULL.
+ */
+static struct connect_attempt *
+connect_race_run(struct connect_race *race)
+{
+    debug_decl(connect_race_run, SUDOERS_DEBUG_UTIL);
+
+    race->winner = NULL;
+    if (race->pending == 0)
+	connect_attempt_next(race);
+    while (race->winner == NULL && race->pending != 0) {
+	if (sudo_ev_dispatch(race->evbase) == -1) {
+	    sudo_warn("%s", U_("error in event loop"));
 	    break;
+	}
+    }
+
+    debug_return_ptr(race->winner);
+}
+
+/*
+ * Finish setting up a connection to a log server, including the
+ * TLS handshake if needed.  Other attempts may still be in progress
+ * in case this fails.
+ * Returns open socket or -1 on error.
+ */
+static int
+connect_attempt_finish(struct connect_attempt *attempt,
+    struct client_closure *closure)
+{
+    struct connect_race *race = attempt->race;
+    struct addrinfo *res = attempt->ai;
+    const char *addr;
+    int save_errno, sock;
+    debug_decl(connect_attempt_finish, SUDOERS_DEBUG_UTIL);
+
+    switch (res->ai_family) {
+    case AF_INET:
+	addr = (char *)&((struct sockaddr_in *)res->ai_addr)->sin_addr;
+	break;
 #ifdef HAVE_STRUCT_IN6_ADDR
-	case AF_INET6:
-	    addr = (char *)&((struct sockaddr_in6 *)res->ai_addr)->sin6_addr;
-	    break;
+    case AF_INET6:
+	addr = (char *)&((struct sockaddr_in6 *)res->ai_addr)->sin6_addr;
+	break;
 #endif
-	default:
-            cause = "ai_family";
-	    save_errno = EAFNOSUPPORT;
-	    shutdown(sock, SHUT_RDWR);
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
-	}
-        if (inet_ntop(res->ai_family, addr, closure->server_ip,
-                sizeof(closure->server_ip)) == NULL) {
-            cause = "inet_ntop";
-	    save_errno = errno;
-	    shutdown(sock, SHUT_RDWR);
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
-        }
-	free(closure->server_name);
-	if ((closure->server_name = strdup(host)) == NULL) {
-	    cause = "strdup";
-	    save_errno = errno;
-	    shutdown(sock, SHUT_RDWR);
-	    close(sock);
-	    errno = save_errno;
-	    sock = -1;
-	    continue;
-	}
+    default:
+	race->cause = "ai_family";
+	errno = EAFNOSUPPORT;
+	goto bad;
+    }
+    if (inet_ntop(res->ai_family, addr, closure->server_ip,
+	    sizeof(closure->server_ip)) == NULL) {
+	race->cause = "inet_ntop";
+	goto bad;
+    }
+    free(closure->server_name);
+    if ((closure->server_name = strdup(attempt->host)) == NULL) {
+	race->cause = "strdup";
+	goto bad;
+    }
 
 #if defined(HAVE_OPENSSL)
-        if (tls) {
-            if (!tls_init(closure) || !SSL_set_fd(closure->ssl, sock)) {
-                cause = U_("TLS initialization was unsuccessful");
-                save_errno = errno;
-		shutdown(sock, SHUT_RDWR);
-                close(sock);
-                errno = save_errno;
-                sock = -1;
-                continue;
-            }
-            /* Perform TLS handshake. */
-            if (!tls_timed_connect(closure->ssl, host, port, timeout)) {
-                cause = U_("TLS handshake was unsuccessful");
-                save_errno = errno;
-		shutdown(sock, SHUT_RDWR);
-                close(sock);
-                errno = save_errno;
-                sock = -1;
-                continue;
-            }
-        } else {
-            /* No TLS for this connection, make sure it is not initialized. */
-            SSL_free(closure->ssl);
-            closure->ssl = NULL;
-            SSL_CTX_free(closure->ssl_ctx);
-            closure->ssl_ctx = NULL;
-        }
-#endif /* HAVE_OPENSSL */
-	break;	/* success */
+    if (attempt->tls) {
+	if (!tls_init(closure) || !SSL_set_fd(closure->ssl, attempt->sock)) {
+	    race->cause = U_("TLS initialization was unsuccessful");
+	    goto bad;
+	}
+	/* Perform TLS handshake. */
+	if (!tls_timed_connect(closure->ssl, attempt->host, attempt->port,
+		race->timeout)) {
+	    race->cause = U_("TLS handshake was unsuccessful");
+	    goto bad;
+	}
+    } else {
+	/* No TLS for this connection, make sure it is not initialized. */
+	SSL_free(closure->ssl);
+	closure->ssl = NULL;
+	SSL_CTX_free(closure->ssl_ctx);
+	closure->ssl_ctx = NULL;
     }
-    freeaddrinfo(res0);
-
-    if (sock == -1)
-	*reason = cause;
+#endif /* HAVE_OPENSSL */
 
+    /* The caller now owns the socket. */
+    connect_attempt_record(attempt, true);
+    sock = attempt->sock;
+    attempt->sock = -1;
+    connect_attempt_close(attempt);
     debug_return_int(sock);
+bad:
+    save_errno = errno;
+    connect_attempt_record(attempt, false);
+    shutdown(attempt->sock, SHUT_RDWR);
+    connect_attempt_close(attempt);
+    errno = save_errno;
+    debug_return_int(-1);
 }
 
 /*
- * Connect to the first server in the list.
+ * Connect to the first log server that responds.
+ * Connections to each server address are started in list order,
+ * staggered by a short delay, so an unreachable server does not
+ * hold up the others for the full timeout.
  * Stores socket in closure with O_NONBLOCK and close-on-exec flags set.
  * Returns true on success, else false.
  */
 bool
 log_server_connect(struct client_closure *closure)
 {
+    struct connect_race race;
+    struct connect_attempt *attempt;
     struct sudoers_string *server;
-    char *host, *port, *copy = NULL;
-    const char *cause = NULL;
-    int sock;
+    char *host, *port, *copy;
+    int sock = -1;
     bool tls, ret = false;
     debug_decl(log_server_connect, SUDOERS_DEBUG_UTIL);
 
+    memset(&race, 0, sizeof(race));
+    race.timeout = &closure->log_details->server_timeout;
+    race.keepalive = closure->log_details->keepalive;
+    if (closure->log_details->state_file != NULL)
+	race.state = log_server_state_open(closure->log_details->state_file);
+    race.evbase = sudo_ev_base_alloc();
+    race.delay_ev = sudo_ev_alloc(-1, SUDO_PLUGIN_EV_TIMEOUT,
+	connect_delay_cb, &race);
+    if (race.evbase == NULL || race.delay_ev == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto done;
+    }
+
     STAILQ_FOREACH(server, closure->log_details->log_servers, entries) {
-        free(copy);
-	if ((copy = strdup(server->str)) == NULL)
-                break;
+	if ((copy = strdup(server->str)) == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    goto done;
+	}
 	if (!iolog_parse_host_port(copy, &host, &port, &tls, DEFAULT_PORT,
 		DEFAULT_PORT_TLS)) {
             sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
                 "unable to parse %s", copy);
+	    free(copy);
 	    continue;
 	}
+#if !defined(HAVE_OPENSSL)
+	if (tls) {
+	    errno = EPROTONOSUPPORT;
+	    sudo_warn("%s:%s(tls)", host, port);
+	    free(copy);
+	    continue;
+	}
+#endif
         sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
             "connecting to %s port %s%s", host, port, tls ? " (tls)" : "");
-	sock = connect_server(host, port, tls, closure, &cause);
-	if (sock != -1) {
-            if (closure->read_ev->set(closure->read_ev, sock,
-                    SUDO_PLUGIN_EV_READ|SUDO_PLUGIN_EV_PERSIST,
-                    server_msg_cb, closure) == -1) {
-                cause = (U_("unable to add event to queue"));
-                break;
-            }
+	if (!connect_race_add(&race, copy, host, port, tls)) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    goto done;
+	}
+    }
+    connect_race_sort(&race);
 
-            if (closure->write_ev->set(closure->write_ev, sock,
-                    SUDO_PLUGIN_EV_WRITE|SUDO_PLUGIN_EV_PERSIST,
-                    client_msg_cb, closure) == -1) {
-                cause = (U_("unable to add event to queue"));
-                break;
-            }
+    while ((attempt = connect_race_run(&race)) != NULL) {
+	sock = connect_attempt_finish(attempt, closure);
+	if (sock != -1)
+	    break;
+    }
+    if (sock != -1) {
+	size_t i;
 
-            /* success */
-            closure->sock = sock;
-            ret = true;
-            break;
+	/* A server that was started first but has not connected is slow. */
+	for (i = 0; &race.attempts[i] != attempt; i++) {
+	    if (race.attempts[i].sock != -1)
+		connect_attempt_record(&race.attempts[i], false);
 	}
+
+	if (closure->read_ev->set(closure->read_ev, sock,
+		SUDO_PLUGIN_EV_READ|SUDO_PLUGIN_EV_PERSIST,
+		server_msg_cb, closure) == -1) {
+	    race.cause = (U_("unable to add event to queue"));
+	    close(sock);
+	    goto done;
+	}
+
+	if (closure->write_ev->set(closure->write_ev, sock,
+		SUDO_PLUGIN_EV_WRITE|SUDO_PLUGIN_EV_PERSIST,
+		client_msg_cb, closure) == -1) {
+	    race.cause = (U_("unable to add event to queue"));
+	    close(sock);
+	    goto done;
+	}
+
+	/* success */
+	closure->sock = sock;
+	ret = true;
     }
-    free(copy);
 
-    if (!ret && cause != NULL)
-        sudo_warn("%s", cause);
+done:
+    connect_race_free(&race);
+    log_server_state_close(race.state);
+    if (!ret && race.cause != NULL)
+        sudo_warn("%s", race.cause);
 
     debug_return_bool(ret);
 }
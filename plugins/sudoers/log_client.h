@@ -121,4 +121,11 @@ void client_closure_free(struct client_closure *closure);
 bool read_server_hello(struct client_closure *closure);
 extern struct client_closure *client_closure;
 
+/* log_server_state.c */
+struct log_server_state;
+struct log_server_state *log_server_state_open(const char *path);
+bool log_server_state_get(struct log_server_state *state, const char *addr, const char *port, time_t *failed, unsigned int *rtt);
+void log_server_state_set(struct log_server_state *state, const char *addr, const char *port, time_t failed, unsigned int rtt);
+void log_server_state_close(struct log_server_state *state);
+
 #endif /* SUDOERS_LOG_CLIENT_H */
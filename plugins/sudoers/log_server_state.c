@@ -0,0 +1,340 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+/*
+ * The log server state file records, for each log server address,
+ * when a connection to it last failed and how long the last successful
+ * connection took.  It is shared by all sudo processes so that when a
+ * log server goes down only the first invocation has to wait for it.
+ *
+ * Each line is of the form:
+ *	address port last_failure rtt_usec last_update
+ * where the times are seconds since the epoch.
+ */
+
+#include <config.h>
+
+#ifdef SUDOERS_LOG_CLIENT
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sudoers.h"
+#include "log_client.h"
+
+/* Upper bound on the number of addresses remembered. */
+#define LOG_SERVER_STATE_MAX	64
+
+/* Upper bound on the size of the state file we will read. */
+#define LOG_SERVER_STATE_SIZE	(LOG_SERVER_STATE_MAX * 128)
+
+struct log_server_health {
+    char addr[INET6_ADDRSTRLEN];
+    char port[32];
+    time_t failed;
+    time_t updated;
+    unsigned int rtt;
+    bool dirty;
+};
+
+struct log_server_state {
+    char *path;
+    struct log_server_health entries[LOG_SERVER_STATE_MAX];
+    size_t nentries;
+    bool dirty;
+};
+
+/*
+ * Open the state file, creating it and its parent directory as needed.
+ * Returns a locked file descriptor or -1 on error.
+ */
+static int
+state_file_open(const char *path)
+{
+    struct stat sb;
+    int fd;
+    debug_decl(state_file_open, SUDOERS_DEBUG_UTIL);
+
+    fd = open(path, O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC, S_IRUSR|S_IWUSR);
+    if (fd == -1 && errno == ENOENT) {
+	if (sudo_mkdir_parents(path, ROOT_UID, ROOT_GID,
+		S_IRWXU|S_IXGRP|S_IXOTH, true)) {
+	    fd = open(path, O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC,
+		S_IRUSR|S_IWUSR);
+	}
+    }
+    if (fd == -1) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "unable to open %s", path);
+	debug_return_int(-1);
+    }
+
+    /* Only trust a root-owned regular file that nobody else can write to. */
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+	    sb.st_uid != ROOT_UID || (sb.st_mode & (S_IWGRP|S_IWOTH))) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "ignoring insecure state file %s", path);
+	close(fd);
+	debug_return_int(-1);
+    }
+    if (!sudo_lock_file(fd, SUDO_LOCK)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "unable to lock %s", path);
+	close(fd);
+	debug_return_int(-1);
+    }
+    debug_return_int(fd);
+}
+
+/*
+ * Find the entry for addr and port, if any.
+ */
+static struct log_server_health *
+state_lookup(struct log_server_state *state, const char *addr,
+    const char *port)
+{
+    size_t i;
+    debug_decl(state_lookup, SUDOERS_DEBUG_UTIL);
+
+    for (i = 0; i < state->nentries; i++) {
+	struct log_server_health *health = &state->entries[i];
+	if (strcmp(health->addr, addr) == 0 && strcmp(health->port, port) == 0)
+	    debug_return_ptr(health);
+    }
+    debug_return_ptr(NULL);
+}
+
+/*
+ * Read the entries in the locked state file fd into state.
+ * Malformed lines are ignored.
+ */
+static void
+state_read(struct log_server_state *state, int fd)
+{
+    char *buf, *line, *last;
+    ssize_t nread;
+    debug_decl(state_read, SUDOERS_DEBUG_UTIL);
+
+    state->nentries = 0;
+    if ((buf = malloc(LOG_SERVER_STATE_SIZE + 1)) == NULL)
+	debug_return;
+    nread = pread(fd, buf, LOG_SERVER_STATE_SIZE, 0);
+    if (nread <= 0) {
+	free(buf);
+	debug_return;
+    }
+    buf[nread] = '\0';
+
+    for (line = strtok_r(buf, "\n", &last); line != NULL;
+	    line = strtok_r(NULL, "\n", &last)) {
+	struct log_server_health *health = &state->entries[state->nentries];
+	long long failed, updated;
+	unsigned int rtt;
+	char addr[INET6_ADDRSTRLEN], port[32];
+
+	if (sscanf(line, "%45s %31s %lld %u %lld", addr, port, &failed,
+		&rtt, &updated) != 5)
+	    continue;
+	if (state_lookup(state, addr, port) != NULL)
+	    continue;
+	memset(health, 0, sizeof(*health));
+	memcpy(health->addr, addr, sizeof(health->addr));
+	memcpy(health->port, port, sizeof(health->port));
+	health->failed = (time_t)failed;
+	health->updated = (time_t)updated;
+	health->rtt = rtt;
+	if (++state->nentries == LOG_SERVER_STATE_MAX)
+	    break;
+    }
+    free(buf);
+
+    debug_return;
+}
+
+/*
+ * Replace the contents of the locked state file fd with state.
+ */
+static bool
+state_write(struct log_server_state *state, int fd)
+{
+    char *buf;
+    size_t i, len = 0;
+    bool ret = false;
+    debug_decl(state_write, SUDOERS_DEBUG_UTIL);
+
+    if ((buf = malloc(LOG_SERVER_STATE_SIZE)) == NULL)
+	debug_return_bool(false);
+    for (i = 0; i < state->nentries; i++) {
+	struct log_server_health *health = &state->entries[i];
+	int n = snprintf(buf + len, LOG_SERVER_STATE_SIZE - len,
+	    "%s %s %lld %u %lld\n", health->addr, health->port,
+	    (long long)health->failed, health->rtt,
+	    (long long)health->updated);
+	if (n < 0 || (size_t)n >= LOG_SERVER_STATE_SIZE - len)
+	    break;
+	len += (size_t)n;
+    }
+    if (pwrite(fd, buf, len, 0) == (ssize_t)len && ftruncate(fd, len) == 0)
+	ret = true;
+    free(buf);
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Read the log server state file at path.
+ * Returns a state container (possibly empty) or NULL on error.
+ */
+struct log_server_state *
+log_server_state_open(const char *path)
+{
+    struct log_server_state *state;
+    int fd;
+    debug_decl(log_server_state_open, SUDOERS_DEBUG_UTIL);
+
+    if ((state = calloc(1, sizeof(*state))) == NULL)
+	debug_return_ptr(NULL);
+    if ((state->path = strdup(path)) == NULL) {
+	free(state);
+	debug_return_ptr(NULL);
+    }
+    if ((fd = state_file_open(path)) != -1) {
+	state_read(state, fd);
+	close(fd);
+    }
+    debug_return_ptr(state);
+}
+
+/*
+ * Look up the health of the server at addr and port.
+ * Returns true if found, filling in failed and rtt.
+ */
+bool
+log_server_state_get(struct log_server_state *state, const char *addr,
+    const char *port, time_t *failed, unsigned int *rtt)
+{
+    struct log_server_health *health;
+    debug_decl(log_server_state_get, SUDOERS_DEBUG_UTIL);
+
+    if ((health = state_lookup(state, addr, port)) == NULL)
+	debug_return_bool(false);
+    *failed = health->failed;
+    *rtt = health->rtt;
+    debug_return_bool(true);
+}
+
+/*
+ * Record the result of a connection to the server at addr and port.
+ * If failed is zero the connection succeeded after rtt microseconds.
+ * The least recently updated entry is replaced if there is no room.
+ */
+void
+log_server_state_set(struct log_server_state *state, const char *addr,
+    const char *port, time_t failed, unsigned int rtt)
+{
+    struct log_server_health *health;
+    size_t i;
+    debug_decl(log_server_state_set, SUDOERS_DEBUG_UTIL);
+
+    if (strlen(addr) >= sizeof(health->addr) ||
+	    strlen(port) >= sizeof(health->port))
+	debug_return;
+
+    if ((health = state_lookup(state, addr, port)) == NULL) {
+	if (state->nentries < LOG_SERVER_STATE_MAX) {
+	    health = &state->entries[state->nentries++];
+	} else {
+	    health = &state->entries[0];
+	    for (i = 1; i < state->nentries; i++) {
+		if (state->entries[i].updated < health->updated)
+		    health = &state->entries[i];
+	    }
+	}
+	memset(health, 0, sizeof(*health));
+	memcpy(health->addr, addr, strlen(addr) + 1);
+	memcpy(health->port, port, strlen(port) + 1);
+    }
+    health->failed = failed;
+    if (failed == 0)
+	health->rtt = rtt;
+    health->updated = time(NULL);
+    health->dirty = true;
+    state->dirty = true;
+
+    debug_return;
+}
+
+/*
+ * Merge any changes into the state file and free state.
+ * Entries updated by other processes in the mean time are preserved.
+ */
+void
+log_server_state_close(struct log_server_state *state)
+{
+    struct log_server_state *current = NULL;
+    size_t i;
+    int fd = -1;
+    debug_decl(log_server_state_close, SUDOERS_DEBUG_UTIL);
+
+    if (state == NULL)
+	debug_return;
+
+    if (state->dirty) {
+	if ((current = calloc(1, sizeof(*current))) == NULL)
+	    goto done;
+	if ((fd = state_file_open(state->path)) == -1)
+	    goto done;
+	state_read(current, fd);
+	for (i = 0; i < state->nentries; i++) {
+	    struct log_server_health *health = &state->entries[i];
+
+	    if (health->dirty) {
+		log_server_state_set(current, health->addr, health->port,
+		    health->failed, health->rtt);
+	    }
+	}
+	if (!state_write(current, fd)) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"unable to write %s", state->path);
+	}
+    }
+
+done:
+    if (fd != -1)
+	close(fd);
+    free(current);
+    free(state->path);
+    free(state);
+
+    debug_return;
+}
+
+#endif /* SUDOERS_LOG_CLIENT */
@@ -116,6 +116,7 @@ init_log_details(struct log_details *details, struct eventlog *evlog)
     details->log_servers = log_servers;
     details->server_timeout.tv_sec = def_log_server_timeout;
     details->keepalive = def_log_server_keepalive;
+    details->state_file = def_log_server_state;
 #if defined(HAVE_OPENSSL)
     details->ca_bundle = def_log_server_cabundle;
     details->cert_file = def_log_server_peer_cert;
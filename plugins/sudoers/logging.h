@@ -27,6 +27,7 @@ struct log_details {
     struct eventlog *evlog;
     struct sudoers_str_list *log_servers;
     struct timespec server_timeout;
+    char *state_file;
 # if defined(HAVE_OPENSSL)
     char *ca_bundle;
     char *cert_file;
@@ -49,6 +49,20 @@ runas_matches_pw(struct sudoers_parse_tree *parse_tree,
     debug_return_int(UNSPEC);
 }
 
+/*
+ * Return the Cmnd_Spec to match after prev, which is at index i.
+ * Uses the compiled array if present, else walks the cmndlist.
+ */
+static inline struct cmndspec *
+cmndspec_next(const struct privilege *priv, struct cmndspec *prev, size_t i)
+{
+    if (priv->cmndvec != NULL)
+	return i < priv->ncmnds ? priv->cmndvec[i] : NULL;
+    if (prev == NULL)
+	return TAILQ_LAST(&priv->cmndlist, cmndspec_list);
+    return TAILQ_PREV(prev, cmndspec_list, entries);
+}
+
 /*
  * Look up the user in the sudoers parse tree for pseudo-commands like
  * list, verify and kill.
@@ -91,6 +105,9 @@ sudoers_lookup_pseudo(struct sudo_nss_list *snl, struct passwd *pw, time_t now,
 	    break;
 	}
 
+	/* Alias match results are only reused within a single check. */
+	match_memo_begin();
+
 	/*
 	 * We have to traverse the policy forwards, not in reverse,
 	 * to support the "pwcheck == all" case.
@@ -197,6 +214,7 @@ sudoers_lookup_pseudo(struct sudo_nss_list *snl, struct passwd *pw, time_t now,
 		}
 	    }
 	}
+	match_memo_end();
 	if (!sudo_nss_can_continue(nss, match))
 	    break;
     }
@@ -236,10 +254,14 @@ sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
     struct privilege *priv;
     struct userspec *us;
     struct member *matching_user;
+    size_t i;
     debug_decl(sudoers_lookup_check, SUDOERS_DEBUG_PARSER);
 
     init_cmnd_info(info);
 
+    /* Alias match results are only reused within a single check. */
+    match_memo_begin();
+
     TAILQ_FOREACH_REVERSE(us, &nss->parse_tree->userspecs, userspec_list, entries) {
 	int user_match = userlist_matches(nss->parse_tree, pw, &us->users);
 	if (user_match != ALLOW) {
@@ -262,11 +284,21 @@ sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
 		}
 		continue;
 	    }
-	    TAILQ_FOREACH_REVERSE(cs, &priv->cmndlist, cmndspec_list, entries) {
+	    for (i = 0, cs = cmndspec_next(priv, NULL, 0); cs != NULL;
+		    cs = cmndspec_next(priv, cs, ++i)) {
 		int cmnd_match = UNSPEC;
 		int date_match = UNSPEC;
 		int runas_match = UNSPEC;
 
+		/*
+		 * Skip compiled specs whose command basename cannot match.
+		 * The command would be UNSPEC so there is nothing to report.
+		 */
+		if (priv->cmndvec != NULL && priv->cmndbase[i] != NULL &&
+			user_ctx.cmnd_base != NULL &&
+			strcmp(priv->cmndbase[i], user_ctx.cmnd_base) != 0)
+		    continue;
+
 		if (cs->notbefore != UNSPEC) {
 		    date_match = now < cs->notbefore ? DENY : ALLOW;
 		}
@@ -305,6 +337,7 @@ sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
 			"userspec matched @ %s:%d:%d: %s",
 			us->file ? us->file : "???", us->line, us->column,
 			cmnd_match ? "allowed" : "denied");
+		    match_memo_end();
 		    debug_return_int(cmnd_match);
 		}
 		free(info->cmnd_path);
@@ -312,6 +345,7 @@ sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
 	    }
 	}
     }
+    match_memo_end();
     debug_return_int(UNSPEC);
 }
 
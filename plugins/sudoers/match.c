@@ -58,6 +58,113 @@
 #include "sudoers.h"
 #include <gram.h>
 
+/*
+ * Per-check memoization of alias and runas list match results.
+ * Between match_memo_begin() and match_memo_end(), the result of
+ * matching a User_Alias, Host_Alias or Runas_Alias is stored in the
+ * alias itself and reused when the alias is referenced again.
+ * Results are tagged with a generation number, which is bumped at
+ * the start of each check and when the runas user or group changes.
+ * Only top-level alias references are memoized.  Inside another alias,
+ * loop detection can make the result depend on which aliases are
+ * already being matched.
+ */
+#define MEMO_USER	0	/* user, host or runas user match */
+#define MEMO_GROUP	1	/* runas group match */
+
+struct runaslist_memo {
+    const struct member_list *list;
+    struct member *member;
+    unsigned int gen;
+    int result;
+};
+
+static struct match_memo {
+    unsigned int gen;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int depth;
+    bool enabled;
+    struct runaslist_memo runas[2];
+} memo;
+
+/*
+ * Start a new check, discarding results memoized by any previous one.
+ */
+void
+match_memo_begin(void)
+{
+    debug_decl(match_memo_begin, SUDOERS_DEBUG_MATCH);
+
+    match_memo_invalidate();
+    memo.hits = 0;
+    memo.misses = 0;
+    memo.enabled = true;
+
+    debug_return;
+}
+
+/*
+ * Finish a check; match results are no longer memoized.
+ */
+void
+match_memo_end(void)
+{
+    debug_decl(match_memo_end, SUDOERS_DEBUG_MATCH);
+
+    if (memo.enabled) {
+	sudo_debug_printf(SUDO_DEBUG_INFO,
+	    "match memo: %u hits, %u misses", memo.hits, memo.misses);
+	memo.enabled = false;
+    }
+
+    debug_return;
+}
+
+/*
+ * Invalidate all memoized results, e.g. when the runas user changes.
+ */
+void
+match_memo_invalidate(void)
+{
+    debug_decl(match_memo_invalidate, SUDOERS_DEBUG_MATCH);
+
+    /* Generation 0 is never current, it is what a new alias starts with. */
+    if (++memo.gen == 0)
+	memo.gen = 1;
+
+    debug_return;
+}
+
+static bool
+alias_memo_get(const struct alias *a, int slot, const void *key, int *result,
+    struct member **matching)
+{
+    if (!memo.enabled || memo.depth != 0)
+	return false;
+    if (a->memo_gen[slot] != memo.gen || a->memo_key[slot] != key) {
+	memo.misses++;
+	return false;
+    }
+    memo.hits++;
+    *result = a->memo_result[slot];
+    if (matching != NULL && a->memo_member[slot] != NULL)
+	*matching = a->memo_member[slot];
+    return true;
+}
+
+static void
+alias_memo_set(struct alias *a, int slot, const void *key, int result,
+    struct member *matching)
+{
+    if (memo.enabled && memo.depth == 0) {
+	a->memo_gen[slot] = memo.gen;
+	a->memo_key[slot] = key;
+	a->memo_result[slot] = (short)result;
+	a->memo_member[slot] = matching;
+    }
+}
+
 /*
  * Check whether user described by pw matches member.
  * Returns ALLOW, DENY or UNSPEC.
@@ -89,7 +196,13 @@ user_matches(const struct sudoers_parse_tree *parse_tree,
 	case ALIAS:
 	    if ((a = alias_get(parse_tree, m->name, USERALIAS)) != NULL) {
 		/* XXX */
-		int rc = userlist_matches(parse_tree, pw, &a->members);
+		int rc;
+		if (!alias_memo_get(a, MEMO_USER, pw, &rc, NULL)) {
+		    memo.depth++;
+		    rc = userlist_matches(parse_tree, pw, alias_members(a));
+		    memo.depth--;
+		    alias_memo_set(a, MEMO_USER, pw, rc, NULL);
+		}
 		if (rc != UNSPEC)
 		    matched = m->negated ? !rc : rc;
 		alias_put(a);
@@ -175,8 +288,18 @@ runas_userlist_matches(const struct sudoers_parse_tree *parse_tree,
 	    case ALIAS:
 		a = alias_get(parse_tree, m->name, RUNASALIAS);
 		if (a != NULL) {
-		    const int rc = runas_userlist_matches(parse_tree,
-			&a->members, matching_user);
+		    int rc;
+		    if (!alias_memo_get(a, MEMO_USER, runas_ctx.pw, &rc,
+			    matching_user)) {
+			struct member *mm = NULL;
+			memo.depth++;
+			rc = runas_userlist_matches(parse_tree,
+			    alias_members(a), &mm);
+			memo.depth--;
+			alias_memo_set(a, MEMO_USER, runas_ctx.pw, rc, mm);
+			if (matching_user != NULL && mm != NULL)
+			    *matching_user = mm;
+		    }
 		    if (rc != UNSPEC)
 			user_matched = m->negated ? !rc : rc;
 		    alias_put(a);
@@ -231,8 +354,22 @@ runas_grouplist_matches(const struct sudoers_parse_tree *parse_tree,
 		case ALIAS:
 		    a = alias_get(parse_tree, m->name, RUNASALIAS);
 		    if (a != NULL) {
-			const int rc = runas_grouplist_matches(parse_tree,
-			    &a->members, matching_group);
+			int rc;
+			/*
+			 * Not flattened: each nested alias falls back on
+			 * the runas user's groups when nothing matches.
+			 */
+			if (!alias_memo_get(a, MEMO_GROUP, runas_ctx.gr, &rc,
+				matching_group)) {
+			    struct member *mm = NULL;
+			    memo.depth++;
+			    rc = runas_grouplist_matches(parse_tree,
+				&a->members, &mm);
+			    memo.depth--;
+			    alias_memo_set(a, MEMO_GROUP, runas_ctx.gr, rc, mm);
+			    if (matching_group != NULL && mm != NULL)
+				*matching_group = mm;
+			}
 			if (rc != UNSPEC)
 			    group_matched = m->negated ? !rc : rc;
 			alias_put(a);
@@ -275,6 +412,42 @@ runas_grouplist_matches(const struct sudoers_parse_tree *parse_tree,
     debug_return_int(group_matched);
 }
 
+/*
+ * Like runas_userlist_matches() or runas_grouplist_matches(), depending
+ * on slot, but reuses the result for list if it was the last one checked.
+ * Consecutive commands in a privilege usually share the same runas lists.
+ */
+static int
+runaslist_matches_memo(const struct sudoers_parse_tree *parse_tree,
+    int slot, const struct member_list *list, struct member **matching)
+{
+    struct runaslist_memo *rm = &memo.runas[slot];
+    struct member *mm = NULL;
+    int rc;
+    debug_decl(runaslist_matches_memo, SUDOERS_DEBUG_MATCH);
+
+    if (memo.enabled && rm->list == list && rm->gen == memo.gen) {
+	memo.hits++;
+	rc = rm->result;
+	mm = rm->member;
+    } else {
+	if (slot == MEMO_USER)
+	    rc = runas_userlist_matches(parse_tree, list, &mm);
+	else
+	    rc = runas_grouplist_matches(parse_tree, list, &mm);
+	if (memo.enabled) {
+	    memo.misses++;
+	    rm->list = list;
+	    rm->gen = memo.gen;
+	    rm->result = rc;
+	    rm->member = mm;
+	}
+    }
+    if (matching != NULL && mm != NULL)
+	*matching = mm;
+    debug_return_int(rc);
+}
+
 /*
  * Check whether the sudoers runaslist, composed of user_list and
  * group_list, matches the runas user/group requested by the user.
@@ -302,10 +475,20 @@ runaslist_matches(const struct sudoers_parse_tree *parse_tree,
 	matching_user = NULL;
     }
 
-    user_matched = runas_userlist_matches(parse_tree, user_list, matching_user);
+    if (user_list == &_user_list) {
+	user_matched = runas_userlist_matches(parse_tree, user_list, NULL);
+    } else {
+	user_matched = runaslist_matches_memo(parse_tree, MEMO_USER,
+	    user_list, matching_user);
+    }
     if (ISSET(runas_ctx.flags, RUNAS_GROUP_SPECIFIED)) {
-	group_matched = runas_grouplist_matches(parse_tree, group_list,
-	    matching_group);
+	if (group_list == NULL) {
+	    group_matched = runas_grouplist_matches(parse_tree, NULL,
+		matching_group);
+	} else {
+	    group_matched = runaslist_matches_memo(parse_tree, MEMO_GROUP,
+		group_list, matching_group);
+	}
     }
 
     if (user_matched == DENY || group_matched == DENY)
@@ -373,15 +556,28 @@ host_matches(const struct sudoers_parse_tree *parse_tree,
 		matched = !m->negated;
 	    break;
 	case NTWKADDR:
-	    if (addr_matches(m->name))
+	    switch (addr_matches(m->name)) {
+	    case true:
 		matched = !m->negated;
+		break;
+	    case -1:
+		/* Local addresses unknown, do not let a negation match. */
+		matched = DENY;
+		break;
+	    }
 	    break;
 	case ALIAS:
 	    a = alias_get(parse_tree, m->name, HOSTALIAS);
 	    if (a != NULL) {
 		/* XXX */
-		int rc = hostlist_matches_int(parse_tree, pw, lhost, shost,
-		    &a->members);
+		int rc;
+		if (!alias_memo_get(a, MEMO_USER, pw, &rc, NULL)) {
+		    memo.depth++;
+		    rc = hostlist_matches_int(parse_tree, pw, lhost, shost,
+			alias_members(a));
+		    memo.depth--;
+		    alias_memo_set(a, MEMO_USER, pw, rc, NULL);
+		}
 		if (rc != UNSPEC)
 		    matched = m->negated ? !rc : rc;
 		alias_put(a);
@@ -444,7 +640,8 @@ cmnd_matches(const struct sudoers_parse_tree *parse_tree,
 	case ALIAS:
 	    a = alias_get(parse_tree, m->name, CMNDALIAS);
 	    if (a != NULL) {
-		rc = cmndlist_matches(parse_tree, &a->members, runchroot, info);
+		rc = cmndlist_matches(parse_tree, alias_members(a), runchroot,
+		    info);
 		if (rc != UNSPEC)
 		    matched = m->negated ? !rc : rc;
 		alias_put(a);
@@ -477,7 +674,7 @@ cmnd_matches_all(const struct sudoers_parse_tree *parse_tree,
 	case ALIAS:
 	    a = alias_get(parse_tree, m->name, CMNDALIAS);
 	    if (a != NULL) {
-		TAILQ_FOREACH_REVERSE(m, &a->members, member_list, entries) {
+		TAILQ_FOREACH_REVERSE(m, alias_members(a), member_list, entries) {
 		    matched = cmnd_matches_all(parse_tree, m, runchroot, info);
 		    if (matched != UNSPEC) {
 			if (negated)
@@ -44,10 +44,11 @@
 #include "sudoers.h"
 #include "interfaces.h"
 
-static bool
+static int
 addr_matches_if(const char *n)
 {
     union sudo_in_addr_un addr;
+    struct interface_list *ifaces;
     struct interface *ifp;
 #ifdef HAVE_STRUCT_IN6_ADDR
     size_t j;
@@ -63,10 +64,12 @@ addr_matches_if(const char *n)
     if (inet_pton(AF_INET, n, &addr.ip4) == 1) {
 	family = AF_INET;
     } else {
-	debug_return_bool(false);
+	debug_return_int(false);
     }
 
-    SLIST_FOREACH(ifp, get_interfaces(), entries) {
+    if ((ifaces = get_interfaces()) == NULL)
+	debug_return_int(-1);
+    SLIST_FOREACH(ifp, ifaces, entries) {
 	if (ifp->family != family)
 	    continue;
 	switch (family) {
@@ -74,32 +77,33 @@ addr_matches_if(const char *n)
 		if (ifp->addr.ip4.s_addr == addr.ip4.s_addr ||
 		    (ifp->addr.ip4.s_addr & ifp->netmask.ip4.s_addr)
 		    == addr.ip4.s_addr)
-		    debug_return_bool(true);
+		    debug_return_int(true);
 		break;
 #ifdef HAVE_STRUCT_IN6_ADDR
 	    case AF_INET6:
 		if (memcmp(ifp->addr.ip6.s6_addr, addr.ip6.s6_addr,
 		    sizeof(addr.ip6.s6_addr)) == 0)
-		    debug_return_bool(true);
+		    debug_return_int(true);
 		for (j = 0; j < sizeof(addr.ip6.s6_addr); j++) {
 		    if ((ifp->addr.ip6.s6_addr[j] & ifp->netmask.ip6.s6_addr[j]) != addr.ip6.s6_addr[j])
 			break;
 		}
 		if (j == sizeof(addr.ip6.s6_addr))
-		    debug_return_bool(true);
+		    debug_return_int(true);
 		break;
 #endif /* HAVE_STRUCT_IN6_ADDR */
 	}
     }
 
-    debug_return_bool(false);
+    debug_return_int(false);
 }
 
-static bool
+static int
 addr_matches_if_netmask(const char *n, const char *m)
 {
     size_t i;
     union sudo_in_addr_un addr, mask;
+    struct interface_list *ifaces;
     struct interface *ifp;
 #ifdef HAVE_STRUCT_IN6_ADDR
     size_t j;
@@ -116,7 +120,7 @@ addr_matches_if_netmask(const char *n, const char *m)
     if (inet_pton(AF_INET, n, &addr.ip4) == 1) {
 	family = AF_INET;
     } else {
-	debug_return_bool(false);
+	debug_return_int(false);
     }
 
     if (family == AF_INET) {
@@ -124,14 +128,14 @@ addr_matches_if_netmask(const char *n, const char *m)
 	    if (inet_pton(AF_INET, m, &mask.ip4) != 1) {
 		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 		    "IPv4 netmask %s: %s", m, "invalid value");
-		debug_return_bool(false);
+		debug_return_int(false);
 	    }
 	} else {
 	    i = (size_t)sudo_strtonum(m, 1, 32, &errstr);
 	    if (errstr != NULL) {
 		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 		    "IPv4 netmask %s: %s", m, errstr);
-		debug_return_bool(false);
+		debug_return_int(false);
 	    }
 	    mask.ip4.s_addr = htonl(0xffffffffU << (32 - i));
 	}
@@ -144,7 +148,7 @@ addr_matches_if_netmask(const char *n, const char *m)
 	    if (errstr != NULL) {
 		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 		    "IPv6 netmask %s: %s", m, errstr);
-		debug_return_bool(false);
+		debug_return_int(false);
 	    }
 	    for (i = 0; i < sizeof(addr.ip6.s6_addr); i++) {
 		if (j < i * 8)
@@ -159,13 +163,15 @@ addr_matches_if_netmask(const char *n, const char *m)
     }
 #endif /* HAVE_STRUCT_IN6_ADDR */
 
-    SLIST_FOREACH(ifp, get_interfaces(), entries) {
+    if ((ifaces = get_interfaces()) == NULL)
+	debug_return_int(-1);
+    SLIST_FOREACH(ifp, ifaces, entries) {
 	if (ifp->family != family)
 	    continue;
 	switch (family) {
 	    case AF_INET:
 		if ((ifp->addr.ip4.s_addr & mask.ip4.s_addr) == addr.ip4.s_addr)
-		    debug_return_bool(true);
+		    debug_return_int(true);
 		break;
 #ifdef HAVE_STRUCT_IN6_ADDR
 	    case AF_INET6:
@@ -174,24 +180,25 @@ addr_matches_if_netmask(const char *n, const char *m)
 			break;
 		}
 		if (j == sizeof(addr.ip6.s6_addr))
-		    debug_return_bool(true);
+		    debug_return_int(true);
 		break;
 #endif /* HAVE_STRUCT_IN6_ADDR */
 	}
     }
 
-    debug_return_bool(false);
+    debug_return_int(false);
 }
 
 /*
  * Returns true if "n" is one of our ip addresses or if
- * "n" is a network that we are on, else returns false.
+ * "n" is a network that we are on, false if it is not, or
+ * -1 if the list of local addresses is not available.
  */
-bool
+int
 addr_matches(char *n)
 {
     char *m;
-    bool rc;
+    int rc;
     debug_decl(addr_matches, SUDOERS_DEBUG_MATCH);
 
     /* If there's an explicit netmask, use it. */
@@ -203,6 +210,7 @@ addr_matches(char *n)
 	rc = addr_matches_if(n);
 
     sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-	"IP address %s matches local host: %s", n, rc ? "true" : "false");
-    debug_return_bool(rc);
+	"IP address %s matches local host: %s", n,
+	rc == -1 ? "error" : rc ? "true" : "false");
+    debug_return_int(rc);
 }
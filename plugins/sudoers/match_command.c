@@ -915,3 +915,79 @@ done:
 	rc ? "true" : "false");
     debug_return_bool(rc);
 }
+
+/*
+ * Return the basename a command must have to match cs, or NULL if
+ * the command cannot be rejected by name alone.  This mirrors the
+ * basename check in command_matches_normal() above.
+ */
+static const char *
+cmndspec_basename(const struct cmndspec *cs)
+{
+    const struct sudo_command *c;
+    size_t len;
+    debug_decl(cmndspec_basename, SUDOERS_DEBUG_PARSER);
+
+    if (cs->cmnd->type != COMMAND || cs->runchroot != NULL)
+	debug_return_const_str(NULL);
+    c = (struct sudo_command *)cs->cmnd->name;
+    if (c->cmnd == NULL || c->cmnd[0] != '/' || has_meta(c->cmnd))
+	debug_return_const_str(NULL);
+    len = strlen(c->cmnd);
+    if (c->cmnd[len - 1] == '/')
+	debug_return_const_str(NULL);
+    debug_return_const_str(sudo_basename(c->cmnd));
+}
+
+/*
+ * Build a flat array of each privilege's Cmnd_Specs in the order
+ * they are matched (last to first) along with the basename each
+ * command must have.  This lets sudoers_lookup_check() skip specs
+ * that cannot match without walking the list or calling into the
+ * command matcher.  The cmndlist is left intact for display purposes.
+ * Privileges that are not compiled are matched using the cmndlist.
+ */
+bool
+sudoers_compile_privileges(struct sudoers_parse_tree *parse_tree)
+{
+    struct privilege *priv;
+    struct userspec *us;
+    struct cmndspec *cs;
+    size_t n;
+    debug_decl(sudoers_compile_privileges, SUDOERS_DEBUG_PARSER);
+
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries) {
+	TAILQ_FOREACH(priv, &us->privileges, entries) {
+	    free(priv->cmndvec);
+	    free(priv->cmndbase);
+	    priv->cmndvec = NULL;
+	    priv->cmndbase = NULL;
+	    priv->ncmnds = 0;
+
+	    n = 0;
+	    TAILQ_FOREACH(cs, &priv->cmndlist, entries)
+		n++;
+	    if (n == 0)
+		continue;
+	    priv->cmndvec = reallocarray(NULL, n, sizeof(*priv->cmndvec));
+	    priv->cmndbase = reallocarray(NULL, n, sizeof(*priv->cmndbase));
+	    if (priv->cmndvec == NULL || priv->cmndbase == NULL) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		free(priv->cmndvec);
+		free(priv->cmndbase);
+		priv->cmndvec = NULL;
+		priv->cmndbase = NULL;
+		debug_return_bool(false);
+	    }
+	    n = 0;
+	    TAILQ_FOREACH_REVERSE(cs, &priv->cmndlist, cmndspec_list, entries) {
+		priv->cmndvec[n] = cs;
+		priv->cmndbase[n] = cmndspec_basename(cs);
+		n++;
+	    }
+	    priv->ncmnds = n;
+	}
+    }
+    debug_return_bool(true);
+}
@@ -206,6 +206,9 @@ struct privilege {
     struct member_list hostlist;	/* list of hosts */
     struct cmndspec_list cmndlist;	/* list of Cmnd_Specs */
     struct defaults_list defaults;	/* list of sudoOptions */
+    struct cmndspec **cmndvec;		/* Cmnd_Specs in match order */
+    const char **cmndbase;		/* basename each must match, or NULL */
+    size_t ncmnds;			/* number of entries in cmndvec */
 };
 
 /*
@@ -281,8 +284,21 @@ struct alias {
     int column;				/* column number of alias entry */
     char *file;				/* file the alias entry was in */
     struct member_list members;		/* list of alias members */
+    struct member_list expansion;	/* members with nested aliases inlined */
+    bool expanded;			/* true if expansion is valid */
+    short memo_result[2];		/* memoized ALLOW, DENY or UNSPEC */
+    unsigned int memo_gen[2];		/* match memo generation of result */
+    const void *memo_key[2];		/* passwd or group result is for */
+    struct member *memo_member[2];	/* matching runas member, if any */
 };
 
+/*
+ * Members to use when matching an alias: the flattened expansion
+ * if alias_expand() has been run, else the list as parsed.
+ */
+#define alias_members(_a) \
+    ((_a)->expanded ? &(_a)->expansion : &(_a)->members)
+
 /*
  * Structure describing a Defaults entry in sudoers.
  */
@@ -396,7 +412,9 @@ bool alias_add(struct sudoers_parse_tree *parse_tree, char *name, short type, ch
 const char *alias_type_to_string(short alias_type);
 struct alias *alias_get(const struct sudoers_parse_tree *parse_tree, const char *name, short type);
 struct alias *alias_remove(struct sudoers_parse_tree *parse_tree, const char *name, short type);
+bool alias_insert(struct sudoers_parse_tree *parse_tree, struct alias *a);
 bool alias_find_used(struct sudoers_parse_tree *parse_tree, struct rbtree *used_aliases);
+bool alias_expand(struct sudoers_parse_tree *parse_tree);
 void alias_apply(struct sudoers_parse_tree *parse_tree, int (*func)(struct sudoers_parse_tree *, struct alias *, void *), void *cookie);
 void alias_free(void *a);
 void alias_put(struct alias *a);
@@ -433,10 +451,11 @@ bool sudoers_error_recovery(void);
 bool sudoers_strict(void);
 
 /* match_addr.c */
-bool addr_matches(char *n);
+int addr_matches(char *n);
 
 /* match_command.c */
 bool command_matches(const char *sudoers_cmnd, const char *sudoers_args, const char *runchroot, struct cmnd_info *info, const struct command_digest_list *digests);
+bool sudoers_compile_privileges(struct sudoers_parse_tree *parse_tree);
 
 /* match_digest.c */
 bool digest_matches(int fd, const char *path, const struct command_digest_list *digests);
@@ -457,6 +476,9 @@ int hostlist_matches(const struct sudoers_parse_tree *parse_tree, const struct p
 int runaslist_matches(const struct sudoers_parse_tree *parse_tree, const struct member_list *user_list, const struct member_list *group_list, struct member **matching_user, struct member **matching_group);
 int user_matches(const struct sudoers_parse_tree *parse_tree, const struct passwd *pw, const struct member *m);
 int userlist_matches(const struct sudoers_parse_tree *parse_tree, const struct passwd *pw, const struct member_list *list);
+void match_memo_begin(void);
+void match_memo_end(void);
+void match_memo_invalidate(void);
 const char *sudo_getdomainname(void);
 struct gid_list *runas_getgroups(void);
 
@@ -482,7 +504,7 @@ unsigned char *sudo_filedigest(int fd, const char *file, unsigned int digest_typ
 /* digestname.c */
 const char *digest_type_to_name(unsigned int digest_type);
 
-/* parse.c */
+/* lookup.c */
 struct sudo_nss_list;
 unsigned int sudoers_lookup(struct sudo_nss_list *snl, struct passwd *pw, time_t now, sudoers_lookup_callback_fn_t callback, void *cb_data, int *cmnd_status, int pwflag);
 
@@ -490,6 +512,12 @@ unsigned int sudoers_lookup(struct sudo_nss_list *snl, struct passwd *pw, time_t
 int display_privs(const struct sudo_nss_list *snl, struct passwd *pw, bool verbose);
 int display_cmnd(const struct sudo_nss_list *snl, struct passwd *pw, bool verbose);
 
+/* parse_reload.c */
+struct sudoers_reload;
+struct sudoers_reload *sudoers_reload_open(const struct sudoers_parser_config *conf, struct sudoers_parse_tree *parse_tree);
+int sudoers_reload(struct sudoers_reload *rl);
+void sudoers_reload_free(struct sudoers_reload *rl);
+
 /* parse_ldif.c */
 bool sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree, FILE *fp, const char *sudoers_base, bool store_options);
 
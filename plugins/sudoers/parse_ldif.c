@@ -467,6 +467,47 @@ role_to_sudoers(struct sudoers_parse_tree *parse_tree, struct sudo_role *role,
     debug_return;
 }
 
+/*
+ * Convert a sudo_role to sudoers data structures, merging it into
+ * the previous userspec and privilege where possible.  Roles must
+ * be converted in sudoOrder order.
+ */
+static void
+ldif_role_to_sudoers(struct sudoers_parse_tree *parse_tree,
+    struct sudo_role *role, struct sudo_role *prev_role, bool store_options)
+{
+    bool reuse_userspec = false;
+    bool reuse_privilege = false;
+    bool reuse_runas = false;
+    debug_decl(ldif_role_to_sudoers, SUDOERS_DEBUG_UTIL);
+
+    /* Check whether we can reuse the previous user and host specs */
+    if (prev_role != NULL && role->users == prev_role->users) {
+	reuse_userspec = true;
+
+	/*
+	 * Since options are stored per-privilege we can't
+	 * append to the previous privilege's cmndlist if
+	 * we are storing options.
+	 */
+	if (!store_options) {
+	    if (role->hosts == prev_role->hosts) {
+		reuse_privilege = true;
+
+		/* Reuse runasusers and runasgroups if possible. */
+		if (role->runasusers == prev_role->runasusers &&
+		    role->runasgroups == prev_role->runasgroups)
+		    reuse_runas = true;
+	    }
+	}
+    }
+
+    role_to_sudoers(parse_tree, role, store_options, reuse_userspec,
+	reuse_privilege, reuse_runas);
+
+    debug_return;
+}
+
 /*
  * Convert the list of sudoRoles to sudoers format and store in the parse tree.
  */
@@ -494,37 +535,9 @@ ldif_to_sudoers(struct sudoers_parse_tree *parse_tree,
     /*
      * Iterate over roles in sorted order, converting to sudoers.
      */
-    for (n = 0, role = NULL; n < numroles; n++) {
-	bool reuse_userspec = false;
-	bool reuse_privilege = false;
-	bool reuse_runas = false;
-	struct sudo_role *prev_role = role;
-
-	role = role_array[n];
-
-	/* Check whether we can reuse the previous user and host specs */
-	if (prev_role != NULL && role->users == prev_role->users) {
-	    reuse_userspec = true;
-
-	    /*
-	     * Since options are stored per-privilege we can't
-	     * append to the previous privilege's cmndlist if
-	     * we are storing options.
-	     */
-	    if (!store_options) {
-		if (role->hosts == prev_role->hosts) {
-		    reuse_privilege = true;
-
-		    /* Reuse runasusers and runasgroups if possible. */
-		    if (role->runasusers == prev_role->runasusers &&
-			role->runasgroups == prev_role->runasgroups)
-			reuse_runas = true;
-		}
-	    }
-	}
-
-	role_to_sudoers(parse_tree, role, store_options, reuse_userspec,
-	    reuse_privilege, reuse_runas);
+    for (n = 0; n < numroles; n++) {
+	ldif_role_to_sudoers(parse_tree, role_array[n],
+	    n ? role_array[n - 1] : NULL, store_options);
     }
 
     /* Clean up. */
@@ -561,41 +574,85 @@ char *unquote_cn(const char *src)
     debug_return_str(new_cn);
 }
 
+enum ldif_mode {
+    LDIF_CHECK_ORDER,		/* only check whether roles are sorted */
+    LDIF_STREAM,		/* convert each role as soon as it is read */
+    LDIF_BUFFER			/* store all roles, sort, then convert */
+};
+
+struct ldif_reader {
+    struct sudoers_parse_tree *parse_tree;
+    const char *sudoers_base;
+    struct rbtree *usercache, *groupcache, *hostcache;
+    struct sudo_role_list roles;	/* LDIF_BUFFER */
+    struct sudo_role *prev_role;	/* LDIF_STREAM */
+    double prev_order;			/* LDIF_CHECK_ORDER */
+    unsigned int numroles;
+    enum ldif_mode mode;
+    bool store_options;
+    bool sorted;
+};
+
+/*
+ * Store a complete sudoRole based on the reader mode.
+ * In LDIF_STREAM mode, the role is converted to sudoers format
+ * immediately and only the previous role is kept.
+ */
+static void
+ldif_store_role(struct ldif_reader *reader, struct sudo_role *role)
+{
+    debug_decl(ldif_store_role, SUDOERS_DEBUG_UTIL);
+
+    if (reader->mode == LDIF_CHECK_ORDER) {
+	if (reader->numroles != 0 && role->order < reader->prev_order)
+	    reader->sorted = false;
+	reader->prev_order = role->order;
+	reader->numroles++;
+	sudo_role_free(role);
+	debug_return;
+    }
+
+    /* Cache users, hosts, runasusers and runasgroups. */
+    if (str_list_cache(reader->usercache, &role->users) == -1 ||
+	str_list_cache(reader->hostcache, &role->hosts) == -1 ||
+	str_list_cache(reader->usercache, &role->runasusers) == -1 ||
+	str_list_cache(reader->groupcache, &role->runasgroups) == -1) {
+	sudo_fatalx(U_("%s: %s"), __func__,
+	    U_("unable to allocate memory"));
+    }
+
+    if (reader->mode == LDIF_STREAM) {
+	ldif_role_to_sudoers(reader->parse_tree, role, reader->prev_role,
+	    reader->store_options);
+	sudo_role_free(reader->prev_role);
+	reader->prev_role = role;
+    } else {
+	STAILQ_INSERT_TAIL(&reader->roles, role, entries);
+    }
+    reader->numroles++;
+
+    debug_return;
+}
+
 /*
- * Parse a sudoers file in LDIF format, https://tools.ietf.org/html/rfc2849
- * Parsed sudoRole objects are stored in the specified parse_tree which
- * must already be initialized.
+ * Read sudoRole objects and global defaults from fp.
+ * In LDIF_CHECK_ORDER mode nothing is stored and no warnings are
+ * displayed; reading stops as soon as an out of order role is found.
+ * Returns the number of errors found.
  */
-bool
-sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
-    FILE *fp, const char *sudoers_base, bool store_options)
+static int
+ldif_read(struct ldif_reader *reader, FILE *fp)
 {
-    struct sudo_role_list roles = STAILQ_HEAD_INITIALIZER(roles);
+    const char *sudoers_base = reader->sudoers_base;
+    const bool quiet = reader->mode == LDIF_CHECK_ORDER;
     struct sudo_role *role = NULL;
-    struct rbtree *usercache, *groupcache, *hostcache;
-    unsigned numroles = 0;
     bool in_role = false;
     size_t linesize = 0;
     char *attr, *name, *line = NULL, *savedline = NULL;
     size_t savedlen = 0;
     bool mismatch = false;
     int errors = 0;
-    debug_decl(sudoers_parse_ldif, SUDOERS_DEBUG_UTIL);
-
-    /* Free old contents of the parse tree (if any). */
-    free_parse_tree(parse_tree);
-
-    /*
-     * We cache user, group and host lists to make it eay to detect when there
-     * are identical lists (simple pointer compare).  This makes it possible
-     * to merge multiplpe sudoRole objects into a single UserSpec and/or
-     * Privilege.  The lists are sorted since LDAP order is arbitrary.
-     */
-    usercache = rbcreate(str_list_cmp);
-    groupcache = rbcreate(str_list_cmp);
-    hostcache = rbcreate(str_list_cmp);
-    if (usercache == NULL || groupcache == NULL || hostcache == NULL)
-	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    debug_decl(ldif_read, SUDOERS_DEBUG_UTIL);
 
     /* Read through input, parsing into sudo_roles and global defaults. */
     for (;;) {
@@ -610,27 +667,20 @@ sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
 	if (len <= 0) {
 	    if (in_role) {
 		if (role->cn != NULL && strcasecmp(role->cn, "defaults") == 0) {
-		    ldif_store_options(parse_tree, role->options);
+		    if (!quiet)
+			ldif_store_options(reader->parse_tree, role->options);
 		    sudo_role_free(role);
 		} else if (STAILQ_EMPTY(role->users) ||
 		    STAILQ_EMPTY(role->hosts) || STAILQ_EMPTY(role->cmnds)) {
 		    /* Incomplete role. */
-		    sudo_warnx(U_("ignoring incomplete sudoRole: cn: %s"),
-			role->cn ? role->cn : "UNKNOWN");
+		    if (!quiet) {
+			sudo_warnx(U_("ignoring incomplete sudoRole: cn: %s"),
+			    role->cn ? role->cn : "UNKNOWN");
+		    }
 		    sudo_role_free(role);
 		} else {
-		    /* Cache users, hosts, runasusers and runasgroups. */
-		    if (str_list_cache(usercache, &role->users) == -1 ||
-			str_list_cache(hostcache, &role->hosts) == -1 ||
-			str_list_cache(usercache, &role->runasusers) == -1 ||
-			str_list_cache(groupcache, &role->runasgroups) == -1) {
-			sudo_fatalx(U_("%s: %s"), __func__,
-			    U_("unable to allocate memory"));
-		    }
-
 		    /* Store finished role. */
-		    STAILQ_INSERT_TAIL(&roles, role, entries);
-		    numroles++;
+		    ldif_store_role(reader, role);
 		}
 		role = NULL;
 		in_role = false;
@@ -639,6 +689,10 @@ sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
 		/* EOF */
 		break;
 	    }
+	    if (quiet && !reader->sorted) {
+		/* No need to check the rest of the roles. */
+		break;
+	    }
 	    mismatch = false;
 	    continue;
 	}
@@ -675,7 +729,8 @@ sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
 
 	/* Reject invalid LDIF. */
 	if (!ldif_parse_attribute(line, &name, &attr)) {
-	    sudo_warnx(U_("invalid LDIF attribute: %s"), line);
+	    if (!quiet)
+		sudo_warnx(U_("invalid LDIF attribute: %s"), line);
 	    errors++;
 	    continue;
 	}
@@ -745,7 +800,8 @@ sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
 	    char *ep;
 	    role->order = strtod(attr, &ep);
 	    if (ep == attr || *ep != '\0') {
-		sudo_warnx(U_("invalid sudoOrder attribute: %s"), attr);
+		if (!quiet)
+		    sudo_warnx(U_("invalid sudoOrder attribute: %s"), attr);
 		errors++;
 	    }
 	} else if (strcasecmp(name, "sudoNotBefore") == 0) {
@@ -768,14 +824,81 @@ sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
     free(line);
     free(savedline);
 
+    debug_return_int(errors);
+}
+
+/*
+ * Parse a sudoers file in LDIF format, https://tools.ietf.org/html/rfc2849
+ * Parsed sudoRole objects are stored in the specified parse_tree which
+ * must already be initialized.
+ * If fp is seekable and the sudoRole objects are already in sudoOrder
+ * order, they are converted as they are read instead of being stored
+ * and sorted, which keeps memory usage low for large inputs.
+ */
+bool
+sudoers_parse_ldif(struct sudoers_parse_tree *parse_tree,
+    FILE *fp, const char *sudoers_base, bool store_options)
+{
+    struct ldif_reader reader;
+    off_t pos;
+    int errors;
+    debug_decl(sudoers_parse_ldif, SUDOERS_DEBUG_UTIL);
+
+    /* Free old contents of the parse tree (if any). */
+    free_parse_tree(parse_tree);
+
+    memset(&reader, 0, sizeof(reader));
+    reader.parse_tree = parse_tree;
+    reader.sudoers_base = sudoers_base;
+    reader.store_options = store_options;
+    reader.sorted = true;
+    STAILQ_INIT(&reader.roles);
+
+    /* Check whether roles can be converted in the order they are read. */
+    reader.mode = LDIF_BUFFER;
+    pos = ftello(fp);
+    if (pos != -1) {
+	reader.mode = LDIF_CHECK_ORDER;
+	(void)ldif_read(&reader, fp);
+	if (fseeko(fp, pos, SEEK_SET) == -1) {
+	    sudo_warn("%s", U_("unable to rewind LDIF input"));
+	    debug_return_bool(false);
+	}
+	clearerr(fp);
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "sudoRole objects are %ssorted by sudoOrder",
+	    reader.sorted ? "" : "not ");
+	reader.mode = reader.sorted ? LDIF_STREAM : LDIF_BUFFER;
+	reader.numroles = 0;
+    }
+
+    /*
+     * We cache user, group and host lists to make it eay to detect when there
+     * are identical lists (simple pointer compare).  This makes it possible
+     * to merge multiplpe sudoRole objects into a single UserSpec and/or
+     * Privilege.  The lists are sorted since LDAP order is arbitrary.
+     */
+    reader.usercache = rbcreate(str_list_cmp);
+    reader.groupcache = rbcreate(str_list_cmp);
+    reader.hostcache = rbcreate(str_list_cmp);
+    if (reader.usercache == NULL || reader.groupcache == NULL ||
+	    reader.hostcache == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+
+    /* Read through input, parsing into sudo_roles and global defaults. */
+    errors = ldif_read(&reader, fp);
+
     /* Convert from roles to sudoers data structures. */
-    if (numroles > 0)
-	ldif_to_sudoers(parse_tree, &roles, numroles, store_options);
+    if (reader.mode == LDIF_BUFFER && reader.numroles > 0) {
+	ldif_to_sudoers(parse_tree, &reader.roles, reader.numroles,
+	    store_options);
+    }
 
     /* Clean up. */
-    rbdestroy(usercache, str_list_free);
-    rbdestroy(groupcache, str_list_free);
-    rbdestroy(hostcache, str_list_free);
+    sudo_role_free(reader.prev_role);
+    rbdestroy(reader.usercache, str_list_free);
+    rbdestroy(reader.groupcache, str_list_free);
+    rbdestroy(reader.hostcache, str_list_free);
 
     debug_return_bool(errors == 0);
 }
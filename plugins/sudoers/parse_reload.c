@@ -0,0 +1,909 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+/*
+ * Incremental reloading of a sudoers file and its includes.
+ *
+ * While parsing, the lexer's include hook is used to record which
+ * range of userspecs and defaults each file (and include dir) produced.
+ * The result is a preorder list of nodes, one per file or dir, where
+ * each node's range also covers that of its descendants.  On reload,
+ * only the files that have changed are reparsed and their entries are
+ * spliced back into the parse tree in place of the old ones, which
+ * preserves rule order.
+ */
+
+#include <config.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+
+#include "sudoers.h"
+#include "toke.h"
+#include <gram.h>
+
+#define RELOAD_FILE	1	/* sudoers file or @include file */
+#define RELOAD_DIR	2	/* @includedir directory */
+#define RELOAD_DIRFILE	3	/* file inside an @includedir directory */
+
+#define RELOAD_NONE	SIZE_MAX
+
+struct reload_node {
+    char *path;			/* path (or search path) used to open */
+    char *file;			/* path of the file that was read */
+    char *listing;		/* for dirs: sorted list of files */
+    size_t parent;		/* index of parent node or RELOAD_NONE */
+    size_t nsub;		/* number of nodes in subtree, incl. self */
+    size_t us_start;		/* index of first userspec */
+    size_t us_count;		/* number of userspecs in subtree */
+    size_t def_start;		/* index of first Defaults entry */
+    size_t def_count;		/* number of Defaults entries in subtree */
+    struct timespec mtime;
+    off_t size;
+    dev_t dev;
+    ino_t ino;
+    bool exists;
+    short type;
+};
+
+struct reload_tracker {
+    struct reload_node *nodes;
+    size_t nnodes;
+    size_t nodes_size;
+    size_t cur;
+    size_t pending_dir;
+    size_t us_total;
+    size_t def_total;
+    struct userspec *us_last;
+    struct defaults *def_last;
+    bool error;
+};
+
+struct sudoers_reload {
+    struct sudoers_parser_config conf;
+    struct sudoers_parse_tree *parse_tree;
+    struct reload_node *nodes;
+    size_t nnodes;
+    char *sudoers_path;
+};
+
+/* Tracker in use by the lexer include hook. */
+static struct reload_tracker *active_tracker;
+
+static int
+reload_namecmp(const void *v1, const void *v2)
+{
+    return strcmp(*(char * const *)v1, *(char * const *)v2);
+}
+
+/*
+ * Return a newline-separated, sorted list of the files in dirpath
+ * that the lexer would consider for @includedir.
+ * A missing directory results in an empty string.
+ */
+static char *
+reload_dir_listing(const char *dirpath)
+{
+    char **names = NULL, *listing = NULL, *cp;
+    size_t i, len = 1, count = 0, max_names = 0;
+    struct dirent *dent;
+    DIR *dir;
+    debug_decl(reload_dir_listing, SUDOERS_DEBUG_PARSER);
+
+    if ((dir = opendir(dirpath)) != NULL) {
+	while ((dent = readdir(dir)) != NULL) {
+	    const char *name = dent->d_name;
+	    const size_t namelen = strlen(name);
+	    char path[PATH_MAX];
+	    struct stat sb;
+
+	    /* Same rules as read_dir_files() in the lexer. */
+	    if (namelen == 0 || name[namelen - 1] == '~' ||
+		    strchr(name, '.') != NULL)
+		continue;
+	    if ((size_t)snprintf(path, sizeof(path), "%s/%s", dirpath, name)
+		    >= sizeof(path))
+		continue;
+	    if (stat(path, &sb) != 0 || !S_ISREG(sb.st_mode))
+		continue;
+	    if (count == max_names) {
+		char **tmp;
+
+		max_names = max_names ? max_names * 2 : 32;
+		tmp = reallocarray(names, max_names, sizeof(*names));
+		if (tmp == NULL)
+		    goto done;
+		names = tmp;
+	    }
+	    if ((names[count] = strdup(name)) == NULL)
+		goto done;
+	    len += namelen + 1;
+	    count++;
+	}
+    }
+
+    if (count > 1)
+	qsort(names, count, sizeof(*names), reload_namecmp);
+    if ((listing = malloc(len)) == NULL)
+	goto done;
+    cp = listing;
+    for (i = 0; i < count; i++) {
+	const size_t namelen = strlen(names[i]);
+	memcpy(cp, names[i], namelen);
+	cp += namelen;
+	*cp++ = '\n';
+    }
+    *cp = '\0';
+
+done:
+    if (dir != NULL)
+	closedir(dir);
+    for (i = 0; i < count; i++)
+	free(names[i]);
+    free(names);
+    if (listing == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    }
+    debug_return_str(listing);
+}
+
+/*
+ * Store the stat signature for a node's file.
+ */
+static void
+reload_node_stat(struct reload_node *node)
+{
+    struct stat sb;
+    debug_decl(reload_node_stat, SUDOERS_DEBUG_PARSER);
+
+    if (stat(node->file, &sb) == 0) {
+	node->exists = true;
+	node->dev = sb.st_dev;
+	node->ino = sb.st_ino;
+	node->size = sb.st_size;
+	mtim_get(&sb, node->mtime);
+    } else {
+	node->exists = false;
+	node->dev = 0;
+	node->ino = 0;
+	node->size = 0;
+	sudo_timespecclear(&node->mtime);
+    }
+
+    debug_return;
+}
+
+/*
+ * Returns true if the file (or directory listing) for the node
+ * has changed since it was last read, else false.
+ * An unchanged directory with a new mtime has its signature updated.
+ */
+static bool
+reload_node_changed(struct reload_node *node)
+{
+    struct reload_node cur = *node;
+    char *listing;
+    debug_decl(reload_node_changed, SUDOERS_DEBUG_PARSER);
+
+    reload_node_stat(&cur);
+    if (cur.exists == node->exists && cur.dev == node->dev &&
+	    cur.ino == node->ino && cur.size == node->size &&
+	    sudo_timespeccmp(&cur.mtime, &node->mtime, ==))
+	debug_return_bool(false);
+
+    if (node->type != RELOAD_DIR)
+	debug_return_bool(true);
+
+    /* Only the set of files matters for a directory. */
+    if ((listing = reload_dir_listing(node->path)) == NULL)
+	debug_return_bool(true);
+    if (strcmp(listing, node->listing) != 0) {
+	free(listing);
+	debug_return_bool(true);
+    }
+    free(listing);
+    *node = cur;
+    debug_return_bool(false);
+}
+
+static void
+reload_free_nodes(struct reload_node *nodes, size_t nnodes)
+{
+    size_t i;
+    debug_decl(reload_free_nodes, SUDOERS_DEBUG_PARSER);
+
+    for (i = 0; i < nnodes; i++) {
+	sudo_rcstr_delref(nodes[i].path);
+	sudo_rcstr_delref(nodes[i].file);
+	free(nodes[i].listing);
+    }
+    free(nodes);
+
+    debug_return;
+}
+
+/*
+ * Count any userspecs and Defaults entries added to parsed_policy
+ * since the last time we checked.
+ */
+static void
+reload_count(struct reload_tracker *tr)
+{
+    struct userspec *us;
+    struct defaults *def;
+    debug_decl(reload_count, SUDOERS_DEBUG_PARSER);
+
+    us = tr->us_last ? TAILQ_NEXT(tr->us_last, entries) :
+	TAILQ_FIRST(&parsed_policy.userspecs);
+    while (us != NULL) {
+	tr->us_last = us;
+	tr->us_total++;
+	us = TAILQ_NEXT(us, entries);
+    }
+    def = tr->def_last ? TAILQ_NEXT(tr->def_last, entries) :
+	TAILQ_FIRST(&parsed_policy.defaults);
+    while (def != NULL) {
+	tr->def_last = def;
+	tr->def_total++;
+	def = TAILQ_NEXT(def, entries);
+    }
+
+    debug_return;
+}
+
+/*
+ * Append a new node to the tracker, returning its index.
+ * Returns RELOAD_NONE on memory allocation failure.
+ */
+static size_t
+reload_add_node(struct reload_tracker *tr, short type, const char *path,
+    const char *file, size_t parent)
+{
+    struct reload_node *node;
+    debug_decl(reload_add_node, SUDOERS_DEBUG_PARSER);
+
+    if (tr->nnodes == tr->nodes_size) {
+	const size_t new_size = tr->nodes_size ? tr->nodes_size * 2 : 16;
+	struct reload_node *new_nodes;
+
+	new_nodes = reallocarray(tr->nodes, new_size, sizeof(*new_nodes));
+	if (new_nodes == NULL)
+	    goto oom;
+	tr->nodes = new_nodes;
+	tr->nodes_size = new_size;
+    }
+    node = &tr->nodes[tr->nnodes];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->parent = parent;
+    node->nsub = 1;
+    node->us_start = tr->us_total;
+    node->def_start = tr->def_total;
+    node->path = sudo_rcstr_dup(path);
+    node->file = sudo_rcstr_dup(file);
+    if (type == RELOAD_DIR)
+	node->listing = reload_dir_listing(path);
+    if (node->path == NULL || node->file == NULL ||
+	    (type == RELOAD_DIR && node->listing == NULL)) {
+	sudo_rcstr_delref(node->path);
+	sudo_rcstr_delref(node->file);
+	free(node->listing);
+	goto oom;
+    }
+    reload_node_stat(node);
+
+    debug_return_size_t(tr->nnodes++);
+oom:
+    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    tr->error = true;
+    debug_return_size_t(RELOAD_NONE);
+}
+
+/*
+ * Finish a node, storing the sizes of its subtree.
+ */
+static void
+reload_close_node(struct reload_tracker *tr, size_t idx)
+{
+    struct reload_node *node = &tr->nodes[idx];
+
+    node->nsub = tr->nnodes - idx;
+    node->us_count = tr->us_total - node->us_start;
+    node->def_count = tr->def_total - node->def_start;
+}
+
+/*
+ * Called by the lexer when it switches files.
+ * Directory nodes are children of the including file and the files
+ * in that directory are children of the directory node.
+ */
+static void
+reload_include_hook(int event, const char *path)
+{
+    struct reload_tracker *tr = active_tracker;
+    size_t idx, parent;
+    debug_decl(reload_include_hook, SUDOERS_DEBUG_PARSER);
+
+    if (tr == NULL || tr->error)
+	debug_return;
+
+    /* Entries parsed so far belong to the current file. */
+    reload_count(tr);
+
+    switch (event) {
+    case SUDOERS_INCLUDE_DIR:
+	idx = reload_add_node(tr, RELOAD_DIR, path, path, tr->cur);
+	if (idx != RELOAD_NONE)
+	    reload_close_node(tr, idx);
+	tr->pending_dir = idx;
+	break;
+    case SUDOERS_INCLUDE_PUSHDIR:
+	if (tr->pending_dir == RELOAD_NONE) {
+	    tr->error = true;
+	    break;
+	}
+	tr->cur = tr->pending_dir;
+	tr->pending_dir = RELOAD_NONE;
+	tr->cur = reload_add_node(tr, RELOAD_DIRFILE, path, path, tr->cur);
+	break;
+    case SUDOERS_INCLUDE_PUSH:
+	/* The file name is only set if open_sudoers() filled it in. */
+	if (path == NULL)
+	    path = sudoers_search_path;
+	tr->cur = reload_add_node(tr, RELOAD_FILE, sudoers_search_path ?
+	    sudoers_search_path : path, path, tr->cur);
+	break;
+    case SUDOERS_INCLUDE_NEXT:
+	reload_close_node(tr, tr->cur);
+	parent = tr->nodes[tr->cur].parent;
+	tr->cur = reload_add_node(tr, RELOAD_DIRFILE, path, path, parent);
+	break;
+    case SUDOERS_INCLUDE_POP:
+	reload_close_node(tr, tr->cur);
+	tr->cur = tr->nodes[tr->cur].parent;
+	if (tr->cur != RELOAD_NONE && tr->nodes[tr->cur].type == RELOAD_DIR) {
+	    reload_close_node(tr, tr->cur);
+	    tr->cur = tr->nodes[tr->cur].parent;
+	}
+	break;
+    default:
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "unexpected include event %d", event);
+	tr->error = true;
+	break;
+    }
+    if (tr->cur == RELOAD_NONE)
+	tr->error = true;
+
+    debug_return;
+}
+
+/*
+ * Parse path (and anything it includes) into parse_tree, which must
+ * be initialized, recording per-file entry ranges in tr.
+ * Returns true on success, false on error.
+ */
+static bool
+reload_parse(const struct sudoers_parser_config *conf, const char *path,
+    short type, bool doedit, struct sudoers_parse_tree *parse_tree,
+    struct reload_tracker *tr)
+{
+    char *outfile = NULL;
+    bool keepopen = false;
+    bool ret = false;
+    FILE *fp;
+    int error;
+    debug_decl(reload_parse, SUDOERS_DEBUG_PARSER);
+
+    memset(tr, 0, sizeof(*tr));
+    tr->pending_dir = RELOAD_NONE;
+
+    fp = open_sudoers(path, type == RELOAD_DIRFILE ? NULL : &outfile,
+	doedit, &keepopen);
+    if (fp == NULL)
+	debug_return_bool(false);
+    /* Set the file name the same way the lexer and sudo_file_open() do. */
+    if (!init_parser(type == RELOAD_DIRFILE ? path : outfile, conf))
+	goto done;
+    tr->cur = reload_add_node(tr, type, path, outfile ? outfile : path,
+	RELOAD_NONE);
+    if (tr->cur == RELOAD_NONE)
+	goto done;
+
+    sudoersin = fp;
+    active_tracker = tr;
+    sudoers_include_hook = reload_include_hook;
+    error = sudoersparse();
+    sudoers_include_hook = NULL;
+    active_tracker = NULL;
+
+    if (error || (parse_error && !conf->recovery) || tr->error)
+	goto done;
+
+    /* Close the root node (and any others left open on error). */
+    reload_count(tr);
+    while (tr->cur != RELOAD_NONE) {
+	reload_close_node(tr, tr->cur);
+	tr->cur = tr->nodes[tr->cur].parent;
+    }
+
+    reparent_parse_tree(parse_tree);
+    ret = true;
+
+done:
+    if (!ret) {
+	reload_free_nodes(tr->nodes, tr->nnodes);
+	tr->nodes = NULL;
+	tr->nnodes = 0;
+    }
+    free_parse_tree(&parsed_policy);
+    sudoersin = NULL;
+    if (!keepopen)
+	fclose(fp);
+    sudo_rcstr_delref(outfile);
+    debug_return_bool(ret);
+}
+
+/*
+ * Rebuild the state derived from the parse tree that is used for
+ * matching: the flattened alias expansions, which point into the
+ * member lists of other aliases, and the compiled Cmnd_Spec arrays.
+ * Memoized alias match results are discarded too.
+ */
+static void
+reload_derive(struct sudoers_parse_tree *parse_tree)
+{
+    debug_decl(reload_derive, SUDOERS_DEBUG_PARSER);
+
+    match_memo_invalidate();
+    (void)alias_expand(parse_tree);
+    (void)sudoers_compile_privileges(parse_tree);
+
+    debug_return;
+}
+
+/*
+ * Parse the sudoers file specified by conf->sudoers_path into parse_tree,
+ * which must be initialized, and track the files it includes for use by
+ * sudoers_reload().  The caller must not modify the userspecs, Defaults
+ * or aliases in parse_tree between reloads.  Aliases are expanded and
+ * privileges compiled, as for a sudoers file opened via sudo_nss.
+ * Returns a reload handle on success and NULL on error.
+ */
+struct sudoers_reload *
+sudoers_reload_open(const struct sudoers_parser_config *conf,
+    struct sudoers_parse_tree *parse_tree)
+{
+    struct sudoers_reload *rl;
+    struct reload_tracker tr;
+    debug_decl(sudoers_reload_open, SUDOERS_DEBUG_PARSER);
+
+    if (conf == NULL || conf->sudoers_path == NULL) {
+	errno = EINVAL;
+	debug_return_ptr(NULL);
+    }
+
+    if ((rl = calloc(1, sizeof(*rl))) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_ptr(NULL);
+    }
+    if ((rl->sudoers_path = sudo_rcstr_dup(conf->sudoers_path)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	free(rl);
+	debug_return_ptr(NULL);
+    }
+    rl->conf = *conf;
+    rl->conf.sudoers_path = rl->sudoers_path;
+    rl->parse_tree = parse_tree;
+
+    if (!reload_parse(&rl->conf, rl->sudoers_path, RELOAD_FILE, false,
+	    parse_tree, &tr)) {
+	sudoers_reload_free(rl);
+	debug_return_ptr(NULL);
+    }
+    rl->nodes = tr.nodes;
+    rl->nnodes = tr.nnodes;
+    reload_derive(parse_tree);
+
+    debug_return_ptr(rl);
+}
+
+void
+sudoers_reload_free(struct sudoers_reload *rl)
+{
+    debug_decl(sudoers_reload_free, SUDOERS_DEBUG_PARSER);
+
+    if (rl != NULL) {
+	reload_free_nodes(rl->nodes, rl->nnodes);
+	sudo_rcstr_delref(rl->sudoers_path);
+	free(rl);
+    }
+
+    debug_return;
+}
+
+/*
+ * State used while reparsing the changed parts of the tree.
+ */
+struct reload_result {
+    size_t idx;				/* index of replaced node */
+    struct reload_tracker tr;		/* nodes for the new subtree */
+    struct sudoers_parse_tree tree;	/* entries for the new subtree */
+};
+
+struct reload_closure {
+    struct sudoers_reload *rl;
+    struct reload_result *results;
+    size_t nresults;
+    size_t cur;
+    struct alias **aliases;
+    size_t naliases;
+    size_t aliases_size;
+    bool error;
+};
+
+/*
+ * Returns true if file belongs to one of the subtrees being replaced.
+ */
+static bool
+reload_replaced_file(struct reload_closure *closure, const char *file)
+{
+    const struct reload_node *nodes = closure->rl->nodes;
+    size_t i, j;
+
+    if (file == NULL)
+	return false;
+    for (i = 0; i < closure->nresults; i++) {
+	const size_t start = closure->results[i].idx;
+	for (j = start; j < start + nodes[start].nsub; j++) {
+	    if (strcmp(nodes[j].file, file) == 0)
+		return true;
+	}
+    }
+    return false;
+}
+
+/*
+ * Check a new alias for conflicts with aliases that will remain
+ * in the parse tree and with aliases from other replaced subtrees.
+ */
+static int
+reload_check_alias(struct sudoers_parse_tree *parse_tree, struct alias *a,
+    void *v)
+{
+    struct reload_closure *closure = v;
+    struct alias *other;
+    size_t i;
+    debug_decl(reload_check_alias, SUDOERS_DEBUG_PARSER);
+
+    other = alias_get(closure->rl->parse_tree, a->name, a->type);
+    if (other != NULL) {
+	const bool replaced = reload_replaced_file(closure, other->file);
+	alias_put(other);
+	if (!replaced)
+	    goto conflict;
+    }
+    for (i = 0; i < closure->nresults; i++) {
+	if (i == closure->cur)
+	    continue;
+	other = alias_get(&closure->results[i].tree, a->name, a->type);
+	if (other != NULL) {
+	    alias_put(other);
+	    goto conflict;
+	}
+    }
+    debug_return_int(0);
+conflict:
+    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	"%s:%d:%d: duplicate %s \"%s\"", a->file, a->line, a->column,
+	alias_type_to_string(a->type), a->name);
+    closure->error = true;
+    debug_return_int(-1);
+}
+
+/*
+ * Collect aliases, optionally only those from replaced files.
+ */
+static int
+reload_collect_alias(struct sudoers_parse_tree *parse_tree, struct alias *a,
+    void *v)
+{
+    struct reload_closure *closure = v;
+    debug_decl(reload_collect_alias, SUDOERS_DEBUG_PARSER);
+
+    if (parse_tree == closure->rl->parse_tree &&
+	    !reload_replaced_file(closure, a->file))
+	debug_return_int(0);
+
+    if (closure->naliases == closure->aliases_size) {
+	const size_t new_size =
+	    closure->aliases_size ? closure->aliases_size * 2 : 32;
+	struct alias **new_aliases = reallocarray(closure->aliases, new_size,
+	    sizeof(*new_aliases));
+	if (new_aliases == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    closure->error = true;
+	    debug_return_int(-1);
+	}
+	closure->aliases = new_aliases;
+	closure->aliases_size = new_size;
+    }
+    closure->aliases[closure->naliases++] = a;
+    debug_return_int(0);
+}
+
+/*
+ * Replace the subtree rooted at result->idx with the new entries
+ * and nodes in result.
+ */
+static bool
+reload_splice(struct sudoers_reload *rl, struct reload_result *result)
+{
+    struct sudoers_parse_tree *parse_tree = rl->parse_tree;
+    struct reload_node *old = &rl->nodes[result->idx];
+    struct reload_node *new_nodes = result->tr.nodes;
+    const size_t idx = result->idx;
+    const size_t old_nsub = old->nsub;
+    const size_t new_nsub = new_nodes[0].nsub;
+    const size_t parent = old->parent;
+    struct userspec *us, *us_next;
+    struct defaults *def, *def_next;
+    struct reload_node *nodes;
+    size_t i, us_start, def_start, us_delta, def_delta;
+    debug_decl(reload_splice, SUDOERS_DEBUG_PARSER);
+
+    /* Resize the node list first since it is the only thing that can fail. */
+    if (new_nsub > old_nsub) {
+	nodes = reallocarray(rl->nodes, rl->nnodes - old_nsub + new_nsub,
+	    sizeof(*nodes));
+	if (nodes == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    debug_return_bool(false);
+	}
+	rl->nodes = nodes;
+	old = &rl->nodes[idx];
+    }
+    us_start = old->us_start;
+    def_start = old->def_start;
+
+    /* Replace userspecs, preserving order. */
+    us = TAILQ_FIRST(&parse_tree->userspecs);
+    for (i = 0; us != NULL && i < us_start; i++)
+	us = TAILQ_NEXT(us, entries);
+    for (i = 0; us != NULL && i < old->us_count; i++) {
+	us_next = TAILQ_NEXT(us, entries);
+	TAILQ_REMOVE(&parse_tree->userspecs, us, entries);
+	free_userspec(us);
+	us = us_next;
+    }
+    while ((us_next = TAILQ_FIRST(&result->tree.userspecs)) != NULL) {
+	TAILQ_REMOVE(&result->tree.userspecs, us_next, entries);
+	if (us != NULL)
+	    TAILQ_INSERT_BEFORE(us, us_next, entries);
+	else
+	    TAILQ_INSERT_TAIL(&parse_tree->userspecs, us_next, entries);
+    }
+
+    /* Replace Defaults, preserving order. */
+    def = TAILQ_FIRST(&parse_tree->defaults);
+    for (i = 0; def != NULL && i < def_start; i++)
+	def = TAILQ_NEXT(def, entries);
+    for (i = 0; def != NULL && i < old->def_count; i++) {
+	def_next = TAILQ_NEXT(def, entries);
+	TAILQ_REMOVE(&parse_tree->defaults, def, entries);
+	free_default(def);
+	def = def_next;
+    }
+    while ((def_next = TAILQ_FIRST(&result->tree.defaults)) != NULL) {
+	TAILQ_REMOVE(&result->tree.defaults, def_next, entries);
+	if (def != NULL)
+	    TAILQ_INSERT_BEFORE(def, def_next, entries);
+	else
+	    TAILQ_INSERT_TAIL(&parse_tree->defaults, def_next, entries);
+    }
+
+    /* Sizes may shrink, so deltas are computed modulo SIZE_MAX + 1. */
+    us_delta = new_nodes[0].us_count - old->us_count;
+    def_delta = new_nodes[0].def_count - old->def_count;
+
+    /* Update ancestors of the replaced subtree. */
+    for (i = parent; i != RELOAD_NONE; i = rl->nodes[i].parent) {
+	rl->nodes[i].nsub += new_nsub - old_nsub;
+	rl->nodes[i].us_count += us_delta;
+	rl->nodes[i].def_count += def_delta;
+    }
+
+    /* Shift nodes after the replaced subtree. */
+    for (i = 0; i < old_nsub; i++) {
+	sudo_rcstr_delref(old[i].path);
+	sudo_rcstr_delref(old[i].file);
+	free(old[i].listing);
+    }
+    memmove(old + new_nsub, old + old_nsub,
+	(rl->nnodes - idx - old_nsub) * sizeof(*old));
+    rl->nnodes = rl->nnodes - old_nsub + new_nsub;
+    for (i = idx + new_nsub; i < rl->nnodes; i++) {
+	if (rl->nodes[i].parent != RELOAD_NONE &&
+		rl->nodes[i].parent >= idx + old_nsub)
+	    rl->nodes[i].parent += new_nsub - old_nsub;
+	rl->nodes[i].us_start += us_delta;
+	rl->nodes[i].def_start += def_delta;
+    }
+
+    /* Install the new nodes. */
+    for (i = 0; i < new_nsub; i++) {
+	old[i] = new_nodes[i];
+	old[i].parent = i ? new_nodes[i].parent + idx : parent;
+	old[i].us_start += us_start;
+	old[i].def_start += def_start;
+    }
+    free(new_nodes);
+    result->tr.nodes = NULL;
+    result->tr.nnodes = 0;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Check the files used to build the parse tree for changes and reparse
+ * only the files that have changed, splicing the results back into the
+ * parse tree.  A change to the set of files in an @includedir causes
+ * the file containing the @includedir directive to be reparsed.
+ * Returns the number of files (and their includes) that were reparsed,
+ * 0 if nothing changed or -1 on error.  Other than on memory allocation
+ * failure, the parse tree is left unmodified if there is an error.
+ * Once the tree has been modified, the alias expansions and compiled
+ * privileges are rebuilt since they may refer to entries that were freed.
+ */
+int
+sudoers_reload(struct sudoers_reload *rl)
+{
+    struct reload_closure closure;
+    struct reload_result *results = NULL;
+    struct sudoers_parser_config conf;
+    bool *dirty = NULL, modified = false;
+    size_t i, nresults = 0;
+    int ret = -1;
+    debug_decl(sudoers_reload, SUDOERS_DEBUG_PARSER);
+
+    memset(&closure, 0, sizeof(closure));
+
+    /* Find changed files, a changed dir dirties the including file. */
+    if ((dirty = calloc(rl->nnodes, sizeof(*dirty))) == NULL)
+	goto oom;
+    for (i = 0; i < rl->nnodes; i++) {
+	if (reload_node_changed(&rl->nodes[i])) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"%s: changed", rl->nodes[i].file);
+	    if (rl->nodes[i].type == RELOAD_DIR)
+		dirty[rl->nodes[i].parent] = true;
+	    else
+		dirty[i] = true;
+	}
+    }
+
+    /* Reparse the topmost changed file in each subtree. */
+    for (i = 0; i < rl->nnodes; ) {
+	struct reload_result *new_results;
+	struct reload_node *node = &rl->nodes[i];
+
+	if (!dirty[i]) {
+	    i++;
+	    continue;
+	}
+	new_results = reallocarray(results, nresults + 1, sizeof(*results));
+	if (new_results == NULL)
+	    goto oom;
+	results = new_results;
+	results[nresults].idx = i;
+	init_parse_tree(&results[nresults].tree, NULL, NULL, NULL);
+	memset(&results[nresults].tr, 0, sizeof(results[nresults].tr));
+	nresults++;
+
+	conf = rl->conf;
+	if (node->parent != RELOAD_NONE)
+	    conf.sudoers_path = node->path;
+	if (!reload_parse(&conf, node->path, node->type,
+		node->parent != RELOAD_NONE && node->type == RELOAD_FILE,
+		&results[nresults - 1].tree, &results[nresults - 1].tr))
+	    goto done;
+	i += node->nsub;
+    }
+    if (nresults == 0) {
+	ret = 0;
+	goto done;
+    }
+
+    /* New aliases must not conflict with the ones we are keeping. */
+    closure.rl = rl;
+    closure.results = results;
+    closure.nresults = nresults;
+    for (i = 0; i < nresults && !closure.error; i++) {
+	closure.cur = i;
+	alias_apply(&results[i].tree, reload_check_alias, &closure);
+    }
+    if (closure.error) {
+	errno = EEXIST;
+	goto done;
+    }
+
+    /* Remove aliases defined in the replaced files. */
+    alias_apply(rl->parse_tree, reload_collect_alias, &closure);
+    if (closure.error)
+	goto done;
+    modified = true;
+    for (i = 0; i < closure.naliases; i++) {
+	struct alias *a = closure.aliases[i];
+	a = alias_remove(rl->parse_tree, a->name, a->type);
+	alias_free(a);
+    }
+    closure.naliases = 0;
+
+    /* Splice in new entries, last to first so indices remain valid. */
+    for (i = nresults; i-- > 0; ) {
+	struct sudoers_parse_tree *tree = &results[i].tree;
+	size_t j;
+
+	if (!reload_splice(rl, &results[i]))
+	    goto done;
+	alias_apply(tree, reload_collect_alias, &closure);
+	if (closure.error)
+	    goto done;
+	for (j = 0; j < closure.naliases; j++) {
+	    struct alias *a = closure.aliases[j];
+	    a = alias_remove(tree, a->name, a->type);
+	    if (!alias_insert(rl->parse_tree, a)) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		alias_free(a);
+		goto done;
+	    }
+	}
+	closure.naliases = 0;
+    }
+    ret = (int)nresults;
+    goto done;
+
+oom:
+    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+done:
+    if (modified)
+	reload_derive(rl->parse_tree);
+    for (i = 0; i < nresults; i++) {
+	reload_free_nodes(results[i].tr.nodes, results[i].tr.nnodes);
+	free_parse_tree(&results[i].tree);
+    }
+    free(results);
+    free(closure.aliases);
+    free(dirty);
+    debug_return_int(ret);
+}
@@ -674,7 +674,7 @@ sudoers_policy_store_result(bool accepted, char *argv[], char *envp[],
     }
 
     /* Increase the length of command_info as needed, it is *not* checked. */
-    command_info = calloc(74, sizeof(char *));
+    command_info = calloc(76, sizeof(char *));
     if (command_info == NULL)
 	goto oom;
 
@@ -713,6 +713,11 @@ sudoers_policy_store_result(bool accepted, char *argv[], char *envp[],
 	if (def_compress_io) {
 	    if ((command_info[info_len++] = strdup("iolog_compress=true")) == NULL)
 		goto oom;
+	    if (def_compress_io_streams != NULL) {
+		if ((command_info[info_len++] = sudo_new_key_val(
+			"iolog_compress_streams", def_compress_io_streams)) == NULL)
+		    goto oom;
+	    }
 	}
 	if (def_iolog_flush) {
 	    if ((command_info[info_len++] = strdup("iolog_flush=true")) == NULL)
@@ -908,6 +913,10 @@ sudoers_policy_store_result(bool accepted, char *argv[], char *envp[],
 
 	if (asprintf(&command_info[info_len++], "log_server_timeout=%u", def_log_server_timeout) == -1)
 	    goto oom;
+	if (def_log_server_state != NULL) {
+	    if ((command_info[info_len++] = sudo_new_key_val("log_server_state", def_log_server_state)) == NULL)
+		goto oom;
+	}
     }
 
     if ((command_info[info_len++] = sudo_new_key_val("log_server_keepalive",
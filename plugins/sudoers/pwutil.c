@@ -44,19 +44,22 @@
 #include <grp.h>
 
 #include "sudoers.h"
-#include "redblack.h"
+#include "hashtab.h"
 #include "pwutil.h"
 
 /*
  * The passwd and group caches.
  */
-static struct rbtree *pwcache_byuid, *pwcache_byname;
-static struct rbtree *grcache_bygid, *grcache_byname;
-static struct rbtree *gidlist_cache, *grlist_cache;
+static struct hashtab *pwcache_byuid, *pwcache_byname;
+static struct hashtab *grcache_bygid, *grcache_byname;
+static struct hashtab *gidlist_cache, *grlist_cache;
 
 static int  cmp_pwuid(const void *, const void *);
 static int  cmp_pwnam(const void *, const void *);
 static int  cmp_grgid(const void *, const void *);
+static unsigned int hash_pwuid(const void *);
+static unsigned int hash_pwnam(const void *);
+static unsigned int hash_grgid(const void *);
 
 static int max_groups;
 
@@ -69,6 +72,8 @@ static sudo_make_gidlist_item_t make_gidlist_item = sudo_make_gidlist_item;
 static sudo_make_grlist_item_t make_grlist_item = sudo_make_grlist_item;
 
 #define cmp_grnam	cmp_pwnam
+#define hash_grnam	hash_pwnam
+#define hash_gidlist	hash_pwnam
 
 /*
  * AIX has the concept of authentication registries (files, NIS, LDAP, etc).
@@ -149,6 +154,30 @@ cmp_pwnam(const void *v1, const void *v2)
     return ret;
 }
 
+/*
+ * Hash by user-ID and registry.
+ */
+static unsigned int
+hash_pwuid(const void *v)
+{
+    const struct cache_item *ci = (const struct cache_item *) v;
+    unsigned int h = hthash_bytes(HTHASH_INIT, &ci->k.uid, sizeof(ci->k.uid));
+    return hthash_string(h, ci->registry);
+}
+
+/*
+ * Hash by user/group name and registry.
+ * The gidlist cache uses this too, entries that differ only in
+ * type will hash to the same value.
+ */
+static unsigned int
+hash_pwnam(const void *v)
+{
+    const struct cache_item *ci = (const struct cache_item *) v;
+    unsigned int h = hthash_string(HTHASH_INIT, ci->k.name);
+    return hthash_string(h, ci->registry);
+}
+
 /*
  * Compare by user name, taking into account the source type.
  * Need to differentiate between group-IDs received from the front-end
@@ -206,11 +235,11 @@ struct passwd *
 sudo_getpwuid(uid_t uid)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_getpwuid, SUDOERS_DEBUG_NSS);
 
     if (pwcache_byuid == NULL) {
-	pwcache_byuid = rbcreate(cmp_pwuid);
+	pwcache_byuid = htcreate(hash_pwuid, cmp_pwuid);
 	if (pwcache_byuid == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -219,7 +248,7 @@ sudo_getpwuid(uid_t uid)
 
     key.k.uid = uid;
     getauthregistry(IDtouser(uid), key.registry);
-    if ((node = rbfind(pwcache_byuid, &key)) != NULL) {
+    if ((node = htfind(pwcache_byuid, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -244,7 +273,7 @@ sudo_getpwuid(uid_t uid)
 	/* item->d.pw = NULL; */
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(pwcache_byuid, item, NULL)) {
+    switch (htinsert(pwcache_byuid, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache uid %u, already exists"),
@@ -277,11 +306,11 @@ struct passwd *
 sudo_getpwnam(const char *name)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_getpwnam, SUDOERS_DEBUG_NSS);
 
     if (pwcache_byname == NULL) {
-	pwcache_byname = rbcreate(cmp_pwnam);
+	pwcache_byname = htcreate(hash_pwnam, cmp_pwnam);
 	if (pwcache_byname == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -290,7 +319,7 @@ sudo_getpwnam(const char *name)
 
     key.k.name = (char *) name;
     getauthregistry((char *) name, key.registry);
-    if ((node = rbfind(pwcache_byname, &key)) != NULL) {
+    if ((node = htfind(pwcache_byname, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -317,7 +346,7 @@ sudo_getpwnam(const char *name)
 	/* item->d.pw = NULL; */
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(pwcache_byname, item, NULL)) {
+    switch (htinsert(pwcache_byname, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache user %s, already exists"), name);
@@ -357,9 +386,9 @@ sudo_mkpwent(const char *user, uid_t uid, gid_t gid, const char *home,
     debug_decl(sudo_mkpwent, SUDOERS_DEBUG_NSS);
 
     if (pwcache_byuid == NULL)
-	pwcache_byuid = rbcreate(cmp_pwuid);
+	pwcache_byuid = htcreate(hash_pwuid, cmp_pwuid);
     if (pwcache_byname == NULL)
-	pwcache_byname = rbcreate(cmp_pwnam);
+	pwcache_byname = htcreate(hash_pwnam, cmp_pwnam);
     if (pwcache_byuid == NULL || pwcache_byname == NULL) {
 	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	debug_return_ptr(NULL);
@@ -383,8 +412,8 @@ sudo_mkpwent(const char *user, uid_t uid, gid_t gid, const char *home,
 	home_len + 1 /* pw_dir */ + shell_len + 1 /* pw_shell */;
 
     for (i = 0; i < 2; i++) {
-	struct rbtree *pwcache;
-	struct rbnode *node;
+	struct hashtab *pwcache;
+	struct htnode *node;
 
 	pwitem = calloc(1, len);
 	if (pwitem == NULL) {
@@ -418,7 +447,7 @@ sudo_mkpwent(const char *user, uid_t uid, gid_t gid, const char *home,
 	    pwcache = pwcache_byname;
 	}
 	getauthregistry(NULL, item->registry);
-	switch (rbinsert(pwcache, item, &node)) {
+	switch (htinsert(pwcache, item, &node)) {
 	case 1:
 	    /* Already exists. */
 	    item = node->data;
@@ -467,11 +496,11 @@ sudo_freepwcache(void)
     debug_decl(sudo_freepwcache, SUDOERS_DEBUG_NSS);
 
     if (pwcache_byuid != NULL) {
-	rbdestroy(pwcache_byuid, sudo_pw_delref_item);
+	htdestroy(pwcache_byuid, sudo_pw_delref_item);
 	pwcache_byuid = NULL;
     }
     if (pwcache_byname != NULL) {
-	rbdestroy(pwcache_byname, sudo_pw_delref_item);
+	htdestroy(pwcache_byname, sudo_pw_delref_item);
 	pwcache_byname = NULL;
     }
 
@@ -494,6 +523,17 @@ cmp_grgid(const void *v1, const void *v2)
     return 1;
 }
 
+/*
+ * Hash by group-ID and registry.
+ */
+static unsigned int
+hash_grgid(const void *v)
+{
+    const struct cache_item *ci = (const struct cache_item *) v;
+    unsigned int h = hthash_bytes(HTHASH_INIT, &ci->k.gid, sizeof(ci->k.gid));
+    return hthash_string(h, ci->registry);
+}
+
 void
 sudo_gr_addref(struct group *gr)
 {
@@ -529,11 +569,11 @@ struct group *
 sudo_getgrgid(gid_t gid)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_getgrgid, SUDOERS_DEBUG_NSS);
 
     if (grcache_bygid == NULL) {
-	grcache_bygid = rbcreate(cmp_grgid);
+	grcache_bygid = htcreate(hash_grgid, cmp_grgid);
 	if (grcache_bygid == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -542,7 +582,7 @@ sudo_getgrgid(gid_t gid)
 
     key.k.gid = gid;
     getauthregistry(NULL, key.registry);
-    if ((node = rbfind(grcache_bygid, &key)) != NULL) {
+    if ((node = htfind(grcache_bygid, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -561,7 +601,7 @@ sudo_getgrgid(gid_t gid)
 	/* item->d.gr = NULL; */
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(grcache_bygid, item, NULL)) {
+    switch (htinsert(grcache_bygid, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache gid %u, already exists"),
@@ -594,11 +634,11 @@ struct group *
 sudo_getgrnam(const char *name)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_getgrnam, SUDOERS_DEBUG_NSS);
 
     if (grcache_byname == NULL) {
-	grcache_byname = rbcreate(cmp_grnam);
+	grcache_byname = htcreate(hash_grnam, cmp_grnam);
 	if (grcache_byname == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -607,7 +647,7 @@ sudo_getgrnam(const char *name)
 
     key.k.name = (char *) name;
     getauthregistry(NULL, key.registry);
-    if ((node = rbfind(grcache_byname, &key)) != NULL) {
+    if ((node = htfind(grcache_byname, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -628,7 +668,7 @@ sudo_getgrnam(const char *name)
 	/* item->d.gr = NULL; */
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(grcache_byname, item, NULL)) {
+    switch (htinsert(grcache_byname, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache group %s, already exists"), name);
@@ -668,9 +708,9 @@ sudo_mkgrent(const char *group, gid_t gid, ...)
     debug_decl(sudo_mkgrent, SUDOERS_DEBUG_NSS);
 
     if (grcache_bygid == NULL)
-	grcache_bygid = rbcreate(cmp_grgid);
+	grcache_bygid = htcreate(hash_grgid, cmp_grgid);
     if (grcache_byname == NULL)
-	grcache_byname = rbcreate(cmp_grnam);
+	grcache_byname = htcreate(hash_grnam, cmp_grnam);
     if (grcache_bygid == NULL || grcache_byname == NULL) {
 	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	debug_return_ptr(NULL);
@@ -687,8 +727,8 @@ sudo_mkgrent(const char *group, gid_t gid, ...)
     total += sizeof(char *) * nmem;
 
     for (i = 0; i < 2; i++) {
-	struct rbtree *grcache;
-	struct rbnode *node;
+	struct hashtab *grcache;
+	struct htnode *node;
 
 	/*
 	 * Fill in group contents and make strings relative to space
@@ -731,7 +771,7 @@ sudo_mkgrent(const char *group, gid_t gid, ...)
 	    grcache = grcache_byname;
 	}
 	getauthregistry(NULL, item->registry);
-	switch (rbinsert(grcache, item, &node)) {
+	switch (htinsert(grcache, item, &node)) {
 	case 1:
 	    /* Already exists. */
 	    item = node->data;
@@ -838,19 +878,19 @@ sudo_freegrcache(void)
     debug_decl(sudo_freegrcache, SUDOERS_DEBUG_NSS);
 
     if (grcache_bygid != NULL) {
-	rbdestroy(grcache_bygid, sudo_gr_delref_item);
+	htdestroy(grcache_bygid, sudo_gr_delref_item);
 	grcache_bygid = NULL;
     }
     if (grcache_byname != NULL) {
-	rbdestroy(grcache_byname, sudo_gr_delref_item);
+	htdestroy(grcache_byname, sudo_gr_delref_item);
 	grcache_byname = NULL;
     }
     if (grlist_cache != NULL) {
-	rbdestroy(grlist_cache, sudo_grlist_delref_item);
+	htdestroy(grlist_cache, sudo_grlist_delref_item);
 	grlist_cache = NULL;
     }
     if (gidlist_cache != NULL) {
-	rbdestroy(gidlist_cache, sudo_gidlist_delref_item);
+	htdestroy(gidlist_cache, sudo_gidlist_delref_item);
 	gidlist_cache = NULL;
     }
 
@@ -861,14 +901,14 @@ struct group_list *
 sudo_get_grlist(const struct passwd *pw)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_get_grlist, SUDOERS_DEBUG_NSS);
 
     sudo_debug_printf(SUDO_DEBUG_DEBUG, "%s: looking up group names for %s",
 	__func__, pw->pw_name);
 
     if (grlist_cache == NULL) {
-	grlist_cache = rbcreate(cmp_pwnam);
+	grlist_cache = htcreate(hash_pwnam, cmp_pwnam);
 	if (grlist_cache == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -877,7 +917,7 @@ sudo_get_grlist(const struct passwd *pw)
 
     key.k.name = pw->pw_name;
     getauthregistry(pw->pw_name, key.registry);
-    if ((node = rbfind(grlist_cache, &key)) != NULL) {
+    if ((node = htfind(grlist_cache, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -890,7 +930,7 @@ sudo_get_grlist(const struct passwd *pw)
 	debug_return_ptr(NULL);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(grlist_cache, item, NULL)) {
+    switch (htinsert(grlist_cache, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache group list for %s, already exists"),
@@ -958,7 +998,7 @@ sudo_set_grlist(struct passwd *pw, char * const *groups)
     sudo_debug_group_list(pw->pw_name, groups, SUDO_DEBUG_DEBUG);
 
     if (grlist_cache == NULL) {
-	grlist_cache = rbcreate(cmp_pwnam);
+	grlist_cache = htcreate(hash_pwnam, cmp_pwnam);
 	if (grlist_cache == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_int(-1);
@@ -970,13 +1010,13 @@ sudo_set_grlist(struct passwd *pw, char * const *groups)
      */
     key.k.name = pw->pw_name;
     getauthregistry(NULL, key.registry);
-    if (rbfind(grlist_cache, &key) == NULL) {
+    if (htfind(grlist_cache, &key) == NULL) {
 	if ((item = make_grlist_item(pw, groups)) == NULL) {
 	    sudo_warnx(U_("unable to parse groups for %s"), pw->pw_name);
 	    debug_return_int(-1);
 	}
 	strlcpy(item->registry, key.registry, sizeof(item->registry));
-	switch (rbinsert(grlist_cache, item, NULL)) {
+	switch (htinsert(grlist_cache, item, NULL)) {
 	case 1:
 	    sudo_warnx(U_("unable to cache group list for %s, already exists"),
 		pw->pw_name);
@@ -999,14 +1039,14 @@ struct gid_list *
 sudo_get_gidlist(const struct passwd *pw, unsigned int type)
 {
     struct cache_item key, *item;
-    struct rbnode *node;
+    struct htnode *node;
     debug_decl(sudo_get_gidlist, SUDOERS_DEBUG_NSS);
 
     sudo_debug_printf(SUDO_DEBUG_DEBUG, "%s: looking up group-IDs for %s",
 	__func__, pw->pw_name);
 
     if (gidlist_cache == NULL) {
-	gidlist_cache = rbcreate(cmp_gidlist);
+	gidlist_cache = htcreate(hash_gidlist, cmp_gidlist);
 	if (gidlist_cache == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_ptr(NULL);
@@ -1016,7 +1056,7 @@ sudo_get_gidlist(const struct passwd *pw, unsigned int type)
     key.k.name = pw->pw_name;
     key.type = type;
     getauthregistry(pw->pw_name, key.registry);
-    if ((node = rbfind(gidlist_cache, &key)) != NULL) {
+    if ((node = htfind(gidlist_cache, &key)) != NULL) {
 	item = node->data;
 	goto done;
     }
@@ -1029,7 +1069,7 @@ sudo_get_gidlist(const struct passwd *pw, unsigned int type)
 	debug_return_ptr(NULL);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
-    switch (rbinsert(gidlist_cache, item, NULL)) {
+    switch (htinsert(gidlist_cache, item, NULL)) {
     case 1:
 	/* should not happen */
 	sudo_warnx(U_("unable to cache group list for %s, already exists"),
@@ -1065,7 +1105,7 @@ sudo_set_gidlist(struct passwd *pw, char * const *gids, unsigned int type)
     sudo_debug_group_list(pw->pw_name, gids, SUDO_DEBUG_DEBUG);
 
     if (gidlist_cache == NULL) {
-	gidlist_cache = rbcreate(cmp_gidlist);
+	gidlist_cache = htcreate(hash_gidlist, cmp_gidlist);
 	if (gidlist_cache == NULL) {
 	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	    debug_return_int(-1);
@@ -1078,13 +1118,13 @@ sudo_set_gidlist(struct passwd *pw, char * const *gids, unsigned int type)
     key.k.name = pw->pw_name;
     key.type = type;
     getauthregistry(NULL, key.registry);
-    if (rbfind(gidlist_cache, &key) == NULL) {
+    if (htfind(gidlist_cache, &key) == NULL) {
 	if ((item = make_gidlist_item(pw, gids, type)) == NULL) {
 	    sudo_warnx(U_("unable to parse gids for %s"), pw->pw_name);
 	    debug_return_int(-1);
 	}
 	strlcpy(item->registry, key.registry, sizeof(item->registry));
-	switch (rbinsert(gidlist_cache, item, NULL)) {
+	switch (htinsert(gidlist_cache, item, NULL)) {
 	case 1:
 	    sudo_warnx(U_("unable to cache group list for %s, already exists"),
 		pw->pw_name);
@@ -0,0 +1,10 @@
+#!/bin/sh
+#
+# Test cvtsudoers merge:
+#  * four files, each bound to a host
+#  * duplicate, overridden and conflicting Defaults and userspecs
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+$CVTSUDOERS -f sudoers -l /dev/null xerxes:${TESTDIR}/sudoers5 xyzzy:${TESTDIR}/sudoers6 plugh:${TESTDIR}/sudoers5 quux:${TESTDIR}/sudoers6
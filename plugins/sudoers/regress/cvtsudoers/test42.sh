@@ -0,0 +1,9 @@
+#!/bin/sh
+#
+# Test LDIF parsing of sudoRole objects that are not sorted by sudoOrder
+# from a file, which is checked for order before it is parsed.
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+$CVTSUDOERS -c "" -i ldif -f sudoers -b "ou=SUDOers,dc=sudo,dc=ws" ${TESTDIR}/sudoers.ldif
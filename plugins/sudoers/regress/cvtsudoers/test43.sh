@@ -0,0 +1,9 @@
+#!/bin/sh
+#
+# Test LDIF parsing of sudoRole objects that are not sorted by sudoOrder
+# from a pipe, which cannot be checked for order in advance.
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+cat ${TESTDIR}/sudoers.ldif | $CVTSUDOERS -c "" -i ldif -f sudoers -b "ou=SUDOers,dc=sudo,dc=ws"
@@ -0,0 +1,23 @@
+#!/bin/sh
+#
+# Test batch host filtering with a host list, output should match
+# running cvtsudoers with a host filter for each host.
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+OUTDIR=`mktemp -d ${TMPDIR:-/tmp}/cvtsudoers.XXXXXXXX` || exit 1
+trap "rm -rf $OUTDIR" 0 1 2 3 13 15
+
+printf "# hosts to generate policies for\nhercules\nwww\n\nblackhole\n" | \
+    $CVTSUDOERS -c "" -f sudoers -m user=millert --host-list=- --jobs=2 \
+    -o $OUTDIR $TESTDIR/sudoers
+
+for h in hercules www blackhole; do
+    echo "# $h"
+    cat $OUTDIR/$h
+    $CVTSUDOERS -c "" -f sudoers -m user=millert,host=$h $TESTDIR/sudoers | \
+	cmp -s - $OUTDIR/$h || echo "$h: batch output differs"
+done
+
+exit 0
@@ -0,0 +1,20 @@
+#!/bin/sh
+#
+# Test LDIF parsing of sudoRole objects that are sorted by sudoOrder
+# from a file, which are converted as they are read.  The output should
+# match that of the same input from a pipe, which is stored and sorted.
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+OUTFILE=`mktemp ${TMPDIR:-/tmp}/cvtsudoers.XXXXXXXX` || exit 1
+trap "rm -f $OUTFILE" 0 1 2 3 13 15
+
+$CVTSUDOERS -c "" -i ldif -f sudoers -b "ou=SUDOers,dc=sudo,dc=ws" \
+    ${TESTDIR}/sudoers_sorted.ldif > $OUTFILE
+cat $OUTFILE
+cat ${TESTDIR}/sudoers_sorted.ldif | \
+    $CVTSUDOERS -c "" -i ldif -f sudoers -b "ou=SUDOers,dc=sudo,dc=ws" | \
+    cmp -s - $OUTFILE || echo "streamed and buffered output differ"
+
+exit 0
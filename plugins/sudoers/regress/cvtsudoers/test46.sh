@@ -0,0 +1,20 @@
+#!/bin/sh
+#
+# Test that a host listed more than once in a host list is only
+# converted once and that --jobs may not be used without a host list.
+#
+
+: ${CVTSUDOERS=cvtsudoers}
+
+OUTDIR=`mktemp -d ${TMPDIR:-/tmp}/cvtsudoers.XXXXXXXX` || exit 1
+trap "rm -rf $OUTDIR" 0 1 2 3 13 15
+
+printf "www\nhercules\nwww\nWWW\n" | \
+    $CVTSUDOERS -c "" -f sudoers -m user=millert --host-list=- --jobs=2 \
+    -o $OUTDIR $TESTDIR/sudoers
+ls $OUTDIR
+
+$CVTSUDOERS -c "" -f sudoers --jobs=2 $TESTDIR/sudoers >/dev/null 2>&1
+echo "exit status $?"
+
+exit 0
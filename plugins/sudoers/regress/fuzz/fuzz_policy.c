@@ -897,6 +897,14 @@ cb_iolog_mode(const char *file, int line, int column,
     return true;
 }
 
+/* STUB */
+bool
+cb_compress_io_streams(const char *file, int line, int column,
+    const union sudo_defs_val *sd_un, int op)
+{
+    return true;
+}
+
 /* STUB */
 bool
 cb_group_plugin(const char *file, int line, int column,
@@ -115,6 +115,9 @@ main(int argc, char *argv[])
      * address: addr[/mask] 1/0
      * interfaces: addr3/mask addr4/mask ...
      * address: addr[/mask] 1/0
+     *
+     * A bad_interfaces line contains an invalid interfaces list
+     * that set_interfaces() is expected to reject.
      */
 
     while (fgets(line, sizeof(line), fp) != NULL) {
@@ -134,6 +137,14 @@ main(int argc, char *argv[])
 		sudo_warn("unable to parse interfaces list");
 		errors++;
 	    }
+	} else if (strncmp(line, "bad_interfaces:", sizeof("bad_interfaces:") - 1) == 0) {
+	    /* A malformed interfaces list must be rejected up front. */
+	    if (set_interfaces(line + sizeof("bad_interfaces:") - 1)) {
+		sudo_warnx("%s: accepted: FAIL",
+		    line + sizeof("bad_interfaces:") - 1);
+		errors++;
+	    }
+	    ntests++;
 	} else if (strncmp(line, "address:", sizeof("address:") - 1) == 0) {
 	    errors += check_addr(line + sizeof("address:") - 1);
 	    ntests++;
@@ -0,0 +1,468 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2023 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pwd.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudoers.h"
+#include "sudo_lbuf.h"
+#include <gram.h>
+
+sudo_dso_public int main(int argc, char *argv[]);
+
+struct sudoers_user_context user_ctx;
+struct sudoers_runas_context runas_ctx;
+
+static char tmpdir[PATH_MAX];
+static int verbose;
+
+/*
+ * Each step modifies the files under tmpdir, then we check that an
+ * incremental reload gives the same result as a full parse.
+ * File contents may contain "%s", which is replaced by tmpdir.
+ */
+struct reload_test {
+    const char *file;		/* file to write, relative to tmpdir */
+    const char *contents;	/* new contents or NULL to remove */
+    const char *file2;		/* optional second file to write */
+    const char *contents2;
+    int expected;		/* expected return value of sudoers_reload() */
+};
+
+static const struct reload_test initial[] = {
+    { "sudoers",
+      "Defaults env_reset\n"
+      "User_Alias ADMINS = alice, bob, OPS\n"
+      "@include %s/inc1\n"
+      "root ALL = (ALL) ALL\n"
+      "@includedir %s/sudoers.d\n"
+      "ADMINS ALL = /usr/bin/id\n" },
+    { "inc1",
+      "Defaults:alice !lecture\n"
+      "Cmnd_Alias SHELLS = /bin/sh\n"
+      "User_Alias OPS = carol\n"
+      "alice ALL = SHELLS\n" },
+    { "sudoers.d/a",
+      "bob ALL = /bin/ls\n"
+      "Defaults:bob timestamp_timeout=0\n" },
+    { "sudoers.d/b",
+      "carol ALL = /bin/cat\n" },
+};
+
+static const struct reload_test tests[] = {
+    /* Nothing changed. */
+    { NULL, NULL, NULL, NULL, 0 },
+    /* Change an @include file. */
+    { "inc1",
+      "Defaults:alice !lecture, mail_badpass\n"
+      "Cmnd_Alias SHELLS = /bin/sh, /bin/ksh\n"
+      "alice ALL = SHELLS\n"
+      "alice ALL = NOPASSWD: /bin/true\n",
+      NULL, NULL, 1 },
+    /* Change a file in an @includedir. */
+    { "sudoers.d/a",
+      "bob ALL = /bin/ls, /bin/df\n",
+      NULL, NULL, 1 },
+    /* Add a file to an @includedir, reparses the including file. */
+    { "sudoers.d/c",
+      "dave ALL = /bin/date\n"
+      "Defaults:dave !authenticate\n",
+      NULL, NULL, 1 },
+    /* Conflicting alias is an error, the tree must be unchanged. */
+    { "inc1",
+      "User_Alias ADMINS = carol\n",
+      NULL, NULL, -1 },
+    /* Fix the conflict. */
+    { "inc1",
+      "Cmnd_Alias SHELLS = /bin/bash\n"
+      "User_Alias OPERATORS = carol\n"
+      "OPERATORS ALL = SHELLS\n",
+      NULL, NULL, 1 },
+    /* Change two independent files. */
+    { "inc1",
+      "Cmnd_Alias SHELLS = /bin/sh\n",
+      "sudoers.d/b",
+      "carol ALL = /bin/cat, /bin/more\n"
+      "Defaults:carol !lecture\n", 2 },
+    /* Remove a file from an @includedir. */
+    { "sudoers.d/a", NULL, NULL, NULL, 1 },
+    /* Change the main sudoers file. */
+    { "sudoers",
+      "@include %s/inc1\n"
+      "@includedir %s/sudoers.d\n"
+      "root ALL = (ALL) ALL\n",
+      NULL, NULL, 1 },
+    /* Change a file after the main file was reparsed. */
+    { "sudoers.d/c",
+      "Defaults:dave authenticate\n",
+      NULL, NULL, 1 },
+};
+
+/*
+ * These run first.  Each step changes inc1, which defines the OPS alias
+ * used by ADMINS in the main sudoers file, and then matches a user
+ * against ADMINS.  The expansion of ADMINS must not refer to the
+ * replaced OPS alias.
+ */
+struct alias_test {
+    struct reload_test reload;
+    const char *user;		/* user to match against ADMINS */
+    int matched;		/* expected result of user_matches() */
+};
+
+static const struct alias_test alias_tests[] = {
+    { { NULL, NULL, NULL, NULL, 0 },
+      "carol", ALLOW },
+    { { "inc1",
+	"User_Alias OPS = dave\n",
+	NULL, NULL, 1 },
+      "dave", ALLOW },
+    { { NULL, NULL, NULL, NULL, 0 },
+      "carol", UNSPEC },
+    { { "inc1",
+	"User_Alias OPS = !erin, frank\n"
+	"frank ALL = /bin/date\n",
+	NULL, NULL, 1 },
+      "erin", DENY },
+};
+
+FILE *
+open_sudoers(const char *file, char **outfile, bool doedit, bool *keepopen)
+{
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) != NULL && outfile != NULL) {
+	if ((*outfile = sudo_rcstr_dup(file)) == NULL) {
+	    fclose(fp);
+	    fp = NULL;
+	}
+    }
+    return fp;
+}
+
+/*
+ * Store the path to file (plus suffix) in tmpdir in path,
+ * which must be PATH_MAX bytes.  Exits if the path is too long.
+ */
+static void
+tmpdir_path(char *path, const char *file, const char *suffix)
+{
+    int len;
+
+    len = snprintf(path, PATH_MAX, "%s/%s%s", tmpdir, file, suffix);
+    if (len < 0 || len >= PATH_MAX) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/%s%s", tmpdir, file, suffix);
+    }
+}
+
+static bool
+write_file(const char *file, const char *contents)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    FILE *fp;
+
+    tmpdir_path(path, file, "");
+    if (contents == NULL)
+	return unlink(path) == 0;
+
+    /* Replace the file via rename() the way an editor would. */
+    tmpdir_path(tmp, file, ".tmp");
+    if ((fp = fopen(tmp, "w")) == NULL) {
+	sudo_warn("%s", tmp);
+	return false;
+    }
+    fprintf(fp, contents, tmpdir, tmpdir);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+	sudo_warn("%s", path);
+	return false;
+    }
+    return true;
+}
+
+static int
+format_alias(struct sudoers_parse_tree *parse_tree, struct alias *a, void *v)
+{
+    struct sudo_lbuf *lbuf = v;
+    struct member *m;
+    char where[PATH_MAX + 32];
+
+    (void)snprintf(where, sizeof(where), "%s:%d", a->file, a->line);
+    sudo_lbuf_append(lbuf, "%s %s (%s) =", alias_type_to_string(a->type),
+	a->name, where);
+    TAILQ_FOREACH(m, &a->members, entries) {
+	sudo_lbuf_append(lbuf, " ");
+	sudoers_format_member(lbuf, parse_tree, m, NULL, UNSPEC);
+    }
+    sudo_lbuf_append(lbuf, "\n");
+    return 0;
+}
+
+/*
+ * Format a parse tree, including the file and line of each entry.
+ */
+static char *
+format_tree(struct sudoers_parse_tree *parse_tree)
+{
+    struct sudo_lbuf lbuf;
+    struct userspec *us;
+    struct defaults *def;
+    char *ret, where[PATH_MAX + 32];
+
+    sudo_lbuf_init(&lbuf, NULL, 0, NULL, 0);
+    TAILQ_FOREACH(def, &parse_tree->defaults, entries) {
+	(void)snprintf(where, sizeof(where), "%s:%d: type %d: ", def->file,
+	    def->line, def->type);
+	sudo_lbuf_append(&lbuf, "%s", where);
+	sudoers_format_default(&lbuf, def);
+	sudo_lbuf_append(&lbuf, "\n");
+    }
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries) {
+	(void)snprintf(where, sizeof(where), "%s:%d: ", us->file, us->line);
+	sudo_lbuf_append(&lbuf, "%s", where);
+	sudoers_format_userspec(&lbuf, parse_tree, us, false);
+    }
+    alias_apply(parse_tree, format_alias, &lbuf);
+    if (sudo_lbuf_error(&lbuf))
+	sudo_fatalx("%s: %s", __func__, "unable to format parse tree");
+    ret = strdup(lbuf.buf ? lbuf.buf : "");
+    sudo_lbuf_destroy(&lbuf);
+    if (ret == NULL)
+	sudo_fatalx("%s: %s", __func__, "unable to allocate memory");
+    return ret;
+}
+
+/*
+ * Do a full parse of the sudoers file and return the formatted result.
+ */
+static char *
+full_parse(const struct sudoers_parser_config *conf)
+{
+    struct sudoers_parse_tree parse_tree;
+    struct sudoers_reload *rl;
+    char *ret = NULL;
+
+    init_parse_tree(&parse_tree, NULL, NULL, NULL);
+    rl = sudoers_reload_open(conf, &parse_tree);
+    if (rl != NULL) {
+	ret = format_tree(&parse_tree);
+	sudoers_reload_free(rl);
+    }
+    free_parse_tree(&parse_tree);
+    return ret;
+}
+
+/*
+ * Every privilege must be compiled after a reload.
+ */
+static bool
+check_compiled(struct sudoers_parse_tree *parse_tree)
+{
+    struct privilege *priv;
+    struct userspec *us;
+
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries) {
+	TAILQ_FOREACH(priv, &us->privileges, entries) {
+	    if (priv->cmndvec == NULL)
+		return false;
+	}
+    }
+    return true;
+}
+
+/*
+ * Apply a test's file changes, reload and compare the result to a
+ * full parse.  Returns the number of errors.
+ */
+static int
+do_reload_test(struct sudoers_reload *rl,
+    struct sudoers_parse_tree *parse_tree,
+    const struct sudoers_parser_config *conf,
+    const struct reload_test *test, size_t i)
+{
+    char *before, *after, *expected;
+    int rval, errors = 0;
+
+    before = format_tree(parse_tree);
+    if (test->file != NULL && !write_file(test->file, test->contents)) {
+	free(before);
+	return 1;
+    }
+    if (test->file2 != NULL && !write_file(test->file2, test->contents2)) {
+	free(before);
+	return 1;
+    }
+
+    rval = sudoers_reload(rl);
+    after = format_tree(parse_tree);
+    if (rval != test->expected) {
+	fprintf(stderr, "%s[%zu]: expected %d, got %d\n", getprogname(),
+	    i, test->expected, rval);
+	errors++;
+    } else if (rval == -1) {
+	/* Tree must be unchanged on error. */
+	if (strcmp(before, after) != 0) {
+	    fprintf(stderr, "%s[%zu]: parse tree modified on error\n",
+		getprogname(), i);
+	    errors++;
+	}
+    } else {
+	/* Must match a full reparse. */
+	expected = full_parse(conf);
+	if (expected == NULL || strcmp(expected, after) != 0) {
+	    fprintf(stderr, "%s[%zu]: mismatch\nexpected:\n%s\ngot:\n%s\n",
+		getprogname(), i, expected ? expected : "(parse error)",
+		after);
+	    errors++;
+	} else if (verbose) {
+	    printf("%s[%zu]:\n%s\n", getprogname(), i, after);
+	}
+	free(expected);
+    }
+    if (!check_compiled(parse_tree)) {
+	fprintf(stderr, "%s[%zu]: privileges not compiled\n",
+	    getprogname(), i);
+	errors++;
+    }
+    free(before);
+    free(after);
+    return errors;
+}
+
+static void
+cleanup(void)
+{
+    const char *files[] = {
+	"sudoers.d/a", "sudoers.d/b", "sudoers.d/c", "sudoers.d", "inc1",
+	"sudoers"
+    };
+    char path[PATH_MAX];
+    size_t i;
+    int len;
+
+    for (i = 0; i < nitems(files); i++) {
+	/* Called via atexit(), so skip a path that is too long. */
+	len = snprintf(path, sizeof(path), "%s/%s", tmpdir, files[i]);
+	if (len < 0 || len >= ssizeof(path))
+	    continue;
+	(void)remove(path);
+    }
+    (void)rmdir(tmpdir);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sudoers_parser_config conf = SUDOERS_PARSER_CONFIG_INITIALIZER;
+    struct sudoers_parse_tree parse_tree;
+    struct sudoers_reload *rl;
+    char sudoers_path[PATH_MAX];
+    int ch, ntests = 0, errors = 0;
+    size_t i;
+
+    initprogname(argc > 0 ? argv[0] : "check_reload");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    verbose++;
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    /* Write the initial sudoers file and its includes. */
+    (void)strlcpy(tmpdir, "/tmp/check_reload.XXXXXXXX", sizeof(tmpdir));
+    if (mkdtemp(tmpdir) == NULL) {
+	sudo_warn("%s", tmpdir);
+	return EXIT_FAILURE;
+    }
+    atexit(cleanup);
+    tmpdir_path(sudoers_path, "sudoers.d", "");
+    if (mkdir(sudoers_path, S_IRWXU) != 0) {
+	sudo_warn("%s", sudoers_path);
+	return EXIT_FAILURE;
+    }
+    for (i = 0; i < nitems(initial); i++) {
+	if (!write_file(initial[i].file, initial[i].contents))
+	    return EXIT_FAILURE;
+    }
+
+    /* Used to expand %h in include paths. */
+    user_ctx.host = user_ctx.shost = (char *)"localhost";
+
+    tmpdir_path(sudoers_path, "sudoers", "");
+    conf.sudoers_path = sudoers_path;
+    conf.sudoers_uid = geteuid();
+    conf.sudoers_gid = getegid();
+    conf.verbose = verbose;
+
+    init_parse_tree(&parse_tree, NULL, NULL, NULL);
+    if ((rl = sudoers_reload_open(&conf, &parse_tree)) == NULL) {
+	sudo_warnx("unable to parse %s", sudoers_path);
+	return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < nitems(alias_tests); i++) {
+	const struct alias_test *test = &alias_tests[i];
+	struct member m;
+	struct passwd pw;
+	int matched;
+
+	ntests++;
+	memset(&m, 0, sizeof(m));
+	m.name = (char *)"ADMINS";
+	m.type = ALIAS;
+	memset(&pw, 0, sizeof(pw));
+	pw.pw_name = (char *)test->user;
+	pw.pw_uid = (uid_t)-1;
+	errors += do_reload_test(rl, &parse_tree, &conf, &test->reload, i);
+	matched = user_matches(&parse_tree, &pw, &m);
+	if (matched != test->matched) {
+	    fprintf(stderr, "%s[%zu]: %s: expected %d, got %d\n",
+		getprogname(), i, test->user, test->matched, matched);
+	    errors++;
+	}
+    }
+
+    for (i = 0; i < nitems(tests); i++) {
+	ntests++;
+	errors += do_reload_test(rl, &parse_tree, &conf, &tests[i],
+	    nitems(alias_tests) + i);
+    }
+
+    sudoers_reload_free(rl);
+    free_parse_tree(&parse_tree);
+
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    return errors;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+# Test matching through nested, negated, duplicate and recursive aliases.
+#
+
+: ${TESTSUDOERS=testsudoers}
+
+exec 2>&1
+
+cat > policy.$$ <<'EOF'
+User_Alias OPS = admin, operator
+User_Alias STAFF = OPS, !daemon, daemon, STAFF
+User_Alias NOTOPS = !OPS, ALL
+Host_Alias WEB = web1, web2
+Host_Alias DMZ = WEB, !web2, web2, !WEB
+Host_Alias LOOP1 = LOOP2, db1
+Host_Alias LOOP2 = LOOP1, LOOP1
+Runas_Alias SVC = daemon, !root
+Runas_Alias SVC2 = !SVC, SVC
+Runas_Alias SVC3 = !SVC, wheel
+Cmnd_Alias IDS = /usr/bin/id, /bin/id
+Cmnd_Alias NOIDS = !IDS, /usr/bin/*
+Cmnd_Alias BOGUS = NOSUCH, /bin/true
+STAFF WEB = (SVC2) IDS
+STAFF DMZ, LOOP1 = (root) NOIDS
+NOTOPS LOOP2 = BOGUS
+OPS WEB = (operator : SVC3) /usr/bin/who
+EOF
+
+for args in "-h web1 admin /usr/bin/id" "-h web1 operator /bin/id" \
+	"-h web1 daemon /usr/bin/id" "-h web1 root /usr/bin/id" \
+	"-h web1 -u daemon admin /usr/bin/id" \
+	"-h web1 -u root admin /bin/id" "-h web1 admin /usr/bin/who" \
+	"-h web2 admin /usr/bin/who" "-h db1 admin /usr/bin/id" \
+	"-h db1 admin /usr/bin/who" "-h LOOP1 admin /usr/bin/who" \
+	"-h LOOP2 nobody /bin/true" "-h LOOP1 admin /bin/true" \
+	"-h LOOP2 admin /bin/true" \
+	"-h web1 -u operator -g operator admin /usr/bin/who" \
+	"-h web1 -u operator -g wheel admin /usr/bin/who"; do
+    echo "testsudoers $args"
+    $TESTSUDOERS -p ${TESTDIR}/passwd -P ${TESTDIR}/group $args < policy.$$
+    echo ""
+done
+rm -f policy.$$
+
+exit 0
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Test that alias match results reused within a check are not affected
+# by alias loops or by the order in which rules are matched.
+#
+
+: ${TESTSUDOERS=testsudoers}
+
+exec 2>&1
+
+cat > policy.$$ <<'EOF'
+User_Alias ADMINS = admin, ADMINS
+Host_Alias SERVERS = db1, web1
+Runas_Alias R0 = !R1, operator, !root
+Runas_Alias R1 = !root, root, daemon, !R1, !R4
+Runas_Alias R4 = RX, !nobody, R0
+ADMINS SERVERS = (R1 : R4) /bin/true
+ADMINS SERVERS = (nobody, root : daemon, R0) /usr/bin/id
+ADMINS SERVERS, !web1 = (R0 : R0) /usr/bin/who
+ADMINS !SERVERS = (R4) /usr/bin/who
+EOF
+
+for args in "-h web1 admin /usr/bin/id" "-h web1 -u bin -g daemon admin /usr/bin/who" \
+	"-h db1 -u bin -g daemon admin /usr/bin/who" \
+	"-h db1 -u operator -g operator admin /usr/bin/who" \
+	"-h db1 -u daemon admin /bin/true" "-h db2 -u operator admin /usr/bin/who"; do
+    echo "testsudoers $args"
+    $TESTSUDOERS -p ${TESTDIR}/passwd -P ${TESTDIR}/group $args < policy.$$
+    echo ""
+done
+rm -f policy.$$
+
+exit 0
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Test that compiled Cmnd_Specs are matched in the same order as the
+# list they were built from, including specs that cannot be rejected
+# by command basename alone.
+#
+
+: ${TESTSUDOERS=testsudoers}
+
+exec 2>&1
+
+cat > policy.$$ <<'EOF'
+Cmnd_Alias WHO = /usr/bin/who, !/usr/bin/id
+admin ALL = (root) /usr/bin/id, /bin/true, !/usr/bin/who
+admin ALL = (root) /usr/bin/, !/usr/bin/id -u, /bin/tru?, WHO
+admin ALL = (operator) NOPASSWD: /usr/bin/id "", !/bin/true
+EOF
+
+for args in "admin /usr/bin/id" "admin /usr/bin/id -u" "admin /usr/bin/id -g" \
+	"admin /usr/bin/who" "admin /bin/true" "-u operator admin /usr/bin/id" \
+	"-u operator admin /bin/true"; do
+    echo "testsudoers $args"
+    $TESTSUDOERS -p ${TESTDIR}/passwd -P ${TESTDIR}/group $args < policy.$$
+    echo ""
+done
+rm -f policy.$$
+
+exit 0
@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Test that compiled Cmnd_Specs whose command basename does not match
+# are skipped even when a lookup callback is in use.  Each spec that is
+# actually checked prints a "runas" line; skipped specs print nothing.
+#
+
+: ${TESTSUDOERS=testsudoers}
+
+exec 2>&1
+
+cat > policy.$$ <<'EOF'
+Cmnd_Alias IDS = /usr/bin/id
+admin ALL = (root) /usr/bin/who, /usr/bin/id, /bin/false
+admin ALL = (root) /usr/bin/who, IDS
+admin ALL = (operator) /usr/bin/who, /usr/bin/id
+EOF
+
+for args in "admin /usr/bin/id" "admin /bin/true" "admin /bin/false" \
+	"-u operator admin /usr/bin/who"; do
+    echo "testsudoers $args"
+    $TESTSUDOERS -p ${TESTDIR}/passwd -P ${TESTDIR}/group $args < policy.$$
+    echo ""
+done
+rm -f policy.$$
+
+exit 0
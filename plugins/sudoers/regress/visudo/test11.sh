@@ -0,0 +1,17 @@
+#!/bin/sh
+#
+# Test checking of the compress_io_streams syntax
+#
+
+: ${VISUDO=visudo}
+
+$VISUDO -cf - <<-EOF
+	Defaults compress_io_streams = "ttyout=6:rle, stdin=none"
+	EOF
+
+$VISUDO -cf - <<-EOF
+	Defaults compress_io_streams = "ttyout=6:rle, stdin=none"
+	Defaults compress_io_streams = "ttyout=6:deflate"
+	EOF
+
+exit 0
@@ -194,6 +194,7 @@ int
 sudoers_init(void *info, sudoers_logger_t logger, char * const envp[])
 {
     struct sudo_nss *nss, *nss_next;
+    struct timespec start_time, then, now;
     int oldlocale, sources = 0;
     static int ret = -1;
     debug_decl(sudoers_init, SUDOERS_DEBUG_PLUGIN);
@@ -202,6 +203,10 @@ sudoers_init(void *info, sudoers_logger_t logger, char * const envp[])
     if (snl != NULL)
 	debug_return_int(ret);
 
+    /* Startup time is logged at debug level to help tune configurations. */
+    if (sudo_gettime_mono(&start_time) == -1)
+	sudo_timespecclear(&start_time);
+
     bindtextdomain("sudoers", LOCALEDIR);
 
     /* Hook up logging function for parse errors. */
@@ -247,6 +252,8 @@ sudoers_init(void *info, sudoers_logger_t logger, char * const envp[])
 
     /* Open and parse sudoers, set global defaults.  */
     TAILQ_FOREACH_SAFE(nss, snl, entries, nss_next) {
+	if (sudo_gettime_mono(&then) == -1)
+	    sudo_timespecclear(&then);
 	if (nss->open(nss) == -1 || (nss->parse_tree = nss->parse(nss)) == NULL) {
 	    TAILQ_REMOVE(snl, nss, entries);
 	    continue;
@@ -261,6 +268,12 @@ sudoers_init(void *info, sudoers_logger_t logger, char * const envp[])
 	    (void)update_defaults(nss->parse_tree, NULL,
 		SETDEF_GENERIC|SETDEF_HOST|SETDEF_USER|SETDEF_RUNAS, false);
 	}
+	if (sudo_timespecisset(&then) && sudo_gettime_mono(&now) != -1) {
+	    sudo_timespecsub(&now, &then, &now);
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"%s: loaded in %lld.%09ld seconds", nss->source,
+		(long long)now.tv_sec, now.tv_nsec);
+	}
     }
     if (sources == 0) {
 	sudo_warnx("%s", U_("no valid sudoers sources found, quitting"));
@@ -281,6 +294,13 @@ cleanup:
     sudo_warn_set_locale_func(NULL);
     sudoers_setlocale(oldlocale, NULL);
 
+    if (sudo_timespecisset(&start_time) && sudo_gettime_mono(&now) != -1) {
+	sudo_timespecsub(&now, &start_time, &now);
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "sudoers initialized in %lld.%09ld seconds",
+	    (long long)now.tv_sec, now.tv_nsec);
+    }
+
     debug_return_int(ret);
 }
 
@@ -1440,6 +1460,7 @@ set_runaspw(const char *user, bool quiet)
     if (runas_ctx.pw != NULL)
 	sudo_pw_delref(runas_ctx.pw);
     runas_ctx.pw = pw;
+    match_memo_invalidate();
     debug_return_bool(true);
 }
 
@@ -1474,6 +1495,7 @@ set_runasgr(const char *group, bool quiet)
     if (runas_ctx.gr != NULL)
 	sudo_gr_delref(runas_ctx.gr);
     runas_ctx.gr = gr;
+    match_memo_invalidate();
     debug_return_bool(true);
 }
 
@@ -339,6 +339,7 @@ bool cb_maxseq(const char *file, int line, int column, const union sudo_defs_val
 bool cb_iolog_user(const char *file, int line, int column, const union sudo_defs_val *sd_un, int op);
 bool cb_iolog_group(const char *file, int line, int column, const union sudo_defs_val *sd_un, int op);
 bool cb_iolog_mode(const char *file, int line, int column, const union sudo_defs_val *sd_un, int op);
+bool cb_compress_io_streams(const char *file, int line, int column, const union sudo_defs_val *sd_un, int op);
 
 /* iolog_path_escapes.c */
 struct iolog_path_escape;
@@ -361,6 +361,8 @@ main(int argc, char *argv[])
     }
     if (!update_defaults(&parsed_policy, NULL, SETDEF_ALL, false))
 	parse_error = true;
+    (void)alias_expand(&parsed_policy);
+    (void)sudoers_compile_privileges(&parsed_policy);
 
     if (!parse_error)
 	(void) puts("Parses OK");
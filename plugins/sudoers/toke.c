@@ -5703,6 +5703,11 @@ struct include_stack {
     bool keepopen;
 };
 
+/*
+ * Optional function called when the lexer switches sudoers files.
+ */
+void (*sudoers_include_hook)(int event, const char *path);
+
 /*
  * Compare two struct path_list structs in reverse order.
  */
@@ -6088,6 +6093,8 @@ push_include_int(const char *opath, bool isdir, int verbose)
 	int fd, status;
 	size_t count;
 
+	if (sudoers_include_hook != NULL)
+	    sudoers_include_hook(SUDOERS_INCLUDE_DIR, path);
 	fd = sudo_open_conf_path(path, dname, sizeof(dname), NULL);
 	status = sudo_secure_fd(fd, S_IFDIR, sudoers_file_uid(),
 	    sudoers_file_gid(), &sb);
@@ -6169,6 +6176,9 @@ push_include_int(const char *opath, bool isdir, int verbose)
     sudoers_search_path = path;
     sudoers_switch_to_buffer(sudoers_create_buffer(fp, YY_BUF_SIZE));
     memset(&sudolinebuf, 0, sizeof(sudolinebuf));
+    if (sudoers_include_hook != NULL)
+	sudoers_include_hook(isdir ? SUDOERS_INCLUDE_PUSHDIR :
+	    SUDOERS_INCLUDE_PUSH, sudoers);
 
     debug_return_bool(true);
 }
@@ -6218,6 +6228,8 @@ pop_include(void)
 	    sudolineno = 1;
 	    sudoers_switch_to_buffer(sudoers_create_buffer(fp, YY_BUF_SIZE));
 	    free(pl);
+	    if (sudoers_include_hook != NULL)
+		sudoers_include_hook(SUDOERS_INCLUDE_NEXT, sudoers);
 	    break;
 	}
 	/* Unable to open path in include dir, go to next one. */
@@ -6236,6 +6248,8 @@ pop_include(void)
 	sudoers_search_path = istack[idepth].path;
 	sudolineno = istack[idepth].lineno;
 	keepopen = istack[idepth].keepopen;
+	if (sudoers_include_hook != NULL)
+	    sudoers_include_hook(SUDOERS_INCLUDE_POP, sudoers);
     }
     debug_return_bool(true);
 }
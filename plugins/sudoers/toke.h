@@ -29,10 +29,20 @@ struct sudolinebuf {
     size_t toke_end;		/* ending column of current token */
 };
 
+/*
+ * Events passed to sudoers_include_hook.
+ */
+#define SUDOERS_INCLUDE_DIR	1	/* about to read an include dir */
+#define SUDOERS_INCLUDE_PUSH	2	/* started reading an included file */
+#define SUDOERS_INCLUDE_PUSHDIR	3	/* started reading first file in a dir */
+#define SUDOERS_INCLUDE_NEXT	4	/* moved to the next file in a dir */
+#define SUDOERS_INCLUDE_POP	5	/* returned to the including file */
+
 extern const char *sudoers_errstr;
 extern struct sudolinebuf sudolinebuf;
 extern int sudolineno;
 extern char *sudoers_search_path;
+extern void (*sudoers_include_hook)(int event, const char *path);
 
 bool append(const char *, int);
 bool fill_args(const char *, int, bool);
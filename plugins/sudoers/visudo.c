@@ -68,6 +68,7 @@
 #include "redblack.h"
 #include "sudoers_version.h"
 #include "sudo_conf.h"
+#include "sudo_iolog.h"
 #include <gram.h>
 
 struct sudoersfile {
@@ -93,6 +94,7 @@ static bool check_syntax(const char *, bool, bool, bool, bool);
 static bool edit_sudoers(struct sudoersfile *, char *, int, char **, int);
 static bool install_sudoers(struct sudoersfile *, bool, bool);
 static bool visudo_track_error(const char *file, int line, int column, const char * restrict fmt, va_list args) sudo_printf0like(4, 0);
+static bool visudo_compress_io_streams(const char *file, int line, int column, const union sudo_defs_val *sd_un, int op);
 static int print_unused(struct sudoers_parse_tree *, struct alias *, void *);
 static bool reparse_sudoers(char *, int, char **, bool, bool);
 static int run_command(const char *, char *const *);
@@ -166,6 +168,9 @@ main(int argc, char *argv[])
     /* Set sudoers locale callback. */
     sudo_defs_table[I_SUDOERS_LOCALE].callback = sudoers_locale_callback;
 
+    /* Check compress_io_streams syntax, it is not parsed until run time. */
+    sudo_defs_table[I_COMPRESS_IO_STREAMS].callback = visudo_compress_io_streams;
+
     /* Read debug and plugin sections of sudo.conf. */
     if (sudo_conf_read(NULL, SUDO_CONF_DEBUG|SUDO_CONF_PLUGINS) == -1)
 	return EXIT_FAILURE;
@@ -343,12 +348,15 @@ done:
     return exitcode;
 }
 
-static bool
-visudo_track_error(const char *file, int line, int column, const char * restrict fmt,
-     va_list args)
+/*
+ * Record the line of the first error in file so the editor can
+ * start there.
+ */
+static void
+visudo_set_errorline(const char *file, int line)
 {
     struct sudoersfile *sp;
-    debug_decl(visudo_track_error, SUDOERS_DEBUG_UTIL);
+    debug_decl(visudo_set_errorline, SUDOERS_DEBUG_UTIL);
 
     TAILQ_FOREACH(sp, &sudoerslist, entries) {
 	if (sp->errorline > 0)
@@ -360,11 +368,45 @@ visudo_track_error(const char *file, int line, int column, const char * restrict
 	    break;
 	}
     }
+
+    debug_return;
+}
+
+static bool
+visudo_track_error(const char *file, int line, int column, const char * restrict fmt,
+     va_list args)
+{
+    debug_decl(visudo_track_error, SUDOERS_DEBUG_UTIL);
+
+    visudo_set_errorline(file, line);
     errors++;
 
     debug_return_bool(true);
 }
 
+/*
+ * Visudo callback for compress_io_streams Defaults setting.
+ * The value is only parsed by the I/O log plugin at run time,
+ * so check its syntax here.
+ */
+static bool
+visudo_compress_io_streams(const char *file, int line, int column,
+    const union sudo_defs_val *sd_un, int op)
+{
+    struct iolog_compress_params params;
+    debug_decl(visudo_compress_io_streams, SUDOERS_DEBUG_UTIL);
+
+    if (sd_un->str == NULL || iolog_parse_compress_params(sd_un->str, &params))
+	debug_return_bool(true);
+
+    if (sudoers_conf.verbose > 0) {
+	sudo_warnx(U_("%s:%d:%d: invalid compress_io_streams setting \"%s\""),
+	    file, line, column, sd_un->str);
+    }
+    visudo_set_errorline(file, line);
+    debug_return_bool(false);
+}
+
 static char *
 get_editor(int *editor_argc, char ***editor_argv)
 {
@@ -39,27 +39,31 @@ static bool
 sudo_qualify_plugin(struct plugin_info *info, char *fullpath, size_t pathsize)
 {
     const char *plugin_dir = sudo_conf_plugin_dir_path();
+#ifdef STATIC_SUDOERS_PLUGIN
+    const char *static_path;
+#endif
     int len;
     debug_decl(sudo_stat_plugin, SUDO_DEBUG_PLUGIN);
 
+#ifdef STATIC_SUDOERS_PLUGIN
+    /* Check static symbols, even if the path is fully-qualified. */
+    static_path = preload_static_path(info->path);
+    if (static_path != NULL) {
+	if (strlcpy(fullpath, static_path, pathsize) >= pathsize) {
+	    errno = ENAMETOOLONG;
+	    goto bad;
+	}
+	/* Plugin is static, do not fully-qualify. */
+	debug_return_bool(true);
+    }
+#endif /* STATIC_SUDOERS_PLUGIN */
+
     if (info->path[0] == '/') {
 	if (strlcpy(fullpath, info->path, pathsize) >= pathsize) {
 	    errno = ENAMETOOLONG;
 	    goto bad;
 	}
     } else {
-#ifdef STATIC_SUDOERS_PLUGIN
-	/* Check static symbols. */
-	if (strcmp(info->path, _PATH_SUDOERS_PLUGIN) == 0) {
-	    if (strlcpy(fullpath, info->path, pathsize) >= pathsize) {
-		errno = ENAMETOOLONG;
-		goto bad;
-	    }
-	    /* Plugin is static, do not fully-qualify. */
-	    debug_return_bool(true);
-	}
-#endif /* STATIC_SUDOERS_PLUGIN */
-
 	if (plugin_dir == NULL) {
 	    errno = ENOENT;
 	    goto bad;
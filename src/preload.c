@@ -23,6 +23,8 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #ifdef HAVE_GSS_KRB5_CCACHE_NAME
 # if defined(HAVE_GSSAPI_GSSAPI_KRB5_H)
 #  include <gssapi/gssapi.h>
@@ -43,6 +45,7 @@
 extern struct policy_plugin sudoers_policy;
 extern struct io_plugin sudoers_io;
 extern struct audit_plugin sudoers_audit;
+extern struct audit_plugin audit_json;
 
 static struct sudo_preload_symbol sudo_rtld_default_symbols[] = {
 # ifdef HAVE_GSS_KRB5_CCACHE_NAME
@@ -59,12 +62,18 @@ static struct sudo_preload_symbol sudo_sudoers_plugin_symbols[] = {
     { (const char *)0, (void *)0 }
 };
 
+static struct sudo_preload_symbol sudo_audit_json_plugin_symbols[] = {
+    { "audit_json", (void *)&audit_json },
+    { (const char *)0, (void *)0 }
+};
+
 /*
  * Statically compiled symbols indexed by handle.
  */
 static struct sudo_preload_table sudo_preload_table[] = {
     { (char *)0, SUDO_DSO_DEFAULT, sudo_rtld_default_symbols },
     { _PATH_SUDOERS_PLUGIN, &sudo_sudoers_plugin_symbols, sudo_sudoers_plugin_symbols },
+    { "audit_json.so", &sudo_audit_json_plugin_symbols, sudo_audit_json_plugin_symbols },
     { (char *)0, (void *)0, (struct sudo_preload_symbol *)0 }
 };
 
@@ -74,4 +83,42 @@ preload_static_symbols(void)
     sudo_dso_preload_table(sudo_preload_table);
 }
 
+/*
+ * Map a plugin path from sudo.conf to a statically compiled plugin.
+ * A fully-qualified path only matches the static plugin of the same
+ * name if it is in the default plugin directory; any other path names
+ * a file the administrator wants loaded from disk.
+ * Returns the preload table path or NULL.
+ */
+const char *
+preload_static_path(const char *path)
+{
+    const char *plugin_dir = _PATH_SUDO_PLUGIN_DIR;
+    struct sudo_preload_table *pt;
+    size_t len;
+    debug_decl(preload_static_path, SUDO_DEBUG_PLUGIN);
+
+    if (path[0] == '/') {
+	len = strlen(plugin_dir);
+	if (strncmp(path, plugin_dir, len) != 0)
+	    debug_return_const_str(NULL);
+	if (len == 0 || plugin_dir[len - 1] != '/') {
+	    if (path[len] != '/')
+		debug_return_const_str(NULL);
+	    len++;
+	}
+	path += len;
+	while (*path == '/')
+	    path++;
+	if (strchr(path, '/') != NULL)
+	    debug_return_const_str(NULL);
+    }
+
+    for (pt = sudo_preload_table; pt->handle != NULL; pt++) {
+	if (pt->path != NULL && strcmp(path, pt->path) == 0)
+	    debug_return_const_str(pt->path);
+    }
+    debug_return_const_str(NULL);
+}
+
 #endif /* STATIC_SUDOERS_PLUGIN */
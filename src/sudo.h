@@ -330,6 +330,7 @@ bool signal_pending(int signo);
 
 /* preload.c */
 void preload_static_symbols(void);
+const char *preload_static_path(const char *path);
 
 /* preserve_fds.c */
 int add_preserved_fd(struct preserved_fd_list *pfds, int fd);